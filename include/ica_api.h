@@ -502,19 +502,104 @@ void ica_set_offload_mode(int offload_mode);
  * Environment variable for setting libica stats mode.
  * By default libica counts its crypto operations in shared memory.
  * If this environment variable is defined to be zero, libica will not
- * count crypto operations.
+ * count crypto operations. The ICA_STATS_MODE_* flags below enable
+ * additional statistics.
  */
 #define ICA_STATS_ENV "LIBICA_STATS_MODE"
 
+/**
+ * Stats mode flag to additionally record the latency of the RSA, ECC,
+ * EdDSA and X25519/X448 operations, see icastats --latency.
+ */
+#define ICA_STATS_MODE_LATENCY	2
+
+/**
+ * Stats mode flag to additionally count the operations per process, see
+ * icastats --top.
+ */
+#define ICA_STATS_MODE_PROCESS	4
+
 /**
  * Set libica stats mode.
  * By default libica counts its crypto operations in shared memory.
  * If this function is called with stats_mode = 0, libica will not
- * count crypto operations.
+ * count crypto operations. Any of the ICA_STATS_MODE_* flags in
+ * stats_mode enable the corresponding additional statistics.
  */
 ICA_EXPORT
 void ica_set_stats_mode(int stats_mode);
 
+/**
+ * Definitions for the ica_set_rsa_crt_verify_mode function.
+ */
+#define ICA_RSA_CRT_VERIFY_ENABLED	1
+#define ICA_RSA_CRT_VERIFY_DISABLED	0
+
+/**
+ * Environment variable for defining the default RSA CRT verify mode.
+ * When this environment variable exists and has a numeric value, the
+ * verify mode is set via ica_set_rsa_crt_verify_mode().
+ */
+#define ICA_RSA_CRT_VERIFY_ENV "LIBICA_RSA_CRT_VERIFY_MODE"
+
+/**
+ * Set libica RSA CRT verify mode.
+ * The software fallback of ica_rsa_crt() and ica_rsa_crt_prepared()
+ * blinds its input and, by default, verifies its result with the public
+ * exponent, which is recovered from the CRT key, before returning it. A
+ * result, which was corrupted e.g. by a hardware fault, is not returned
+ * then, as it would reveal the private key: the call fails with EIO. Keys
+ * whose public exponent cannot be recovered are refused with EINVAL. With
+ * verify_mode = 0 the verification, which costs about one public key
+ * operation, is skipped. Adapters verify their results themselves.
+ */
+ICA_EXPORT
+void ica_set_rsa_crt_verify_mode(int verify_mode);
+
+/**
+ * Environment variable for defining the default RSA route mode.
+ * When this environment variable exists and has a numeric value, the
+ * route mode is set via ica_set_rsa_route_mode().
+ */
+#define ICA_RSA_ROUTE_ENV "LIBICA_RSA_ROUTE_MODE"
+
+/**
+ * Set libica RSA route mode.
+ * By default, ica_rsa_crt() and ica_rsa_crt_prepared() use the software
+ * fallback only if no adapter is available or the adapter request fails.
+ * With route_mode = 1 to 100, libica measures the latency of the adapter
+ * and of the software fallback per key size, and while an overloaded
+ * adapter is slower than the software fallback, route_mode percent of the
+ * requests are done in software instead. A small share of the requests
+ * goes to the other path in either state, to keep both measurements
+ * current. The changes are recorded as fallback events, see icastats -e.
+ * Routing requires the software fallbacks to be enabled (see
+ * ica_set_fallback_mode()); route_mode = 0 disables it.
+ */
+ICA_EXPORT
+void ica_set_rsa_route_mode(int route_mode);
+
+/**
+ * Environment variable for defining the default card rescan interval.
+ * When this environment variable exists and has a numeric value, the
+ * interval is set via ica_set_card_rescan_interval().
+ */
+#define ICA_CARD_RESCAN_ENV "LIBICA_CARD_RESCAN_MS"
+
+/**
+ * Set libica card rescan interval.
+ * libica looks for online crypto cards in /sys/devices/ap on first use of
+ * an adapter. Cards set online or offline afterwards, e.g. by hot-plug or
+ * chzdev, are found when an adapter is used at least interval_ms
+ * milliseconds after the last search; this updates the adapter flags and
+ * properties returned by ica_get_functionlist() and the cards of open
+ * adapter pools. The search is done by the request that finds the interval
+ * passed, so it adds to the latency of that request. The default interval
+ * is 0, which disables the rescan.
+ */
+ICA_EXPORT
+void ica_set_card_rescan_interval(int interval_ms);
+
 /**
  * Opens the specified adapter
  * @param adapter_handle Pointer to the file descriptor for the adapter or
@@ -536,6 +621,116 @@ unsigned int ica_open_adapter(ica_adapter_handle_t *adapter_handle);
 ICA_EXPORT
 unsigned int ica_close_adapter(ica_adapter_handle_t adapter_handle);
 
+/**
+ * A pool of adapter handles, one per online crypto card, see
+ * ica_adapter_pool_open().
+ */
+typedef struct ica_adapter_pool ICA_ADAPTER_POOL;
+
+/**
+ * Definitions for the flags of ica_adapter_pool_get().
+ */
+#define ICA_ADAPTER_POOL_RSA	0x01	/* any accelerator or coprocessor */
+#define ICA_ADAPTER_POOL_ECC	0x02	/* CEX4C or newer coprocessors */
+
+typedef struct {
+	unsigned int card;		/* AP card number */
+	char type[6];			/* e.g. "CEX7C" */
+	ica_adapter_handle_t adapter_handle;
+	/* 1 if the handle only reaches this card */
+	unsigned int dedicated;
+	/* handles got, but not yet put back */
+	unsigned int outstanding;
+	uint64_t requests;		/* handles got in total */
+} ica_adapter_pool_card_t;
+
+/**
+ * Open a pool of adapter handles, one for each online card found in
+ * /sys/devices/ap, for spreading requests over the cards.
+ *
+ * A handle is opened on a zcrypt device node whose apmask only contains
+ * its card, if there is one (see zcryptctl), so all requests on it go to
+ * that card. Otherwise it is opened like ica_open_adapter() does; then the
+ * driver selects the card for RSA requests, while the CPRBs of the ECC
+ * functions on it are addressed to its card (and sent to any card again, if
+ * that fails).
+ *
+ * With a card rescan interval set (see ica_set_card_rescan_interval()),
+ * cards set online later are added to the pool, and cards set offline are
+ * skipped until they are online again.
+ *
+ * @param pool
+ * On output contains the new pool.
+ *
+ * @return 0 if successful.
+ * EINVAL if pool is NULL.
+ * ENODEV if no card is online or the crypto device cannot be opened.
+ * ENOMEM if memory allocation fails.
+ */
+ICA_EXPORT
+unsigned int ica_adapter_pool_open(ICA_ADAPTER_POOL **pool);
+
+/**
+ * Close all handles of a pool and free it.
+ *
+ * @param pool
+ * Pointer to the pool. May be NULL.
+ */
+ICA_EXPORT
+void ica_adapter_pool_close(ICA_ADAPTER_POOL *pool);
+
+/**
+ * Get the handle of the card with the fewest outstanding requests (ties
+ * are served in turn) among the cards supporting the requests given in
+ * flags. Put it back with ica_adapter_pool_put() after the request.
+ *
+ * @param pool
+ * Pointer to the pool.
+ * @param flags
+ * ICA_ADAPTER_POOL_RSA and/or ICA_ADAPTER_POOL_ECC.
+ * @param adapter_handle
+ * On output contains the adapter handle, to be used with any libica
+ * function taking one.
+ *
+ * @return 0 if successful.
+ * EINVAL if at least one invalid parameter is given.
+ * ENODEV if no card of the pool supports the requests.
+ */
+ICA_EXPORT
+unsigned int ica_adapter_pool_get(ICA_ADAPTER_POOL *pool, unsigned int flags,
+				  ica_adapter_handle_t *adapter_handle);
+
+/**
+ * Put back a handle got with ica_adapter_pool_get().
+ *
+ * @param pool
+ * Pointer to the pool.
+ * @param adapter_handle
+ * The adapter handle.
+ */
+ICA_EXPORT
+void ica_adapter_pool_put(ICA_ADAPTER_POOL *pool,
+			  ica_adapter_handle_t adapter_handle);
+
+/**
+ * Get the card number, type, handle and request counts of a card of a pool.
+ *
+ * @param pool
+ * Pointer to the pool.
+ * @param index
+ * Index of the card in the pool, starting at 0.
+ * @param card
+ * On output contains the data of the card.
+ *
+ * @return 0 if successful.
+ * EINVAL if at least one invalid parameter is given.
+ * ENOENT if index is not less than the number of cards in the pool.
+ */
+ICA_EXPORT
+unsigned int ica_adapter_pool_stats(ICA_ADAPTER_POOL *pool,
+				    unsigned int index,
+				    ica_adapter_pool_card_t *card);
+
 /**
  * Generate a random number.
  *
@@ -1150,6 +1345,48 @@ int ica_ecdsa_verify(ica_adapter_handle_t adapter_handle,
 		const ICA_EC_KEY *pubkey, const unsigned char *hash, unsigned int hash_length,
 		const unsigned char *signature, unsigned int signature_length);
 
+/**
+ * Verify a batch of ECDSA signatures like ica_ecdsa_verify(), e.g. the
+ * certificate chains and OCSP responses of many TLS handshakes.
+ *
+ * Signatures on curves supported by CPACF (MSA9 or later) share one KDSA
+ * parameter block, up to 16 adapter requests of the batch are in flight at
+ * the same time, and signatures going to the software fallback with the
+ * same key share its setup.
+ *
+ * @param adapter_handle
+ * Pointer to a previously opened device handle.
+ * @param count
+ * Number of signatures.
+ * @param pubkeys
+ * Array of count pointers to public ICA_EC_KEY objects. The same key may
+ * occur several times, and the curves may differ.
+ * @param hashes
+ * Array of count pointers to the hashed data.
+ * @param hash_lengths
+ * Array of count lengths of the hashed data, see ica_ecdsa_verify().
+ * @param signatures
+ * Array of count pointers to the signatures r || s, each 2*privlen bytes
+ * long as returned when creating the ICA_EC_KEY object.
+ * @param status
+ * Array of count return codes, on output contains the return code of each
+ * verification, as ica_ecdsa_verify() would have returned it: 0 if the
+ * signature is valid, EFAULT if not.
+ *
+ * @return 0 if the batch was processed, the result of each verification is
+ * in status.
+ * EINVAL if at least one of the arrays is NULL or count is 0.
+ * ENOMEM if memory allocation fails.
+ */
+ICA_EXPORT
+unsigned int ica_ecdsa_verify_batch(ica_adapter_handle_t adapter_handle,
+				    unsigned int count,
+				    const ICA_EC_KEY *const *pubkeys,
+				    const unsigned char *const *hashes,
+				    const unsigned int *hash_lengths,
+				    const unsigned char *const *signatures,
+				    unsigned int *status);
+
 /**
  * provide the public key (X,Y) of the given ICA_EC_KEY.
  *
@@ -1202,7 +1439,13 @@ typedef struct ica_ed25519_ctx ICA_ED25519_CTX;
 typedef struct ica_ed448_ctx ICA_ED448_CTX;
 
 /*
- * Allocate a new context. MSA9 required.
+ * The ica_x25519, ica_x448, ica_ed25519 and ica_ed448 functions require MSA9.
+ * Without MSA9, they use a software implementation if software fallbacks are
+ * enabled, see ica_set_fallback_mode().
+ */
+
+/*
+ * Allocate a new context.
  * Returns 0 if successful. Otherwise, -1 is returned.
  */
 ICA_EXPORT
@@ -1215,7 +1458,7 @@ ICA_EXPORT
 int ica_ed448_ctx_new(ICA_ED448_CTX **ctx);
 
 /*
- * Copy the private and public key to the context. MSA9 required.
+ * Copy the private and public key to the context.
  * Returns 0 if successful. Otherwise, -1 is returned.
  */
 ICA_EXPORT
@@ -1232,7 +1475,7 @@ int ica_ed448_key_set(ICA_ED448_CTX *ctx, const unsigned char priv[57],
 		      const unsigned char pub[57]);
 
 /*
- * Copy the private and public key from the context. MSA9 required.
+ * Copy the private and public key from the context.
  * Returns 0 if successful. Otherwise, -1 is returned.
  */
 ICA_EXPORT
@@ -1249,7 +1492,7 @@ int ica_ed448_key_get(ICA_ED448_CTX *ctx, unsigned char priv[57],
 		      unsigned char pub[57]);
 
 /*
- * Generate a key. MSA9 required.
+ * Generate a key.
  * Returns 0 if successful. Otherwise, -1 is returned.
  */
 ICA_EXPORT
@@ -1262,7 +1505,7 @@ ICA_EXPORT
 int ica_ed448_key_gen(ICA_ED448_CTX *ctx);
 /*
  * Derive a shared secret. Requires the context to hold the private key.
- * MSA9 required. Returns 0 if successful. Otherwise, -1 is returned.
+ * Returns 0 if successful. Otherwise, -1 is returned.
  */
 ICA_EXPORT
 int ica_x25519_derive(ICA_X25519_CTX *ctx,
@@ -1274,7 +1517,7 @@ int ica_x448_derive(ICA_X448_CTX *ctx,
 		    const unsigned char peer_pub[56]);
 
 /*
- * Sign. Requires the context to hold the private key. MSA9 required.
+ * Sign. Requires the context to hold the private key.
  * Returns 0 if successful. Otherwise, -1 is returned.
  */
 ICA_EXPORT
@@ -1286,7 +1529,7 @@ int ica_ed448_sign(ICA_ED448_CTX *ctx, unsigned char sig[114],
 
 /*
  * Verify. Requires the public key. If the context only holds the private key,
- * the public key is derived. MSA9 required.
+ * the public key is derived.
  * Returns 0 if signature is valid. Otherwise, -1 is returned.
  */
 ICA_EXPORT
@@ -1297,7 +1540,7 @@ int ica_ed448_verify(ICA_ED448_CTX *ctx, const unsigned char sig[114],
 		     const unsigned char *msg, size_t msglen);
 
 /*
- * Delete a context. Its sensitive data is erased. MSA9 required.
+ * Delete a context. Its sensitive data is erased.
  * Returns 0 if successful. Otherwise, -1 is returned.
  */
 ICA_EXPORT
@@ -1373,6 +1616,61 @@ unsigned int ica_rsa_key_generate_crt(ica_adapter_handle_t adapter_handle,
 				      ica_rsa_key_mod_expo_t *public_key,
 				      ica_rsa_key_crt_t *private_key);
 
+/**
+ * Keep a pool of RSA keys, generated in the background, for
+ * ica_rsa_key_generate_mod_expo() and ica_rsa_key_generate_crt().
+ *
+ * A key generation request with modulus_bit_length and the exponent
+ * public_exponent is served from the pool, if it is not empty, and is
+ * generated synchronously otherwise. A background thread refills the pool
+ * up to size keys once it has low_water or fewer keys left. Each pooled key
+ * is handed out once. A forked child does not inherit the pooled keys.
+ *
+ * ica_cleanup() stops the background thread and zeroizes all pooled keys.
+ * It has to be called before libica is unloaded while a pool is in use.
+ *
+ * @param modulus_bit_length
+ * Bit length of the pooled keys' modulus.
+ * @param public_exponent
+ * Public exponent of the pooled keys, or 0 for a random exponent per key,
+ * as requested by an exponent of 0 in ica_rsa_key_generate_*().
+ * @param size
+ * Number of keys to keep. 0 removes the pool and zeroizes its keys.
+ * @param low_water
+ * Refill the pool when it has low_water or fewer keys left. Has to be less
+ * than size.
+ *
+ * @return 0 if successful.
+ * EINVAL if at least one invalid parameter is given.
+ * EPERM if modulus bit length is greater than 4096 (CEX adapter restriction).
+ * ENOSPC if there are 8 pools already.
+ * EAGAIN if the background thread cannot be started.
+ */
+ICA_EXPORT
+unsigned int ica_rsa_keygen_pool_set(unsigned int modulus_bit_length,
+				     unsigned long public_exponent,
+				     unsigned int size, unsigned int low_water);
+
+/**
+ * Get the statistics of a RSA key pool, see ica_rsa_keygen_pool_set().
+ *
+ * @param hits
+ * On output, the number of key generation requests served from the pool.
+ * @param misses
+ * On output, the number of requests which found the pool empty.
+ * @param available
+ * On output, the number of keys in the pool.
+ *
+ * @return 0 if successful.
+ * EINVAL if at least one invalid parameter is given.
+ * ENOENT if there is no such pool.
+ */
+ICA_EXPORT
+unsigned int ica_rsa_keygen_pool_stats(unsigned int modulus_bit_length,
+				       unsigned long public_exponent,
+				       uint64_t *hits, uint64_t *misses,
+				       unsigned int *available);
+
 /**
  * @brief Perform a RSA encryption/decryption operation using a key in
  * modulus/exponent form.
@@ -1408,6 +1706,11 @@ unsigned int ica_rsa_mod_expo(ica_adapter_handle_t adapter_handle,
  *
  * Make sure your message is padded before using this function. Otherwise you
  * will risk security!
+ *
+ * rsa_key is not modified, so it may be shared by several threads. A key
+ * not in privileged form (see ica_rsa_crt_key_check()) is converted in a
+ * copy on every call: convert it once with ica_rsa_crt_key_check() or use
+ * ica_rsa_key_crt_prepare() and ica_rsa_crt_prepared() instead.
  * @param adapter_handle
  * Pointer to a previously opened device handle.
  * @param input_data
@@ -1447,6 +1750,258 @@ unsigned int ica_rsa_crt(ica_adapter_handle_t adapter_handle,
 ICA_EXPORT
 unsigned int ica_rsa_crt_key_check(ica_rsa_key_crt_t *rsa_key);
 
+typedef struct ica_rsa_prepared_key ICA_RSA_PREPARED_KEY;
+
+/**
+ * Prepare a RSA key in modulus/exponent form for repeated use with
+ * ica_rsa_mod_expo_prepared().
+ *
+ * The prepared key holds its own copy of the key, so rsa_key may be
+ * released afterwards. If the software fallback is built in, the parsed
+ * key parts and the Montgomery context of the modulus are computed once
+ * here instead of on every operation.
+ *
+ * @param rsa_key
+ * Pointer to the key, in modulus/exponent format.
+ * @param prepared
+ * On output contains the prepared key. Free it with
+ * ica_rsa_prepared_key_free().
+ *
+ * @return 0 if successful.
+ * EINVAL if at least one invalid parameter is given.
+ * EPERM if key bit length is greater than 4096 (CEX adapter restriction).
+ * ENOMEM if memory allocation fails.
+ */
+ICA_EXPORT
+unsigned int ica_rsa_key_mod_expo_prepare(const ica_rsa_key_mod_expo_t *rsa_key,
+					  ICA_RSA_PREPARED_KEY **prepared);
+
+/**
+ * Prepare a RSA key in CRT form for repeated use with ica_rsa_crt_prepared().
+ *
+ * The prepared key holds its own copy of the key, which is brought into
+ * privileged form (see ica_rsa_crt_key_check()) and checked for consistency
+ * once, so rsa_key is not modified and may be released afterwards. If the
+ * software fallback is built in, the parsed key parts, the Montgomery
+ * contexts of p and q and the blinding values (see
+ * ica_set_rsa_crt_verify_mode()) are computed once here instead of on every
+ * operation.
+ *
+ * @param rsa_key
+ * Pointer to the key, in CRT format.
+ * @param prepared
+ * On output contains the prepared key. Free it with
+ * ica_rsa_prepared_key_free().
+ *
+ * @return 0 if successful.
+ * EINVAL if at least one invalid parameter is given, or p and q are not
+ * odd or qInverse is not the inverse of q modulo p, or the public exponent
+ * cannot be recovered from the key (see ica_set_rsa_crt_verify_mode()).
+ * EPERM if key bit length is greater than 4096 (CEX adapter restriction).
+ * ENOMEM if memory allocation fails.
+ */
+ICA_EXPORT
+unsigned int ica_rsa_key_crt_prepare(const ica_rsa_key_crt_t *rsa_key,
+				     ICA_RSA_PREPARED_KEY **prepared);
+
+/**
+ * Free a prepared RSA key. Its key material is cleared.
+ *
+ * @param prepared
+ * Pointer to the prepared key. May be NULL.
+ */
+ICA_EXPORT
+void ica_rsa_prepared_key_free(ICA_RSA_PREPARED_KEY *prepared);
+
+/**
+ * @brief Perform a RSA encryption/decryption operation like
+ * ica_rsa_mod_expo(), using a key prepared by
+ * ica_rsa_key_mod_expo_prepare().
+ *
+ * A prepared key may be used by several threads concurrently.
+ *
+ * @return 0 if successful.
+ * EINVAL if at least one invalid parameter is given, or the key was not
+ * prepared in modulus/exponent form.
+ * ENOMEM if memory allocation fails.
+ * EIO if the operation fails. This should never happen.
+ */
+ICA_EXPORT
+unsigned int ica_rsa_mod_expo_prepared(ica_adapter_handle_t adapter_handle,
+				       const unsigned char *input_data,
+				       const ICA_RSA_PREPARED_KEY *prepared,
+				       unsigned char *output_data);
+
+/**
+ * @brief Perform a RSA encryption/decryption operation like ica_rsa_crt(),
+ * using a key prepared by ica_rsa_key_crt_prepare().
+ *
+ * A prepared key may be used by several threads concurrently.
+ *
+ * @return 0 if successful.
+ * EINVAL if at least one invalid parameter is given, or the key was not
+ * prepared in CRT form.
+ * ENOMEM if memory allocation fails.
+ * EIO if the operation fails. This should never happen.
+ */
+ICA_EXPORT
+unsigned int ica_rsa_crt_prepared(ica_adapter_handle_t adapter_handle,
+				  const unsigned char *input_data,
+				  const ICA_RSA_PREPARED_KEY *prepared,
+				  unsigned char *output_data);
+
+typedef struct ica_rsa_queue ICA_RSA_QUEUE;
+
+#define ICA_RSA_REQ_MOD_EXPO	1
+#define ICA_RSA_REQ_CRT		2
+
+/*
+ * An asynchronous RSA request, see ica_rsa_submit(). The request and the
+ * buffers it points to must stay valid until it was returned by
+ * ica_rsa_poll().
+ */
+typedef struct {
+	/* ICA_RSA_REQ_MOD_EXPO or ICA_RSA_REQ_CRT */
+	unsigned int type;
+	const unsigned char *input_data;
+	/* the key matching type, or a key prepared in the matching form */
+	ica_rsa_key_mod_expo_t *mod_expo_key;
+	ica_rsa_key_crt_t *crt_key;
+	const ICA_RSA_PREPARED_KEY *prepared;
+	unsigned char *output_data;
+	/* not used by libica */
+	void *user_data;
+	/* on completion the return code of ica_rsa_mod_expo(_prepared) or
+	 * ica_rsa_crt(_prepared) */
+	unsigned int status;
+} ica_rsa_request_t;
+
+/**
+ * Create a queue for asynchronous RSA operations on an adapter handle.
+ *
+ * The queue runs in_flight worker threads, so up to in_flight requests are
+ * processed by the crypto adapters at the same time, independent of the
+ * number of threads submitting them.
+ *
+ * @param adapter_handle
+ * Pointer to a previously opened device handle. It must stay open until the
+ * queue is freed.
+ * @param in_flight
+ * Number of requests in flight (1 to 256).
+ * @param depth
+ * Maximum number of submitted requests, which were not yet returned by
+ * ica_rsa_poll(). Must be at least in_flight.
+ * @param queue
+ * On output contains the new queue.
+ *
+ * @return 0 if successful.
+ * EINVAL if at least one invalid parameter is given.
+ * ENOMEM if memory allocation fails.
+ * EAGAIN if the worker threads cannot be created.
+ */
+ICA_EXPORT
+unsigned int ica_rsa_queue_new(ica_adapter_handle_t adapter_handle,
+			       unsigned int in_flight, unsigned int depth,
+			       ICA_RSA_QUEUE **queue);
+
+/**
+ * Free a queue. Already submitted requests are processed first, but not
+ * returned.
+ *
+ * @param queue
+ * Pointer to the queue. May be NULL.
+ */
+ICA_EXPORT
+void ica_rsa_queue_free(ICA_RSA_QUEUE *queue);
+
+/**
+ * Return a file descriptor for poll/select/epoll, which is readable while
+ * completed requests can be fetched with ica_rsa_poll(). It must not be
+ * read or closed by the caller.
+ *
+ * @return the file descriptor or -1 if queue is NULL.
+ */
+ICA_EXPORT
+int ica_rsa_queue_fd(ICA_RSA_QUEUE *queue);
+
+/**
+ * Submit an asynchronous RSA request. The call does not block.
+ *
+ * @param queue
+ * Pointer to the queue.
+ * @param request
+ * Pointer to the request.
+ *
+ * @return 0 if successful.
+ * EINVAL if at least one invalid parameter is given.
+ * EAGAIN if the queue already holds depth requests.
+ */
+ICA_EXPORT
+unsigned int ica_rsa_submit(ICA_RSA_QUEUE *queue, ica_rsa_request_t *request);
+
+/**
+ * Fetch completed requests. Each request is returned once, with its status
+ * field set.
+ *
+ * @param queue
+ * Pointer to the queue.
+ * @param requests
+ * Array of at least max request pointers, on output contains the completed
+ * requests in the order of completion.
+ * @param max
+ * Maximum number of requests to return.
+ * @param timeout_ms
+ * Time to wait for the first completion in milliseconds: 0 does not block,
+ * a negative value waits until a request completes.
+ * @param count
+ * On output contains the number of returned requests.
+ *
+ * @return 0 if successful, even if count is 0 on timeout.
+ * EINVAL if at least one invalid parameter is given.
+ */
+ICA_EXPORT
+unsigned int ica_rsa_poll(ICA_RSA_QUEUE *queue, ica_rsa_request_t **requests,
+			  unsigned int max, int timeout_ms,
+			  unsigned int *count);
+
+/**
+ * @brief Perform a batch of RSA encryption/decryption operations like
+ * ica_rsa_mod_expo(), e.g. the public key operations of signature
+ * verifications.
+ *
+ * Up to 16 operations of the batch are in flight on the crypto adapters at
+ * the same time. Operations going to the software fallback share their
+ * setup, and for public exponents of up to 64 bits the Montgomery context
+ * of moduli occurring several times in the batch.
+ *
+ * @param adapter_handle
+ * Pointer to a previously opened device handle.
+ * @param count
+ * Number of operations.
+ * @param input_data
+ * Array of count pointers to the input data, see ica_rsa_mod_expo().
+ * @param rsa_keys
+ * Array of count pointers to the keys, in modulus/exponent format. The
+ * same key may occur several times.
+ * @param output_data
+ * Array of count pointers to the output buffers, see ica_rsa_mod_expo().
+ * @param status
+ * Array of count return codes, on output contains the return code of each
+ * operation, as ica_rsa_mod_expo() would have returned it.
+ *
+ * @return 0 if the batch was processed, the result of each operation is in
+ * status.
+ * EINVAL if at least one of the arrays is NULL or count is 0.
+ * ENOMEM if memory allocation fails.
+ */
+ICA_EXPORT
+unsigned int ica_rsa_mod_expo_batch(ica_adapter_handle_t adapter_handle,
+				    unsigned int count,
+				    const unsigned char *const *input_data,
+				    ica_rsa_key_mod_expo_t *const *rsa_keys,
+				    unsigned char *const *output_data,
+				    unsigned int *status);
+
 /**
  * Encrypt or decrypt data with an DES key using Electronic Cook Book (ECB)
  * mode as described in NIST Special Publication 800-38A Chapter 6.1.
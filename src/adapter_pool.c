@@ -0,0 +1,319 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "adapter_pool.h"
+#include "ica_api.h"
+#include "init.h"
+#include "s390_crypto.h"
+
+/*
+ * A pool has one adapter handle per online card. If the administrator
+ * created a zcrypt device node (see zcryptctl) whose apmask selects only
+ * that card, the handle is opened on it, so that the driver sends all
+ * requests of the handle to the card. Otherwise the handle is opened like
+ * ica_open_adapter does, and only CPRBs can be addressed to the card, see
+ * adapter_pool_card. The open pools are kept in a list for that lookup.
+ * A card set offline keeps its entry and handle, since the handle may be
+ * in use, but it is not handed out until it is online again.
+ */
+#define ZCRYPT_CLASS_PATH	"/sys/class/zcrypt"
+#define MAX_PATH_LEN		280
+
+struct pool_card {
+	ica_adapter_handle_t handle;
+	unsigned int card;
+	unsigned int flags;	/* see card_type_flags */
+	unsigned int dedicated;
+	unsigned int online;
+	unsigned int outstanding;
+	uint64_t requests;
+	char type[6];
+};
+
+struct ica_adapter_pool {
+	struct ica_adapter_pool *next;
+	pthread_mutex_t lock;
+	/* card to start the search for the least busy one at */
+	unsigned int rotor;
+	unsigned int num;
+	struct pool_card cards[MAX_CARDS];
+};
+
+static struct ica_adapter_pool *pools;
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Returns the card selected by the apmask of a zcrypt device node, a string
+ * like "0x4000...", if it selects exactly one card, else -1. Card 0 is the
+ * most significant bit.
+ */
+static int apmask_card(const char *path)
+{
+	char buf[2 + MAX_CARDS / 4 + 2], *ptr;
+	int card = -1, i, bit, value;
+	FILE *file;
+
+	if ((file = fopen(path, "r")) == NULL)
+		return -1;
+	ptr = fgets(buf, sizeof(buf), file);
+	fclose(file);
+	if (ptr == NULL)
+		return -1;
+
+	if (strncmp(ptr, "0x", 2) == 0)
+		ptr += 2;
+	for (i = 0; i < MAX_CARDS / 4 && isxdigit((unsigned char)ptr[i]); i++) {
+		value = isdigit((unsigned char)ptr[i]) ? ptr[i] - '0' :
+			tolower((unsigned char)ptr[i]) - 'a' + 10;
+		for (bit = 0; bit < 4; bit++) {
+			if (!(value & (8 >> bit)))
+				continue;
+			if (card != -1)
+				return -1;
+			card = i * 4 + bit;
+		}
+	}
+	return card;
+}
+
+/* opens the device node dedicated to card, if there is one */
+static ica_adapter_handle_t open_dedicated(unsigned int card)
+{
+	ica_adapter_handle_t handle = DRIVER_NOT_LOADED;
+	char path[MAX_PATH_LEN];
+	struct dirent *direntp;
+	DIR *dir;
+
+	if ((dir = opendir(ZCRYPT_CLASS_PATH)) == NULL)
+		return DRIVER_NOT_LOADED;
+
+	while ((direntp = readdir(dir)) != NULL) {
+		if (direntp->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s/apmask", ZCRYPT_CLASS_PATH,
+			 direntp->d_name);
+		if (apmask_card(path) != (int)card)
+			continue;
+
+		snprintf(path, sizeof(path), "/dev/%s", direntp->d_name);
+		handle = open(path, O_RDWR);
+		if (handle != -1)
+			break;
+		handle = DRIVER_NOT_LOADED;
+	}
+
+	closedir(dir);
+	return handle;
+}
+
+static void add_card(unsigned int card, const char *type, void *arg)
+{
+	ICA_ADAPTER_POOL *pool = arg;
+	struct pool_card *entry;
+	unsigned int i;
+
+	/* e.g. EP11 coprocessors, which serve neither RSA nor ECC requests */
+	if (card_type_flags(type) == 0)
+		return;
+
+	/* a card online again after a rescan */
+	for (i = 0; i < pool->num; i++) {
+		if (pool->cards[i].card == card) {
+			pool->cards[i].online = 1;
+			return;
+		}
+	}
+	if (pool->num == MAX_CARDS)
+		return;
+
+	entry = &pool->cards[pool->num];
+
+	entry->handle = open_dedicated(card);
+	if (entry->handle != DRIVER_NOT_LOADED)
+		entry->dedicated = 1;
+	else
+		ica_open_adapter(&entry->handle);
+	if (entry->handle == DRIVER_NOT_LOADED)
+		return;
+
+	entry->card = card;
+	entry->online = 1;
+	entry->flags = card_type_flags(type);
+	memcpy(entry->type, type, 5);
+	pool->num++;
+}
+
+unsigned int adapter_pool_open(ICA_ADAPTER_POOL **pool)
+{
+	ICA_ADAPTER_POOL *new;
+
+	ica_init_cards();
+
+	if ((new = calloc(1, sizeof(*new))) == NULL)
+		return ENOMEM;
+	pthread_mutex_init(&new->lock, NULL);
+
+	for_each_online_card(add_card, new);
+	if (new->num == 0) {
+		adapter_pool_close(new);
+		return ENODEV;
+	}
+
+	pthread_mutex_lock(&pools_lock);
+	new->next = pools;
+	__atomic_store_n(&pools, new, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&pools_lock);
+
+	*pool = new;
+	return 0;
+}
+
+void adapter_pool_close(ICA_ADAPTER_POOL *pool)
+{
+	ICA_ADAPTER_POOL **ptr;
+	unsigned int i;
+
+	pthread_mutex_lock(&pools_lock);
+	for (ptr = &pools; *ptr; ptr = &(*ptr)->next) {
+		if (*ptr == pool) {
+			__atomic_store_n(ptr, pool->next, __ATOMIC_RELEASE);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pools_lock);
+
+	for (i = 0; i < pool->num; i++)
+		ica_close_adapter(pool->cards[i].handle);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+/* the card with the fewest outstanding requests, ties in turn */
+unsigned int adapter_pool_get(ICA_ADAPTER_POOL *pool, unsigned int flags,
+			      ica_adapter_handle_t *adapter_handle)
+{
+	unsigned int i, j, need = 0, best = MAX_CARDS;
+
+	if (flags & ICA_ADAPTER_POOL_RSA)
+		need |= CARD_AVAILABLE;
+	if (flags & ICA_ADAPTER_POOL_ECC)
+		need |= CEX4C_AVAILABLE;
+
+	pthread_mutex_lock(&pool->lock);
+	for (j = 0; j < pool->num; j++) {
+		i = (pool->rotor + j) % pool->num;
+		if (!pool->cards[i].online ||
+		    (pool->cards[i].flags & need) != need)
+			continue;
+		if (best == MAX_CARDS ||
+		    pool->cards[i].outstanding < pool->cards[best].outstanding)
+			best = i;
+	}
+	if (best != MAX_CARDS) {
+		pool->cards[best].outstanding++;
+		pool->cards[best].requests++;
+		pool->rotor = best + 1;
+		*adapter_handle = pool->cards[best].handle;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return best == MAX_CARDS ? ENODEV : 0;
+}
+
+void adapter_pool_put(ICA_ADAPTER_POOL *pool,
+		      ica_adapter_handle_t adapter_handle)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&pool->lock);
+	for (i = 0; i < pool->num; i++) {
+		if (pool->cards[i].handle == adapter_handle &&
+		    pool->cards[i].outstanding > 0) {
+			pool->cards[i].outstanding--;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+unsigned int adapter_pool_stats(ICA_ADAPTER_POOL *pool, unsigned int index,
+				ica_adapter_pool_card_t *card)
+{
+	struct pool_card *entry;
+
+	/* a rescan may change the cards of the pool meanwhile */
+	pthread_mutex_lock(&pool->lock);
+	if (index >= pool->num) {
+		pthread_mutex_unlock(&pool->lock);
+		return ENOENT;
+	}
+
+	entry = &pool->cards[index];
+	card->card = entry->card;
+	memcpy(card->type, entry->type, sizeof(card->type));
+	card->adapter_handle = entry->handle;
+	card->dedicated = entry->dedicated;
+	card->outstanding = entry->outstanding;
+	card->requests = entry->requests;
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+void adapter_pool_rescan(void)
+{
+	ICA_ADAPTER_POOL *pool;
+	unsigned int i;
+
+	if (__atomic_load_n(&pools, __ATOMIC_ACQUIRE) == NULL)
+		return;
+
+	pthread_mutex_lock(&pools_lock);
+	for (pool = pools; pool; pool = pool->next) {
+		pthread_mutex_lock(&pool->lock);
+		for (i = 0; i < pool->num; i++)
+			pool->cards[i].online = 0;
+		for_each_online_card(add_card, pool);
+		pthread_mutex_unlock(&pool->lock);
+	}
+	pthread_mutex_unlock(&pools_lock);
+}
+
+int adapter_pool_card(ica_adapter_handle_t adapter_handle)
+{
+	ICA_ADAPTER_POOL *pool;
+	unsigned int i;
+	int card = -1;
+
+	/* no lock on the path without pools */
+	if (__atomic_load_n(&pools, __ATOMIC_ACQUIRE) == NULL)
+		return -1;
+
+	pthread_mutex_lock(&pools_lock);
+	for (pool = pools; pool && card == -1; pool = pool->next) {
+		for (i = 0; i < pool->num; i++) {
+			if (pool->cards[i].handle == adapter_handle) {
+				card = pool->cards[i].card;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&pools_lock);
+
+	return card;
+}
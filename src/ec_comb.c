@@ -0,0 +1,586 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+/*
+ * Fixed-base comb for the public keys of the software EC path.
+ *
+ * Field elements are arrays of 64-bit digits, least significant first, in
+ * Montgomery form with R = 2^(64 * limbs). Points are projective (X:Y:Z)
+ * and added with the complete formulas of Renes, Costello and Batina
+ * ("Complete addition formulas for prime order elliptic curves", algorithm
+ * 1), which also double and handle the point at infinity (0:1:0) without
+ * branches. All supported curves have prime order.
+ *
+ * The scalar of b = 8 * privlen bits is split into TEETH teeth of d bits,
+ * and each tooth into TABLES parts of e = d / TABLES bits. Table k holds
+ * the 2^TEETH sums of the points 2^(t*d + k*e) * G selected by the bits of
+ * the index, 27 KB for all tables of a curve, so
+ *
+ *	d * G = sum_{i=e-1..0} 2^i * sum_k table[k][bits k*e+i+t*d of d]
+ *
+ * takes e doublings and TABLES * e additions instead of b of each. Every
+ * lookup reads all entries of a table with masks, the number of iterations
+ * only depends on the curve and the final subtractions are masked, so
+ * neither the timing nor the memory access pattern depends on the scalar.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
+
+#include "ec_comb.h"
+#include "rng.h"
+#include "s390_ecc.h"
+
+#define LIMBS		9	/* 521 bits */
+#define TEETH		5
+#define TABLES		4
+#define ENTRIES		(1 << TEETH)
+/* tries for a random private key below the order */
+#define KEYGEN_TRIES	64
+
+typedef unsigned __int128 uint128_t;
+
+struct point {
+	uint64_t x[LIMBS];
+	uint64_t y[LIMBS];
+	uint64_t z[LIMBS];
+};
+
+struct comb {
+	unsigned int limbs;
+	unsigned int privlen;
+	unsigned int spacing;	/* d, a multiple of TABLES */
+	unsigned int rows;	/* e = d / TABLES */
+	uint64_t p[LIMBS];
+	uint64_t p_inv;		/* -1/p mod 2^64 */
+	uint64_t p_2[LIMBS];	/* p - 2, the inversion exponent */
+	uint64_t one[LIMBS];	/* R mod p */
+	uint64_t a[LIMBS];
+	uint64_t b3[LIMBS];	/* 3 * b */
+	unsigned char order[MAX_ECC_PRIV_SIZE];
+	struct point table[TABLES][ENTRIES];
+};
+
+static const unsigned int comb_nids[] = {
+	NID_X9_62_prime192v1, NID_secp224r1, NID_X9_62_prime256v1,
+	NID_secp384r1, NID_secp521r1, NID_brainpoolP160r1,
+	NID_brainpoolP192r1, NID_brainpoolP224r1, NID_brainpoolP256r1,
+	NID_brainpoolP320r1, NID_brainpoolP384r1, NID_brainpoolP512r1,
+};
+#define CURVES	(sizeof(comb_nids) / sizeof(comb_nids[0]))
+
+/* built on first use, never changed or freed afterwards */
+static struct comb *combs[CURVES];
+
+/* r = r - p if r >= p, for hi * R + r < 2p */
+static void fe_reduce(const struct comb *c, uint64_t *r, uint64_t hi)
+{
+	uint64_t s[LIMBS], borrow = 0, mask;
+	uint128_t diff;
+	unsigned int i;
+
+	for (i = 0; i < c->limbs; i++) {
+		diff = (uint128_t)r[i] - c->p[i] - borrow;
+		s[i] = (uint64_t)diff;
+		borrow = (uint64_t)(diff >> 64) & 1;
+	}
+	mask = 0 - (hi | (borrow ^ 1));
+	for (i = 0; i < c->limbs; i++)
+		r[i] = (s[i] & mask) | (r[i] & ~mask);
+}
+
+static void fe_add(const struct comb *c, uint64_t *r, const uint64_t *a,
+		   const uint64_t *b)
+{
+	uint64_t carry = 0;
+	uint128_t sum;
+	unsigned int i;
+
+	for (i = 0; i < c->limbs; i++) {
+		sum = (uint128_t)a[i] + b[i] + carry;
+		r[i] = (uint64_t)sum;
+		carry = (uint64_t)(sum >> 64);
+	}
+	fe_reduce(c, r, carry);
+}
+
+static void fe_sub(const struct comb *c, uint64_t *r, const uint64_t *a,
+		   const uint64_t *b)
+{
+	uint64_t borrow = 0, carry = 0, mask;
+	uint128_t diff, sum;
+	unsigned int i;
+
+	for (i = 0; i < c->limbs; i++) {
+		diff = (uint128_t)a[i] - b[i] - borrow;
+		r[i] = (uint64_t)diff;
+		borrow = (uint64_t)(diff >> 64) & 1;
+	}
+	/* add p back if a < b */
+	mask = 0 - borrow;
+	for (i = 0; i < c->limbs; i++) {
+		sum = (uint128_t)r[i] + (c->p[i] & mask) + carry;
+		r[i] = (uint64_t)sum;
+		carry = (uint64_t)(sum >> 64);
+	}
+}
+
+/*
+ * r = a * b / R mod p, coarsely integrated operand scanning. Inlined for
+ * each number of digits, so the compiler can unroll the loops.
+ */
+static inline __attribute__((always_inline))
+void fe_mul_n(const struct comb *c, uint64_t *r, const uint64_t *a,
+	      const uint64_t *b, const unsigned int n)
+{
+	uint64_t t[LIMBS + 2], carry, m;
+	unsigned int i, j;
+	uint128_t acc;
+
+	memset(t, 0, sizeof(t));
+	for (i = 0; i < n; i++) {
+		carry = 0;
+		for (j = 0; j < n; j++) {
+			acc = (uint128_t)a[j] * b[i] + t[j] + carry;
+			t[j] = (uint64_t)acc;
+			carry = (uint64_t)(acc >> 64);
+		}
+		acc = (uint128_t)t[n] + carry;
+		t[n] = (uint64_t)acc;
+		t[n + 1] = (uint64_t)(acc >> 64);
+
+		m = t[0] * c->p_inv;
+		acc = (uint128_t)m * c->p[0] + t[0];
+		carry = (uint64_t)(acc >> 64);
+		for (j = 1; j < n; j++) {
+			acc = (uint128_t)m * c->p[j] + t[j] + carry;
+			t[j - 1] = (uint64_t)acc;
+			carry = (uint64_t)(acc >> 64);
+		}
+		acc = (uint128_t)t[n] + carry;
+		t[n - 1] = (uint64_t)acc;
+		t[n] = t[n + 1] + (uint64_t)(acc >> 64);
+	}
+	memcpy(r, t, n * sizeof(uint64_t));
+	fe_reduce(c, r, t[n]);
+}
+
+static void fe_mul(const struct comb *c, uint64_t *r, const uint64_t *a,
+		   const uint64_t *b)
+{
+	switch (c->limbs) {
+	case 3:
+		fe_mul_n(c, r, a, b, 3);
+		break;
+	case 4:
+		fe_mul_n(c, r, a, b, 4);
+		break;
+	case 5:
+		fe_mul_n(c, r, a, b, 5);
+		break;
+	case 6:
+		fe_mul_n(c, r, a, b, 6);
+		break;
+	case 8:
+		fe_mul_n(c, r, a, b, 8);
+		break;
+	default:	/* P-521 */
+		fe_mul_n(c, r, a, b, LIMBS);
+		break;
+	}
+}
+
+/* r = a^e for a public exponent e */
+static void fe_pow(const struct comb *c, uint64_t *r, const uint64_t *a,
+		   const uint64_t *e)
+{
+	uint64_t t[LIMBS];
+	int i;
+
+	memcpy(t, c->one, sizeof(t));
+	for (i = 64 * c->limbs - 1; i >= 0; i--) {
+		fe_mul(c, t, t, t);
+		if ((e[i / 64] >> (i % 64)) & 1)
+			fe_mul(c, t, t, a);
+	}
+	memcpy(r, t, sizeof(t));
+}
+
+/* big endian privlen bytes from and to digits, not converted */
+static void fe_from_bytes(const struct comb *c, uint64_t *r,
+			  const unsigned char *in)
+{
+	unsigned int i;
+
+	memset(r, 0, LIMBS * sizeof(uint64_t));
+	for (i = 0; i < c->privlen; i++)
+		r[i / 8] |= (uint64_t)in[c->privlen - 1 - i] << (8 * (i % 8));
+}
+
+static void fe_to_bytes(const struct comb *c, unsigned char *out,
+			const uint64_t *a)
+{
+	unsigned int i;
+
+	for (i = 0; i < c->privlen; i++)
+		out[c->privlen - 1 - i] = (unsigned char)(a[i / 8] >> (8 * (i % 8)));
+}
+
+/* r = p + q, r may be p or q */
+static void point_add(const struct comb *c, struct point *r,
+		      const struct point *p, const struct point *q)
+{
+	uint64_t t0[LIMBS], t1[LIMBS], t2[LIMBS], t3[LIMBS], t4[LIMBS];
+	uint64_t t5[LIMBS], x3[LIMBS], y3[LIMBS], z3[LIMBS];
+
+	fe_mul(c, t0, p->x, q->x);
+	fe_mul(c, t1, p->y, q->y);
+	fe_mul(c, t2, p->z, q->z);
+	fe_add(c, t3, p->x, p->y);
+	fe_add(c, t4, q->x, q->y);
+	fe_mul(c, t3, t3, t4);
+	fe_add(c, t4, t0, t1);
+	fe_sub(c, t3, t3, t4);
+	fe_add(c, t4, p->x, p->z);
+	fe_add(c, t5, q->x, q->z);
+	fe_mul(c, t4, t4, t5);
+	fe_add(c, t5, t0, t2);
+	fe_sub(c, t4, t4, t5);
+	fe_add(c, t5, p->y, p->z);
+	fe_add(c, x3, q->y, q->z);
+	fe_mul(c, t5, t5, x3);
+	fe_add(c, x3, t1, t2);
+	fe_sub(c, t5, t5, x3);
+	fe_mul(c, z3, c->a, t4);
+	fe_mul(c, x3, c->b3, t2);
+	fe_add(c, z3, x3, z3);
+	fe_sub(c, x3, t1, z3);
+	fe_add(c, z3, t1, z3);
+	fe_mul(c, y3, x3, z3);
+	fe_add(c, t1, t0, t0);
+	fe_add(c, t1, t1, t0);
+	fe_mul(c, t2, c->a, t2);
+	fe_mul(c, t4, c->b3, t4);
+	fe_add(c, t1, t1, t2);
+	fe_sub(c, t2, t0, t2);
+	fe_mul(c, t2, c->a, t2);
+	fe_add(c, t4, t4, t2);
+	fe_mul(c, t2, t1, t4);
+	fe_add(c, y3, y3, t2);
+	fe_mul(c, t2, t5, t4);
+	fe_mul(c, x3, x3, t3);
+	fe_sub(c, x3, x3, t2);
+	fe_mul(c, t2, t3, t1);
+	fe_mul(c, z3, z3, t5);
+	fe_add(c, z3, z3, t2);
+
+	memcpy(r->x, x3, sizeof(x3));
+	memcpy(r->y, y3, sizeof(y3));
+	memcpy(r->z, z3, sizeof(z3));
+}
+
+static void point_infinity(const struct comb *c, struct point *r)
+{
+	memset(r, 0, sizeof(*r));
+	memcpy(r->y, c->one, sizeof(r->y));
+}
+
+/* r = table[k][index], reading all entries */
+static void table_lookup(const struct comb *c, struct point *r,
+			 unsigned int k, unsigned int index)
+{
+	const struct point *entry;
+	unsigned int i, j;
+	uint64_t mask;
+
+	memset(r, 0, sizeof(*r));
+	for (i = 0; i < ENTRIES; i++) {
+		entry = &c->table[k][i];
+		mask = 0 - (((uint64_t)(i ^ index) - 1) >> 63);
+		for (j = 0; j < c->limbs; j++) {
+			r->x[j] |= entry->x[j] & mask;
+			r->y[j] |= entry->y[j] & mask;
+			r->z[j] |= entry->z[j] & mask;
+		}
+	}
+}
+
+static unsigned int scalar_bit(const struct comb *c, const unsigned char *d,
+			       unsigned int bit)
+{
+	if (bit >= 8 * c->privlen)
+		return 0;
+	return (d[c->privlen - 1 - bit / 8] >> (bit % 8)) & 1;
+}
+
+static int bn_to_fe(const struct comb *c, uint64_t *r, const BIGNUM *bn)
+{
+	unsigned char buf[MAX_ECC_PRIV_SIZE];
+
+	if (BN_bn2binpad(bn, buf, c->privlen) < 0)
+		return -1;
+	fe_from_bytes(c, r, buf);
+	return 0;
+}
+
+/* to Montgomery form: r = bn * R mod p */
+static int bn_to_mont(const struct comb *c, uint64_t *r, const BIGNUM *bn,
+		      const uint64_t *r2)
+{
+	if (bn_to_fe(c, r, bn))
+		return -1;
+	fe_mul(c, r, r, r2);
+	return 0;
+}
+
+static void comb_build_table(struct comb *c, const struct point *g)
+{
+	struct point base[TEETH][TABLES], cur = *g;
+	unsigned int t, k, i, bit;
+
+	/* base[t][k] = 2^(t*d + k*e) * G */
+	for (bit = 0; bit < TEETH * c->spacing; bit++) {
+		for (t = 0; t < TEETH; t++) {
+			for (k = 0; k < TABLES; k++) {
+				if (bit == t * c->spacing + k * c->rows)
+					base[t][k] = cur;
+			}
+		}
+		point_add(c, &cur, &cur, &cur);
+	}
+
+	for (k = 0; k < TABLES; k++) {
+		point_infinity(c, &c->table[k][0]);
+		for (i = 1; i < ENTRIES; i++) {
+			/* the highest tooth added to the entry without it */
+			for (t = TEETH - 1; !(i & (1 << t)); t--)
+				;
+			point_add(c, &c->table[k][i],
+				  &c->table[k][i ^ (1 << t)], &base[t][k]);
+		}
+	}
+}
+
+static int comb_new(unsigned int nid, struct comb **comb)
+{
+	BIGNUM *p = NULL, *a = NULL, *b = NULL, *gx = NULL, *gy = NULL;
+	BIGNUM *b3 = NULL, *r = NULL, *r2 = NULL;
+	uint64_t r2_fe[LIMBS], inv;
+	EC_GROUP *group = NULL;
+	BN_CTX *ctx = NULL;
+	struct point g;
+	struct comb *c;
+	unsigned int bits, i;
+	int rc = ENOMEM;
+
+	if ((c = calloc(1, sizeof(*c))) == NULL)
+		return ENOMEM;
+	c->privlen = privlen_from_nid(nid);
+	c->limbs = (c->privlen + 7) / 8;
+	bits = 8 * c->privlen;
+	c->spacing = (bits + TEETH - 1) / TEETH;
+	c->spacing = (c->spacing + TABLES - 1) / TABLES * TABLES;
+	c->rows = c->spacing / TABLES;
+
+	group = EC_GROUP_new_by_curve_name(nid);
+	if (group == NULL) {
+		rc = ENODEV;
+		goto out;
+	}
+	ctx = BN_CTX_new();
+	p = BN_new();
+	a = BN_new();
+	b = BN_new();
+	gx = BN_new();
+	gy = BN_new();
+	b3 = BN_new();
+	r = BN_new();
+	r2 = BN_new();
+	if (ctx == NULL || p == NULL || a == NULL || b == NULL || gx == NULL ||
+	    gy == NULL || b3 == NULL || r == NULL || r2 == NULL)
+		goto out;
+
+	rc = EIO;
+	if (!EC_GROUP_get_curve(group, p, a, b, ctx) ||
+	    !EC_POINT_get_affine_coordinates(group,
+					     EC_GROUP_get0_generator(group),
+					     gx, gy, ctx) ||
+	    BN_bn2binpad(EC_GROUP_get0_order(group), c->order,
+			 c->privlen) < 0)
+		goto out;
+
+	/* R mod p, R^2 mod p and 3 * b */
+	if (!BN_set_bit(r, 64 * c->limbs) || !BN_mod(r, r, p, ctx) ||
+	    !BN_mod_sqr(r2, r, p, ctx) || !BN_mod_lshift1_quick(b3, b, p) ||
+	    !BN_mod_add_quick(b3, b3, b, p))
+		goto out;
+	if (bn_to_fe(c, c->p, p) || bn_to_fe(c, c->one, r) ||
+	    bn_to_fe(c, r2_fe, r2) || !BN_sub_word(p, 2) ||
+	    bn_to_fe(c, c->p_2, p))
+		goto out;
+
+	/* -1/p mod 2^64 by Newton iteration */
+	inv = 1;
+	for (i = 0; i < 6; i++)
+		inv *= 2 - c->p[0] * inv;
+	c->p_inv = 0 - inv;
+
+	if (bn_to_mont(c, c->a, a, r2_fe) || bn_to_mont(c, c->b3, b3, r2_fe) ||
+	    bn_to_mont(c, g.x, gx, r2_fe) || bn_to_mont(c, g.y, gy, r2_fe))
+		goto out;
+	memcpy(g.z, c->one, sizeof(g.z));
+
+	comb_build_table(c, &g);
+	rc = 0;
+
+out:
+	BN_free(p);
+	BN_free(a);
+	BN_free(b);
+	BN_free(gx);
+	BN_free(gy);
+	BN_free(b3);
+	BN_free(r);
+	BN_free(r2);
+	BN_CTX_free(ctx);
+	EC_GROUP_free(group);
+
+	if (rc)
+		free(c);
+	else
+		*comb = c;
+	return rc;
+}
+
+static int comb_get(unsigned int nid, const struct comb **comb)
+{
+	struct comb *new, *old = NULL;
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < CURVES && comb_nids[i] != nid; i++)
+		;
+	if (i == CURVES)
+		return ENODEV;
+
+	*comb = __atomic_load_n(&combs[i], __ATOMIC_ACQUIRE);
+	if (*comb != NULL)
+		return 0;
+
+	/* threads building the same table at once keep the first one */
+	rc = comb_new(nid, &new);
+	if (rc)
+		return rc;
+	if (__atomic_compare_exchange_n(&combs[i], &old, new, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		*comb = new;
+	} else {
+		free(new);
+		*comb = old;
+	}
+	return 0;
+}
+
+static int comb_mul(const struct comb *c, const unsigned char *d,
+		    unsigned char *x, unsigned char *y)
+{
+	uint64_t zinv[LIMBS], raw_one[LIMBS], zero = 0;
+	unsigned int i, k, t, index;
+	struct point r, q;
+
+	point_infinity(c, &r);
+	for (i = c->rows; i-- > 0;) {
+		point_add(c, &r, &r, &r);
+		for (k = 0; k < TABLES; k++) {
+			index = 0;
+			for (t = 0; t < TEETH; t++)
+				index |= scalar_bit(c, d, t * c->spacing +
+						    k * c->rows + i) << t;
+			table_lookup(c, &q, k, index);
+			point_add(c, &r, &r, &q);
+		}
+	}
+
+	/* to affine coordinates, out of Montgomery form */
+	fe_pow(c, zinv, r.z, c->p_2);
+	memset(raw_one, 0, sizeof(raw_one));
+	raw_one[0] = 1;
+	fe_mul(c, r.x, r.x, zinv);
+	fe_mul(c, r.y, r.y, zinv);
+	fe_mul(c, r.x, r.x, raw_one);
+	fe_mul(c, r.y, r.y, raw_one);
+	for (i = 0; i < c->limbs; i++)
+		zero |= r.z[i];
+
+	fe_to_bytes(c, x, r.x);
+	fe_to_bytes(c, y, r.y);
+	OPENSSL_cleanse(&r, sizeof(r));
+	OPENSSL_cleanse(&q, sizeof(q));
+
+	return zero ? 0 : EINVAL;
+}
+
+int ec_comb_mul(unsigned int nid, const unsigned char *d, unsigned char *x,
+		unsigned char *y)
+{
+	const struct comb *c;
+	int rc;
+
+	rc = comb_get(nid, &c);
+	if (rc)
+		return rc;
+	return comb_mul(c, d, x, y);
+}
+
+/* 1 if 0 < d < order, without branches on d */
+static unsigned int scalar_in_range(const struct comb *c,
+				    const unsigned char *d)
+{
+	unsigned int i, borrow = 0, nonzero = 0;
+
+	for (i = c->privlen; i-- > 0;) {
+		borrow = ((unsigned int)d[i] - c->order[i] - borrow) >> 8 & 1;
+		nonzero |= d[i];
+	}
+	return borrow & ((nonzero + 0xff) >> 8);
+}
+
+int ec_comb_keygen(unsigned int nid, unsigned char *d, unsigned char *x,
+		   unsigned char *y)
+{
+	const struct comb *c;
+	unsigned char mask;
+	unsigned int i;
+	int rc;
+
+	rc = comb_get(nid, &c);
+	if (rc)
+		return rc;
+
+	/* the bits of the order in its leading byte */
+	mask = c->order[0];
+	mask |= mask >> 1;
+	mask |= mask >> 2;
+	mask |= mask >> 4;
+
+	/* rejected candidates tell nothing about the key */
+	for (i = 0; i < KEYGEN_TRIES; i++) {
+		if (rng_gen(d, c->privlen))
+			return EIO;
+		d[0] &= mask;
+		if (scalar_in_range(c, d))
+			return comb_mul(c, d, x, y);
+	}
+	return EIO;
+}
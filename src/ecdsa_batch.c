@@ -0,0 +1,195 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "ecdsa_batch.h"
+#include "ica_api.h"
+#include "icastats.h"
+#include "init.h"
+#include "s390_crypto.h"
+#include "s390_ecc.h"
+
+/*
+ * The signatures of a batch on curves supported by CPACF are verified one
+ * after the other with one KDSA parameter block, which is only set up again
+ * when the curve changes. The others are sent to the adapters by up to
+ * ECDSA_BATCH_IN_FLIGHT threads, the caller and helpers started for the
+ * batch, each taking the next element until all are done, like in
+ * rsa_batch.c. The elements still pending afterwards go to the software
+ * fallback, where the elements with the same key share its OpenSSL
+ * objects, see struct ec_key_cache. The latency of each element is taken
+ * from the start of its own request.
+ */
+struct ecdsa_batch {
+	ica_adapter_handle_t adapter_handle;
+	const ICA_EC_KEY *const *pubkeys;
+	const unsigned char *const *hashes;
+	const unsigned int *hash_lengths;
+	const unsigned char *const *signatures;
+	unsigned int *status;
+	/* return code of the adapter request of each element */
+	unsigned int *hw_rc;
+	unsigned int count;
+	unsigned int next;
+};
+
+static stats_fields_t ecdsa_batch_field(const ICA_EC_KEY *pubkey)
+{
+	return ICA_STATS_ECDSA_VERIFY_160 + ecc_keysize_stats_ofs(pubkey->nid);
+}
+
+static void ecdsa_batch_cpacf(struct ecdsa_batch *batch)
+{
+	struct ecdsa_verify_param *param;
+	unsigned int i;
+	uint64_t begin;
+
+	if ((param = malloc(sizeof(*param))) == NULL)
+		return;
+	param->nid = 0;
+
+	for (i = 0; i < batch->count; i++) {
+		if (batch->status[i] != ECDSA_BATCH_PENDING ||
+		    !curve_supported_via_cpacf(batch->pubkeys[i]->nid))
+			continue;
+		begin = stats_latency_begin();
+		batch->status[i] = ecdsa_verify_cpacf_param(param,
+			batch->pubkeys[i], batch->hashes[i],
+			batch->hash_lengths[i], batch->signatures[i]);
+		if (batch->status[i] == 0)
+			stats_increment_latency(
+				ecdsa_batch_field(batch->pubkeys[i]), ALGO_HW,
+				ENCRYPT, begin);
+	}
+
+	free(param);
+}
+
+static void *ecdsa_batch_hw(void *arg)
+{
+	struct ecdsa_batch *batch = arg;
+	unsigned int i, rc;
+	uint64_t begin;
+
+	while ((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED))
+	       < batch->count) {
+		if (batch->status[i] != ECDSA_BATCH_PENDING)
+			continue;
+		begin = stats_latency_begin();
+		rc = ecdsa_verify_hw(batch->adapter_handle, batch->pubkeys[i],
+				     batch->hashes[i], batch->hash_lengths[i],
+				     batch->signatures[i]);
+		if (rc == 0 || rc == EFAULT) {
+			batch->status[i] = rc;
+			if (rc == 0)
+				stats_increment_latency(
+					ecdsa_batch_field(batch->pubkeys[i]),
+					ALGO_HW, ENCRYPT, begin);
+		} else {
+			batch->hw_rc[i] = rc;
+		}
+	}
+
+	return NULL;
+}
+
+static void ecdsa_batch_pipeline(struct ecdsa_batch *batch,
+				 unsigned int pending)
+{
+	pthread_t tid[ECDSA_BATCH_IN_FLIGHT - 1];
+	unsigned int i, helpers;
+
+	helpers = (pending < ECDSA_BATCH_IN_FLIGHT ?
+		   pending : ECDSA_BATCH_IN_FLIGHT) - 1;
+	for (i = 0; i < helpers; i++) {
+		/* with fewer helpers the batch just takes longer */
+		if (pthread_create(&tid[i], NULL, ecdsa_batch_hw, batch))
+			break;
+	}
+	helpers = i;
+
+	ecdsa_batch_hw(batch);
+
+	for (i = 0; i < helpers; i++)
+		pthread_join(tid[i], NULL);
+}
+
+unsigned int ecdsa_batch_verify(ica_adapter_handle_t adapter_handle,
+				unsigned int icapath, unsigned int count,
+				const ICA_EC_KEY *const *pubkeys,
+				const unsigned char *const *hashes,
+				const unsigned int *hash_lengths,
+				const unsigned char *const *signatures,
+				unsigned int *status)
+{
+	struct ecdsa_batch batch;
+	unsigned int i, pending = 0;
+	uint64_t begin;
+
+	batch.hw_rc = calloc(count, sizeof(*batch.hw_rc));
+	if (batch.hw_rc == NULL)
+		return ENOMEM;
+	batch.adapter_handle = adapter_handle;
+	batch.pubkeys = pubkeys;
+	batch.hashes = hashes;
+	batch.hash_lengths = hash_lengths;
+	batch.signatures = signatures;
+	batch.status = status;
+	batch.count = count;
+	batch.next = 0;
+
+	ica_init_cards();
+
+	if (icapath != 2) {
+		if (msa9_switch && !ica_offload_enabled)
+			ecdsa_batch_cpacf(&batch);
+
+		for (i = 0; i < count; i++) {
+			if (status[i] != ECDSA_BATCH_PENDING)
+				continue;
+			if (curve_supported_via_online_card(pubkeys[i]->nid) &&
+			    adapter_handle != DRIVER_NOT_LOADED)
+				pending++;
+		}
+		/* the others fail right away */
+		ecdsa_batch_pipeline(&batch, pending ? pending : 1);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (status[i] != ECDSA_BATCH_PENDING)
+			continue;
+		if (icapath == 1) {
+			/* hw only */
+			status[i] = batch.hw_rc[i];
+			continue;
+		}
+		if (icapath != 2) {
+			stats_fallback_event(ecdsa_batch_field(pubkeys[i]),
+					     batch.hw_rc[i] == ENODEV ?
+					     STATS_FB_CURVE : STATS_FB_HW_ERROR,
+					     batch.hw_rc[i]);
+			if (!ica_fallbacks_enabled) {
+				status[i] = ENODEV;
+				continue;
+			}
+		}
+		begin = stats_latency_begin();
+		status[i] = ecdsa_verify_sw(pubkeys[i], hashes[i],
+					    hash_lengths[i], signatures[i]);
+		if (status[i] == 0)
+			stats_increment_latency(ecdsa_batch_field(pubkeys[i]),
+						ALGO_SW, ENCRYPT, begin);
+	}
+
+	free(batch.hw_rc);
+
+	return 0;
+}
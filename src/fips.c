@@ -23,7 +23,7 @@
 #include <unistd.h>
 #include <dlfcn.h>
 #include <link.h>
-#include <sys/mman.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
 #include <openssl/opensslconf.h>
@@ -367,36 +367,23 @@ end:
 	return pkey;
 }
 
-static void* mmap_file(const char *path, struct stat *statbuf)
-{
-	int fd;
-	void *ptr = NULL;
-
-	fd = open(path, O_RDONLY);
-	if (fd < 0)
-		goto end;
-
-	if (fstat(fd, statbuf) < 0)
-		goto end_close;
-
-	ptr = mmap(0, statbuf->st_size, PROT_READ, MAP_SHARED, fd, 0);
-	if (ptr == MAP_FAILED)
-		ptr = NULL;
-end_close:
-	close(fd);
-end:
-	return ptr;
-}
-
+/*
+ * Computes the HMAC of a file by reading it in chunks of READ_BUFFER_LENGTH
+ * bytes, so the library is neither mapped nor read as a whole.
+ */
 static int compute_file_hmac(const char *path, void **buf, size_t *hmaclen)
 {
-	int rc = -1;
+	int fd, rc = -1;
 	unsigned char tmp[32];
+	unsigned char chunk[READ_BUFFER_LENGTH];
 	size_t tmp_len = sizeof(tmp);
 	EVP_MD_CTX *mdctx = NULL;
 	EVP_PKEY *pkey = NULL;
-	void *fdata = NULL;
-	struct stat fdata_stat;
+	ssize_t len;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return rc;
 
 	pkey = get_pkey();
 	if (!pkey)
@@ -406,14 +393,20 @@ static int compute_file_hmac(const char *path, void **buf, size_t *hmaclen)
 	if (!mdctx)
 		goto end;
 
-	fdata = mmap_file(path, &fdata_stat);
-	if (fdata == NULL)
-		goto end;
-
 	if (EVP_DigestSignInit(mdctx, NULL, EVP_sha256(), NULL, pkey) != 1)
 		goto end;
 
-	if (EVP_DigestSign(mdctx, tmp, &tmp_len, fdata, fdata_stat.st_size) != 1)
+	while ((len = read(fd, chunk, sizeof(chunk))) != 0) {
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			goto end;
+		}
+		if (EVP_DigestSignUpdate(mdctx, chunk, len) != 1)
+			goto end;
+	}
+
+	if (EVP_DigestSignFinal(mdctx, tmp, &tmp_len) != 1)
 		goto end;
 
 	*buf = malloc(tmp_len);
@@ -426,8 +419,7 @@ static int compute_file_hmac(const char *path, void **buf, size_t *hmaclen)
 	rc = 0;
 
 end:
-	if (fdata != NULL)
-		munmap(fdata, fdata_stat.st_size);
+	close(fd);
 
 	if (pkey != NULL)
 		EVP_PKEY_free(pkey);
@@ -555,8 +547,11 @@ static int phdr_callback(struct dl_phdr_info *info, size_t size, void *data)
  * the file contents using a static HMAC key, and comparing it to a
  * pre-calculated HMAC in a separate file. The HMAC key and HMAC file
  * may be provided by a Distributor when building the packet.
+ *
+ * @return  0 if check succeeded
+ *          ICA_FIPS_INTEGRITY otherwise
  */
-static void fips_lib_integrity_check(void)
+static int fips_lib_integrity_check(void)
 {
 	char path[PATH_MAX];
 	struct phdr_cb_data data = {
@@ -569,17 +564,27 @@ static void fips_lib_integrity_check(void)
 	dl_iterate_phdr(phdr_callback, &data);
 	if (data.count != 1) {
 		syslog(LOG_ERR, msg1);
-		fips |= ICA_FIPS_INTEGRITY;
-		return;
+		return ICA_FIPS_INTEGRITY;
 	}
 
 	if (!FIPSCHECK_verify(path)) {
 		syslog(LOG_ERR, msg2, path);
-		fips |= ICA_FIPS_INTEGRITY;
-		return;
+		return ICA_FIPS_INTEGRITY;
 	}
 
 	syslog(LOG_INFO, msg3);
+	return 0;
+}
+
+/*
+ * The integrity check runs in its own thread while the known answer tests
+ * run. It must not change fips itself, since the known answer tests fail,
+ * if fips indicates an error.
+ */
+static void *fips_lib_integrity_thread(void *arg)
+{
+	*(int *)arg = fips_lib_integrity_check();
+	return NULL;
 }
 #endif /* ICA_INTERNAL_TEST */
 
@@ -595,20 +600,32 @@ fips_powerup_tests(void)
 		ecdsa_kat, ecdh_kat,
 	};
 	size_t i, num_kats = sizeof(kats) / sizeof(kat_func);
+/* ICA internal test does not link against the library. So we should
+ * skip the library integrity check in that case.
+ */
+#ifndef ICA_INTERNAL_TEST
+	pthread_t integrity_thread;
+	int integrity_rc = 0, threaded;
+
+	/* Library integrity test, in parallel to the known answer tests */
+	threaded = pthread_create(&integrity_thread, NULL,
+				  fips_lib_integrity_thread, &integrity_rc) == 0;
+#endif
 
 	for (i = 0; i < num_kats; i++) {
 		if (kats[i]() != 0) {
 			fips |= ICA_FIPS_CRYPTOALG;
-			return;
+			break;
 		}
 	}
 
-/* ICA internal test does not link against the library. So we should
- * skip the library integrity check in that case.
- */
 #ifndef ICA_INTERNAL_TEST
-	/* Library integrity test */
-	fips_lib_integrity_check();
+	if (threaded)
+		pthread_join(integrity_thread, NULL);
+	else if (!(fips & ICA_FIPS_CRYPTOALG))
+		integrity_rc = fips_lib_integrity_check();
+
+	fips |= integrity_rc;
 #endif
 }
 
@@ -32,6 +32,12 @@
 #include "fips.h"
 #include "rng.h"
 #include "s390_rsa.h"
+#include "rsa_queue.h"
+#include "rsa_batch.h"
+#include "ecdsa_batch.h"
+#include "rsa_keypool.h"
+#include "rsa_route.h"
+#include "adapter_pool.h"
 #include "s390_ecc.h"
 #include "s390_crypto.h"
 #include "s390_sha.h"
@@ -84,10 +90,40 @@ void ica_set_offload_mode(int offload_mode)
 }
 
 int ica_stats_enabled = 1;
+int ica_stats_latency_enabled = 0;
+int ica_stats_proc_enabled = 0;
 
 void ica_set_stats_mode(int stats_mode)
 {
 	ica_stats_enabled = stats_mode ? 1 : 0;
+	ica_stats_latency_enabled = stats_mode & ICA_STATS_MODE_LATENCY ? 1 : 0;
+	ica_stats_proc_enabled = stats_mode & ICA_STATS_MODE_PROCESS ? 1 : 0;
+}
+
+int ica_rsa_crt_verify_enabled = 1;
+
+void ica_set_rsa_crt_verify_mode(int verify_mode)
+{
+	ica_rsa_crt_verify_enabled = verify_mode ? 1 : 0;
+}
+
+int ica_rsa_route_mode = 0;
+
+void ica_set_rsa_route_mode(int route_mode)
+{
+	if (route_mode < 0)
+		route_mode = 0;
+	if (route_mode > 100)
+		route_mode = 100;
+	ica_rsa_route_mode = route_mode;
+}
+
+int ica_card_rescan_interval;
+
+void ica_set_card_rescan_interval(int interval_ms)
+{
+	__atomic_store_n(&ica_card_rescan_interval,
+			 interval_ms > 0 ? interval_ms : 0, __ATOMIC_RELAXED);
 }
 
 #ifndef NO_CPACF
@@ -348,6 +384,8 @@ unsigned int ica_open_adapter(ica_adapter_handle_t *adapter_handle)
 	if (!adapter_handle)
 		return EINVAL;
 
+	ica_init_cards();
+
 	*adapter_handle = DRIVER_NOT_LOADED;
 	name = getenv("LIBICA_CRYPT_DEVICE");
 	if (name)
@@ -384,6 +422,51 @@ unsigned int ica_close_adapter(ica_adapter_handle_t adapter_handle)
 	return 0;
 }
 
+unsigned int ica_adapter_pool_open(ICA_ADAPTER_POOL **pool)
+{
+	if (pool == NULL)
+		return EINVAL;
+
+	return adapter_pool_open(pool);
+}
+
+void ica_adapter_pool_close(ICA_ADAPTER_POOL *pool)
+{
+	if (!pool)
+		return;
+
+	adapter_pool_close(pool);
+}
+
+unsigned int ica_adapter_pool_get(ICA_ADAPTER_POOL *pool, unsigned int flags,
+				  ica_adapter_handle_t *adapter_handle)
+{
+	if (pool == NULL || adapter_handle == NULL ||
+	    (flags & ~(ICA_ADAPTER_POOL_RSA | ICA_ADAPTER_POOL_ECC)))
+		return EINVAL;
+
+	return adapter_pool_get(pool, flags, adapter_handle);
+}
+
+void ica_adapter_pool_put(ICA_ADAPTER_POOL *pool,
+			  ica_adapter_handle_t adapter_handle)
+{
+	if (!pool)
+		return;
+
+	adapter_pool_put(pool, adapter_handle);
+}
+
+unsigned int ica_adapter_pool_stats(ICA_ADAPTER_POOL *pool,
+				    unsigned int index,
+				    ica_adapter_pool_card_t *card)
+{
+	if (pool == NULL || card == NULL)
+		return EINVAL;
+
+	return adapter_pool_stats(pool, index, card);
+}
+
 unsigned int ica_sha1(unsigned int message_part,
 		      unsigned int input_length,
 		      const unsigned char *input_data,
@@ -1080,6 +1163,10 @@ unsigned int ica_rsa_key_generate_mod_expo(ica_adapter_handle_t adapter_handle,
 		if (*public_exponent != 0)
 			return EINVAL;
 
+	if (rsa_keypool_get_mod_expo(modulus_bit_length, public_key,
+				     private_key) == 0)
+		return 0;
+
 	/* There is no need to zeroize any buffers here. This will be done in
 	 * the lower routines.
 	 */
@@ -1116,6 +1203,10 @@ unsigned int ica_rsa_key_generate_crt(ica_adapter_handle_t adapter_handle,
 		if (*public_exponent != 0)
 			return EINVAL;
 
+	if (rsa_keypool_get_crt(modulus_bit_length, public_key,
+				private_key) == 0)
+		return 0;
+
 	/* There is no need to zeroize any buffers here. This will be done in
 	 * the lower routines.
 	 */
@@ -1123,32 +1214,84 @@ unsigned int ica_rsa_key_generate_crt(ica_adapter_handle_t adapter_handle,
 				    public_key, private_key);
 }
 
-unsigned int ica_rsa_mod_expo(ica_adapter_handle_t adapter_handle,
-			      const unsigned char *input_data,
-			      ica_rsa_key_mod_expo_t *rsa_key,
-			      unsigned char *output_data)
+unsigned int ica_rsa_keygen_pool_set(unsigned int modulus_bit_length,
+				     unsigned long public_exponent,
+				     unsigned int size, unsigned int low_water)
 {
-	ica_rsa_modexpo_t rb;
-	int hardware, rc;
-
 #ifdef ICA_FIPS
 	if (fips >> 1)
 		return EACCES;
+	if ((fips & ICA_FIPS_MODE) && modulus_bit_length < 2048)
+		return EPERM;
 #endif /* ICA_FIPS */
 
-	/* check for obvious errors in parms */
-	if (input_data == NULL || rsa_key == NULL || output_data == NULL)
+	if (modulus_bit_length < 8 * sizeof(unsigned long) ||
+	    size > RSA_KEYPOOL_MAX_KEYS || (size && low_water >= size))
+		return EINVAL;
+	if (modulus_bit_length > MAX_RSA_KEY_BITS)
+		return EPERM;
+	if (public_exponent && (public_exponent <= 2 || !(public_exponent % 2)))
 		return EINVAL;
 
-	if (rsa_key->key_length < sizeof(unsigned long))
+	return rsa_keypool_set(modulus_bit_length, public_exponent, size,
+			       low_water);
+}
+
+unsigned int ica_rsa_keygen_pool_stats(unsigned int modulus_bit_length,
+				       unsigned long public_exponent,
+				       uint64_t *hits, uint64_t *misses,
+				       unsigned int *available)
+{
+	if (hits == NULL || misses == NULL || available == NULL)
 		return EINVAL;
-	if (rsa_key->key_length * 8 > MAX_RSA_KEY_BITS)
+
+	return rsa_keypool_stats(modulus_bit_length, public_exponent, hits,
+				 misses, available);
+}
+
+static unsigned int rsa_key_length_check(unsigned int key_length)
+{
+	if (key_length < sizeof(unsigned long))
+		return EINVAL;
+	if (key_length * 8 > MAX_RSA_KEY_BITS)
 		return EPERM;
 
 #ifdef ICA_FIPS
-	if ((fips & ICA_FIPS_MODE) && rsa_key->key_length * 8 < 2048)
+	if ((fips & ICA_FIPS_MODE) && key_length * 8 < 2048)
 		return EPERM;
 #endif
+	return 0;
+}
+
+static unsigned int rsa_mod_expo_fallback(ica_rsa_modexpo_t *rb,
+					  const ICA_RSA_PREPARED_KEY *prepared)
+{
+	return prepared ? rsa_mod_expo_prepared_sw(rb, prepared) :
+			  rsa_mod_expo_sw(rb);
+}
+
+static unsigned int rsa_crt_fallback(ica_rsa_modexpo_crt_t *rb,
+				     const ICA_RSA_PREPARED_KEY *prepared)
+{
+	return prepared ? rsa_crt_prepared_sw(rb, prepared) : rsa_crt_sw(rb);
+}
+
+/*
+ * Common part of ica_rsa_mod_expo and ica_rsa_mod_expo_prepared: the
+ * software fallback uses the prepared key, if there is one.
+ */
+static unsigned int rsa_mod_expo(ica_adapter_handle_t adapter_handle,
+				 const unsigned char *input_data,
+				 const ica_rsa_key_mod_expo_t *rsa_key,
+				 const ICA_RSA_PREPARED_KEY *prepared,
+				 unsigned char *output_data)
+{
+	ica_rsa_modexpo_t rb;
+	uint64_t begin;
+	stats_fields_t field;
+	int hardware, rc;
+
+	begin = stats_latency_begin();
 
 	/* fill driver structure */
 	rb.inputdata = (unsigned char *)input_data;
@@ -1158,32 +1301,83 @@ unsigned int ica_rsa_mod_expo(ica_adapter_handle_t adapter_handle,
 	rb.b_key = rsa_key->exponent;
 	rb.n_modulus = rsa_key->modulus;
 
+	ica_init_cards();
+
+	field = ICA_STATS_RSA_ME_512 +
+		rsa_keysize_stats_ofs(rsa_key->key_length);
 	hardware = ALGO_SW;
-	if (adapter_handle == DRIVER_NOT_LOADED)
+	if (adapter_handle == DRIVER_NOT_LOADED) {
+		stats_fallback_event(field, STATS_FB_NO_DRIVER, ENODEV);
 		rc = ica_fallbacks_enabled ?
-			rsa_mod_expo_sw(&rb) : ENODEV;
-	else {
-		if (any_card_online)
+			rsa_mod_expo_fallback(&rb, prepared) : ENODEV;
+	} else {
+		if (any_card_online) {
 			rc = ioctl(adapter_handle, ICARSAMODEXPO, &rb);
-		else
+			if (rc)
+				stats_fallback_event(field, STATS_FB_HW_ERROR,
+						     errno);
+		} else {
+			stats_fallback_event(field, STATS_FB_NO_CARD, ENODEV);
 			rc = ENODEV;
+		}
 
 		if (!rc)
 			hardware = ALGO_HW;
 		else
 			rc = ica_fallbacks_enabled ?
-				rsa_mod_expo_sw(&rb) : ENODEV;
+				rsa_mod_expo_fallback(&rb, prepared) : ENODEV;
 	}
 	if (rc == 0)
-		stats_increment(ICA_STATS_RSA_ME_512 +
-				rsa_keysize_stats_ofs(rsa_key->key_length),
-				hardware, ENCRYPT);
+		stats_increment_latency(field, hardware, ENCRYPT, begin);
 
 	OPENSSL_cleanse(&rb, sizeof(rb));
 
 	return rc;
 }
 
+unsigned int ica_rsa_mod_expo(ica_adapter_handle_t adapter_handle,
+			      const unsigned char *input_data,
+			      ica_rsa_key_mod_expo_t *rsa_key,
+			      unsigned char *output_data)
+{
+	unsigned int rc;
+
+#ifdef ICA_FIPS
+	if (fips >> 1)
+		return EACCES;
+#endif /* ICA_FIPS */
+
+	/* check for obvious errors in parms */
+	if (input_data == NULL || rsa_key == NULL || output_data == NULL)
+		return EINVAL;
+
+	if ((rc = rsa_key_length_check(rsa_key->key_length)) != 0)
+		return rc;
+
+	return rsa_mod_expo(adapter_handle, input_data, rsa_key, NULL,
+			    output_data);
+}
+
+unsigned int ica_rsa_mod_expo_prepared(ica_adapter_handle_t adapter_handle,
+				       const unsigned char *input_data,
+				       const ICA_RSA_PREPARED_KEY *prepared,
+				       unsigned char *output_data)
+{
+#ifdef ICA_FIPS
+	if (fips >> 1)
+		return EACCES;
+#endif /* ICA_FIPS */
+
+	/* check for obvious errors in parms */
+	if (input_data == NULL || prepared == NULL || output_data == NULL)
+		return EINVAL;
+	if (prepared->crt)
+		return EINVAL;
+
+	return rsa_mod_expo(adapter_handle, input_data, &prepared->mod_expo,
+			    prepared, output_data);
+}
+
 unsigned int ica_rsa_crt_key_check(ica_rsa_key_crt_t *rsa_key)
 {
 	int pq_comp;
@@ -1249,32 +1443,24 @@ unsigned int ica_rsa_crt_key_check(ica_rsa_key_crt_t *rsa_key)
 	return 0;
 }
 
-unsigned int ica_rsa_crt(ica_adapter_handle_t adapter_handle,
-			 const unsigned char *input_data,
-			 ica_rsa_key_crt_t *rsa_key,
-			 unsigned char *output_data)
+/*
+ * Common part of ica_rsa_crt and ica_rsa_crt_prepared: rsa_key must be in
+ * privileged form. The software fallback uses the prepared key, if there is
+ * one. Requests may be routed to it while the adapter is slower, see
+ * ica_set_rsa_route_mode.
+ */
+static unsigned int rsa_crt(ica_adapter_handle_t adapter_handle,
+			    const unsigned char *input_data,
+			    const ica_rsa_key_crt_t *rsa_key,
+			    const ICA_RSA_PREPARED_KEY *prepared,
+			    unsigned char *output_data)
 {
 	ica_rsa_modexpo_crt_t rb;
-	int hardware, rc;
-
-#ifdef ICA_FIPS
-	if (fips >> 1)
-		return EACCES;
-#endif /* ICA_FIPS */
-
-	/* check for obvious errors in parms */
-	if (input_data == NULL || rsa_key == NULL || output_data == NULL)
-		return EINVAL;
+	uint64_t begin, route;
+	stats_fields_t field;
+	int bucket, hardware, rc;
 
-	if (rsa_key->key_length < sizeof(unsigned long))
-		return EINVAL;
-	if (rsa_key->key_length * 8 > MAX_RSA_KEY_BITS)
-		return EPERM;
-
-#ifdef ICA_FIPS
-	if ((fips & ICA_FIPS_MODE) && rsa_key->key_length * 8 < 2048)
-		return EPERM;
-#endif
+	begin = stats_latency_begin();
 
 	/* fill driver structure */
 	rb.inputdata = (unsigned char *)input_data;
@@ -1282,40 +1468,380 @@ unsigned int ica_rsa_crt(ica_adapter_handle_t adapter_handle,
 	rb.outputdata = output_data;
 	rb.outputdatalength = rsa_key->key_length;
 
-	ica_rsa_crt_key_check(rsa_key);
-
 	rb.np_prime = rsa_key->p;
 	rb.nq_prime = rsa_key->q;
 	rb.bp_key = rsa_key->dp;
 	rb.bq_key = rsa_key->dq;
 	rb.u_mult_inv = rsa_key->qInverse;
 
+	ica_init_cards();
+
+	bucket = rsa_keysize_stats_ofs(rsa_key->key_length);
+	field = ICA_STATS_RSA_CRT_512 + bucket;
 	hardware = ALGO_SW;
-	if (adapter_handle == DRIVER_NOT_LOADED)
+	if (adapter_handle == DRIVER_NOT_LOADED) {
+		stats_fallback_event(field, STATS_FB_NO_DRIVER, ENODEV);
 		rc = ica_fallbacks_enabled ?
-			rsa_crt_sw(&rb) : ENODEV;
-	else {
-		if (any_card_online)
+			rsa_crt_fallback(&rb, prepared) : ENODEV;
+	} else if (ica_rsa_route_mode && ica_fallbacks_enabled &&
+		   any_card_online && rsa_route_divert(bucket)) {
+		route = rsa_route_clock();
+		rc = rsa_crt_fallback(&rb, prepared);
+		rsa_route_record(bucket, ALGO_SW, route, rc);
+	} else {
+		if (any_card_online) {
+			route = rsa_route_clock();
 			rc = ioctl(adapter_handle, ICARSACRT, &rb);
-		else
+			if (rc)
+				stats_fallback_event(field, STATS_FB_HW_ERROR,
+						     errno);
+			rsa_route_record(bucket, ALGO_HW, route, rc);
+		} else {
+			stats_fallback_event(field, STATS_FB_NO_CARD, ENODEV);
 			rc = ENODEV;
+		}
 
 		if (!rc)
 			hardware = ALGO_HW;
 		else
 			rc = ica_fallbacks_enabled ?
-				rsa_crt_sw(&rb) : ENODEV;
+				rsa_crt_fallback(&rb, prepared) : ENODEV;
 	}
 	if (rc == 0)
-		stats_increment(ICA_STATS_RSA_CRT_512 +
-				rsa_keysize_stats_ofs(rsa_key->key_length),
-				hardware, ENCRYPT);
+		stats_increment_latency(field, hardware, ENCRYPT, begin);
 
 	OPENSSL_cleanse(&rb, sizeof(rb));
 
 	return rc;
 }
 
+/* p, dp and qInverse have 8 bytes of padding, see ica_rsa_key_crt_t */
+#define RSA_CRT_SHORT_LEN(key_length)	(((key_length) + 1) / 2)
+#define RSA_CRT_LONG_LEN(key_length)	(RSA_CRT_SHORT_LEN(key_length) + 8)
+#define RSA_CRT_KEY_BUFLEN(key_length)	(3 * RSA_CRT_LONG_LEN(key_length) + \
+					 2 * RSA_CRT_SHORT_LEN(key_length))
+
+/* copy rsa_key to copy, with the key parts in buf */
+static void rsa_crt_key_copy(ica_rsa_key_crt_t *copy, unsigned char *buf,
+			     const ica_rsa_key_crt_t *rsa_key)
+{
+	unsigned int short_len = RSA_CRT_SHORT_LEN(rsa_key->key_length);
+	unsigned int long_len = RSA_CRT_LONG_LEN(rsa_key->key_length);
+
+	copy->key_length = rsa_key->key_length;
+	copy->p = buf;
+	memcpy(buf, rsa_key->p, long_len);
+	buf += long_len;
+	copy->q = buf;
+	memcpy(buf, rsa_key->q, short_len);
+	buf += short_len;
+	copy->dp = buf;
+	memcpy(buf, rsa_key->dp, long_len);
+	buf += long_len;
+	copy->dq = buf;
+	memcpy(buf, rsa_key->dq, short_len);
+	buf += short_len;
+	copy->qInverse = buf;
+	memcpy(buf, rsa_key->qInverse, long_len);
+}
+
+/* p > q, the comparison of ica_rsa_crt_key_check */
+static int rsa_crt_key_privileged(const ica_rsa_key_crt_t *rsa_key)
+{
+	return memcmp(rsa_key->p + 8, rsa_key->q, rsa_key->key_length / 2) >= 0;
+}
+
+/*
+ * Check a key in privileged form for consistency: p and q are odd and
+ * qInverse * q = 1 mod p.
+ */
+static unsigned int rsa_crt_key_validate(const ica_rsa_key_crt_t *rsa_key)
+{
+	unsigned int short_len = RSA_CRT_SHORT_LEN(rsa_key->key_length);
+	unsigned int long_len = RSA_CRT_LONG_LEN(rsa_key->key_length);
+	BIGNUM *p, *q, *qinv;
+	BN_CTX *ctx;
+	unsigned int rc = ENOMEM;
+
+	if ((ctx = BN_CTX_new()) == NULL)
+		return ENOMEM;
+	BN_CTX_start(ctx);
+	p = BN_CTX_get(ctx);
+	q = BN_CTX_get(ctx);
+	if ((qinv = BN_CTX_get(ctx)) == NULL ||
+	    !BN_bin2bn(rsa_key->p, long_len, p) ||
+	    !BN_bin2bn(rsa_key->q, short_len, q) ||
+	    !BN_bin2bn(rsa_key->qInverse, long_len, qinv))
+		goto out;
+
+	rc = EINVAL;
+	if (!BN_is_odd(p) || !BN_is_odd(q) || BN_is_one(q) ||
+	    BN_ucmp(qinv, p) >= 0)
+		goto out;
+	BN_set_flags(p, BN_FLG_CONSTTIME);
+	if (BN_mod_mul(qinv, qinv, q, p, ctx) && BN_is_one(qinv))
+		rc = 0;
+out:
+	BN_CTX_end(ctx);
+	BN_CTX_free(ctx);
+	return rc;
+}
+
+unsigned int ica_rsa_crt(ica_adapter_handle_t adapter_handle,
+			 const unsigned char *input_data,
+			 ica_rsa_key_crt_t *rsa_key,
+			 unsigned char *output_data)
+{
+	unsigned char buf[RSA_CRT_KEY_BUFLEN(MAX_RSA_KEY_BITS / 8)];
+	ica_rsa_key_crt_t copy;
+	unsigned int rc;
+
+#ifdef ICA_FIPS
+	if (fips >> 1)
+		return EACCES;
+#endif /* ICA_FIPS */
+
+	/* check for obvious errors in parms */
+	if (input_data == NULL || rsa_key == NULL || output_data == NULL)
+		return EINVAL;
+
+	if ((rc = rsa_key_length_check(rsa_key->key_length)) != 0)
+		return rc;
+
+	/*
+	 * rsa_key is only read, so that threads may share it: a key in
+	 * privileged form is used as it is, others are brought into that form
+	 * in a copy.
+	 */
+	if (rsa_crt_key_privileged(rsa_key))
+		return rsa_crt(adapter_handle, input_data, rsa_key, NULL,
+			       output_data);
+
+	rsa_crt_key_copy(&copy, buf, rsa_key);
+	if (ica_rsa_crt_key_check(&copy) == ENOMEM)
+		rc = ENOMEM;
+	else
+		rc = rsa_crt(adapter_handle, input_data, &copy, NULL,
+			     output_data);
+	OPENSSL_cleanse(buf, sizeof(buf));
+	return rc;
+}
+
+unsigned int ica_rsa_crt_prepared(ica_adapter_handle_t adapter_handle,
+				  const unsigned char *input_data,
+				  const ICA_RSA_PREPARED_KEY *prepared,
+				  unsigned char *output_data)
+{
+#ifdef ICA_FIPS
+	if (fips >> 1)
+		return EACCES;
+#endif /* ICA_FIPS */
+
+	/* check for obvious errors in parms */
+	if (input_data == NULL || prepared == NULL || output_data == NULL)
+		return EINVAL;
+	if (!prepared->crt)
+		return EINVAL;
+
+	return rsa_crt(adapter_handle, input_data, &prepared->crt_key,
+		       prepared, output_data);
+}
+
+static ICA_RSA_PREPARED_KEY *rsa_prepared_key_new(int crt, size_t buflen)
+{
+	ICA_RSA_PREPARED_KEY *key;
+
+	if ((key = calloc(1, sizeof(*key))) == NULL)
+		return NULL;
+	if ((key->buf = calloc(1, buflen)) == NULL) {
+		free(key);
+		return NULL;
+	}
+	key->buflen = buflen;
+	key->crt = crt;
+	return key;
+}
+
+unsigned int ica_rsa_key_mod_expo_prepare(const ica_rsa_key_mod_expo_t *rsa_key,
+					  ICA_RSA_PREPARED_KEY **prepared)
+{
+	ICA_RSA_PREPARED_KEY *key;
+	unsigned int len, rc;
+
+#ifdef ICA_FIPS
+	if (fips >> 1)
+		return EACCES;
+#endif /* ICA_FIPS */
+
+	if (rsa_key == NULL || prepared == NULL ||
+	    rsa_key->modulus == NULL || rsa_key->exponent == NULL)
+		return EINVAL;
+	if ((rc = rsa_key_length_check(rsa_key->key_length)) != 0)
+		return rc;
+
+	len = rsa_key->key_length;
+	if ((key = rsa_prepared_key_new(0, 2 * len)) == NULL)
+		return ENOMEM;
+
+	key->mod_expo.key_length = len;
+	key->mod_expo.modulus = key->buf;
+	key->mod_expo.exponent = key->buf + len;
+	memcpy(key->mod_expo.modulus, rsa_key->modulus, len);
+	memcpy(key->mod_expo.exponent, rsa_key->exponent, len);
+
+	if ((rc = rsa_prepared_key_init_sw(key)) != 0) {
+		ica_rsa_prepared_key_free(key);
+		return rc;
+	}
+
+	*prepared = key;
+	return 0;
+}
+
+unsigned int ica_rsa_key_crt_prepare(const ica_rsa_key_crt_t *rsa_key,
+				     ICA_RSA_PREPARED_KEY **prepared)
+{
+	ICA_RSA_PREPARED_KEY *key;
+	unsigned int rc;
+
+#ifdef ICA_FIPS
+	if (fips >> 1)
+		return EACCES;
+#endif /* ICA_FIPS */
+
+	if (rsa_key == NULL || prepared == NULL || rsa_key->p == NULL ||
+	    rsa_key->q == NULL || rsa_key->dp == NULL || rsa_key->dq == NULL ||
+	    rsa_key->qInverse == NULL)
+		return EINVAL;
+	if ((rc = rsa_key_length_check(rsa_key->key_length)) != 0)
+		return rc;
+
+	if ((key = rsa_prepared_key_new(1,
+			RSA_CRT_KEY_BUFLEN(rsa_key->key_length))) == NULL)
+		return ENOMEM;
+
+	rsa_crt_key_copy(&key->crt_key, key->buf, rsa_key);
+	rc = ica_rsa_crt_key_check(&key->crt_key);
+	if (rc == ENOMEM || (rc = rsa_crt_key_validate(&key->crt_key)) != 0 ||
+	    (rc = rsa_prepared_key_init_sw(key)) != 0) {
+		ica_rsa_prepared_key_free(key);
+		return rc;
+	}
+
+	*prepared = key;
+	return 0;
+}
+
+void ica_rsa_prepared_key_free(ICA_RSA_PREPARED_KEY *prepared)
+{
+	if (!prepared)
+		return;
+
+	rsa_prepared_key_free_sw(prepared);
+	if (prepared->buf) {
+		OPENSSL_cleanse(prepared->buf, prepared->buflen);
+		free(prepared->buf);
+	}
+	OPENSSL_cleanse(prepared, sizeof(*prepared));
+	free(prepared);
+}
+
+unsigned int ica_rsa_queue_new(ica_adapter_handle_t adapter_handle,
+			       unsigned int in_flight, unsigned int depth,
+			       ICA_RSA_QUEUE **queue)
+{
+#ifdef ICA_FIPS
+	if (fips >> 1)
+		return EACCES;
+#endif /* ICA_FIPS */
+
+	if (queue == NULL || in_flight == 0 ||
+	    in_flight > RSA_QUEUE_MAX_IN_FLIGHT || depth < in_flight)
+		return EINVAL;
+
+	return rsa_queue_new(adapter_handle, in_flight, depth, queue);
+}
+
+void ica_rsa_queue_free(ICA_RSA_QUEUE *queue)
+{
+	if (!queue)
+		return;
+
+	rsa_queue_free(queue);
+}
+
+int ica_rsa_queue_fd(ICA_RSA_QUEUE *queue)
+{
+	if (!queue)
+		return -1;
+
+	return rsa_queue_fd(queue);
+}
+
+unsigned int ica_rsa_submit(ICA_RSA_QUEUE *queue, ica_rsa_request_t *request)
+{
+	if (queue == NULL || request == NULL ||
+	    request->input_data == NULL || request->output_data == NULL)
+		return EINVAL;
+
+	switch (request->type) {
+	case ICA_RSA_REQ_MOD_EXPO:
+		if (request->prepared == NULL && request->mod_expo_key == NULL)
+			return EINVAL;
+		break;
+	case ICA_RSA_REQ_CRT:
+		if (request->prepared == NULL && request->crt_key == NULL)
+			return EINVAL;
+		break;
+	default:
+		return EINVAL;
+	}
+
+	return rsa_queue_submit(queue, request);
+}
+
+unsigned int ica_rsa_poll(ICA_RSA_QUEUE *queue, ica_rsa_request_t **requests,
+			  unsigned int max, int timeout_ms,
+			  unsigned int *count)
+{
+	if (queue == NULL || requests == NULL || count == NULL)
+		return EINVAL;
+
+	return rsa_queue_poll(queue, requests, max, timeout_ms, count);
+}
+
+unsigned int ica_rsa_mod_expo_batch(ica_adapter_handle_t adapter_handle,
+				    unsigned int count,
+				    const unsigned char *const *input_data,
+				    ica_rsa_key_mod_expo_t *const *rsa_keys,
+				    unsigned char *const *output_data,
+				    unsigned int *status)
+{
+	unsigned int i;
+
+#ifdef ICA_FIPS
+	if (fips >> 1)
+		return EACCES;
+#endif /* ICA_FIPS */
+
+	/* check for obvious errors in parms */
+	if (count == 0 || input_data == NULL || rsa_keys == NULL ||
+	    output_data == NULL || status == NULL)
+		return EINVAL;
+
+	for (i = 0; i < count; i++) {
+		if (input_data[i] == NULL || rsa_keys[i] == NULL ||
+		    output_data[i] == NULL)
+			status[i] = EINVAL;
+		else if ((status[i] =
+			  rsa_key_length_check(rsa_keys[i]->key_length)) == 0)
+			status[i] = RSA_BATCH_PENDING;
+	}
+
+	return rsa_batch_mod_expo(adapter_handle, count, input_data, rsa_keys,
+				  output_data, status);
+}
+
 /*******************************************************************************
  *
  *                          Begin of ECC API
@@ -1345,6 +1871,12 @@ ICA_EC_KEY* ica_ec_key_new(unsigned int nid, unsigned int *privlen)
 		free(key);
 		return NULL;
 	}
+	key->cache = ec_key_cache_new();
+	if (!key->cache) {
+		free(key->X);
+		free(key);
+		return NULL;
+	}
 
 	key->nid = nid;
 	key->Y = key->X + len;
@@ -1375,6 +1907,8 @@ int ica_ec_key_init(const unsigned char *X, const unsigned char *Y,
 	}
 #endif /* ICA_FIPS */
 
+	ica_init_cards();
+
 	/* check if curve is supported by hw */
 	if (!(curve_supported_via_online_card(key->nid) ||
 		  curve_supported_via_cpacf(key->nid)))
@@ -1385,6 +1919,8 @@ int ica_ec_key_init(const unsigned char *X, const unsigned char *Y,
 
 	privlen = privlen_from_nid(key->nid);
 
+	ec_key_cache_clear(key->cache);
+
 	if (X != NULL && Y != NULL) {
 		memcpy(key->X, X, privlen);
 		memcpy(key->Y, Y, privlen);
@@ -1398,11 +1934,21 @@ int ica_ec_key_init(const unsigned char *X, const unsigned char *Y,
 	if (curve_supported_via_openssl(key->nid) && !ec_key_check(key))
 		return EINVAL;
 
-	return 0;
+	return 0;
+}
+
+/* The *_hw functions return ENODEV if no online card supports the curve,
+ * EIO if the driver is not loaded or the request failed.
+ */
+static void ecc_fallback_event(stats_fields_t field, int rc)
+{
+	stats_fallback_event(field, rc == ENODEV ? STATS_FB_CURVE :
+			     STATS_FB_HW_ERROR, rc);
 }
 
 int ica_ec_key_generate(ica_adapter_handle_t adapter_handle, ICA_EC_KEY *key)
 {
+	uint64_t begin;
 	int hardware, rc;
 	unsigned int icapath = 0;
 
@@ -1420,6 +1966,8 @@ int ica_ec_key_generate(ica_adapter_handle_t adapter_handle, ICA_EC_KEY *key)
 	}
 #endif /* ICA_FIPS */
 
+	ica_init_cards();
+
 	/* check if curve is supported by hw */
 	if (!(curve_supported_via_online_card(key->nid) ||
 		  curve_supported_via_cpacf(key->nid)))
@@ -1441,6 +1989,10 @@ int ica_ec_key_generate(ica_adapter_handle_t adapter_handle, ICA_EC_KEY *key)
 		icapath = 2;
 #endif
 
+	begin = stats_latency_begin();
+
+	ec_key_cache_clear(key->cache);
+
 	switch (icapath) {
 	case 1: /* hw only */
 		hardware = ALGO_HW;
@@ -1458,15 +2010,18 @@ int ica_ec_key_generate(ica_adapter_handle_t adapter_handle, ICA_EC_KEY *key)
 		rc = eckeygen_hw(adapter_handle, key);
 		if (rc == 0)
 			hardware = ALGO_HW;
-		else
+		else {
+			ecc_fallback_event(ICA_STATS_ECKGEN_160 +
+					   ecc_keysize_stats_ofs(key->nid), rc);
 			rc = ica_fallbacks_enabled ?
 				eckeygen_sw(key) : ENODEV;
+		}
 	}
 
 	if (rc == 0)
-		stats_increment(ICA_STATS_ECKGEN_160 +
-				ecc_keysize_stats_ofs(key->nid),
-				hardware, ENCRYPT);
+		stats_increment_latency(ICA_STATS_ECKGEN_160 +
+					ecc_keysize_stats_ofs(key->nid),
+					hardware, ENCRYPT, begin);
 
 	return rc;
 }
@@ -1475,6 +2030,7 @@ int ica_ecdh_derive_secret(ica_adapter_handle_t adapter_handle,
 		const ICA_EC_KEY *privkey_A, const ICA_EC_KEY *pubkey_B,
 		unsigned char *z, unsigned int z_length)
 {
+	uint64_t begin;
 	int hardware, rc;
 	unsigned int privlen;
 	unsigned int icapath = 0;
@@ -1499,6 +2055,8 @@ int ica_ecdh_derive_secret(ica_adapter_handle_t adapter_handle,
 	if (z == NULL || z_length < privlen || privkey_A->nid != pubkey_B->nid)
 		return EINVAL;
 
+	ica_init_cards();
+
 	/* check if curve is supported by hw */
 	if (!(curve_supported_via_online_card(privkey_A->nid) ||
 		  curve_supported_via_cpacf(privkey_A->nid)))
@@ -1509,6 +2067,8 @@ int ica_ecdh_derive_secret(ica_adapter_handle_t adapter_handle,
 #else
 	icapath = 1;
 #endif
+	begin = stats_latency_begin();
+
 	switch (icapath) {
 	case 1: /* hw only */
 		hardware = ALGO_HW;
@@ -1526,15 +2086,18 @@ int ica_ecdh_derive_secret(ica_adapter_handle_t adapter_handle,
 		rc = ecdh_hw(adapter_handle, privkey_A, pubkey_B, z);
 		if (rc == 0)
 			hardware = ALGO_HW;
-		else
+		else {
+			ecc_fallback_event(ICA_STATS_ECDH_160 +
+				ecc_keysize_stats_ofs(privkey_A->nid), rc);
 			rc = ica_fallbacks_enabled ?
 				ecdh_sw(privkey_A, pubkey_B, z) : ENODEV;
+		}
 	}
 
 	if (rc == 0)
-		stats_increment(ICA_STATS_ECDH_160 +
-				ecc_keysize_stats_ofs(privkey_A->nid),
-				hardware, ENCRYPT);
+		stats_increment_latency(ICA_STATS_ECDH_160 +
+					ecc_keysize_stats_ofs(privkey_A->nid),
+					hardware, ENCRYPT, begin);
 
 	return rc;
 }
@@ -1552,6 +2115,7 @@ int ica_ecdsa_sign_ex(ica_adapter_handle_t adapter_handle,
 		unsigned char *signature, unsigned int signature_length,
 		const unsigned char *k)
 {
+	uint64_t begin;
 	int hardware, rc;
 	unsigned int privlen;
 	unsigned int icapath = 0;
@@ -1580,6 +2144,9 @@ int ica_ecdsa_sign_ex(ica_adapter_handle_t adapter_handle,
 #else
 	icapath = 1;
 #endif
+	ica_init_cards();
+	begin = stats_latency_begin();
+
 	switch (icapath) {
 	case 1: /* hw only */
 		hardware = ALGO_HW;
@@ -1604,15 +2171,17 @@ int ica_ecdsa_sign_ex(ica_adapter_handle_t adapter_handle,
 		else {
 			if (k != NULL)
 				return EPERM;
+			ecc_fallback_event(ICA_STATS_ECDSA_SIGN_160 +
+				ecc_keysize_stats_ofs(privkey->nid), rc);
 			rc = ica_fallbacks_enabled ?
 				ecdsa_sign_sw(privkey, hash, hash_length, signature) : ENODEV;
 		}
 	}
 
 	if (rc == 0)
-		stats_increment(ICA_STATS_ECDSA_SIGN_160 +
-				ecc_keysize_stats_ofs(privkey->nid),
-				hardware, ENCRYPT);
+		stats_increment_latency(ICA_STATS_ECDSA_SIGN_160 +
+					ecc_keysize_stats_ofs(privkey->nid),
+					hardware, ENCRYPT, begin);
 
 	return rc;
 }
@@ -1621,6 +2190,7 @@ int ica_ecdsa_verify(ica_adapter_handle_t adapter_handle,
 		const ICA_EC_KEY *pubkey, const unsigned char *hash, unsigned int hash_length,
 		const unsigned char *signature, unsigned int signature_length)
 {
+	uint64_t begin;
 	int hardware, rc;
 	unsigned int privlen;
 	unsigned int icapath = 0;
@@ -1649,6 +2219,9 @@ int ica_ecdsa_verify(ica_adapter_handle_t adapter_handle,
 #else
 	icapath = 1;
 #endif
+	ica_init_cards();
+	begin = stats_latency_begin();
+
 	switch (icapath) {
 	case 1: /* hw only */
 		hardware = ALGO_HW;
@@ -1667,6 +2240,8 @@ int ica_ecdsa_verify(ica_adapter_handle_t adapter_handle,
 		if (rc == 0) {
 			hardware = ALGO_HW;
 		} else if (rc != EFAULT) {
+			ecc_fallback_event(ICA_STATS_ECDSA_VERIFY_160 +
+				ecc_keysize_stats_ofs(pubkey->nid), rc);
 			rc = ica_fallbacks_enabled ?
 			     ecdsa_verify_sw(pubkey, hash, hash_length,
 					     signature) : ENODEV;
@@ -1674,13 +2249,59 @@ int ica_ecdsa_verify(ica_adapter_handle_t adapter_handle,
 	}
 
 	if (rc == 0)
-		stats_increment(ICA_STATS_ECDSA_VERIFY_160 +
-				ecc_keysize_stats_ofs(pubkey->nid),
-				hardware, ENCRYPT);
+		stats_increment_latency(ICA_STATS_ECDSA_VERIFY_160 +
+					ecc_keysize_stats_ofs(pubkey->nid),
+					hardware, ENCRYPT, begin);
 
 	return rc;
 }
 
+unsigned int ica_ecdsa_verify_batch(ica_adapter_handle_t adapter_handle,
+				    unsigned int count,
+				    const ICA_EC_KEY *const *pubkeys,
+				    const unsigned char *const *hashes,
+				    const unsigned int *hash_lengths,
+				    const unsigned char *const *signatures,
+				    unsigned int *status)
+{
+	const ICA_EC_KEY *pubkey;
+	unsigned int i, icapath;
+
+#ifdef ICA_FIPS
+	if (fips >> 1)
+		return EACCES;
+#endif /* ICA_FIPS */
+
+	/* check for obvious errors in parms */
+	if (count == 0 || pubkeys == NULL || hashes == NULL ||
+	    hash_lengths == NULL || signatures == NULL || status == NULL)
+		return EINVAL;
+
+	for (i = 0; i < count; i++) {
+		pubkey = pubkeys[i];
+		status[i] = ECDSA_BATCH_PENDING;
+		if (pubkey == NULL || hashes[i] == NULL ||
+		    !hash_length_valid(hash_lengths[i]) ||
+		    signatures[i] == NULL)
+			status[i] = EINVAL;
+#ifdef ICA_FIPS
+		else if ((fips & ICA_FIPS_MODE) &&
+			 (!curve_supported_via_openssl(pubkey->nid) ||
+			  !curve_supported_via_cpacf(pubkey->nid)))
+			status[i] = EPERM;
+#endif /* ICA_FIPS */
+	}
+
+#ifndef NO_SW_FALLBACKS
+	icapath = getenv_icapath();
+#else
+	icapath = 1;
+#endif
+
+	return ecdsa_batch_verify(adapter_handle, icapath, count, pubkeys,
+				  hashes, hash_lengths, signatures, status);
+}
+
 int ica_ec_key_get_public_key(const ICA_EC_KEY *key, unsigned char *q, unsigned int *q_len)
 {
 	if (!key || !(key->X) || privlen_from_nid(key->nid) < 0)
@@ -1713,6 +2334,7 @@ void ica_ec_key_free(ICA_EC_KEY *key)
 		OPENSSL_cleanse((void *)key->X, 3*privlen_from_nid(key->nid));
 		free(key->X);
 	}
+	ec_key_cache_free(key->cache);
 
 	OPENSSL_cleanse((void *)key, sizeof(ICA_EC_KEY));
 	free(key);
@@ -1729,73 +2351,156 @@ static inline int check_fips_ed_x(void)
 }
 
 
-int ica_x25519_ctx_new(ICA_X25519_CTX **ctx)
-{
+/*
+ * X25519, X448, Ed25519 and Ed448 use CPACF if MSA 9 is available. Otherwise
+ * they fall back to software, if fallbacks are enabled.
+ */
 #ifdef NO_CPACF
-	UNUSED(ctx);
-	return EPERM;
+#define ED_X_UNAVAILABLE	EPERM
 #else
-	if (!msa9_switch || ctx == NULL)
+#define ED_X_UNAVAILABLE	-1
+#endif
+
+static inline int ed_x_available(void)
+{
+	return ed_x_via_cpacf() || ica_fallbacks_enabled;
+}
+
+/*
+ * Derive the public key of a context from its private key, in the layout
+ * used by the CPACF functions.
+ */
+static int x25519_ctx_derive_pub(ICA_X25519_CTX *ctx)
+{
+	uint64_t begin;
+	int rc;
+
+	if (ed_x_via_cpacf())
+		return x25519_derive_pub(ctx->pub, ctx->priv);
+
+	begin = stats_latency_begin();
+
+	rc = ed_x_derive_pub_sw(&ctx->sw_priv, NID_X25519, ctx->priv,
+				ctx->pub);
+	if (rc == 0)
+		stats_increment_latency(ICA_STATS_X25519_KEYGEN, ALGO_SW,
+					ENCRYPT, begin);
+	return rc;
+}
+
+static int x448_ctx_derive_pub(ICA_X448_CTX *ctx)
+{
+	uint64_t begin;
+	int rc;
+
+	if (ed_x_via_cpacf())
+		return x448_derive_pub(ctx->pub, ctx->priv);
+
+	begin = stats_latency_begin();
+
+	rc = ed_x_derive_pub_sw(&ctx->sw_priv, NID_X448, ctx->priv, ctx->pub);
+	if (rc == 0)
+		stats_increment_latency(ICA_STATS_X448_KEYGEN, ALGO_SW,
+					ENCRYPT, begin);
+	return rc;
+}
+
+static int ed25519_ctx_derive_pub(ICA_ED25519_CTX *ctx)
+{
+	unsigned char pub[32];
+	uint64_t begin;
+	int rc;
+
+	if (ed_x_via_cpacf())
+		return ed25519_derive_pub(ctx->verify_param.pub,
+					  ctx->sign_param.priv);
+
+	begin = stats_latency_begin();
+
+	rc = ed_x_derive_pub_sw(&ctx->sw_priv, NID_ED25519,
+				ctx->sign_param.priv, pub);
+	if (rc == 0) {
+		s390_flip_endian_32(ctx->verify_param.pub, pub);
+		stats_increment_latency(ICA_STATS_ED25519_KEYGEN, ALGO_SW,
+					ENCRYPT, begin);
+	}
+	return rc;
+}
+
+static int ed448_ctx_derive_pub(ICA_ED448_CTX *ctx)
+{
+	unsigned char pub64[64];
+	uint64_t begin;
+	int rc;
+
+	if (ed_x_via_cpacf())
+		return ed448_derive_pub(ctx->verify_param.pub + 64 - 57,
+					ctx->sign_param.priv + 64 - 57);
+
+	begin = stats_latency_begin();
+	memset(pub64, 0, sizeof(pub64));
+
+	rc = ed_x_derive_pub_sw(&ctx->sw_priv, NID_ED448,
+				ctx->sign_param.priv + 64 - 57, pub64);
+	if (rc == 0) {
+		s390_flip_endian_64(ctx->verify_param.pub, pub64);
+		stats_increment_latency(ICA_STATS_ED448_KEYGEN, ALGO_SW,
+					ENCRYPT, begin);
+	}
+	return rc;
+}
+
+int ica_x25519_ctx_new(ICA_X25519_CTX **ctx)
+{
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (ctx == NULL)
 		return -1;
 
 	*ctx = calloc(1, sizeof(**ctx));
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_x448_ctx_new(ICA_X448_CTX **ctx)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	return EPERM;
-#else
-	if (!msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (ctx == NULL)
 		return -1;
 
 	*ctx = calloc(1, sizeof(**ctx));
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_ed25519_ctx_new(ICA_ED25519_CTX **ctx)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	return EPERM;
-#else
-	if (!msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (ctx == NULL)
 		return -1;
 
 	*ctx = calloc(1, sizeof(**ctx));
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_ed448_ctx_new(ICA_ED448_CTX **ctx)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	return EPERM;
-#else
-	if (!msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (ctx == NULL)
 		return -1;
 
 	*ctx = calloc(1, sizeof(**ctx));
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_x25519_key_set(ICA_X25519_CTX *ctx,
 		       const unsigned char priv[32],
 		       const unsigned char pub[32])
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(priv);
-	UNUSED(pub);
-	return EPERM;
-#else
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL)
 		return -1;
 
 	if (priv != NULL) {
@@ -1803,6 +2508,7 @@ int ica_x25519_key_set(ICA_X25519_CTX *ctx,
 		ctx->priv_init = 1;
 		memset(ctx->pub, 0, 32);
 		ctx->pub_init = 0;
+		ed_x_pkey_free_sw(&ctx->sw_priv);
 	}
 
 	if (pub != NULL) {
@@ -1811,20 +2517,15 @@ int ica_x25519_key_set(ICA_X25519_CTX *ctx,
 	}
 
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_x448_key_set(ICA_X448_CTX *ctx,
 		     const unsigned char priv[56],
 		     const unsigned char pub[56])
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(priv);
-	UNUSED(pub);
-	return EPERM;
-#else
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL)
 		return -1;
 
 	if (priv != NULL) {
@@ -1832,6 +2533,7 @@ int ica_x448_key_set(ICA_X448_CTX *ctx,
 		ctx->priv_init = 1;
 		memset(ctx->pub, 0, 56);
 		ctx->pub_init = 0;
+		ed_x_pkey_free_sw(&ctx->sw_priv);
 	}
 
 	if (pub != NULL) {
@@ -1840,20 +2542,15 @@ int ica_x448_key_set(ICA_X448_CTX *ctx,
 	}
 
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_ed25519_key_set(ICA_ED25519_CTX *ctx,
 			const unsigned char priv[32],
 			const unsigned char pub[32])
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(priv);
-	UNUSED(pub);
-	return EPERM;
-#else
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL)
 		return -1;
 
 	if (priv != NULL) {
@@ -1861,28 +2558,26 @@ int ica_ed25519_key_set(ICA_ED25519_CTX *ctx,
 		ctx->priv_init = 1;
 		memset(ctx->verify_param.pub, 0, 32);
 		ctx->pub_init = 0;
+		ed_x_pkey_free_sw(&ctx->sw_priv);
+		ed_x_pkey_free_sw(&ctx->sw_pub);
 	}
 
 	if (pub != NULL) {
 		s390_flip_endian_32(ctx->verify_param.pub, pub);
 		ctx->pub_init = 1;
+		ed_x_pkey_free_sw(&ctx->sw_pub);
 	}
 
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_ed448_key_set(ICA_ED448_CTX *ctx,
 		      const unsigned char priv[57],
 		      const unsigned char pub[57])
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(priv);
-	UNUSED(pub);
-	return EPERM;
-#else
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL)
 		return -1;
 
 	if (priv != NULL) {
@@ -1891,6 +2586,8 @@ int ica_ed448_key_set(ICA_ED448_CTX *ctx,
 		ctx->priv_init = 1;
 		memset(ctx->verify_param.pub, 0, 57);
 		ctx->pub_init = 0;
+		ed_x_pkey_free_sw(&ctx->sw_priv);
+		ed_x_pkey_free_sw(&ctx->sw_pub);
 	}
 
 	if (pub != NULL) {
@@ -1900,24 +2597,20 @@ int ica_ed448_key_set(ICA_ED448_CTX *ctx,
 		s390_flip_endian_64(ctx->verify_param.pub,
                                     ctx->verify_param.pub);
 		ctx->pub_init = 1;
+		ed_x_pkey_free_sw(&ctx->sw_pub);
 	}
 
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_x25519_key_get(ICA_X25519_CTX *ctx, unsigned char priv[32],
 		       unsigned char pub[32])
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(priv);
-	UNUSED(pub);
-	return EPERM;
-#else
 	int rc;
 
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL)
 		return -1;
 
 	if (priv != NULL) {
@@ -1932,7 +2625,7 @@ int ica_x25519_key_get(ICA_X25519_CTX *ctx, unsigned char priv[32],
 			if (!ctx->priv_init)
 				return -1;
 
-			rc = x25519_derive_pub(ctx->pub, ctx->priv);
+			rc = x25519_ctx_derive_pub(ctx);
 			if (rc) {
 				memset(ctx->pub, 0, 32);
 				return -1;
@@ -1945,21 +2638,16 @@ int ica_x25519_key_get(ICA_X25519_CTX *ctx, unsigned char priv[32],
 	}
 
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_x448_key_get(ICA_X448_CTX *ctx, unsigned char priv[56],
 		     unsigned char pub[56])
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(priv);
-	UNUSED(pub);
-	return EPERM;
-#else
 	int rc;
 
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL)
 		return -1;
 
 	if (priv != NULL) {
@@ -1974,7 +2662,7 @@ int ica_x448_key_get(ICA_X448_CTX *ctx, unsigned char priv[56],
 			if (!ctx->priv_init)
 				return -1;
 
-			rc = x448_derive_pub(ctx->pub, ctx->priv);
+			rc = x448_ctx_derive_pub(ctx);
 			if (rc) {
 				memset(ctx->pub, 0, 56);
 				return -1;
@@ -1987,21 +2675,16 @@ int ica_x448_key_get(ICA_X448_CTX *ctx, unsigned char priv[56],
 	}
 
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_ed25519_key_get(ICA_ED25519_CTX *ctx, unsigned char priv[32],
 			unsigned char pub[32])
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(priv);
-	UNUSED(pub);
-	return EPERM;
-#else
 	int rc;
 
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL)
 		return -1;
 
 	if (priv != NULL) {
@@ -2017,8 +2700,7 @@ int ica_ed25519_key_get(ICA_ED25519_CTX *ctx, unsigned char priv[32],
 			if (!ctx->priv_init)
 				return -1;
 
-			rc = ed25519_derive_pub(ctx->verify_param.pub,
-						ctx->sign_param.priv);
+			rc = ed25519_ctx_derive_pub(ctx);
 			if (rc) {
 				memset(ctx->verify_param.pub, 0, 32);
 				return -1;
@@ -2031,22 +2713,17 @@ int ica_ed25519_key_get(ICA_ED25519_CTX *ctx, unsigned char priv[32],
 	}
 
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_ed448_key_get(ICA_ED448_CTX *ctx, unsigned char priv[57],
 			unsigned char pub[57])
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(priv);
-	UNUSED(pub);
-	return EPERM;
-#else
 	unsigned char pub64[64];
 	int rc;
 
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL)
 		return -1;
 
 	if (priv != NULL) {
@@ -2062,8 +2739,7 @@ int ica_ed448_key_get(ICA_ED448_CTX *ctx, unsigned char priv[57],
 			if (!ctx->priv_init)
 				return -1;
 
-			rc = ed448_derive_pub(ctx->verify_param.pub + 64 - 57,
-					      ctx->sign_param.priv + 64 - 57);
+			rc = ed448_ctx_derive_pub(ctx);
 			if (rc) {
 				memset(ctx->verify_param.pub, 0, 57);
 				return -1;
@@ -2077,72 +2753,92 @@ int ica_ed448_key_get(ICA_ED448_CTX *ctx, unsigned char priv[57],
 	}
 
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_x25519_derive(ICA_X25519_CTX *ctx,
 		      unsigned char shared_secret[32],
 		      const unsigned char peer_pub[32])
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(shared_secret);
-	UNUSED(peer_pub);
-	return EPERM;
-#else
-	int rc;
+	uint64_t begin;
+	int hardware, rc;
 
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL
 	    || !ctx->priv_init || shared_secret == NULL || peer_pub == NULL)
 		return -1;
 
-	rc = scalar_mulx_cpacf(shared_secret, ctx->priv, peer_pub,
-			       NID_X25519);
+	begin = stats_latency_begin();
+
+	if (ed_x_via_cpacf()) {
+		hardware = ALGO_HW;
+		rc = scalar_mulx_cpacf(shared_secret, ctx->priv, peer_pub,
+				       NID_X25519);
+	} else {
+		hardware = ALGO_SW;
+		rc = x_derive_sw(&ctx->sw_priv, NID_X25519, ctx->priv,
+				 peer_pub, shared_secret) ? -1 : 0;
+	}
 
-	stats_increment(ICA_STATS_X25519_DERIVE, ALGO_HW, ENCRYPT);
+	stats_increment_latency(ICA_STATS_X25519_DERIVE, hardware, ENCRYPT,
+				begin);
 	return rc;
-#endif /* NO_CPACF */
 }
 
 int ica_x448_derive(ICA_X448_CTX *ctx,
 		    unsigned char shared_secret[56],
 		    const unsigned char peer_pub[56])
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(shared_secret);
-	UNUSED(peer_pub);
-	return EPERM;
-#else
-	int rc;
+	uint64_t begin;
+	int hardware, rc;
 
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL
 	    || !ctx->priv_init || shared_secret == NULL || peer_pub == NULL)
 		return -1;
 
-	rc = scalar_mulx_cpacf(shared_secret, ctx->priv, peer_pub, NID_X448);
+	begin = stats_latency_begin();
+
+	if (ed_x_via_cpacf()) {
+		hardware = ALGO_HW;
+		rc = scalar_mulx_cpacf(shared_secret, ctx->priv, peer_pub,
+				       NID_X448);
+	} else {
+		hardware = ALGO_SW;
+		rc = x_derive_sw(&ctx->sw_priv, NID_X448, ctx->priv,
+				 peer_pub, shared_secret) ? -1 : 0;
+	}
 
-	stats_increment(ICA_STATS_X448_DERIVE, ALGO_HW, ENCRYPT);
+	stats_increment_latency(ICA_STATS_X448_DERIVE, hardware, ENCRYPT,
+				begin);
 	return rc;
-#endif /* NO_CPACF */
 }
 
 int ica_ed25519_sign(ICA_ED25519_CTX *ctx, unsigned char sig[64],
 		     const unsigned char *msg, size_t msglen)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(sig);
-	UNUSED(msg);
-	UNUSED(msglen);
-	return EPERM;
-#else
+	uint64_t begin;
 	int rc;
 
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL
 	    || !ctx->priv_init || sig == NULL || (msg == NULL && msglen != 0))
 		return -1;
 
+	begin = stats_latency_begin();
+
+	if (!ed_x_via_cpacf()) {
+		if (eddsa_sign_sw(&ctx->sw_priv, NID_ED25519,
+				  ctx->sign_param.priv, msg, msglen, sig))
+			return -1;
+
+		stats_increment_latency(ICA_STATS_ED25519_SIGN, ALGO_SW,
+					ENCRYPT, begin);
+		return 0;
+	}
+
 	rc = s390_kdsa(S390_CRYPTO_EDDSA_SIGN_ED25519,
 		       &ctx->sign_param, msg, msglen);
 	if (rc) {
@@ -2154,27 +2850,36 @@ int ica_ed25519_sign(ICA_ED25519_CTX *ctx, unsigned char sig[64],
 	s390_flip_endian_32(sig + 32, ctx->sign_param.sig + 32);
 	memset(ctx->sign_param.sig, 0, sizeof(ctx->sign_param.sig));
 
-	stats_increment(ICA_STATS_ED25519_SIGN, ALGO_HW, ENCRYPT);
+	stats_increment_latency(ICA_STATS_ED25519_SIGN, ALGO_HW, ENCRYPT,
+				begin);
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_ed448_sign(ICA_ED448_CTX *ctx, unsigned char sig[114],
 		     const unsigned char *msg, size_t msglen)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(sig);
-	UNUSED(msg);
-	UNUSED(msglen);
-	return EPERM;
-#else
+	uint64_t begin;
 	int rc;
 
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL
 	    || !ctx->priv_init || sig == NULL || (msg == NULL && msglen != 0))
 		return -1;
 
+	begin = stats_latency_begin();
+
+	if (!ed_x_via_cpacf()) {
+		if (eddsa_sign_sw(&ctx->sw_priv, NID_ED448,
+				  ctx->sign_param.priv + 64 - 57, msg, msglen,
+				  sig))
+			return -1;
+
+		stats_increment_latency(ICA_STATS_ED448_SIGN, ALGO_SW,
+					ENCRYPT, begin);
+		return 0;
+	}
+
 	rc = s390_kdsa(S390_CRYPTO_EDDSA_SIGN_ED448,
 		       &ctx->sign_param, msg, msglen);
 	if (rc) {
@@ -2189,33 +2894,31 @@ int ica_ed448_sign(ICA_ED448_CTX *ctx, unsigned char sig[114],
 	memcpy(sig + 57, ctx->sign_param.sig + 64, 57);
 	memset(ctx->sign_param.sig, 0, sizeof(ctx->sign_param.sig));
 
-	stats_increment(ICA_STATS_ED448_SIGN, ALGO_HW, ENCRYPT);
+	stats_increment_latency(ICA_STATS_ED448_SIGN, ALGO_HW, ENCRYPT,
+				begin);
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_ed25519_verify(ICA_ED25519_CTX *ctx, const unsigned char sig[64],
 		       const unsigned char *msg, size_t msglen)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(sig);
-	UNUSED(msg);
-	UNUSED(msglen);
-	return EPERM;
-#else
+	unsigned char pub[32];
+	uint64_t begin;
 	int rc;
 
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL || sig == NULL
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL || sig == NULL
 	    || (msg == NULL && msglen != 0))
 		return -1;
 
+	begin = stats_latency_begin();
+
 	if (!ctx->pub_init) {
 		if (!ctx->priv_init)
 			return -1;
 
-		rc = ed25519_derive_pub(ctx->verify_param.pub,
-				        ctx->sign_param.priv);
+		rc = ed25519_ctx_derive_pub(ctx);
 		if (rc) {
 			memset(ctx->verify_param.pub, 0, 32);
 			return -1;
@@ -2224,6 +2927,16 @@ int ica_ed25519_verify(ICA_ED25519_CTX *ctx, const unsigned char sig[64],
 		ctx->pub_init = 1;
 	}
 
+	if (!ed_x_via_cpacf()) {
+		s390_flip_endian_32(pub, ctx->verify_param.pub);
+		rc = eddsa_verify_sw(&ctx->sw_pub, NID_ED25519, pub, msg,
+				     msglen, sig);
+
+		stats_increment_latency(ICA_STATS_ED25519_VERIFY, ALGO_SW,
+					ENCRYPT, begin);
+		return rc == 0 ? 0 : -1;
+	}
+
 	s390_flip_endian_32(ctx->verify_param.sig, sig);
 	s390_flip_endian_32(ctx->verify_param.sig + 32, sig + 32);
 
@@ -2232,33 +2945,31 @@ int ica_ed25519_verify(ICA_ED25519_CTX *ctx, const unsigned char sig[64],
 
 	memset(ctx->verify_param.sig, 0, sizeof(ctx->verify_param.sig));
 
-	stats_increment(ICA_STATS_ED25519_VERIFY, ALGO_HW, ENCRYPT);
+	stats_increment_latency(ICA_STATS_ED25519_VERIFY, ALGO_HW, ENCRYPT,
+				begin);
 	return rc == 0 ? 0 : -1;
-#endif /* NO_CPACF */
 }
 
 int ica_ed448_verify(ICA_ED448_CTX *ctx, const unsigned char sig[114],
 		     const unsigned char *msg, size_t msglen)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	UNUSED(sig);
-	UNUSED(msg);
-	UNUSED(msglen);
-	return EPERM;
-#else
+	unsigned char pub64[64];
+	uint64_t begin;
 	int rc;
 
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL || sig == NULL
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL || sig == NULL
 	    || (msg == NULL && msglen != 0))
 		return -1;
 
+	begin = stats_latency_begin();
+
 	if (!ctx->pub_init) {
 		if (!ctx->priv_init)
 			return -1;
 
-		rc = ed448_derive_pub(ctx->verify_param.pub + 64 - 57,
-				      ctx->sign_param.priv + 64 - 57);
+		rc = ed448_ctx_derive_pub(ctx);
 		if (rc) {
 			memset(ctx->verify_param.pub, 0, 57);
 			return -1;
@@ -2267,6 +2978,16 @@ int ica_ed448_verify(ICA_ED448_CTX *ctx, const unsigned char sig[114],
 		ctx->pub_init = 1;
 	}
 
+	if (!ed_x_via_cpacf()) {
+		s390_flip_endian_64(pub64, ctx->verify_param.pub);
+		rc = eddsa_verify_sw(&ctx->sw_pub, NID_ED448, pub64, msg,
+				     msglen, sig);
+
+		stats_increment_latency(ICA_STATS_ED448_VERIFY, ALGO_SW,
+					ENCRYPT, begin);
+		return rc == 0 ? 0 : -1;
+	}
+
 	memcpy(ctx->verify_param.sig, sig, 57);
 	memcpy(ctx->verify_param.sig + 64, sig + 57, 57);
 	s390_flip_endian_64(ctx->verify_param.sig, ctx->verify_param.sig);
@@ -2280,84 +3001,77 @@ int ica_ed448_verify(ICA_ED448_CTX *ctx, const unsigned char sig[114],
 
 	memset(ctx->verify_param.sig, 0, sizeof(ctx->verify_param.sig));
 
-	stats_increment(ICA_STATS_ED448_VERIFY, ALGO_HW, ENCRYPT);
+	stats_increment_latency(ICA_STATS_ED448_VERIFY, ALGO_HW, ENCRYPT,
+				begin);
 	return rc == 0 ? 0 : -1;
-#endif /* NO_CPACF */
 }
 
 int ica_x25519_ctx_del(ICA_X25519_CTX **ctx)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	return EPERM;
-#else
-	if (!msa9_switch || ctx == NULL || *ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (ctx == NULL || *ctx == NULL)
 		return -1;
 
+	ed_x_pkey_free_sw(&(*ctx)->sw_priv);
 	OPENSSL_cleanse(*ctx, sizeof(**ctx));
 	free(*ctx);
 	*ctx = NULL;
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_x448_ctx_del(ICA_X448_CTX **ctx)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	return EPERM;
-#else
-	if (!msa9_switch || ctx == NULL || *ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (ctx == NULL || *ctx == NULL)
 		return -1;
 
+	ed_x_pkey_free_sw(&(*ctx)->sw_priv);
 	OPENSSL_cleanse(*ctx, sizeof(**ctx));
 	free(*ctx);
 	*ctx = NULL;
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_ed25519_ctx_del(ICA_ED25519_CTX **ctx)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	return EPERM;
-#else
-	if (!msa9_switch || ctx == NULL || *ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (ctx == NULL || *ctx == NULL)
 		return -1;
 
+	ed_x_pkey_free_sw(&(*ctx)->sw_priv);
+	ed_x_pkey_free_sw(&(*ctx)->sw_pub);
 	OPENSSL_cleanse(*ctx, sizeof(**ctx));
 	free(*ctx);
 	*ctx = NULL;
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_ed448_ctx_del(ICA_ED448_CTX **ctx)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	return EPERM;
-#else
-	if (!msa9_switch || ctx == NULL || *ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (ctx == NULL || *ctx == NULL)
 		return -1;
 
+	ed_x_pkey_free_sw(&(*ctx)->sw_priv);
+	ed_x_pkey_free_sw(&(*ctx)->sw_pub);
 	OPENSSL_cleanse(*ctx, sizeof(**ctx));
 	free(*ctx);
 	*ctx = NULL;
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_x25519_key_gen(ICA_X25519_CTX *ctx)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	return EPERM;
-#else
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL)
 		return -1;
 
+	ed_x_pkey_free_sw(&ctx->sw_priv);
 	memset(ctx, 0, sizeof(*ctx));
 	ctx->pub_init = 0;
 
@@ -2366,18 +3080,16 @@ int ica_x25519_key_gen(ICA_X25519_CTX *ctx)
 
 	ctx->priv_init = 1;
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_x448_key_gen(ICA_X448_CTX *ctx)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	return EPERM;
-#else
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL)
 		return -1;
 
+	ed_x_pkey_free_sw(&ctx->sw_priv);
 	memset(ctx, 0, sizeof(*ctx));
 	ctx->pub_init = 0;
 
@@ -2386,18 +3098,17 @@ int ica_x448_key_gen(ICA_X448_CTX *ctx)
 
 	ctx->priv_init = 1;
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_ed25519_key_gen(ICA_ED25519_CTX *ctx)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	return EPERM;
-#else
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL)
 		return -1;
 
+	ed_x_pkey_free_sw(&ctx->sw_priv);
+	ed_x_pkey_free_sw(&ctx->sw_pub);
 	memset(ctx, 0, sizeof(*ctx));
 	ctx->pub_init = 0;
 
@@ -2406,18 +3117,17 @@ int ica_ed25519_key_gen(ICA_ED25519_CTX *ctx)
 
 	ctx->priv_init = 1;
 	return 0;
-#endif /* NO_CPACF */
 }
 
 int ica_ed448_key_gen(ICA_ED448_CTX *ctx)
 {
-#ifdef NO_CPACF
-	UNUSED(ctx);
-	return EPERM;
-#else
-	if (check_fips_ed_x() || !msa9_switch || ctx == NULL)
+	if (!ed_x_available())
+		return ED_X_UNAVAILABLE;
+	if (check_fips_ed_x() || ctx == NULL)
 		return -1;
 
+	ed_x_pkey_free_sw(&ctx->sw_priv);
+	ed_x_pkey_free_sw(&ctx->sw_pub);
 	memset(ctx, 0, sizeof(*ctx));
 	ctx->pub_init = 0;
 
@@ -2427,7 +3137,6 @@ int ica_ed448_key_gen(ICA_ED448_CTX *ctx)
 
 	ctx->priv_init = 1;
 	return 0;
-#endif /* NO_CPACF */
 }
 
 
@@ -2699,7 +3408,8 @@ unsigned int ica_des_cmac_intermediate(const unsigned char *message,
 		       iv);
 
 	if (!rc)
-		stats_increment(ICA_STATS_DES_CMAC, ALGO_HW, ICA_DECRYPT);
+		stats_increment_bytes(ICA_STATS_DES_CMAC, ALGO_HW, ICA_DECRYPT,
+				      message_length);
 	return rc;
 #endif /* NO_CPACF */
 }
@@ -2744,7 +3454,8 @@ unsigned int ica_des_cmac_last(const unsigned char *message, unsigned long messa
 		if (rc)
 			return rc;
 		else
-			stats_increment(ICA_STATS_DES_CMAC, ALGO_HW, direction);
+			stats_increment_bytes(ICA_STATS_DES_CMAC, ALGO_HW,
+					      direction, message_length);
 	} else {
 		/* verify */
 		rc = s390_cmac(function_code, message, message_length,
@@ -2754,7 +3465,8 @@ unsigned int ica_des_cmac_last(const unsigned char *message, unsigned long messa
 		if (CRYPTO_memcmp(tmp_mac, mac, mac_length))
 			return EFAULT;
 		else
-			stats_increment(ICA_STATS_DES_CMAC, ALGO_HW, direction);
+			stats_increment_bytes(ICA_STATS_DES_CMAC, ALGO_HW,
+					      direction, message_length);
 	}
 
 	return 0;
@@ -3024,7 +3736,8 @@ unsigned int ica_3des_cmac_intermediate(const unsigned char *message,
 		       iv);
 
 	if (!rc)
-		stats_increment(ICA_STATS_3DES_CMAC, ALGO_HW, DECRYPT);
+		stats_increment_bytes(ICA_STATS_3DES_CMAC, ALGO_HW, DECRYPT,
+				      message_length);
 	return rc;
 #endif /* NO_CPACF */
 }
@@ -3069,7 +3782,8 @@ unsigned int ica_3des_cmac_last(const unsigned char *message, unsigned long mess
 		if (rc)
 			return rc;
 		else
-			stats_increment(ICA_STATS_3DES_CMAC, ALGO_HW, direction);
+			stats_increment_bytes(ICA_STATS_3DES_CMAC, ALGO_HW,
+					      direction, message_length);
 	} else {
 		/* verify */
 		rc = s390_cmac(function_code, message, message_length,
@@ -3079,7 +3793,8 @@ unsigned int ica_3des_cmac_last(const unsigned char *message, unsigned long mess
 		if (CRYPTO_memcmp(tmp_mac, mac, mac_length))
 			return EFAULT;
 		else
-			stats_increment(ICA_STATS_3DES_CMAC, ALGO_HW, direction);
+			stats_increment_bytes(ICA_STATS_3DES_CMAC, ALGO_HW,
+					      direction, message_length);
 	}
 
 	return 0;
@@ -3445,9 +4160,9 @@ unsigned int ica_aes_cmac_intermediate(const unsigned char *message,
 		       iv);
 
 	if (!rc)
-		stats_increment(ICA_STATS_AES_CMAC_128 +
-				aes_directed_fc_stats_ofs(function_code),
-				ALGO_HW, ICA_DECRYPT);
+		stats_increment_bytes(ICA_STATS_AES_CMAC_128 +
+				      aes_directed_fc_stats_ofs(function_code),
+				      ALGO_HW, ICA_DECRYPT, message_length);
 	return rc;
 #endif /* NO_CPACF */
 }
@@ -3493,9 +4208,9 @@ unsigned int ica_aes_cmac_last(const unsigned char *message, unsigned long messa
 		if (rc)
 			return rc;
 
-		stats_increment(ICA_STATS_AES_CMAC_128 +
-				aes_directed_fc_stats_ofs(function_code),
-				ALGO_HW, direction);
+		stats_increment_bytes(ICA_STATS_AES_CMAC_128 +
+				      aes_directed_fc_stats_ofs(function_code),
+				      ALGO_HW, direction, message_length);
 	} else {
 		/* verify */
 		rc = s390_cmac(function_code, message, message_length,
@@ -3505,9 +4220,9 @@ unsigned int ica_aes_cmac_last(const unsigned char *message, unsigned long messa
 		if (CRYPTO_memcmp(tmp_mac, mac, mac_length))
 			return EFAULT;
 
-		stats_increment(ICA_STATS_AES_CMAC_128 +
-				aes_directed_fc_stats_ofs(function_code),
-				ALGO_HW, direction);
+		stats_increment_bytes(ICA_STATS_AES_CMAC_128 +
+				      aes_directed_fc_stats_ofs(function_code),
+				      ALGO_HW, direction, message_length);
 	}
 
 	return 0;
@@ -4063,6 +4778,10 @@ unsigned int ica_get_version(libica_version_info *version_info)
 unsigned int ica_get_functionlist(libica_func_list_element *pmech_list,
 					  unsigned int *pmech_list_len)
 {
+	ica_init_functionlist();
+	/* the adapter flags follow the cards set online or offline */
+	ica_init_cards();
+
 	return s390_get_functionlist(pmech_list, pmech_list_len);
 }
 
@@ -4127,6 +4846,8 @@ int ica_drbg_instantiate(ica_drbg_t **sh,
 	if (status)
 		return ica_drbg_error(status);
 
+	ica_init_drbg();
+
 	/* Run instantiate health test (11.3.2). */
 	pthread_rwlock_wrlock(&mech->lock);
 	status = drbg_health_test(drbg_instantiate, sec, pr, mech);
@@ -23,6 +23,11 @@
 #include <libgen.h>
 #include <errno.h>
 #include <time.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <sys/utsname.h>
 #include "icastats.h"
 
@@ -49,12 +54,25 @@ void print_help(char *cmd)
 	       " -S, --summary       show the accumulated statistics from all users. (root user only)\n"
 	       " -A, --all	     show the statistic tables from all users. (root user only)\n"
 	       " -k, --key-sizes     show statistics per key size.\n"
+	       " -b, --bytes         show the number of processed bytes as well.\n"
+	       " -l, --latency       show the latency percentiles of the asymmetric\n"
+	       "                     functions as well (LIBICA_STATS_MODE=2).\n"
+	       " -i, --interval <n>  show the operations and bytes per second every n\n"
+	       "                     seconds, until interrupted.\n"
+	       " -t, --top <n>       show the n processes with the most operations\n"
+	       "                     (LIBICA_STATS_MODE=4).\n"
+	       " -e, --events        show the last fallbacks from hardware to software\n"
+	       "                     and why the hardware was not used.\n"
+	       " -s, --serve <addr>  serve the statistics of all users in the OpenMetrics\n"
+	       "                     text format via HTTP on the Unix socket <addr>, if it\n"
+	       "                     starts with a '/', else on the TCP socket\n"
+	       "                     [<host>:]<port> (default host: localhost).\n"
 	       " -j, --json          output the statistics in JSON format.\n"
 	       " -v, --version       output version information\n"
 	       " -h, --help          display help information\n");
 }
 
-#define getopt_string "rRdDU:SAkjvh"
+#define getopt_string "rRdDU:SAkbli:t:es:jvh"
 static struct option getopt_long_options[] = {
 	{"reset", 0, 0, 'r'},
 	{"reset-all", 0, 0, 'R'},
@@ -64,6 +82,12 @@ static struct option getopt_long_options[] = {
 	{"summary", 0, 0, 'S'},
 	{"all", 0, 0, 'A'},
 	{"key-sizes", 0, 0, 'k'},
+	{"bytes", 0, 0, 'b'},
+	{"latency", 0, 0, 'l'},
+	{"interval", required_argument, 0, 'i'},
+	{"top", required_argument, 0, 't'},
+	{"events", 0, 0, 'e'},
+	{"serve", required_argument, 0, 's'},
 	{"json", 0, 0, 'j'},
 	{"version", 0, 0, 'v'},
 	{"help", 0, 0, 'h'},
@@ -76,27 +100,41 @@ const char *const STATS_DESC[ICA_NUM_STATS] = {
 
 
 
+/* bytes are only counted for symmetric ciphers, hashes and MACs */
+static int stats_counts_bytes(unsigned int i)
+{
+	return i < ICA_STATS_PRNG || i > ICA_STATS_RSA_CRT_4096;
+}
+
 #define CELL_SIZE 12
-void print_stats(stats_entry_t *stats, int key_sizes)
+#define BYTES_CELL_SIZE 15
+void print_stats(stats_entry_t *stats, int key_sizes, int bytes)
 {
-	printf(" function       |             hardware         |              software\n");
-	printf("----------------+------------------------------+-----------------------------\n");
-	printf("                |        ENC    CRYPT     DEC  |        ENC     CRYPT    DEC \n");
-	printf("----------------+------------------------------+-----------------------------\n");
+	if (bytes) {
+		printf(" function       |             hardware         |              software       |  hardware bytes |  software bytes\n");
+		printf("----------------+------------------------------+-----------------------------+-----------------+-----------------\n");
+		printf("                |        ENC    CRYPT     DEC  |        ENC     CRYPT    DEC  |                 |\n");
+		printf("----------------+------------------------------+-----------------------------+-----------------+-----------------\n");
+	} else {
+		printf(" function       |             hardware         |              software\n");
+		printf("----------------+------------------------------+-----------------------------\n");
+		printf("                |        ENC    CRYPT     DEC  |        ENC     CRYPT    DEC \n");
+		printf("----------------+------------------------------+-----------------------------\n");
+	}
 	unsigned int i;
 	for (i = 0; i < ICA_NUM_STATS; ++i) {
 		if (!key_sizes && strncmp(STATS_DESC[i], "- ", 2) == 0)
 			continue;
 
 		if (i <= ICA_STATS_RSA_CRT_4096) {
-			printf(" %14s |        %*lu          |         %*lu\n",
+			printf(" %14s |        %*lu          |         %*lu",
 			       STATS_DESC[i],
 			       CELL_SIZE,
 			       stats[i].enc.hw,
 			       CELL_SIZE,
 			       stats[i].enc.sw);
 		} else {
-			printf(" %14s |%*lu     %*lu |%*lu    %*lu\n",
+			printf(" %14s |%*lu     %*lu |%*lu    %*lu",
 			       STATS_DESC[i],
 			       CELL_SIZE,
 			       stats[i].enc.hw,
@@ -107,9 +145,604 @@ void print_stats(stats_entry_t *stats, int key_sizes)
 			       CELL_SIZE,
 			       stats[i].dec.sw);
 		}
+		/* encrypt and decrypt bytes are shown accumulated */
+		if (bytes) {
+			printf(" %s| %*lu | %*lu",
+			       i <= ICA_STATS_RSA_CRT_4096 ? "       " : "",
+			       BYTES_CELL_SIZE,
+			       stats[i].enc_bytes.hw + stats[i].dec_bytes.hw,
+			       BYTES_CELL_SIZE,
+			       stats[i].enc_bytes.sw + stats[i].dec_bytes.sw);
+		}
+		printf("\n");
+	}
+}
+
+/* percentiles shown for the latency histograms, in per mille */
+static const unsigned int LATENCY_PERCENTILES[] = { 500, 990, 999 };
+static const char *const LATENCY_PERCENTILE_DESC[] = { "p50", "p99", "p999" };
+#define NUM_LATENCY_PERCENTILES \
+	(sizeof(LATENCY_PERCENTILES) / sizeof(LATENCY_PERCENTILES[0]))
+
+#define LATENCY_CELL_SIZE 9
+void print_latency(stats_latency_t *latency, int key_sizes)
+{
+	unsigned int i, j;
+
+	printf("\n");
+	printf(" function       |    hardware latency (usec)     |    software latency (usec)\n");
+	printf("----------------+--------------------------------+-------------------------------\n");
+	printf("                |       p50       p99      p999  |       p50       p99      p999\n");
+	printf("----------------+--------------------------------+-------------------------------\n");
+	/* only the asymmetric functions record their latency */
+	for (i = ICA_STATS_ECDH; i <= ICA_STATS_RSA_CRT_4096; ++i) {
+		if (!key_sizes && strncmp(STATS_DESC[i], "- ", 2) == 0)
+			continue;
+
+		printf(" %14s |", STATS_DESC[i]);
+		for (j = 0; j < NUM_LATENCY_PERCENTILES; j++)
+			printf(" %*.1f", LATENCY_CELL_SIZE,
+			       stats_latency_percentile(latency[i].hw,
+						LATENCY_PERCENTILES[j]) / 1000.0);
+		printf("  |");
+		for (j = 0; j < NUM_LATENCY_PERCENTILES; j++)
+			printf(" %*.1f", LATENCY_CELL_SIZE,
+			       stats_latency_percentile(latency[i].sw,
+						LATENCY_PERCENTILES[j]) / 1000.0);
+		printf("\n");
+	}
+}
+
+/* counters may have been reset since the last snapshot */
+static inline uint64_t counter_delta(uint64_t cur, uint64_t prev)
+{
+	return cur >= prev ? cur - prev : cur;
+}
+
+/* add the difference of two snapshots to delta */
+void stats_delta(const stats_entry_t *cur, const stats_entry_t *prev,
+		 stats_entry_t *delta)
+{
+	unsigned int i;
+
+	for (i = 0; i < ICA_NUM_STATS; i++) {
+		delta[i].enc.hw += counter_delta(cur[i].enc.hw, prev[i].enc.hw);
+		delta[i].enc.sw += counter_delta(cur[i].enc.sw, prev[i].enc.sw);
+		delta[i].dec.hw += counter_delta(cur[i].dec.hw, prev[i].dec.hw);
+		delta[i].dec.sw += counter_delta(cur[i].dec.sw, prev[i].dec.sw);
+		delta[i].enc_bytes.hw += counter_delta(cur[i].enc_bytes.hw,
+						       prev[i].enc_bytes.hw);
+		delta[i].enc_bytes.sw += counter_delta(cur[i].enc_bytes.sw,
+						       prev[i].enc_bytes.sw);
+		delta[i].dec_bytes.hw += counter_delta(cur[i].dec_bytes.hw,
+						       prev[i].dec_bytes.hw);
+		delta[i].dec_bytes.sw += counter_delta(cur[i].dec_bytes.sw,
+						       prev[i].dec_bytes.sw);
 	}
 }
 
+#define RATE_CELL_SIZE 13
+/* print the functions used during an interval of secs seconds */
+void print_rates(stats_entry_t *delta, double secs, int key_sizes)
+{
+	unsigned int i;
+
+	printf(" function       |     hw ops/s  |     sw ops/s  |   hw bytes/s  |   sw bytes/s\n");
+	printf("----------------+---------------+---------------+---------------+--------------\n");
+	for (i = 0; i < ICA_NUM_STATS; ++i) {
+		if (!key_sizes && strncmp(STATS_DESC[i], "- ", 2) == 0)
+			continue;
+		if (delta[i].enc.hw + delta[i].dec.hw +
+		    delta[i].enc.sw + delta[i].dec.sw == 0)
+			continue;
+
+		/* encrypt and decrypt are shown accumulated */
+		printf(" %14s | %*.1f | %*.1f | %*.1f | %*.1f\n",
+		       STATS_DESC[i],
+		       RATE_CELL_SIZE,
+		       (delta[i].enc.hw + delta[i].dec.hw) / secs,
+		       RATE_CELL_SIZE,
+		       (delta[i].enc.sw + delta[i].dec.sw) / secs,
+		       RATE_CELL_SIZE,
+		       (delta[i].enc_bytes.hw + delta[i].dec_bytes.hw) / secs,
+		       RATE_CELL_SIZE,
+		       (delta[i].enc_bytes.sw + delta[i].dec_bytes.sw) / secs);
+	}
+}
+
+/* Show the rates of one or all users every interval seconds. The segments
+ * stay mapped between the intervals.
+ */
+int print_rates_loop(int user, int all, int sum, unsigned int interval,
+		     int key_sizes)
+{
+	stats_entry_t delta[ICA_NUM_STATS];
+	struct timespec last, now;
+	stats_reader_t reader;
+	struct passwd *pswd;
+	char timestamp[64];
+	unsigned int i;
+	double secs;
+	time_t t;
+
+	if (stats_reader_open(&reader, all || sum ? STATS_READER_ALL : user)) {
+		perror("stats_reader_open: ");
+		return EXIT_FAILURE;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &last);
+	while (1) {
+		sleep(interval);
+
+		if (stats_reader_update(&reader)) {
+			perror("stats_reader_update: ");
+			stats_reader_close(&reader);
+			return EXIT_FAILURE;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		secs = (now.tv_sec - last.tv_sec) +
+		       (now.tv_nsec - last.tv_nsec) / 1e9;
+		last = now;
+
+		time(&t);
+		strftime(timestamp, sizeof(timestamp), "%F %T",
+			 localtime(&t));
+		printf("%s\n", timestamp);
+
+		memset(delta, 0, sizeof(delta));
+		for (i = 0; i < reader.num; i++) {
+			stats_delta(reader.segs[i].cur, reader.segs[i].prev,
+				    delta);
+			if (sum)
+				continue;
+
+			if (all) {
+				pswd = getpwuid(reader.segs[i].uid);
+				if (pswd != NULL)
+					printf("user: %s\n", pswd->pw_name);
+				else
+					printf("user: %u\n",
+					       reader.segs[i].uid);
+			}
+			print_rates(delta, secs, key_sizes);
+			memset(delta, 0, sizeof(delta));
+		}
+		if (sum)
+			print_rates(delta, secs, key_sizes);
+
+		printf("\n");
+		fflush(stdout);
+	}
+}
+
+/* Returns the name of a field including its key size, e.g. "RSA-CRT 2048" */
+static void stats_field_name(int i, char *name, size_t len)
+{
+	int j = i;
+
+	if (strncmp(STATS_DESC[i], "- ", 2) != 0) {
+		snprintf(name, len, "%s", STATS_DESC[i]);
+		return;
+	}
+	while (j > 0 && strncmp(STATS_DESC[j], "- ", 2) == 0)
+		j--;
+	snprintf(name, len, "%s %s", STATS_DESC[j], STATS_DESC[i] + 2);
+}
+
+static int proc_ops_cmp(const void *a, const void *b)
+{
+	const stats_proc_info_t *pa = a, *pb = b;
+	uint64_t ops_a = pa->ops.hw + pa->ops.sw, ops_b = pb->ops.hw + pb->ops.sw;
+
+	return ops_a < ops_b ? 1 : ops_a > ops_b ? -1 : 0;
+}
+
+/* boot time in seconds since the epoch, see proc(5) */
+static time_t boot_time(void)
+{
+	char line[256];
+	time_t btime = 0;
+	FILE *f;
+
+	if ((f = fopen("/proc/stat", "r")) == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "btime %ld", &btime) == 1)
+			break;
+	}
+	fclose(f);
+	return btime;
+}
+
+/* print the top processes of the mapped shared memory segment */
+int print_top(unsigned int top)
+{
+	stats_proc_info_t procs[STATS_PROC_SLOTS];
+	char started[32], name[32];
+	unsigned int i, num;
+	time_t btime, t;
+	long ticks;
+
+	num = get_stats_procs(procs);
+	qsort(procs, num, sizeof(procs[0]), proc_ops_cmp);
+
+	btime = boot_time();
+	ticks = sysconf(_SC_CLK_TCK);
+
+	printf("     pid | command          | state   | started             |       hw ops |       sw ops |     hw bytes |     sw bytes | top function\n");
+	printf("---------+------------------+---------+---------------------+--------------+--------------+--------------+--------------+-----------------\n");
+	for (i = 0; i < num && i < top; i++) {
+		t = btime + procs[i].start_time / (ticks > 0 ? ticks : 100);
+		strftime(started, sizeof(started), "%F %T", localtime(&t));
+		if (procs[i].top_field >= 0)
+			stats_field_name(procs[i].top_field, name,
+					 sizeof(name));
+		else
+			strcpy(name, "-");
+
+		printf(" %7d | %-16s | %-7s | %s | %12lu | %12lu | %12lu | %12lu | %s\n",
+		       procs[i].pid, procs[i].comm,
+		       procs[i].alive ? "running" : "exited", started,
+		       procs[i].ops.hw, procs[i].ops.sw,
+		       procs[i].bytes.hw, procs[i].bytes.sw, name);
+	}
+	return EXIT_SUCCESS;
+}
+
+static const char *const FALLBACK_REASONS[] = {
+	[STATS_FB_NO_DRIVER] = "driver not loaded",
+	[STATS_FB_NO_CARD] = "no card online",
+	[STATS_FB_DISABLED] = "function disabled",
+	[STATS_FB_CURVE] = "curve not on card",
+	[STATS_FB_HW_ERROR] = "hardware error",
+	[STATS_FB_ROUTE_SW] = "routed to sw",
+	[STATS_FB_ROUTE_HW] = "routed to hw",
+};
+
+/* print the fallback events of the mapped shared memory segment */
+int print_events(void)
+{
+	stats_event_t *events;
+	char time[32], name[32];
+	const char *reason;
+	unsigned int i, num;
+	uint64_t lost;
+	time_t t;
+
+	if ((events = malloc(sizeof(stats_event_t) * STATS_EVENTS)) == NULL) {
+		perror("malloc: ");
+		return EXIT_FAILURE;
+	}
+	num = get_stats_events(events, &lost);
+
+	printf(" time                       |     pid | function         | reason            | error\n");
+	printf("----------------------------+---------+------------------+-------------------+------------------\n");
+	for (i = 0; i < num; i++) {
+		t = events[i].time / 1000000000;
+		strftime(time, sizeof(time), "%F %T", localtime(&t));
+		if (events[i].field >= 0 && events[i].field < ICA_NUM_STATS)
+			stats_field_name(events[i].field, name, sizeof(name));
+		else
+			strcpy(name, "-");
+		if (events[i].reason > 0 &&
+		    events[i].reason <= STATS_FB_ROUTE_HW)
+			reason = FALLBACK_REASONS[events[i].reason];
+		else
+			reason = "-";
+
+		printf(" %s.%06lu | %7d | %-16s | %-17s | %s\n", time,
+		       (events[i].time % 1000000000) / 1000, events[i].pid,
+		       name, reason,
+		       events[i].err ? strerror(events[i].err) : "-");
+	}
+	if (lost)
+		printf("(%lu older events overwritten)\n", lost);
+
+	free(events);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * OpenMetrics exporter
+ */
+#define SERVE_REQUEST_MAX	4096
+#define SERVE_TIMEOUT		5	/* seconds per request */
+
+static volatile sig_atomic_t serve_stop;
+
+static void serve_signal(int sig)
+{
+	(void)sig;
+	serve_stop = 1;
+}
+
+/* Returns the mechanism of a field and its key size or NULL if it has no
+ * key sizes. Fields with key size subentries are only counted by them.
+ */
+static const char *metric_mechanism(unsigned int i, const char **keysize)
+{
+	*keysize = NULL;
+	if (strncmp(STATS_DESC[i], "- ", 2) != 0)
+		return STATS_DESC[i];
+
+	*keysize = STATS_DESC[i] + 2;
+	while (i > 0 && strncmp(STATS_DESC[i], "- ", 2) == 0)
+		i--;
+	return STATS_DESC[i];
+}
+
+static void print_metric(FILE *fp, const char *name, uid_t uid,
+			 unsigned int i, const char *direction,
+			 const char *path, uint64_t value)
+{
+	const char *mechanism, *keysize;
+
+	mechanism = metric_mechanism(i, &keysize);
+	fprintf(fp, "%s{uid=\"%u\",mechanism=\"%s\"", name, uid, mechanism);
+	if (keysize != NULL)
+		fprintf(fp, ",keysize=\"%s\"", keysize);
+	if (direction != NULL)
+		fprintf(fp, ",direction=\"%s\"", direction);
+	fprintf(fp, ",path=\"%s\"} %lu\n", path, value);
+}
+
+static void print_metric_entry(FILE *fp, const char *name, uid_t uid,
+			       unsigned int i, const crypt_opts_t *enc,
+			       const crypt_opts_t *dec)
+{
+	/* the crypt counters have no direction */
+	if (i <= ICA_STATS_RSA_CRT_4096) {
+		print_metric(fp, name, uid, i, NULL, "hw", enc->hw);
+		print_metric(fp, name, uid, i, NULL, "sw", enc->sw);
+		return;
+	}
+
+	print_metric(fp, name, uid, i, "encrypt", "hw", enc->hw);
+	print_metric(fp, name, uid, i, "encrypt", "sw", enc->sw);
+	print_metric(fp, name, uid, i, "decrypt", "hw", dec->hw);
+	print_metric(fp, name, uid, i, "decrypt", "sw", dec->sw);
+}
+
+void print_metrics(FILE *fp, stats_reader_t *reader)
+{
+	stats_entry_t *entries;
+	unsigned int i, j;
+
+	fprintf(fp, "# TYPE libica_operations counter\n");
+	fprintf(fp, "# HELP libica_operations Number of crypto operations.\n");
+	for (j = 0; j < reader->num; j++) {
+		entries = reader->segs[j].cur;
+		for (i = 0; i < ICA_NUM_STATS; i++) {
+			if (i < ICA_NUM_STATS - 1 &&
+			    strncmp(STATS_DESC[i + 1], "- ", 2) == 0 &&
+			    strncmp(STATS_DESC[i], "- ", 2) != 0)
+				continue;
+			print_metric_entry(fp, "libica_operations_total",
+					   reader->segs[j].uid, i,
+					   &entries[i].enc, &entries[i].dec);
+		}
+	}
+
+	fprintf(fp, "# TYPE libica_bytes counter\n");
+	fprintf(fp, "# HELP libica_bytes Number of processed bytes.\n");
+	for (j = 0; j < reader->num; j++) {
+		entries = reader->segs[j].cur;
+		for (i = 0; i < ICA_NUM_STATS; i++) {
+			if (!stats_counts_bytes(i))
+				continue;
+			if (i < ICA_NUM_STATS - 1 &&
+			    strncmp(STATS_DESC[i + 1], "- ", 2) == 0 &&
+			    strncmp(STATS_DESC[i], "- ", 2) != 0)
+				continue;
+			print_metric_entry(fp, "libica_bytes_total",
+					   reader->segs[j].uid, i,
+					   &entries[i].enc_bytes,
+					   &entries[i].dec_bytes);
+		}
+	}
+
+	fprintf(fp, "# EOF\n");
+}
+
+static int serve_write(int fd, const char *buf, size_t len)
+{
+	ssize_t rc;
+
+	while (len > 0) {
+		rc = send(fd, buf, len, MSG_NOSIGNAL);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += rc;
+		len -= rc;
+	}
+	return 0;
+}
+
+static void serve_response(int fd, const char *status, const char *type,
+			   const char *body, size_t len)
+{
+	char header[256];
+
+	snprintf(header, sizeof(header), "HTTP/1.0 %s\r\n"
+		 "Content-Type: %s\r\n"
+		 "Content-Length: %zu\r\n"
+		 "Connection: close\r\n\r\n", status, type, len);
+
+	if (serve_write(fd, header, strlen(header)) == 0)
+		serve_write(fd, body, len);
+}
+
+/* handles one HTTP request, only GET /metrics is supported */
+void serve_request(int fd, stats_reader_t *reader)
+{
+	char request[SERVE_REQUEST_MAX + 1], *body = NULL;
+	struct timeval timeout = { SERVE_TIMEOUT, 0 };
+	size_t len = 0, body_len = 0;
+	ssize_t rc;
+	FILE *fp;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	/* read the request header, the request line is all we need */
+	do {
+		rc = recv(fd, request + len, SERVE_REQUEST_MAX - len, 0);
+		if (rc <= 0)
+			return;
+		len += rc;
+		request[len] = 0;
+	} while (strstr(request, "\r\n\r\n") == NULL &&
+		 strstr(request, "\n\n") == NULL && len < SERVE_REQUEST_MAX);
+
+	if (strncmp(request, "GET ", 4) != 0) {
+		serve_response(fd, "405 Method Not Allowed", "text/plain",
+			       "", 0);
+		return;
+	}
+	if (strncmp(request + 4, "/metrics ", 9) != 0 &&
+	    strncmp(request + 4, "/ ", 2) != 0) {
+		serve_response(fd, "404 Not Found", "text/plain", "", 0);
+		return;
+	}
+
+	if (stats_reader_update(reader) ||
+	    (fp = open_memstream(&body, &body_len)) == NULL) {
+		serve_response(fd, "500 Internal Server Error", "text/plain",
+			       "", 0);
+		return;
+	}
+	print_metrics(fp, reader);
+	fclose(fp);
+
+	serve_response(fd, "200 OK", "application/openmetrics-text; "
+		       "version=1.0.0; charset=utf-8", body, body_len);
+	free(body);
+}
+
+/* Returns a listening socket for addr, see print_help, or -1 on error. */
+int serve_listen(const char *addr)
+{
+	struct addrinfo hints, *res, *ai;
+	char host[256] = "localhost";
+	const char *port = addr, *p;
+	struct sockaddr_un sun;
+	struct stat stat_buf;
+	int fd, rc, one = 1;
+
+	if (addr[0] == '/') {
+		if (strlen(addr) >= sizeof(sun.sun_path)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		strcpy(sun.sun_path, addr);
+
+		/* remove a stale socket of a previous run */
+		if (lstat(addr, &stat_buf) == 0 && S_ISSOCK(stat_buf.st_mode))
+			unlink(addr);
+
+		if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+			return -1;
+		if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) ||
+		    listen(fd, SOMAXCONN)) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	if ((p = strrchr(addr, ':')) != NULL) {
+		if ((size_t)(p - addr) >= sizeof(host)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		/* [<ipv6 address>]:<port> */
+		if (addr[0] == '[' && p > addr && p[-1] == ']')
+			snprintf(host, sizeof(host), "%.*s",
+				 (int)(p - addr - 2), addr + 1);
+		else
+			snprintf(host, sizeof(host), "%.*s",
+				 (int)(p - addr), addr);
+		port = p + 1;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if ((rc = getaddrinfo(host, port, &hints, &res)) != 0) {
+		fprintf(stderr, "%s: %s\n", addr, gai_strerror(rc));
+		errno = EINVAL;
+		return -1;
+	}
+
+	fd = -1;
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd == -1)
+			continue;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+		    listen(fd, SOMAXCONN) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+/* Serve the statistics until SIGINT or SIGTERM. The segments stay mapped
+ * between the requests.
+ */
+int serve_loop(const char *addr, int user)
+{
+	stats_reader_t reader;
+	struct sigaction sa;
+	int fd, conn, rc = EXIT_SUCCESS;
+
+	if (stats_reader_open(&reader, user == -1 ? STATS_READER_ALL : user)) {
+		perror("stats_reader_open: ");
+		return EXIT_FAILURE;
+	}
+
+	if ((fd = serve_listen(addr)) == -1) {
+		fprintf(stderr, "Could not listen on %s: %s\n", addr,
+			strerror(errno));
+		stats_reader_close(&reader);
+		return EXIT_FAILURE;
+	}
+
+	/* no SA_RESTART, so accept returns on a signal */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = serve_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while (!serve_stop) {
+		conn = accept(fd, NULL, NULL);
+		if (conn == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			perror("accept: ");
+			rc = EXIT_FAILURE;
+			break;
+		}
+		serve_request(conn, &reader);
+		close(conn);
+	}
+
+	close(fd);
+	if (addr[0] == '/')
+		unlink(addr);
+	stats_reader_close(&reader);
+	return rc;
+}
+
 static int first_usr;
 
 void print_json_header()
@@ -141,7 +774,21 @@ void print_json_header()
 	first_usr = 1;
 }
 
-void print_stats_json(stats_entry_t *stats, const char *usr)
+void print_latency_json(const char *name, const uint64_t *buckets)
+{
+	unsigned int j;
+
+	printf(",\n\t\t\t\t\t\"%s\": {", name);
+	for (j = 0; j < NUM_LATENCY_PERCENTILES; j++)
+		printf("%s\"%s\": %lu", j ? ", " : " ",
+		       LATENCY_PERCENTILE_DESC[j],
+		       stats_latency_percentile(buckets,
+						LATENCY_PERCENTILES[j]));
+	printf(" }");
+}
+
+void print_stats_json(stats_entry_t *stats, stats_latency_t *latency,
+		      const char *usr)
 {
 	unsigned int i;
 	const char *last_func = NULL;
@@ -175,8 +822,21 @@ void print_stats_json(stats_entry_t *stats, const char *usr)
 		if (i <= ICA_STATS_RSA_CRT_4096) {
 			printf("\t\t\t\t\t\"hw-crypt\": %lu,\n",
 			       stats[i].enc.hw);
-			printf("\t\t\t\t\t\"sw-crypt\": %lu\n",
+			printf("\t\t\t\t\t\"sw-crypt\": %lu",
 			       stats[i].enc.sw);
+			if (stats_counts_bytes(i)) {
+				printf(",\n\t\t\t\t\t\"hw-crypt-bytes\": %lu",
+				       stats[i].enc_bytes.hw);
+				printf(",\n\t\t\t\t\t\"sw-crypt-bytes\": %lu",
+				       stats[i].enc_bytes.sw);
+			}
+			/* latency percentiles in nanoseconds */
+			if (latency != NULL && i >= ICA_STATS_ECDH) {
+				print_latency_json("hw-latency-ns",
+						   latency[i].hw);
+				print_latency_json("sw-latency-ns",
+						   latency[i].sw);
+			}
 		} else {
 			printf("\t\t\t\t\t\"hw-enc\": %lu,\n",
 			       stats[i].enc.hw);
@@ -184,11 +844,19 @@ void print_stats_json(stats_entry_t *stats, const char *usr)
 			       stats[i].enc.sw);
 			printf("\t\t\t\t\t\"hw-dec\": %lu,\n",
 			       stats[i].dec.hw);
-			printf("\t\t\t\t\t\"sw-dec\": %lu\n",
+			printf("\t\t\t\t\t\"sw-dec\": %lu,\n",
 			       stats[i].dec.sw);
+			printf("\t\t\t\t\t\"hw-enc-bytes\": %lu,\n",
+			       stats[i].enc_bytes.hw);
+			printf("\t\t\t\t\t\"sw-enc-bytes\": %lu,\n",
+			       stats[i].enc_bytes.sw);
+			printf("\t\t\t\t\t\"hw-dec-bytes\": %lu,\n",
+			       stats[i].dec_bytes.hw);
+			printf("\t\t\t\t\t\"sw-dec-bytes\": %lu",
+			       stats[i].dec_bytes.sw);
 		}
 
-		printf("\t\t\t\t}");
+		printf("\n\t\t\t\t}");
 	}
 
 	printf("\n\t\t\t]\n\t\t}");
@@ -212,6 +880,14 @@ int main(int argc, char *argv[])
 	int all = 0;
 	int key_sizes = 0;
 	int json = 0;
+	int bytes = 0;
+	int latency = 0;
+	long interval = 0;
+	char *serve = NULL;
+	long top = 0;
+	int events = 0;
+	char *endptr;
+	stats_latency_t *lat = NULL;
 	struct passwd *pswd;
 
 	while ((rc = getopt_long(argc, argv, getopt_string,
@@ -256,6 +932,35 @@ int main(int argc, char *argv[])
 		case 'k':
 			key_sizes = 1;
 			break;
+		case 'b':
+			bytes = 1;
+			break;
+		case 'l':
+			latency = 1;
+			break;
+		case 'i':
+			interval = strtol(optarg, &endptr, 10);
+			if (*endptr != '\0' || interval < 1 ||
+			    interval > 3600) {
+				fprintf(stderr, "Invalid interval %s, expected"
+					" 1 to 3600 seconds.\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 't':
+			top = strtol(optarg, &endptr, 10);
+			if (*endptr != '\0' || top < 1) {
+				fprintf(stderr, "Invalid number of processes"
+					" %s.\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'e':
+			events = 1;
+			break;
+		case 's':
+			serve = optarg;
+			break;
 		case 'j':
 			json = 1;
 			break;
@@ -281,6 +986,12 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	if (latency && (lat = malloc(sizeof(stats_latency_t)*ICA_NUM_STATS))
+	    == NULL) {
+		perror("malloc: ");
+		return EXIT_FAILURE;
+	}
+
 	if (delete == 2) {
 		if (delete_all() == -1) {
 			perror("deleteall: ");
@@ -292,6 +1003,34 @@ int main(int argc, char *argv[])
 		stats_munmap(user, SHM_DESTROY);
 		return EXIT_SUCCESS;
 	}
+	if (serve)
+		return serve_loop(serve, user);
+
+	if (interval) {
+		if (json) {
+			fprintf(stderr, "The --interval option does not support"
+				" the JSON output format.\n");
+			return EXIT_FAILURE;
+		}
+		/* the own segment is created, as without --interval */
+		if (!all && !sum)
+			stats_mmap(user);
+		return print_rates_loop(user, all, sum, interval, key_sizes);
+	}
+
+	if ((top || events) && all) {
+		char *usr;
+
+		while ((usr = get_next_usr()) != NULL) {
+			printf("user: %s\n", usr);
+			if (top)
+				print_top(top);
+			else
+				print_events();
+		}
+		return EXIT_SUCCESS;
+	}
+
 	if (all) {
 		char *usr;
 		stats_entry_t *entries;
@@ -303,11 +1042,15 @@ int main(int argc, char *argv[])
 				return EXIT_FAILURE;
 			}
 			get_stats_data(entries);
+			if (lat)
+				get_stats_latency(lat);
 			if (json) {
-				print_stats_json(entries, usr);
+				print_stats_json(entries, lat, usr);
 			} else {
 				printf("user: %s\n", usr);
-				print_stats(entries, key_sizes);
+				print_stats(entries, key_sizes, bytes);
+				if (lat)
+					print_latency(lat, key_sizes);
 			}
 			free(entries);
 		}
@@ -323,16 +1066,18 @@ int main(int argc, char *argv[])
 			return EXIT_FAILURE;
 		}
 
-		if (!get_stats_sum(entries)) {
+		if (!get_stats_sum(entries, lat)) {
 			perror("get_stats_sum: ");
 			return EXIT_FAILURE;
 		}
 		if (json) {
 			print_json_header();
-			print_stats_json(entries, "all users");
+			print_stats_json(entries, lat, "all users");
 			print_json_footer();
 		} else {
-			print_stats(entries, key_sizes);
+			print_stats(entries, key_sizes, bytes);
+			if (lat)
+				print_latency(lat, key_sizes);
 		}
 		return EXIT_SUCCESS;
 	}
@@ -352,6 +1097,10 @@ int main(int argc, char *argv[])
 
 	if (reset) {
 		stats_reset();
+	} else if (top) {
+		return print_top(top);
+	} else if (events) {
+		return print_events();
 	} else {
 		stats_entry_t *stats;
 		if ((stats = malloc(sizeof(stats_entry_t)*ICA_NUM_STATS)) == NULL) {
@@ -359,6 +1108,8 @@ int main(int argc, char *argv[])
 			return EXIT_FAILURE;
 		}
 		get_stats_data(stats);
+		if (lat)
+			get_stats_latency(lat);
 		if (json) {
 			pswd = getpwuid(user == -1 ? geteuid() : (uid_t)user);
 			if (pswd == NULL) {
@@ -366,10 +1117,12 @@ int main(int argc, char *argv[])
 				return EXIT_FAILURE;
 			}
 			print_json_header();
-			print_stats_json(stats, pswd->pw_name);
+			print_stats_json(stats, lat, pswd->pw_name);
 			print_json_footer();
 		} else {
-			print_stats(stats, key_sizes);
+			print_stats(stats, key_sizes, bytes);
+			if (lat)
+				print_latency(lat, key_sizes);
 		}
 
 	}
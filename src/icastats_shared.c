@@ -19,17 +19,70 @@
 #include <unistd.h>
 #include <pwd.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/file.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <pthread.h>
 #include "icastats.h"
 #include "init.h"
+#include "s390_crypto.h"
 
-#define NAME_LENGHT 20
+#define NAME_LENGHT 32
 
-static stats_entry_t *stats = NULL;
+static stats_shm_t *stats = NULL;
+
+/* returns the address of the counter selected by hardware and direction */
+static inline uint64_t *stats_counter(stats_entry_t *entry, int hardware,
+				      int direction)
+{
+	if (direction == ENCRYPT)
+		return hardware == ALGO_HW ? &entry->enc.hw : &entry->enc.sw;
+	else
+		return hardware == ALGO_HW ? &entry->dec.hw : &entry->dec.sw;
+}
+
+/* returns the address of the byte counter selected by hardware and direction */
+static inline uint64_t *stats_bytes_counter(stats_entry_t *entry, int hardware,
+					    int direction)
+{
+	if (direction == ENCRYPT)
+		return hardware == ALGO_HW ? &entry->enc_bytes.hw :
+					     &entry->enc_bytes.sw;
+	else
+		return hardware == ALGO_HW ? &entry->dec_bytes.hw :
+					     &entry->dec_bytes.sw;
+}
+
+/* add all counters of one stats entry to another */
+static inline void stats_entry_add(stats_entry_t *sum,
+				   const stats_entry_t *entry)
+{
+	sum->enc.hw += entry->enc.hw;
+	sum->enc.sw += entry->enc.sw;
+	sum->dec.hw += entry->dec.hw;
+	sum->dec.sw += entry->dec.sw;
+	sum->enc_bytes.hw += entry->enc_bytes.hw;
+	sum->enc_bytes.sw += entry->enc_bytes.sw;
+	sum->dec_bytes.hw += entry->dec_bytes.hw;
+	sum->dec_bytes.sw += entry->dec_bytes.sw;
+}
+
+/* Add all shards of a shared memory segment to a stats_entry_t array.
+ * Each counter is read atomically on its own, but writers are not stopped
+ * while the shards are summed up, see stats_shard_t for why that is fine.
+ */
+static void stats_shards_sum(const stats_shm_t *shm, stats_entry_t *sum)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < STATS_SHARDS; i++) {
+		for (j = 0; j < ICA_NUM_STATS; j++)
+			stats_entry_add(&sum[j], &shm->shards[i].entries[j]);
+	}
+}
 
 /* map shared memory segment for statistics
  * Arguments:
@@ -51,7 +104,7 @@ int stats_mmap(int user)
 	if (stats != NULL)
 		return 0;
 
-	sprintf(shm_id, "icastats_%d",
+	sprintf(shm_id, STATS_SHM_PREFIX "%d",
 		user == -1 ? geteuid() : (uid_t)user);
 
 	stats_shm_handle = shm_open(shm_id,
@@ -68,21 +121,26 @@ int stats_mmap(int user)
 	if (fstat(stats_shm_handle, &stat_buf))
 		goto end;
 
-	if (ftruncate(stats_shm_handle, STATS_SHM_SIZE) == -1)
+	/* A segment in use is never resized: a new segment is empty and gets
+	 * zero filled by ftruncate, any other size is not our layout.
+	 */
+	if (stat_buf.st_size == 0) {
+		if (ftruncate(stats_shm_handle, STATS_SHM_SIZE) == -1)
+			goto end;
+	} else if (stat_buf.st_size != STATS_SHM_SIZE) {
+		errno = EINVAL;
 		goto end;
+	}
 
-	stats = (stats_entry_t *) mmap(NULL, STATS_SHM_SIZE, PROT_READ |
-					 PROT_WRITE, MAP_SHARED,
-					 stats_shm_handle, 0);
+	stats = (stats_shm_t *) mmap(NULL, STATS_SHM_SIZE, PROT_READ |
+				       PROT_WRITE, MAP_SHARED,
+				       stats_shm_handle, 0);
 
 	if (stats == MAP_FAILED) {
 		stats = NULL;
 		goto end;
 	}
 
-	if (stat_buf.st_size != STATS_SHM_SIZE)
-		memset(stats, 0, STATS_SHM_SIZE);
-
 	rc = 0;
 end:
 	close(stats_shm_handle);
@@ -108,7 +166,7 @@ void stats_munmap(int user, int unlink)
 	if (unlink == SHM_DESTROY) {
 		char shm_id[NAME_LENGHT];
 
-		sprintf(shm_id, "icastats_%d",
+		sprintf(shm_id, STATS_SHM_PREFIX "%d",
 			user == -1 ? geteuid() : (uid_t)user);
 
 		shm_unlink(shm_id);
@@ -125,133 +183,345 @@ void stats_munmap(int user, int unlink)
 
 uint64_t stats_query(stats_fields_t field, int hardware, int direction)
 {
+	unsigned int i;
+	uint64_t sum = 0;
+
 	if (stats == NULL)
 		return 0;
 
-	if (direction == ENCRYPT)
-		if (hardware == ALGO_HW)
-			return stats[field].enc.hw;
-		else
-			return stats[field].enc.sw;
-	else
-		if (hardware == ALGO_HW)
-			return stats[field].dec.hw;
-		else
-			return stats[field].dec.sw;
+	for (i = 0; i < STATS_SHARDS; i++)
+		sum += *stats_counter(&stats->shards[i].entries[field],
+				      hardware, direction);
+
+	return sum;
 }
 
-static uint64_t calc_summary(stats_fields_t start, unsigned int num,
-		             int hardware, int direction)
+/* query the processed bytes of a specific field
+ * arguments: see stats_query
+ */
+
+uint64_t stats_query_bytes(stats_fields_t field, int hardware, int direction)
 {
 	unsigned int i;
 	uint64_t sum = 0;
 
-	for (i = 0; i < num; i++)
-		sum += stats_query(start + i, hardware, direction);
+	if (stats == NULL)
+		return 0;
+
+	for (i = 0; i < STATS_SHARDS; i++)
+		sum += *stats_bytes_counter(&stats->shards[i].entries[field],
+					    hardware, direction);
 
 	return sum;
 }
 
+/* Returns the number of consecutive fields shown accumulated as field,
+ * starting at *start. Entries with key size subentries are shown as the sum
+ * of their subentries.
+ */
+static unsigned int stats_group(unsigned int field, unsigned int *start)
+{
+	*start = field + 1;
+
+	switch (field) {
+	case ICA_STATS_AES_ECB:
+	case ICA_STATS_AES_CBC:
+	case ICA_STATS_AES_OFB:
+	case ICA_STATS_AES_CFB:
+	case ICA_STATS_AES_CTR:
+	case ICA_STATS_AES_CMAC:
+	case ICA_STATS_AES_GCM:
+		return 3;
+
+	case ICA_STATS_AES_XTS:
+		return 2;
+
+	case ICA_STATS_RSA_ME:
+	case ICA_STATS_RSA_CRT:
+		return 4;
+
+	case ICA_STATS_ECDH:
+	case ICA_STATS_ECDSA_SIGN:
+	case ICA_STATS_ECDSA_VERIFY:
+	case ICA_STATS_ECKGEN:
+		return 8;
+
+	default:
+		*start = field;
+		return 1;
+	}
+}
+
+/* takes a snapshot of a shared memory segment, grouped for display
+ * @entries - Needs to be a array of size ICA_NUM_STATS.
+ */
+static void stats_snapshot(const stats_shm_t *shm, stats_entry_t *entries)
+{
+	stats_entry_t raw[ICA_NUM_STATS];
+	unsigned int i, j, start, num;
+
+	memset(raw, 0, sizeof(raw));
+	memset(entries, 0, sizeof(stats_entry_t) * ICA_NUM_STATS);
+
+	if (shm == NULL)
+		return;
+
+	stats_shards_sum(shm, raw);
+
+	for (i = 0; i < ICA_NUM_STATS; i++) {
+		num = stats_group(i, &start);
+		for (j = 0; j < num; j++)
+			stats_entry_add(&entries[i], &raw[start + j]);
+	}
+}
+
 /* Returns the statistic data in a stats_entry_t array
  * @entries - Needs to be a array of size ICA_NUM_STATS.
  */
 void get_stats_data(stats_entry_t *entries)
+{
+	stats_snapshot(stats, entries);
+}
+
+/* add one latency histogram to another */
+static void stats_latency_add(stats_latency_t *sum,
+			      const stats_latency_t *latency)
 {
 	unsigned int i;
+
+	for (i = 0; i < STATS_LAT_BUCKETS; i++) {
+		sum->hw[i] += latency->hw[i];
+		sum->sw[i] += latency->sw[i];
+	}
+}
+
+/* Returns the latency histograms in a stats_latency_t array, grouped
+ * like get_stats_data.
+ * @latency - Needs to be a array of size ICA_NUM_STATS.
+ */
+void get_stats_latency(stats_latency_t *latency)
+{
+	unsigned int i, j, start, num;
+
+	memset(latency, 0, sizeof(stats_latency_t) * ICA_NUM_STATS);
+
+	if (stats == NULL)
+		return;
+
 	for (i = 0; i < ICA_NUM_STATS; i++) {
-		switch (i) {
-		case ICA_STATS_AES_ECB:
-		case ICA_STATS_AES_CBC:
-		case ICA_STATS_AES_OFB:
-		case ICA_STATS_AES_CFB:
-		case ICA_STATS_AES_CTR:
-		case ICA_STATS_AES_CMAC:
-		case ICA_STATS_AES_GCM:
-			entries[i].enc.hw = calc_summary(i + 1, 3,
-					                 ALGO_HW, ENCRYPT);
-			entries[i].enc.sw = calc_summary(i + 1, 3,
-					                 ALGO_SW, ENCRYPT);
-			entries[i].dec.hw = calc_summary(i + 1, 3,
-					                 ALGO_HW, DECRYPT);
-			entries[i].dec.sw = calc_summary(i + 1, 3,
-					                 ALGO_SW, DECRYPT);
-			break;
+		num = stats_group(i, &start);
+		for (j = 0; j < num; j++)
+			stats_latency_add(&latency[i],
+					  &stats->latency[start + j]);
+	}
+}
 
-		case ICA_STATS_AES_XTS:
-			entries[i].enc.hw = calc_summary(i + 1, 2,
-					                 ALGO_HW, ENCRYPT);
-			entries[i].enc.sw = calc_summary(i + 1, 2,
-					                 ALGO_SW, ENCRYPT);
-			entries[i].dec.hw = calc_summary(i + 1, 2,
-					                 ALGO_HW, DECRYPT);
-			entries[i].dec.sw = calc_summary(i + 1, 2,
-					                 ALGO_SW, DECRYPT);
-			break;
+/* Reads start time and (optionally) command name of a process from
+ * /proc/<pid>/stat, see proc(5).
+ * Return value:
+ *  0 - Success
+ * -1 - Error, e.g. the process does not exist (anymore)
+ */
+static int stats_proc_stat(pid_t pid, uint64_t *start_time, char *comm)
+{
+	char path[32], buf[512], *p, *q;
+	unsigned int i;
+	ssize_t len;
+	int fd;
 
-		case ICA_STATS_RSA_ME:
-		case ICA_STATS_RSA_CRT:
-			entries[i].enc.hw = calc_summary(i + 1, 4,
-					                 ALGO_HW, ENCRYPT);
-			entries[i].enc.sw = calc_summary(i + 1, 4,
-					                 ALGO_SW, ENCRYPT);
-			entries[i].dec.hw = calc_summary(i + 1, 4,
-					                 ALGO_HW, DECRYPT);
-			entries[i].dec.sw = calc_summary(i + 1, 4,
-					                 ALGO_SW, DECRYPT);
-			break;
+	sprintf(path, "/proc/%d/stat", pid);
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return -1;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = 0;
 
-		case ICA_STATS_ECDH:
-		case ICA_STATS_ECDSA_SIGN:
-		case ICA_STATS_ECDSA_VERIFY:
-		case ICA_STATS_ECKGEN:
-			entries[i].enc.hw = calc_summary(i + 1, 8,
-					                 ALGO_HW, ENCRYPT);
-			entries[i].enc.sw = calc_summary(i + 1, 8,
-					                 ALGO_SW, ENCRYPT);
-			entries[i].dec.hw = calc_summary(i + 1, 8,
-					                 ALGO_HW, DECRYPT);
-			entries[i].dec.sw = calc_summary(i + 1, 8,
-					                 ALGO_SW, DECRYPT);
-			break;
+	/* the command name is in parentheses and may contain any character */
+	p = strchr(buf, '(');
+	q = strrchr(buf, ')');
+	if (p == NULL || q == NULL || q < p)
+		return -1;
+	if (comm != NULL) {
+		memset(comm, 0, STATS_COMM_LEN);
+		memcpy(comm, p + 1, q - p - 1 < STATS_COMM_LEN - 1 ?
+				    q - p - 1 : STATS_COMM_LEN - 1);
+	}
 
-		default:
-			entries[i].enc.hw = stats_query(i, ALGO_HW, ENCRYPT);
-			entries[i].enc.sw = stats_query(i, ALGO_SW, ENCRYPT);
-			entries[i].dec.hw = stats_query(i, ALGO_HW, DECRYPT);
-			entries[i].dec.sw = stats_query(i, ALGO_SW, DECRYPT);
-			break;
+	/* starttime is field 22, the 20th after the command name */
+	for (p = q + 1, i = 0; i < 19 && p != NULL; i++)
+		p = strchr(p + 1, ' ');
+	if (p == NULL)
+		return -1;
+	*start_time = strtoull(p + 1, NULL, 10);
+	return 0;
+}
+
+/* a pid may have been reused by another process */
+static int stats_proc_alive(pid_t pid, uint64_t start_time)
+{
+	uint64_t t;
+
+	return stats_proc_stat(pid, &t, NULL) == 0 && t == start_time;
+}
+
+/* Returns the number of used process slots and their summaries
+ * @procs - Needs to be a array of size STATS_PROC_SLOTS.
+ */
+unsigned int get_stats_procs(stats_proc_info_t *procs)
+{
+	const stats_proc_shard_t *shard;
+	const stats_proc_t *proc;
+	stats_proc_info_t *info;
+	unsigned int i, j, k, num = 0;
+	uint64_t ops, top;
+
+	if (stats == NULL)
+		return 0;
+
+	for (i = 0; i < STATS_PROC_SLOTS; i++) {
+		proc = &stats->procs[i];
+		/* free or just being claimed */
+		if (proc->pid <= 0 || proc->start_time == 0)
+			continue;
+
+		info = &procs[num++];
+		memset(info, 0, sizeof(*info));
+		info->pid = proc->pid;
+		info->start_time = proc->start_time;
+		memcpy(info->comm, proc->comm, STATS_COMM_LEN);
+		info->comm[STATS_COMM_LEN - 1] = 0;
+		info->alive = stats_proc_alive(info->pid, info->start_time);
+		info->top_field = -1;
+
+		for (j = 0, top = 0; j < ICA_NUM_STATS; j++) {
+			for (k = 0, ops = 0; k < STATS_PROC_SHARDS; k++) {
+				shard = &proc->shards[k];
+				info->ops.hw += shard->ops[j].hw;
+				info->ops.sw += shard->ops[j].sw;
+				info->bytes.hw += shard->bytes[j].hw;
+				info->bytes.sw += shard->bytes[j].sw;
+				ops += shard->ops[j].hw + shard->ops[j].sw;
+			}
+
+			if (ops > top) {
+				top = ops;
+				info->top_field = j;
+			}
 		}
 	}
+	return num;
 }
 
+/* Returns the number of recorded fallback events, oldest first
+ * @events - Needs to be a array of size STATS_EVENTS.
+ * @lost - NULL or the number of events overwritten before they were read
+ */
+unsigned int get_stats_events(stats_event_t *events, uint64_t *lost)
+{
+	const stats_event_t *event;
+	uint64_t head, tail, seq, first;
+	unsigned int num = 0;
+
+	if (lost != NULL)
+		*lost = 0;
+
+	if (stats == NULL)
+		return 0;
+
+	tail = stats->events.tail;
+	head = stats->events.head;
+	if (tail > head)
+		tail = head;
+	first = head - tail > STATS_EVENTS ? head - STATS_EVENTS : tail;
+
+	for (seq = first; seq < head; seq++) {
+		event = &stats->events.ring[seq % STATS_EVENTS];
+		if (event->seq != seq + 1)
+			goto skip;
+		__sync_synchronize();
+		events[num] = *event;
+		__sync_synchronize();
+		/* overwritten or still being written */
+		if (event->seq != seq + 1 || events[num].seq != seq + 1)
+			goto skip;
+		num++;
+		continue;
+skip:
+		if (lost != NULL)
+			(*lost)++;
+	}
+
+	if (lost != NULL)
+		*lost += first - tail;
+	return num;
+}
+
+/* Returns the upper bound in nanoseconds of the histogram bucket, which
+ * contains the given percentile, e.g. per_mille = 990 for p99.
+ * Returns 0 if the histogram is empty.
+ * @buckets - array of size STATS_LAT_BUCKETS
+ */
+uint64_t stats_latency_percentile(const uint64_t *buckets,
+				  unsigned int per_mille)
+{
+	uint64_t total = 0, rank, n = 0;
+	unsigned int i;
 
+	for (i = 0; i < STATS_LAT_BUCKETS; i++)
+		total += buckets[i];
+
+	if (total == 0)
+		return 0;
+
+	/* rank of the percentile, rounded up */
+	rank = (total * per_mille + 999) / 1000;
+	if (rank == 0)
+		rank = 1;
+
+	for (i = 0; i < STATS_LAT_BUCKETS - 1; i++) {
+		n += buckets[i];
+		if (n >= rank)
+			break;
+	}
+
+	return 2ULL << i;
+}
 
 /* get the statistic data from all shared memory segments
  * accumulated in one variable
  * @sum: sum must be array of the size of ICA_NUM_STATS
- * After a call to this function sum contains the accumulated
+ * @latency: NULL or array of the size of ICA_NUM_STATS
+ * After a call to this function sum and latency contain the accumulated
  * data of all shared memory segments.
  * Return value:
  * 1 - Success
  * 0 - Error, check errno!
  */
 
-int get_stats_sum(stats_entry_t *sum)
+int get_stats_sum(stats_entry_t *sum, stats_latency_t *latency)
 {
-	unsigned int i;
 	struct dirent *direntp;
+	struct stat stat_buf;
 	DIR *shmDir;
 
+	unsigned int i;
+
 	memset(sum, 0, sizeof(stats_entry_t)*ICA_NUM_STATS);
+	if (latency != NULL)
+		memset(latency, 0, sizeof(stats_latency_t)*ICA_NUM_STATS);
 	if ((shmDir = opendir("/dev/shm")) == NULL)
 		return 0;
 
 	while ((direntp = readdir(shmDir)) != NULL) {
-		if (strstr(direntp->d_name, "icastats_") != NULL) {
+		if (strncmp(direntp->d_name, STATS_SHM_PREFIX,
+			    STATS_SHM_PREFIX_LEN) == 0) {
+			uid_t uid = atoi(&direntp->d_name[STATS_SHM_PREFIX_LEN]);
+			stats_shm_t *tmp;
 			int fd;
-			stats_entry_t *tmp;
 
-			if ((getpwuid(atoi(&direntp->d_name[9]))) == NULL) {
+			if (getpwuid(uid) == NULL) {
 				closedir(shmDir);
 				return 0;
 			}
@@ -260,20 +530,23 @@ int get_stats_sum(stats_entry_t *sum)
 				closedir(shmDir);
 				return 0;
 			}
-			if ((tmp = (stats_entry_t *)mmap(NULL, STATS_SHM_SIZE,
-						    PROT_READ, MAP_SHARED,
-						    fd, 0)) == MAP_FAILED) {
+			/* skip segments not resized yet */
+			if (fstat(fd, &stat_buf) ||
+			    stat_buf.st_size != STATS_SHM_SIZE) {
+				close(fd);
+				continue;
+			}
+			if ((tmp = (stats_shm_t *)mmap(NULL, STATS_SHM_SIZE,
+						  PROT_READ, MAP_SHARED,
+						  fd, 0)) == MAP_FAILED) {
 				closedir(shmDir);
 				close(fd);
 				return 0;
 			}
 
-			for (i = 0; i<ICA_NUM_STATS; ++i) {
-				sum[i].enc.hw += tmp[i].enc.hw;
-				sum[i].enc.sw += tmp[i].enc.sw;
-				sum[i].dec.hw += tmp[i].dec.hw;
-				sum[i].dec.sw += tmp[i].dec.sw;
-			}
+			stats_shards_sum(tmp, sum);
+			for (i = 0; latency != NULL && i < ICA_NUM_STATS; i++)
+				stats_latency_add(&latency[i], &tmp->latency[i]);
 			munmap(tmp, STATS_SHM_SIZE);
 			close(fd);
 		}
@@ -307,8 +580,9 @@ char *get_next_usr()
 			return NULL;
 	}
 	while ((direntp = readdir(shmDir)) != NULL) {
-		if (strstr(direntp->d_name, "icastats_") != NULL) {
-			int uid = atoi(&direntp->d_name[9]);
+		if (strncmp(direntp->d_name, STATS_SHM_PREFIX,
+			    STATS_SHM_PREFIX_LEN) == 0) {
+			int uid = atoi(&direntp->d_name[STATS_SHM_PREFIX_LEN]);
 			struct passwd *pwd;
 			if ((pwd = getpwuid(uid)) == NULL)
 				return NULL;
@@ -325,7 +599,346 @@ char *get_next_usr()
 	return NULL;
 }
 
+/* maps the shared memory segment of a user read-only
+ * Return value: the mapped segment or NULL, see errno for errorcode
+ */
+static stats_shm_t *stats_mmap_ro(uid_t uid, ino_t *ino)
+{
+	char shm_id[NAME_LENGHT];
+	struct stat stat_buf;
+	stats_shm_t *shm;
+	int fd;
+
+	sprintf(shm_id, STATS_SHM_PREFIX "%d", uid);
+
+	if ((fd = shm_open(shm_id, O_RDONLY, 0)) == -1)
+		return NULL;
+
+	/* segments not resized yet can not be read */
+	if (fstat(fd, &stat_buf) || stat_buf.st_size != STATS_SHM_SIZE) {
+		close(fd);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	shm = (stats_shm_t *)mmap(NULL, STATS_SHM_SIZE, PROT_READ, MAP_SHARED,
+				  fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return NULL;
+
+	*ino = stat_buf.st_ino;
+	return shm;
+}
+
+/* maps the segment of a user and takes its first snapshot */
+static int stats_reader_add(stats_reader_t *reader, uid_t uid)
+{
+	stats_reader_seg_t *segs, *seg;
+	stats_shm_t *shm;
+	ino_t ino;
+
+	if ((shm = stats_mmap_ro(uid, &ino)) == NULL)
+		return -1;
+
+	segs = realloc(reader->segs, (reader->num + 1) * sizeof(*segs));
+	if (segs == NULL) {
+		munmap(shm, STATS_SHM_SIZE);
+		return -1;
+	}
+	reader->segs = segs;
+
+	seg = &segs[reader->num++];
+	seg->uid = uid;
+	seg->ino = ino;
+	seg->seen = 1;
+	seg->shm = shm;
+	stats_snapshot(shm, seg->cur);
+	memcpy(seg->prev, seg->cur, sizeof(seg->prev));
+	return 0;
+}
+
+static void stats_reader_del(stats_reader_t *reader, unsigned int i)
+{
+	munmap(reader->segs[i].shm, STATS_SHM_SIZE);
+	reader->num--;
+	memmove(&reader->segs[i], &reader->segs[i + 1],
+		(reader->num - i) * sizeof(*reader->segs));
+}
+
+/* Maps the segments of new users and unmaps deleted segments. The
+ * directory is only read if it changed since the last scan.
+ */
+static int stats_reader_scan(stats_reader_t *reader)
+{
+	struct dirent *direntp;
+	struct stat stat_buf;
+	unsigned int i;
+	DIR *shmDir;
+	uid_t uid;
+
+	if (stat("/dev/shm", &stat_buf))
+		return -1;
+
+	if (stat_buf.st_mtim.tv_sec == reader->dir_mtime.tv_sec &&
+	    stat_buf.st_mtim.tv_nsec == reader->dir_mtime.tv_nsec)
+		return 0;
+	reader->dir_mtime = stat_buf.st_mtim;
+
+	if ((shmDir = opendir("/dev/shm")) == NULL)
+		return -1;
+
+	for (i = 0; i < reader->num; i++)
+		reader->segs[i].seen = 0;
+
+	while ((direntp = readdir(shmDir)) != NULL) {
+		if (strncmp(direntp->d_name, STATS_SHM_PREFIX,
+			    STATS_SHM_PREFIX_LEN) != 0)
+			continue;
+
+		uid = atoi(&direntp->d_name[STATS_SHM_PREFIX_LEN]);
+		for (i = 0; i < reader->num; i++) {
+			if (reader->segs[i].uid == uid)
+				break;
+		}
+		/* a segment deleted and created again gets a new inode */
+		if (i < reader->num && reader->segs[i].ino == direntp->d_ino) {
+			reader->segs[i].seen = 1;
+			continue;
+		}
+		if (i < reader->num)
+			stats_reader_del(reader, i);
+
+		/* a new segment may not be resized yet, retry next time */
+		if (stats_reader_add(reader, uid) && errno == EAGAIN)
+			memset(&reader->dir_mtime, 0,
+			       sizeof(reader->dir_mtime));
+	}
+	closedir(shmDir);
+
+	for (i = 0; i < reader->num; ) {
+		if (reader->segs[i].seen)
+			i++;
+		else
+			stats_reader_del(reader, i);
+	}
+	return 0;
+}
+
+/* Maps the segment of the user of a single user reader again if it was
+ * deleted or created again since the last check. A user without a segment
+ * has no counters, so the reader is just left without a segment then.
+ */
+static int stats_reader_check(stats_reader_t *reader)
+{
+	char shm_path[sizeof("/dev/shm/") + NAME_LENGHT];
+	struct stat stat_buf;
+	uid_t uid = (uid_t)reader->user;
+
+	sprintf(shm_path, "/dev/shm/" STATS_SHM_PREFIX "%d", uid);
+
+	if (stat(shm_path, &stat_buf)) {
+		if (errno != ENOENT)
+			return -1;
+		if (reader->num > 0)
+			stats_reader_del(reader, 0);
+		return 0;
+	}
+
+	if (reader->num > 0) {
+		if (reader->segs[0].ino == stat_buf.st_ino)
+			return 0;
+		stats_reader_del(reader, 0);
+	}
+
+	/* a new segment may not be resized yet, retry next time */
+	if (stats_reader_add(reader, uid) && errno != EAGAIN &&
+	    errno != ENOENT)
+		return -1;
+	return 0;
+}
+
+/* Open a persistent reader
+ * Arguments:
+ * @user: uid of the segment to read, -1 for the segment of the same user,
+ * STATS_READER_ALL for the segments of all users. Segments showing up,
+ * deleted or created again later are picked up by stats_reader_update, so
+ * a missing segment is not an error.
+ * Return value:
+ *  0 - Success
+ * -1 - Error: See errno for errorcode
+ */
+
+int stats_reader_open(stats_reader_t *reader, int user)
+{
+	memset(reader, 0, sizeof(*reader));
+	reader->user = user == -1 ? (int)geteuid() : user;
+
+	if (user == STATS_READER_ALL)
+		return stats_reader_scan(reader);
+
+	return stats_reader_check(reader);
+}
+
+/* Take a new snapshot of all segments of a reader, the last snapshot is
+ * kept in the prev member of each segment.
+ * Return value:
+ *  0 - Success
+ * -1 - Error: See errno for errorcode
+ */
+
+int stats_reader_update(stats_reader_t *reader)
+{
+	unsigned int i;
+
+	if (reader->user == STATS_READER_ALL) {
+		if (stats_reader_scan(reader))
+			return -1;
+	} else if (stats_reader_check(reader)) {
+		return -1;
+	}
+
+	for (i = 0; i < reader->num; i++) {
+		memcpy(reader->segs[i].prev, reader->segs[i].cur,
+		       sizeof(reader->segs[i].prev));
+		stats_snapshot(reader->segs[i].shm, reader->segs[i].cur);
+	}
+	return 0;
+}
+
+void stats_reader_close(stats_reader_t *reader)
+{
+	while (reader->num > 0)
+		stats_reader_del(reader, reader->num - 1);
+
+	free(reader->segs);
+	reader->segs = NULL;
+}
+
 #ifndef ICASTATS
+/* shard index of the calling thread, -1 until first use */
+static __thread int stats_shard = -1;
+
+/* Returns the calling thread's shard.
+ * Thread ids are unique system wide, so concurrently running threads of
+ * all processes of a user are spread evenly over the shards.
+ */
+static inline stats_shard_t *stats_own_shard(void)
+{
+	if (stats_shard < 0)
+		stats_shard = (unsigned int)syscall(SYS_gettid) % STATS_SHARDS;
+
+	return &stats->shards[stats_shard];
+}
+
+/* slot of the calling process, see stats_proc_count */
+#define STATS_PROC_UNREGISTERED	-1
+#define STATS_PROC_NONE		-2
+
+static int stats_proc_slot = STATS_PROC_UNREGISTERED;
+static pthread_mutex_t stats_proc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* a forked child has to claim its own slot */
+static void stats_proc_atfork_child(void)
+{
+	stats_proc_slot = STATS_PROC_UNREGISTERED;
+	pthread_mutex_init(&stats_proc_mutex, NULL);
+}
+
+/* claims a slot, which currently belongs to pid old (0 if free) */
+static int stats_proc_claim(stats_proc_t *proc, int32_t old, int32_t pid,
+			    uint64_t start_time, const char *comm)
+{
+	if (!__sync_bool_compare_and_swap(&proc->pid, old, pid))
+		return 0;
+
+	/* readers skip the slot until the start time is set */
+	proc->start_time = 0;
+	__sync_synchronize();
+	memset(proc->shards, 0, sizeof(proc->shards));
+	memcpy(proc->comm, comm, STATS_COMM_LEN);
+	__sync_synchronize();
+	proc->start_time = start_time;
+	return 1;
+}
+
+/* Claims a slot for the calling process: a free one or, if there is none,
+ * one of an exited process. If all slots belong to running processes, the
+ * process is not counted per process.
+ */
+static int stats_proc_register(void)
+{
+	static int atfork_registered;
+	char comm[STATS_COMM_LEN];
+	uint64_t start_time;
+	stats_proc_t *proc;
+	int32_t pid, other;
+	int i;
+
+	pthread_mutex_lock(&stats_proc_mutex);
+
+	if (stats_proc_slot != STATS_PROC_UNREGISTERED)
+		goto out;
+
+	if (!atfork_registered) {
+		pthread_atfork(NULL, NULL, stats_proc_atfork_child);
+		atfork_registered = 1;
+	}
+
+	stats_proc_slot = STATS_PROC_NONE;
+	pid = getpid();
+	if (stats_proc_stat(pid, &start_time, comm))
+		goto out;
+
+	for (i = 0; i < STATS_PROC_SLOTS; i++) {
+		proc = &stats->procs[i];
+		if (proc->pid == 0 &&
+		    stats_proc_claim(proc, 0, pid, start_time, comm)) {
+			stats_proc_slot = i;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < STATS_PROC_SLOTS; i++) {
+		proc = &stats->procs[i];
+		other = proc->pid;
+		if (other <= 0 || proc->start_time == 0 ||
+		    stats_proc_alive(other, proc->start_time))
+			continue;
+		if (stats_proc_claim(proc, other, pid, start_time, comm)) {
+			stats_proc_slot = i;
+			goto out;
+		}
+	}
+out:
+	i = stats_proc_slot;
+	pthread_mutex_unlock(&stats_proc_mutex);
+	return i;
+}
+
+/* counts an operation in the slot of the calling process, on the slot
+ * shard of the calling thread, see stats_own_shard
+ */
+static void stats_proc_count(stats_fields_t field, int hardware,
+			     uint64_t bytes)
+{
+	stats_proc_shard_t *shard;
+	int slot = stats_proc_slot;
+
+	if (slot == STATS_PROC_UNREGISTERED)
+		slot = stats_proc_register();
+	if (slot < 0)
+		return;
+
+	shard = &stats->procs[slot].shards[stats_shard % STATS_PROC_SHARDS];
+	__sync_add_and_fetch(hardware == ALGO_HW ? &shard->ops[field].hw :
+						   &shard->ops[field].sw, 1);
+	if (bytes)
+		__sync_add_and_fetch(hardware == ALGO_HW ?
+				     &shard->bytes[field].hw :
+				     &shard->bytes[field].sw, bytes);
+}
+
 /* increments a field of the shared memory segment
  * arguments:
  * @field - the enum of the field see icastats.h
@@ -336,22 +949,161 @@ char *get_next_usr()
 
 void stats_increment(stats_fields_t field, int hardware, int direction)
 {
+	stats_shard_t *shard;
+
 	if (!ica_stats_enabled)
 		return;
 
-	if (stats == NULL)
+	if (stats == NULL) {
+		/* the segment is mapped on first use */
+		ica_init_stats();
+		if (stats == NULL)
+			return;
+	}
+
+	/* threads may share a shard, so the update must still be atomic */
+	shard = stats_own_shard();
+	__sync_add_and_fetch(stats_counter(&shard->entries[field],
+					   hardware, direction), 1);
+
+	if (ica_stats_proc_enabled)
+		stats_proc_count(field, hardware, 0);
+}
+
+/* increments a field of the shared memory segment and adds the number of
+ * processed bytes to its byte counter
+ * arguments: see stats_increment
+ * @bytes - number of bytes processed by the operation
+ */
+
+void stats_increment_bytes(stats_fields_t field, int hardware, int direction,
+			   uint64_t bytes)
+{
+	stats_shard_t *shard;
+	stats_entry_t *entry;
+
+	if (!ica_stats_enabled)
 		return;
 
-	if (direction == ENCRYPT)
-		if (hardware == ALGO_HW)
-			__sync_add_and_fetch(&stats[field].enc.hw, 1);
-		else
-			__sync_add_and_fetch(&stats[field].enc.sw, 1);
-	else
-		if (hardware == ALGO_HW)
-			__sync_add_and_fetch(&stats[field].dec.hw, 1);
-		else
-			__sync_add_and_fetch(&stats[field].dec.sw, 1);
+	if (stats == NULL) {
+		ica_init_stats();
+		if (stats == NULL)
+			return;
+	}
+
+	/* both counters are on the calling thread's shard */
+	shard = stats_own_shard();
+	entry = &shard->entries[field];
+	__sync_add_and_fetch(stats_counter(entry, hardware, direction), 1);
+	__sync_add_and_fetch(stats_bytes_counter(entry, hardware, direction),
+			     bytes);
+
+	if (ica_stats_proc_enabled)
+		stats_proc_count(field, hardware, bytes);
+}
+
+/* Returns the TOD clock in nanoseconds. Bit 51 of the TOD clock is
+ * incremented every microsecond. STORE CLOCK FAST is much cheaper than
+ * clock_gettime().
+ */
+static inline uint64_t stats_clock_ns(void)
+{
+	uint64_t tod;
+
+	s390_stckf_hw(&tod);
+	return (tod >> 12) * 1000 + (((tod & 0xfff) * 1000) >> 12);
+}
+
+/* records the latency of one operation in the histogram of a field */
+static void stats_latency_record(stats_fields_t field, int hardware,
+				 uint64_t nsec)
+{
+	unsigned int bucket = 0;
+
+	if (nsec > 1)
+		bucket = 63 - __builtin_clzll(nsec);
+	if (bucket >= STATS_LAT_BUCKETS)
+		bucket = STATS_LAT_BUCKETS - 1;
+
+	__sync_add_and_fetch(hardware == ALGO_HW ?
+			     &stats->latency[field].hw[bucket] :
+			     &stats->latency[field].sw[bucket], 1);
+}
+
+/* Returns the start time of an operation to be passed to
+ * stats_increment_latency, or 0 if no latency is recorded.
+ */
+uint64_t stats_latency_begin(void)
+{
+	if (!ica_stats_enabled || !ica_stats_latency_enabled)
+		return 0;
+
+	if (stats == NULL) {
+		ica_init_stats();
+		if (stats == NULL)
+			return 0;
+	}
+
+	return stats_clock_ns();
+}
+
+/* increments a field of the shared memory segment and, if begin is not 0,
+ * records the latency of the operation started at begin
+ * arguments: see stats_increment
+ * @begin - return value of stats_latency_begin
+ */
+
+void stats_increment_latency(stats_fields_t field, int hardware, int direction,
+			     uint64_t begin)
+{
+	stats_increment(field, hardware, direction);
+
+	if (begin == 0 || !ica_stats_enabled || stats == NULL)
+		return;
+
+	stats_latency_record(field, hardware, stats_clock_ns() - begin);
+}
+
+/* records a fallback from hardware to software (or a failed hardware
+ * request) in the event ring of the shared memory segment
+ * arguments:
+ * @field - the enum of the field see icastats.h
+ * @reason - why the hardware was not used, see stats_fallback_reason
+ * @err - errno of the failed hardware request, 0 if none
+ */
+
+void stats_fallback_event(stats_fields_t field, int reason, int err)
+{
+	stats_event_t *event;
+	struct timespec ts;
+	uint64_t seq;
+
+	if (!ica_stats_enabled)
+		return;
+
+	if (stats == NULL) {
+		ica_init_stats();
+		if (stats == NULL)
+			return;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	seq = __sync_fetch_and_add(&stats->events.head, 1);
+	event = &stats->events.ring[seq % STATS_EVENTS];
+
+	/* readers skip the entry until seq is set. A writer lapped by
+	 * STATS_EVENTS others meanwhile leaves a seq readers do not expect.
+	 */
+	event->seq = 0;
+	__sync_synchronize();
+	event->time = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	event->field = field;
+	event->reason = reason;
+	event->err = err;
+	event->pid = getpid();
+	__sync_synchronize();
+	event->seq = seq + 1;
 }
 #endif
 
@@ -360,10 +1112,21 @@ void stats_increment(stats_fields_t field, int hardware, int direction)
  */
 void stats_reset()
 {
+	unsigned int i;
+
 	if (stats == NULL)
 		return;
 
-	memset(stats, 0, sizeof(stats_entry_t)*ICA_NUM_STATS);
+	for (i = 0; i < STATS_SHARDS; i++)
+		memset(stats->shards[i].entries, 0,
+		       sizeof(stats->shards[i].entries));
+	memset(stats->latency, 0, sizeof(stats->latency));
+	/* the process slots stay claimed */
+	for (i = 0; i < STATS_PROC_SLOTS; i++)
+		memset(stats->procs[i].shards, 0,
+		       sizeof(stats->procs[i].shards));
+	/* head must not go backwards either, readers start at tail */
+	stats->events.tail = stats->events.head;
 }
 
 
@@ -383,7 +1146,8 @@ int delete_all()
 		return 0;
 
 	while ((direntp = readdir(shmDir)) != NULL) {
-		if (strstr(direntp->d_name, "icastats_") != NULL) {
+		if (strncmp(direntp->d_name, STATS_SHM_PREFIX,
+			    STATS_SHM_PREFIX_LEN) == 0) {
 			if (shm_unlink(direntp->d_name) == -1)
 				return 0;
 		}
@@ -392,3 +1156,251 @@ int delete_all()
 	return 1;
 }
 
+
+#ifdef ICA_INTERNAL_TEST_STATS
+
+#include "../test/testcase.h"
+
+#define TEST_THREADS_MAX	64
+#define TEST_ITERATIONS		1000000
+
+int ica_stats_enabled = 1;
+int ica_stats_latency_enabled = 1;
+int ica_stats_proc_enabled = 0;
+
+/* the test maps a private segment itself */
+void ica_init_stats(void)
+{
+}
+
+/* force all threads onto shard 0 to compare against a single counter */
+static int test_one_shard;
+
+static void *stats_increment_thread(void *arg)
+{
+	int i;
+
+	(void)arg;
+
+	if (test_one_shard)
+		stats_shard = 0;
+
+	for (i = 0; i < TEST_ITERATIONS; i++)
+		stats_increment(ICA_STATS_SHA256, ALGO_HW, ENCRYPT);
+
+	return NULL;
+}
+
+static void stats_contention_run(unsigned int threads)
+{
+	pthread_t tid[TEST_THREADS_MAX];
+	struct timeval start, stop;
+	unsigned long long delta;
+	unsigned int i, cpus;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1 || cpus > threads)
+		cpus = threads;
+
+	stats_reset();
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&tid[i], NULL, stats_increment_thread, NULL))
+			EXIT_ERR("pthread_create failed.");
+	}
+	for (i = 0; i < threads; i++) {
+		if (pthread_join(tid[i], NULL))
+			EXIT_ERR("pthread_join failed.");
+	}
+	gettimeofday(&stop, NULL);
+	delta = delta_usec(&start, &stop);
+
+	if (stats_query(ICA_STATS_SHA256, ALGO_HW, ENCRYPT)
+	    != (uint64_t)threads * TEST_ITERATIONS)
+		EXIT_ERR("counter sum over all shards is wrong.");
+
+	/* cost per increment as seen by one of the concurrently running threads */
+	printf("%-10s %2u threads\t%.2Lf ns/increment\n",
+	       test_one_shard ? "one shard" : "sharded", threads,
+	       (long double)delta * 1000 * cpus
+	       / ((unsigned long long)threads * TEST_ITERATIONS));
+}
+
+static void *stats_increment_bytes_thread(void *arg)
+{
+	int i;
+
+	(void)arg;
+
+	for (i = 0; i < TEST_ITERATIONS; i++)
+		stats_increment_bytes(ICA_STATS_SHA256, ALGO_HW, ENCRYPT, 64);
+
+	return NULL;
+}
+
+/* Counters read while writers are running never go backwards, and the
+ * sums are exact once the writers are done.
+ */
+static void stats_snapshot_check(void)
+{
+	stats_entry_t entries[ICA_NUM_STATS];
+	pthread_t tid[TEST_THREADS_MAX];
+	const stats_entry_t *sha256 = &entries[ICA_STATS_SHA256];
+	uint64_t ops = 0, bytes = 0;
+	unsigned int i, snapshots = 0;
+
+	stats_reset();
+
+	for (i = 0; i < TEST_THREADS_MAX; i++) {
+		if (pthread_create(&tid[i], NULL, stats_increment_bytes_thread,
+				   NULL))
+			EXIT_ERR("pthread_create failed.");
+	}
+	do {
+		get_stats_data(entries);
+		if (sha256->enc.hw < ops || sha256->enc_bytes.hw < bytes)
+			EXIT_ERR("counter went backwards.");
+		ops = sha256->enc.hw;
+		bytes = sha256->enc_bytes.hw;
+		snapshots++;
+	} while (ops < (uint64_t)TEST_THREADS_MAX * TEST_ITERATIONS);
+	for (i = 0; i < TEST_THREADS_MAX; i++) {
+		if (pthread_join(tid[i], NULL))
+			EXIT_ERR("pthread_join failed.");
+	}
+
+	get_stats_data(entries);
+	if (sha256->enc.hw != (uint64_t)TEST_THREADS_MAX * TEST_ITERATIONS ||
+	    sha256->enc_bytes.hw != 64 * sha256->enc.hw)
+		EXIT_ERR("wrong counter sums.");
+
+	V_(printf("%u snapshots\n", snapshots));
+}
+
+static void stats_latency_check(void)
+{
+	stats_latency_t latency[ICA_NUM_STATS];
+	const uint64_t *hw = latency[ICA_STATS_RSA_CRT].hw;
+	struct timeval start, stop;
+	unsigned int i;
+
+	stats_reset();
+
+	/* 990 operations of 1 usec, 9 of 1 msec and one of 1 sec */
+	for (i = 0; i < 990; i++)
+		stats_latency_record(ICA_STATS_RSA_CRT_2048, ALGO_HW, 1000);
+	for (i = 0; i < 9; i++)
+		stats_latency_record(ICA_STATS_RSA_CRT_4096, ALGO_HW, 1000000);
+	stats_latency_record(ICA_STATS_RSA_CRT_4096, ALGO_HW, 1000000000);
+
+	get_stats_latency(latency);
+	if (stats_latency_percentile(hw, 500) != 1024 ||
+	    stats_latency_percentile(hw, 990) != 1024 ||
+	    stats_latency_percentile(hw, 999) != 1048576 ||
+	    stats_latency_percentile(hw, 1000) != 1073741824)
+		EXIT_ERR("latency percentiles are wrong.");
+	if (stats_latency_percentile(latency[ICA_STATS_RSA_CRT].sw, 500) != 0)
+		EXIT_ERR("empty latency histogram has a percentile.");
+
+	stats_reset();
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < TEST_ITERATIONS; i++)
+		stats_increment_latency(ICA_STATS_RSA_ME_2048, ALGO_HW, ENCRYPT,
+					stats_latency_begin());
+	gettimeofday(&stop, NULL);
+
+	printf("%-10s %2u thread \t%.2Lf ns/increment\n", "latency", 1,
+	       (long double)delta_usec(&start, &stop) * 1000 / TEST_ITERATIONS);
+}
+
+#define TEST_EVENTS	1000
+
+static void *stats_fallback_event_thread(void *arg)
+{
+	int i, field = (int)(long)arg;
+
+	for (i = 0; i < TEST_EVENTS; i++)
+		stats_fallback_event(field, STATS_FB_HW_ERROR, field + i);
+
+	return NULL;
+}
+
+static void stats_events_check(void)
+{
+	stats_event_t events[STATS_EVENTS];
+	pthread_t tid[TEST_THREADS_MAX];
+	unsigned int i, num;
+	uint64_t lost;
+	long field;
+
+	stats_reset();
+	if (get_stats_events(events, &lost) != 0 || lost != 0)
+		EXIT_ERR("events after reset.");
+
+	for (field = 0; field < TEST_THREADS_MAX; field++) {
+		if (pthread_create(&tid[field], NULL,
+				   stats_fallback_event_thread, (void *)field))
+			EXIT_ERR("pthread_create failed.");
+	}
+	for (i = 0; i < TEST_THREADS_MAX; i++) {
+		if (pthread_join(tid[i], NULL))
+			EXIT_ERR("pthread_join failed.");
+	}
+
+	/* the ring holds the newest events in order. An entry lapped while
+	 * being written is dropped, which only a preempted writer can cause.
+	 */
+	num = get_stats_events(events, &lost);
+	if (num + lost != TEST_THREADS_MAX * TEST_EVENTS ||
+	    num + TEST_THREADS_MAX < STATS_EVENTS)
+		EXIT_ERR("wrong number of events.");
+	for (i = 0; i < num; i++) {
+		if (events[i].seq <= (i ? events[i - 1].seq :
+				      TEST_THREADS_MAX * TEST_EVENTS -
+				      STATS_EVENTS) ||
+		    events[i].reason != STATS_FB_HW_ERROR ||
+		    events[i].err < events[i].field ||
+		    events[i].err >= events[i].field + TEST_EVENTS ||
+		    events[i].pid != getpid())
+			EXIT_ERR("inconsistent event.");
+	}
+
+	stats_reset();
+	stats_fallback_event(ICA_STATS_RSA_CRT_2048, STATS_FB_NO_CARD, ENODEV);
+	if (get_stats_events(events, &lost) != 1 || lost != 0 ||
+	    events[0].field != ICA_STATS_RSA_CRT_2048)
+		EXIT_ERR("events not reset.");
+
+	V_(printf("%u events checked\n", num));
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int threads;
+
+	set_verbosity(argc, argv);
+
+	/* private segment, so the user's statistics are not touched */
+	stats = mmap(NULL, STATS_SHM_SIZE, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED)
+		EXIT_ERR("mmap failed.");
+
+	for (test_one_shard = 1; test_one_shard >= 0; test_one_shard--) {
+		for (threads = 1; threads <= TEST_THREADS_MAX; threads *= 2)
+			stats_contention_run(threads);
+	}
+
+	stats_snapshot_check();
+	stats_latency_check();
+	stats_events_check();
+
+	munmap(stats, STATS_SHM_SIZE);
+	stats = NULL;
+
+	return TEST_SUCC;
+}
+
+#endif /* ICA_INTERNAL_TEST_STATS */
@@ -0,0 +1,36 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#ifndef ADAPTER_POOL_H
+# define ADAPTER_POOL_H
+
+#include "ica_api.h"
+
+/*
+ * Pools of per-card adapter handles, see ica_adapter_pool_open.
+ */
+unsigned int adapter_pool_open(ICA_ADAPTER_POOL **pool);
+void adapter_pool_close(ICA_ADAPTER_POOL *pool);
+unsigned int adapter_pool_get(ICA_ADAPTER_POOL *pool, unsigned int flags,
+			      ica_adapter_handle_t *adapter_handle);
+void adapter_pool_put(ICA_ADAPTER_POOL *pool,
+		      ica_adapter_handle_t adapter_handle);
+unsigned int adapter_pool_stats(ICA_ADAPTER_POOL *pool, unsigned int index,
+				ica_adapter_pool_card_t *card);
+/*
+ * updates the cards of all open pools to the online cards, called by
+ * ica_init_cards after a rescan
+ */
+void adapter_pool_rescan(void);
+/*
+ * returns the card number a CPRB sent on adapter_handle should be addressed
+ * to, or -1 to let the driver select one, if the handle is not in a pool
+ */
+int adapter_pool_card(ica_adapter_handle_t adapter_handle);
+
+#endif
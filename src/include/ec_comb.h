@@ -0,0 +1,38 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#ifndef EC_COMB_H
+# define EC_COMB_H
+
+/*
+ * Constant time fixed-base scalar multiplication with the generator of the
+ * NIST and brainpool prime curves, from comb tables that are built on the
+ * first use of a curve and then shared read-only by all threads.
+ *
+ * Computes the public key (x,y) = d * G for the big endian private key d of
+ * privlen_from_nid(nid) bytes. x and y are written right justified into
+ * privlen bytes each.
+ *
+ * Returns 0 if successful, EINVAL if d * G is the point at infinity,
+ * ENOMEM if memory allocation fails and ENODEV if the curve is not
+ * supported. The caller then has to use OpenSSL.
+ */
+int ec_comb_mul(unsigned int nid, const unsigned char *d, unsigned char *x,
+		unsigned char *y);
+
+/*
+ * Generates a key pair: a random private key 1 <= d < n, with the order n
+ * of the generator, and its public key (x,y) = d * G.
+ *
+ * Returns 0 if successful, EIO if the random number generator fails, and
+ * like ec_comb_mul otherwise.
+ */
+int ec_comb_keygen(unsigned int nid, unsigned char *d, unsigned char *x,
+		   unsigned char *y);
+
+#endif
@@ -0,0 +1,34 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#ifndef ECDSA_BATCH_H
+# define ECDSA_BATCH_H
+
+#include "ica_api.h"
+
+/* the maximum number of adapter requests of a batch in flight */
+#define ECDSA_BATCH_IN_FLIGHT	16
+
+/* status of an element not processed yet */
+#define ECDSA_BATCH_PENDING	((unsigned int)-1)
+
+/*
+ * Batches of ECDSA signature verifications, see ica_ecdsa_verify_batch.
+ * Elements whose status is ECDSA_BATCH_PENDING on input are processed, the
+ * others are left alone. icapath as returned by getenv_icapath.
+ * Returns 0, or ENOMEM if memory allocation fails.
+ */
+unsigned int ecdsa_batch_verify(ica_adapter_handle_t adapter_handle,
+				unsigned int icapath, unsigned int count,
+				const ICA_EC_KEY *const *pubkeys,
+				const unsigned char *const *hashes,
+				const unsigned int *hash_lengths,
+				const unsigned char *const *signatures,
+				unsigned int *status);
+
+#endif
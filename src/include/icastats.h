@@ -15,6 +15,8 @@
 #define __ICA_STATS_H__
 
 #include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
 
 #include <openssl/obj_mac.h>
 
@@ -28,6 +30,10 @@ typedef struct crypt_opts{
 typedef struct statis_entry {
 	crypt_opts_t  enc;
 	crypt_opts_t  dec;
+	/* number of processed bytes, only counted for symmetric ciphers,
+	 * hashes and MACs */
+	crypt_opts_t  enc_bytes;
+	crypt_opts_t  dec_bytes;
 } stats_entry_t;
 
 
@@ -273,7 +279,132 @@ typedef enum stats_fields {
 	"- 192",	\
 	"- 256"
 
-#define STATS_SHM_SIZE (sizeof(stats_entry_t) * ICA_NUM_STATS)
+/*
+ * The counters are spread over STATS_SHARDS copies of the stats_entry_t
+ * array. Each thread increments the counters of its own shard only, so
+ * threads running concurrently do not bounce the same cache lines. Each
+ * shard starts on its own cache line (256 bytes on s390). Readers sum up
+ * all shards. Each counter is read atomically on its own, so an entry read
+ * while an operation is counted may lack e.g. its bytes.
+ *
+ * Readers do not get a consistent snapshot of an entry on purpose: a
+ * generation count per shard would be written by every operation counted
+ * on it. Counters only grow between resets and icastats only reports them
+ * and their differences between snapshots, never one counter relative to
+ * another. So a torn read at worst moves the bytes of an operation being
+ * counted to the next snapshot, and rates over intervals add up again.
+ */
+#define STATS_SHARDS		32
+#define STATS_CACHELINE_SIZE	256
+
+typedef struct stats_shard {
+	stats_entry_t entries[ICA_NUM_STATS];
+} __attribute__((aligned(STATS_CACHELINE_SIZE))) stats_shard_t;
+
+/*
+ * Optional latency histograms, recorded in stats mode
+ * ICA_STATS_MODE_LATENCY for the asymmetric operations only, see
+ * icastats(1) for why not for the symmetric ones. Bucket i
+ * counts the operations which took [2^i, 2^(i+1)) nanoseconds, the last
+ * bucket also counts all slower ones. Asymmetric operations take at least
+ * microseconds, so the histograms are not sharded.
+ */
+#define STATS_LAT_BUCKETS	32
+
+typedef struct stats_latency {
+	uint64_t hw[STATS_LAT_BUCKETS];
+	uint64_t sw[STATS_LAT_BUCKETS];
+} stats_latency_t;
+
+/*
+ * Optional per process attribution, recorded in stats mode
+ * ICA_STATS_MODE_PROCESS. Each process claims a slot on its first counted
+ * operation and counts its operations there as well, encrypt and decrypt
+ * accumulated. Like the shards of the segment, a slot has shards, so the
+ * threads of a process do not all update the same counters; a thread uses
+ * the slot shard of its segment shard. Slots of exited processes are kept
+ * until a process finds no free slot.
+ */
+#define STATS_PROC_SLOTS	64
+#define STATS_PROC_SHARDS	4
+#define STATS_COMM_LEN		16
+
+typedef struct stats_proc_shard {
+	crypt_opts_t ops[ICA_NUM_STATS];
+	crypt_opts_t bytes[ICA_NUM_STATS];
+} __attribute__((aligned(STATS_CACHELINE_SIZE))) stats_proc_shard_t;
+
+typedef struct stats_proc {
+	int32_t pid;
+	/* start time in clock ticks after boot, see proc(5) */
+	uint64_t start_time;
+	char comm[STATS_COMM_LEN];
+	stats_proc_shard_t shards[STATS_PROC_SHARDS];
+} __attribute__((aligned(STATS_CACHELINE_SIZE))) stats_proc_t;
+
+/* summary of a process slot, see get_stats_procs */
+typedef struct stats_proc_info {
+	pid_t pid;
+	int alive;
+	uint64_t start_time;
+	char comm[STATS_COMM_LEN];
+	crypt_opts_t ops;
+	crypt_opts_t bytes;
+	/* field with the most operations, -1 if none */
+	int top_field;
+} stats_proc_info_t;
+
+/*
+ * Ring buffer of the last STATS_EVENTS fallbacks from hardware to software
+ * (or failed hardware requests, if fallbacks are disabled). Writers reserve
+ * an entry by incrementing head and mark it valid by setting seq to its
+ * sequence number plus one. Events are only recorded on the fallback path,
+ * so operations done in hardware do not pay for it. A reset moves tail up
+ * to head.
+ */
+#define STATS_EVENTS	256
+
+enum stats_fallback_reason {
+	STATS_FB_NO_DRIVER = 1,	/* zcrypt device driver not loaded */
+	STATS_FB_NO_CARD,	/* no crypto card online */
+	STATS_FB_DISABLED,	/* CPACF function not available or disabled */
+	STATS_FB_CURVE,		/* curve not supported by any online card */
+	STATS_FB_HW_ERROR,	/* hardware request failed, see err */
+	STATS_FB_ROUTE_SW,	/* adapter slower than software, see rsa_route.c */
+	STATS_FB_ROUTE_HW,	/* adapter faster again */
+};
+
+typedef struct stats_event {
+	uint64_t seq;
+	/* CLOCK_REALTIME in nanoseconds */
+	uint64_t time;
+	int32_t field;
+	int32_t reason;
+	int32_t err;
+	int32_t pid;
+} stats_event_t;
+
+typedef struct stats_events {
+	uint64_t head;
+	uint64_t tail;
+	stats_event_t ring[STATS_EVENTS];
+} __attribute__((aligned(STATS_CACHELINE_SIZE))) stats_events_t;
+
+typedef struct stats_shm {
+	stats_shard_t shards[STATS_SHARDS];
+	stats_latency_t latency[ICA_NUM_STATS];
+	stats_proc_t procs[STATS_PROC_SLOTS];
+	stats_events_t events;
+} stats_shm_t;
+
+#define STATS_SHM_SIZE (sizeof(stats_shm_t))
+
+/* The segments are named <prefix><uid>. Older libica versions use a different
+ * layout under the name icastats_<uid>, so the prefix has to change whenever
+ * stats_shm_t changes.
+ */
+#define STATS_SHM_PREFIX "icastats2_"
+#define STATS_SHM_PREFIX_LEN (sizeof(STATS_SHM_PREFIX) - 1)
 #define ENCRYPT 1
 #define DECRYPT 0
 
@@ -283,14 +414,53 @@ typedef enum stats_fields {
 #define SHM_CLOSE 0
 #define SHM_DESTROY 1
 
+/*
+ * Persistent reader, which keeps the shared memory segments of one or all
+ * users mapped read-only between snapshots. Each stats_reader_update()
+ * moves the last snapshot of a segment to prev and takes a new one. A
+ * segment deleted or created again is noticed by its inode and mapped again.
+ */
+#define STATS_READER_ALL	-2
+
+typedef struct stats_reader_seg {
+	uid_t uid;
+	ino_t ino;
+	int seen;
+	stats_shm_t *shm;
+	stats_entry_t cur[ICA_NUM_STATS];
+	stats_entry_t prev[ICA_NUM_STATS];
+} stats_reader_seg_t;
+
+typedef struct stats_reader {
+	int user;
+	struct timespec dir_mtime;
+	unsigned int num;
+	stats_reader_seg_t *segs;
+} stats_reader_t;
+
 
 int stats_mmap(int user);
 void stats_munmap(int user, int unlink);
 uint64_t stats_query(stats_fields_t field, int hardware, int direction);
+uint64_t stats_query_bytes(stats_fields_t field, int hardware, int direction);
 void get_stats_data(stats_entry_t *entries);
 void stats_increment(stats_fields_t field, int hardware, int direction);
-int get_stats_sum(stats_entry_t *sum);
+void stats_increment_bytes(stats_fields_t field, int hardware, int direction,
+			   uint64_t bytes);
+uint64_t stats_latency_begin(void);
+void stats_increment_latency(stats_fields_t field, int hardware, int direction,
+			     uint64_t begin);
+void get_stats_latency(stats_latency_t *latency);
+unsigned int get_stats_procs(stats_proc_info_t *procs);
+void stats_fallback_event(stats_fields_t field, int reason, int err);
+unsigned int get_stats_events(stats_event_t *events, uint64_t *lost);
+uint64_t stats_latency_percentile(const uint64_t *buckets,
+				  unsigned int per_mille);
+int get_stats_sum(stats_entry_t *sum, stats_latency_t *latency);
 char *get_next_usr();
+int stats_reader_open(stats_reader_t *reader, int user);
+int stats_reader_update(stats_reader_t *reader);
+void stats_reader_close(stats_reader_t *reader);
 void stats_reset();
 int delete_all();
 
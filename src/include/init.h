@@ -22,9 +22,27 @@
 int begin_sigill_section(struct sigaction *oldact, sigset_t * oldset);
 void end_sigill_section(struct sigaction *oldact, sigset_t * oldset);
 
+/*
+ * Subsystems initialized once on first use, see init.c. Each of these
+ * returns after the subsystem has been initialized by any thread.
+ * ica_init_cards also repeats the card discovery after
+ * ica_card_rescan_interval ms.
+ */
+void ica_init_stats(void);
+void ica_init_cards(void);
+void ica_init_functionlist(void);
+void ica_init_drbg(void);
+void ica_init_rng(void);
+void ica_init_prng(void);
+
 extern int ica_fallbacks_enabled;
 extern int ica_offload_enabled;
 extern int ica_stats_enabled;
+extern int ica_stats_latency_enabled;
+extern int ica_stats_proc_enabled;
+extern int ica_rsa_crt_verify_enabled;
+extern int ica_rsa_route_mode;
+extern int ica_card_rescan_interval;
 
 #endif
 
@@ -0,0 +1,29 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#ifndef RSA_BATCH_H
+# define RSA_BATCH_H
+
+#include "ica_api.h"
+
+/* the maximum number of adapter requests of a batch in flight */
+#define RSA_BATCH_IN_FLIGHT	16
+
+/*
+ * Batches of RSA mod expo operations, see ica_rsa_mod_expo_batch. Elements
+ * whose status is RSA_BATCH_PENDING on input are processed, the others are
+ * left alone.
+ */
+unsigned int rsa_batch_mod_expo(ica_adapter_handle_t adapter_handle,
+				unsigned int count,
+				const unsigned char *const *input_data,
+				ica_rsa_key_mod_expo_t *const *rsa_keys,
+				unsigned char *const *output_data,
+				unsigned int *status);
+
+#endif
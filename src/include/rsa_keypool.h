@@ -0,0 +1,39 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#ifndef RSA_KEYPOOL_H
+# define RSA_KEYPOOL_H
+
+#include <stdint.h>
+#include "ica_api.h"
+
+#define RSA_KEYPOOL_MAX_POOLS	8
+#define RSA_KEYPOOL_MAX_KEYS	1024
+
+/*
+ * Pools of RSA keys generated in the background, see
+ * ica_rsa_keygen_pool_set. The get functions return 0 and fill the keys
+ * from the pool of modulus_bit_length and the exponent in public_key, or
+ * ENOENT if there is no such pool or it is empty.
+ */
+unsigned int rsa_keypool_set(unsigned int modulus_bit_length,
+			     unsigned long public_exponent, unsigned int size,
+			     unsigned int low_water);
+unsigned int rsa_keypool_stats(unsigned int modulus_bit_length,
+			       unsigned long public_exponent, uint64_t *hits,
+			       uint64_t *misses, unsigned int *available);
+unsigned int rsa_keypool_get_mod_expo(unsigned int modulus_bit_length,
+				      ica_rsa_key_mod_expo_t *public_key,
+				      ica_rsa_key_mod_expo_t *private_key);
+unsigned int rsa_keypool_get_crt(unsigned int modulus_bit_length,
+				 ica_rsa_key_mod_expo_t *public_key,
+				 ica_rsa_key_crt_t *private_key);
+/* stops the worker and clears all pooled keys, see ica_cleanup */
+void rsa_keypool_cleanup(void);
+
+#endif
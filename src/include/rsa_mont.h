@@ -0,0 +1,37 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#ifndef RSA_MONT_H
+# define RSA_MONT_H
+
+/* the engine handles odd moduli of up to 4096 bits */
+#define RSA_MONT_MAX_BITS	4096
+#define RSA_MONT_UNSUPPORTED	-1
+
+/*
+ * Constant time Montgomery exponentiation built on the 512x512-bit
+ * multiplication kernels ica_mp_mul512/ica_mp_sqr512, with a portable C
+ * multiplier if the vector facilities are not available.
+ *
+ * Computes res = arg^exp mod mod for big endian numbers. The result is
+ * written right justified into res_length bytes.
+ *
+ * Returns 0 if successful, EINVAL if the result does not fit into res_length
+ * bytes, ENOMEM if memory allocation fails and RSA_MONT_UNSUPPORTED if the
+ * modulus is even or too long or arg is longer than the padded modulus. The
+ * caller then has to use another implementation.
+ */
+int rsa_mont_mod_expo(unsigned char *res, int res_length,
+		      const unsigned char *arg, int arg_length,
+		      const unsigned char *exp, int exp_length,
+		      const unsigned char *mod, int mod_length);
+
+/* returns 1 if ica_mp_mul512/ica_mp_sqr512 run on the vector facilities */
+int rsa_mont_accelerated(void);
+
+#endif
@@ -0,0 +1,31 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#ifndef RSA_QUEUE_H
+# define RSA_QUEUE_H
+
+#include "ica_api.h"
+
+#define RSA_QUEUE_MAX_IN_FLIGHT	256
+
+/*
+ * Asynchronous RSA requests: a pool of worker threads issues the blocking
+ * ioctls, see ica_rsa_queue_new.
+ */
+unsigned int rsa_queue_new(ica_adapter_handle_t adapter_handle,
+			   unsigned int in_flight, unsigned int depth,
+			   ICA_RSA_QUEUE **queue);
+void rsa_queue_free(ICA_RSA_QUEUE *queue);
+int rsa_queue_fd(ICA_RSA_QUEUE *queue);
+unsigned int rsa_queue_submit(ICA_RSA_QUEUE *queue,
+			      ica_rsa_request_t *request);
+unsigned int rsa_queue_poll(ICA_RSA_QUEUE *queue,
+			    ica_rsa_request_t **requests, unsigned int max,
+			    int timeout_ms, unsigned int *count);
+
+#endif
@@ -0,0 +1,36 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#ifndef RSA_ROUTE_H
+# define RSA_ROUTE_H
+
+#include <stdint.h>
+
+/* one per key size, see rsa_keysize_stats_ofs */
+#define RSA_ROUTE_BUCKETS	4
+
+/*
+ * Routing of ica_rsa_crt requests between the adapter and the software
+ * fallback by their observed latency, see ica_set_rsa_route_mode.
+ * rsa_route_divert returns 1 if the next request of the bucket should go
+ * to the software fallback. rsa_route_clock returns the start time of a
+ * request to pass to rsa_route_record, or 0 if routing is disabled.
+ */
+int rsa_route_divert(unsigned int bucket);
+uint64_t rsa_route_clock(void);
+void rsa_route_record(unsigned int bucket, int hardware, uint64_t begin,
+		      int failed);
+/* records one request of nsec nanoseconds */
+void rsa_route_sample(unsigned int bucket, int hardware, uint64_t nsec,
+		      int failed);
+/* returns 1 if the bucket currently diverts requests to software */
+int rsa_route_diverting(unsigned int bucket);
+/* forgets all estimates */
+void rsa_route_reset(void);
+
+#endif
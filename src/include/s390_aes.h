@@ -140,11 +140,12 @@ static inline int s390_aes_gcm(unsigned int fc, const unsigned char *in_data,
 	if (rc)
 		return rc;
 
-	stats_increment(ICA_STATS_AES_GCM_128 + aes_directed_fc_stats_ofs(fc),
+	stats_increment_bytes(ICA_STATS_AES_GCM_128 +
+			aes_directed_fc_stats_ofs(fc),
 			ALGO_HW,
 			(s390_kma_functions[fc].hw_fc &
 			S390_CRYPTO_DIRECTION_MASK) == 0 ?
-			ENCRYPT:DECRYPT);
+			ENCRYPT:DECRYPT, data_length);
 
 	return 0;
 }
@@ -164,11 +165,12 @@ static inline int __s390_aes_ctrlist(unsigned int fc, unsigned long data_length,
 	if (rc)
 		return rc;
 
-	stats_increment(ICA_STATS_AES_CTR_128 + aes_directed_fc_stats_ofs(fc),
+	stats_increment_bytes(ICA_STATS_AES_CTR_128 +
+			aes_directed_fc_stats_ofs(fc),
 			ALGO_HW,
 			 (s390_msa4_functions[fc].hw_fc &
 			 S390_CRYPTO_DIRECTION_MASK) ==
-			 0 ?ENCRYPT:DECRYPT);
+			 0 ?ENCRYPT:DECRYPT, data_length);
 	return 0;
 }
 
@@ -420,6 +422,10 @@ static inline int s390_aes_ecb(unsigned int fc, unsigned long data_length,
 				     data_length, in_data, key,
 				     out_data);
 	if (rc) {
+		stats_fallback_event(ICA_STATS_AES_ECB_128 +
+				aes_directed_fc_stats_ofs(fc),
+				*s390_kmc_functions[fc].enabled ?
+				STATS_FB_HW_ERROR : STATS_FB_DISABLED, rc);
 		if (!ica_fallbacks_enabled)
 			return rc;
 		rc = s390_aes_ecb_sw(s390_kmc_functions[fc].hw_fc,
@@ -428,11 +434,12 @@ static inline int s390_aes_ecb(unsigned int fc, unsigned long data_length,
 		hardware = ALGO_SW;
 	}
 
-	stats_increment(ICA_STATS_AES_ECB_128 + aes_directed_fc_stats_ofs(fc),
+	stats_increment_bytes(ICA_STATS_AES_ECB_128 +
+			aes_directed_fc_stats_ofs(fc),
 			hardware,
 			(s390_kmc_functions[fc].hw_fc &
 			S390_CRYPTO_DIRECTION_MASK) == 0 ?
-			ENCRYPT:DECRYPT);
+			ENCRYPT:DECRYPT, data_length);
 	return rc;
 }
 
@@ -448,6 +455,10 @@ static inline int s390_aes_cbc(unsigned int fc, unsigned long data_length,
 				     data_length, in_data, iv, key,
 				     out_data);
 	if (rc) {
+		stats_fallback_event(ICA_STATS_AES_CBC_128 +
+				aes_directed_fc_stats_ofs(fc),
+				*s390_kmc_functions[fc].enabled ?
+				STATS_FB_HW_ERROR : STATS_FB_DISABLED, rc);
 		if (!ica_fallbacks_enabled)
 			return rc;
 		rc = s390_aes_cbc_sw(s390_kmc_functions[fc].hw_fc,
@@ -456,10 +467,11 @@ static inline int s390_aes_cbc(unsigned int fc, unsigned long data_length,
 		hardware = ALGO_SW;
 	}
 
-	stats_increment(ICA_STATS_AES_CBC_128 + aes_directed_fc_stats_ofs(fc),
+	stats_increment_bytes(ICA_STATS_AES_CBC_128 +
+			aes_directed_fc_stats_ofs(fc),
 			hardware, (s390_kmc_functions[fc].hw_fc &
 			S390_CRYPTO_DIRECTION_MASK) == 0 ?
-			ENCRYPT:DECRYPT);
+			ENCRYPT:DECRYPT, data_length);
 	return rc;
 }
 
@@ -509,11 +521,12 @@ static inline int __s390_aes_cfb(unsigned int fc, unsigned long data_length,
 	if (rc)
 		return rc;
 
-	stats_increment(ICA_STATS_AES_CFB_128 + aes_directed_fc_stats_ofs(fc),
+	stats_increment_bytes(ICA_STATS_AES_CFB_128 +
+			aes_directed_fc_stats_ofs(fc),
 			ALGO_HW,
 			(s390_kmc_functions[fc].hw_fc &
 			S390_CRYPTO_DIRECTION_MASK) == 0 ?
-			ENCRYPT:DECRYPT);
+			ENCRYPT:DECRYPT, data_length);
 
 	return 0;
 }
@@ -603,11 +616,12 @@ static inline int __s390_aes_ofb(unsigned int fc, unsigned long input_length,
 	if (rc)
 		return rc;
 
-	stats_increment(ICA_STATS_AES_OFB_128 + aes_directed_fc_stats_ofs(fc),
+	stats_increment_bytes(ICA_STATS_AES_OFB_128 +
+			aes_directed_fc_stats_ofs(fc),
 			ALGO_HW,
 			(s390_kmc_functions[fc].hw_fc &
 			S390_CRYPTO_DIRECTION_MASK) == 0 ?
-			ENCRYPT:DECRYPT);
+			ENCRYPT:DECRYPT, input_length);
 	return 0;
 }
 
@@ -849,11 +863,12 @@ static inline int s390_aes_xts(unsigned int fc, unsigned long data_length,
 	if (rc)
 		return rc;
 
-	stats_increment(ICA_STATS_AES_XTS_128 + aes_directed_fc_stats_ofs(fc),
+	stats_increment_bytes(ICA_STATS_AES_XTS_128 +
+			aes_directed_fc_stats_ofs(fc),
 			ALGO_HW,
 			(s390_kmc_functions[fc].hw_fc &
 			S390_CRYPTO_DIRECTION_MASK) == 0 ?
-			ENCRYPT:DECRYPT);
+			ENCRYPT:DECRYPT, data_length);
 
 	return 0;
 }
@@ -322,6 +322,9 @@ static inline unsigned int s390_ccm(unsigned int function_code,
 						   key, fc_to_key_length(function_code));
 			if (rc)
 				return rc;
+			_stats_increment(s390_msa4_functions[function_code].hw_fc &
+					 S390_CRYPTO_FUNCTION_MASK, ALGO_HW, DECRYPT,
+					 assoc_data_length + payload_length);
 		} else {
 			/* mac */
 			rc = s390_ccm_authenticate(UNDIRECTED_FC(function_code),
@@ -332,6 +335,9 @@ static inline unsigned int s390_ccm(unsigned int function_code,
 						   key, fc_to_key_length(function_code));
 			if (rc)
 				return rc;
+			_stats_increment(s390_msa4_functions[function_code].hw_fc &
+					 S390_CRYPTO_FUNCTION_MASK, ALGO_HW, ENCRYPT,
+					 assoc_data_length + payload_length);
 
 			/*encrypt */
 			rc = s390_aes_ctr(UNDIRECTED_FC(function_code),
@@ -71,18 +71,24 @@ static inline unsigned int fc_block_size(unsigned int fc)
 	return rc;
 }
 
-static inline void _stats_increment(unsigned int fc, int hw, int direction)
+/* s390_cmac() does not count its calls, callers count each MAC computed
+ * once with its real direction and length.
+ */
+static inline void _stats_increment(unsigned int fc, int hw, int direction,
+				    unsigned long bytes)
 {
 	switch(fc) {
 		case 1:
 		case 9:
-			stats_increment(ICA_STATS_DES_CMAC, hw, direction);
+			stats_increment_bytes(ICA_STATS_DES_CMAC, hw,
+					      direction, bytes);
 			break;
 		case 2:
 		case 3:
 		case 10:
 		case 11:
-			stats_increment(ICA_STATS_3DES_CMAC, hw, direction);
+			stats_increment_bytes(ICA_STATS_3DES_CMAC, hw,
+					      direction, bytes);
 			break;
 		case 18:
 		case 19:
@@ -90,9 +96,9 @@ static inline void _stats_increment(unsigned int fc, int hw, int direction)
 		case 26:
 		case 27:
 		case 28:
-			stats_increment(ICA_STATS_AES_CMAC_128 +
+			stats_increment_bytes(ICA_STATS_AES_CMAC_128 +
 					aes_directed_fc_stats_ofs(fc),
-					hw, direction);
+					hw, direction, bytes);
 			break;
 		default:
 			break;
@@ -108,7 +114,7 @@ static inline int s390_cmac_hw(unsigned long fc,
 {
 	parm_block_t parm_block;
 	struct parm_block_lookup pb_lookup;
-	unsigned int length_tail;
+	unsigned int length_tail = 0;
 	unsigned long length_head;
 	int rc;
 
@@ -131,8 +137,6 @@ static inline int s390_cmac_hw(unsigned long fc,
 		if (rc < 0)
 			return rc;
 
-		_stats_increment(fc, ALGO_HW, ENCRYPT);
-
 		/* rescue iv for chained calls (intermediate) */
 		memcpy(iv, pb_lookup.iv, pb_lookup.block_size);
 	} else {
@@ -152,7 +156,6 @@ static inline int s390_cmac_hw(unsigned long fc,
 					memset(pb_lookup.keys, 0, key_size);
 					return EIO;
 				}
-				_stats_increment(fc, ALGO_HW, ENCRYPT);
 			}
 
 			*pb_lookup.ml = length_tail * 8;	/* message length in bits */
@@ -164,7 +167,6 @@ static inline int s390_cmac_hw(unsigned long fc,
 		if (rc < 0)
 			return EIO;
 
-		_stats_increment(fc, ALGO_HW, ENCRYPT);
 		memcpy(cmac, pb_lookup.iv, cmac_length);
 	}
 
@@ -236,6 +236,27 @@ extern s390_supported_function_t s390_ppno_functions[];
 extern s390_supported_function_t s390_kdsa_functions[];
 
 void s390_crypto_switches_init(void);
+void s390_crypto_cards_init(void);
+/* updates the card switches and the function list, if cards came or went */
+void s390_crypto_cards_rescan(void);
+
+#define CARD_AVAILABLE		0x01
+#define CEXnA_AVAILABLE		0x02
+#define CEXnC_AVAILABLE		0x04
+#define CEX4C_AVAILABLE		0x08
+
+/* AP card numbers are 0 to 255 */
+#define MAX_CARDS		256
+
+/* returns the flags above for a card type string like "CEX7C" */
+unsigned int card_type_flags(const char *type);
+/*
+ * calls fn for each online card in /sys/devices/ap with its number and type,
+ * returns the number of cards
+ */
+unsigned int for_each_online_card(void (*fn)(unsigned int card,
+					     const char *type, void *arg),
+				  void *arg);
 
 /**
  * s390_pcc:
@@ -231,6 +231,12 @@ static inline int s390_des_ecb(unsigned int fc, unsigned long data_length,
 				     data_length, in_data, key,
 				     out_data);
 	if (rc) {
+		stats_fallback_event((s390_kmc_functions[fc].hw_fc &
+				S390_CRYPTO_FUNCTION_MASK) ==
+				S390_CRYPTO_DEA_ENCRYPT ?
+				ICA_STATS_DES_ECB : ICA_STATS_3DES_ECB,
+				*s390_kmc_functions[fc].enabled ?
+				STATS_FB_HW_ERROR : STATS_FB_DISABLED, rc);
 		if (!ica_fallbacks_enabled)
 			return rc;
 		rc = s390_des_ecb_sw(s390_kmc_functions[fc].hw_fc,
@@ -241,17 +247,17 @@ static inline int s390_des_ecb(unsigned int fc, unsigned long data_length,
 
 	switch (s390_kmc_functions[fc].hw_fc & S390_CRYPTO_FUNCTION_MASK) {
 	case S390_CRYPTO_DEA_ENCRYPT:
-		stats_increment(ICA_STATS_DES_ECB, hardware,
+		stats_increment_bytes(ICA_STATS_DES_ECB, hardware,
 				(s390_kmc_functions[fc].hw_fc &
 				S390_CRYPTO_DIRECTION_MASK) ==
-				0 ? ENCRYPT : DECRYPT);
+				0 ? ENCRYPT : DECRYPT, data_length);
 		break;
 	case S390_CRYPTO_TDEA_128_ENCRYPT:
 	case S390_CRYPTO_TDEA_192_ENCRYPT:
-		stats_increment(ICA_STATS_3DES_ECB, hardware,
+		stats_increment_bytes(ICA_STATS_3DES_ECB, hardware,
 				 (s390_kmc_functions[fc].hw_fc &
 				S390_CRYPTO_DIRECTION_MASK) ==
-				0 ? ENCRYPT : DECRYPT);
+				0 ? ENCRYPT : DECRYPT, data_length);
 		break;
 	}
 
@@ -270,6 +276,12 @@ static inline int s390_des_cbc(unsigned int fc, unsigned long data_length,
 				     data_length, in_data, iv, key,
 				     out_data);
 	if (rc) {
+		stats_fallback_event((s390_kmc_functions[fc].hw_fc &
+				S390_CRYPTO_FUNCTION_MASK) ==
+				S390_CRYPTO_DEA_ENCRYPT ?
+				ICA_STATS_DES_CBC : ICA_STATS_3DES_CBC,
+				*s390_kmc_functions[fc].enabled ?
+				STATS_FB_HW_ERROR : STATS_FB_DISABLED, rc);
 		if (!ica_fallbacks_enabled)
 			return rc;
 		rc = s390_des_cbc_sw(s390_kmc_functions[fc].hw_fc,
@@ -280,17 +292,17 @@ static inline int s390_des_cbc(unsigned int fc, unsigned long data_length,
 
 	switch (s390_kmc_functions[fc].hw_fc & S390_CRYPTO_FUNCTION_MASK) {
 	case S390_CRYPTO_DEA_ENCRYPT:
-		stats_increment(ICA_STATS_DES_CBC, hardware,
+		stats_increment_bytes(ICA_STATS_DES_CBC, hardware,
 				(s390_kmc_functions[fc].hw_fc &
 				S390_CRYPTO_DIRECTION_MASK) ==
-				0 ? ENCRYPT : DECRYPT);
+				0 ? ENCRYPT : DECRYPT, data_length);
 		break;
 	case S390_CRYPTO_TDEA_128_ENCRYPT:
 	case S390_CRYPTO_TDEA_192_ENCRYPT:
-		stats_increment(ICA_STATS_3DES_CBC, hardware,
+		stats_increment_bytes(ICA_STATS_3DES_CBC, hardware,
 				(s390_kmc_functions[fc].hw_fc &
 				S390_CRYPTO_DIRECTION_MASK) ==
-				0 ? ENCRYPT : DECRYPT);
+				0 ? ENCRYPT : DECRYPT, data_length);
 		break;
 	}
 
@@ -342,17 +354,17 @@ static inline int __s390_des_cfb(unsigned int fc, unsigned long data_length,
 
 	switch (s390_msa4_functions[fc].hw_fc & S390_CRYPTO_FUNCTION_MASK) {
 	case S390_CRYPTO_DEA_ENCRYPT:
-		stats_increment(ICA_STATS_DES_CFB, ALGO_HW,
+		stats_increment_bytes(ICA_STATS_DES_CFB, ALGO_HW,
 				(s390_msa4_functions[fc].hw_fc &
 				S390_CRYPTO_DIRECTION_MASK) ==
-				0 ? ENCRYPT : DECRYPT);
+				0 ? ENCRYPT : DECRYPT, data_length);
 		break;
 	case S390_CRYPTO_TDEA_128_ENCRYPT:
 	case S390_CRYPTO_TDEA_192_ENCRYPT:
-		stats_increment(ICA_STATS_3DES_CFB, ALGO_HW,
+		stats_increment_bytes(ICA_STATS_3DES_CFB, ALGO_HW,
 				(s390_msa4_functions[fc].hw_fc &
 				S390_CRYPTO_DIRECTION_MASK) ==
-				0 ? ENCRYPT : DECRYPT);
+				0 ? ENCRYPT : DECRYPT, data_length);
 		break;
 	}
 
@@ -402,17 +414,17 @@ static inline int __s390_des_ofb(unsigned int fc, unsigned int input_length,
 
 	switch (s390_msa4_functions[fc].hw_fc & S390_CRYPTO_FUNCTION_MASK) {
 	case S390_CRYPTO_DEA_ENCRYPT:
-		stats_increment(ICA_STATS_DES_OFB, ALGO_HW,
+		stats_increment_bytes(ICA_STATS_DES_OFB, ALGO_HW,
 				(s390_msa4_functions[fc].hw_fc &
 				S390_CRYPTO_DIRECTION_MASK) ==
-				0 ? ENCRYPT : DECRYPT);
+				0 ? ENCRYPT : DECRYPT, input_length);
 		break;
 	case S390_CRYPTO_TDEA_128_ENCRYPT:
 	case S390_CRYPTO_TDEA_192_ENCRYPT:
-		stats_increment(ICA_STATS_3DES_OFB, ALGO_HW,
+		stats_increment_bytes(ICA_STATS_3DES_OFB, ALGO_HW,
 				(s390_msa4_functions[fc].hw_fc &
 				S390_CRYPTO_DIRECTION_MASK) ==
-				0 ? ENCRYPT : DECRYPT);
+				0 ? ENCRYPT : DECRYPT, input_length);
 		break;
 	}
 
@@ -512,17 +524,17 @@ static inline int __s390_des_ctrlist(unsigned int fc, unsigned long data_length,
 
 	switch (s390_msa4_functions[fc].hw_fc & S390_CRYPTO_FUNCTION_MASK) {
 	case S390_CRYPTO_DEA_ENCRYPT:
-		stats_increment(ICA_STATS_DES_CTR, ALGO_HW,
+		stats_increment_bytes(ICA_STATS_DES_CTR, ALGO_HW,
 				(s390_msa4_functions[fc].hw_fc &
 				S390_CRYPTO_DIRECTION_MASK) ==
-				0 ?ENCRYPT: DECRYPT);
+				0 ?ENCRYPT: DECRYPT, data_length);
 		break;
 	case S390_CRYPTO_TDEA_128_ENCRYPT:
 	case S390_CRYPTO_TDEA_192_ENCRYPT:
-		stats_increment(ICA_STATS_3DES_CTR, ALGO_HW,
+		stats_increment_bytes(ICA_STATS_3DES_CTR, ALGO_HW,
 				(s390_msa4_functions[fc].hw_fc &
 				S390_CRYPTO_DIRECTION_MASK) ==
-				0 ?ENCRYPT: DECRYPT);
+				0 ?ENCRYPT: DECRYPT, data_length);
 		break;
 	}
 
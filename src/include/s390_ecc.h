@@ -22,11 +22,15 @@
 #define MAX_ECC_PRIV_SIZE	66 /* 521 bits */
 #define MAX_ECDSA_SIG_SIZE	132
 
+struct ec_key_cache;
+
 struct ec_key_t {
 	uint32_t nid;
 	unsigned char* X;
 	unsigned char* Y;
 	unsigned char* D;
+	/* OpenSSL keys of the software path, or NULL, see s390_ecc.c */
+	struct ec_key_cache *cache;
 }; /* ICA_EC_KEY */
 
 
@@ -37,6 +41,9 @@ struct ica_x25519_ctx {
 
 	int priv_init;
 	int pub_init;
+
+	/* OpenSSL key of the software path, or NULL, see s390_ecc.c */
+	EVP_PKEY *sw_priv;
 };
 
 /* ICA_X448_CTX */
@@ -46,6 +53,9 @@ struct ica_x448_ctx {
 
 	int priv_init;
 	int pub_init;
+
+	/* OpenSSL key of the software path, or NULL, see s390_ecc.c */
+	EVP_PKEY *sw_priv;
 };
 
 /* ICA_ED25519_CTX */
@@ -64,6 +74,10 @@ struct ica_ed25519_ctx {
 
 	int priv_init;
 	int pub_init;
+
+	/* OpenSSL keys of the software path, or NULL, see s390_ecc.c */
+	EVP_PKEY *sw_priv;
+	EVP_PKEY *sw_pub;
 };
 
 /* ICA_ED448_CTX */
@@ -82,6 +96,10 @@ struct ica_ed448_ctx {
 
 	int priv_init;
 	int pub_init;
+
+	/* OpenSSL keys of the software path, or NULL, see s390_ecc.c */
+	EVP_PKEY *sw_priv;
+	EVP_PKEY *sw_pub;
 };
 
 int x25519_derive_pub(unsigned char pub[32],
@@ -98,6 +116,17 @@ int scalar_mulx_cpacf(unsigned char *res_u,
 		      const unsigned char *u,
 		      int curve_nid);
 
+void ed_x_pkey_free_sw(EVP_PKEY **pkey);
+int ed_x_derive_pub_sw(EVP_PKEY **pkey, int nid, const unsigned char *priv,
+		       unsigned char *pub);
+int x_derive_sw(EVP_PKEY **pkey, int nid, const unsigned char *priv,
+		const unsigned char *peer_pub, unsigned char *shared_secret);
+int eddsa_sign_sw(EVP_PKEY **pkey, int nid, const unsigned char *priv,
+		  const unsigned char *msg, size_t msglen, unsigned char *sig);
+int eddsa_verify_sw(EVP_PKEY **pkey, int nid, const unsigned char *pub,
+		    const unsigned char *msg, size_t msglen,
+		    const unsigned char *sig);
+
 /**
  * Refer to z/OS ICSF Application Programmer's Guide,
  * Appendix A. ICSF and cryptographic coprocessor return and reason codes
@@ -333,6 +362,16 @@ unsigned int ecdsa_verify_hw(ica_adapter_handle_t adapter_handle,
 		const ICA_EC_KEY *pubkey, const unsigned char *hash, unsigned int hash_length,
 		const unsigned char *signature);
 
+/* KDSA parameter block kept across ecdsa_verify_cpacf_param calls */
+struct ecdsa_verify_param {
+	unsigned int nid;	/* curve of the block, 0 initially */
+	long long buff[512];	/* 4k buffer: params + reserved area */
+};
+
+int ecdsa_verify_cpacf_param(struct ecdsa_verify_param *param,
+			     const ICA_EC_KEY *pub, const unsigned char *hash,
+			     size_t hashlen, const unsigned char *sig);
+
 unsigned int ecdsa_verify_sw(const ICA_EC_KEY *pubkey,
 		const unsigned char *hash, unsigned int hash_length,
 		const unsigned char *signature);
@@ -379,6 +418,11 @@ unsigned int eckeygen_sw(ICA_EC_KEY *key);
 
 int ec_key_check(const ICA_EC_KEY *ica_key);
 
+struct ec_key_cache *ec_key_cache_new(void);
+/* to be called whenever D, X or Y of the key change */
+void ec_key_cache_clear(struct ec_key_cache *cache);
+void ec_key_cache_free(struct ec_key_cache *cache);
+
 /**
  * returns 1 if the given data length is valid for Crypto Express, 0 otherwise.
  */
@@ -455,6 +499,19 @@ static inline int curve_supported_via_cpacf(unsigned int nid)
 #endif
 }
 
+/**
+ * Returns 1 if X25519, X448, Ed25519 and Ed448 are performed via CPACF,
+ * 0 if they have to use the software fallback.
+ */
+static inline int ed_x_via_cpacf(void)
+{
+#ifdef NO_CPACF
+	return 0;
+#else
+	return msa9_switch;
+#endif
+}
+
 /**
  * returns 1 if the curve specified by nid is supported by openssl, 0 otherwise.
  */
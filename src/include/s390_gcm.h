@@ -89,7 +89,8 @@ static inline int s390_ghash_hw(unsigned int fc,
 	if((unsigned long)rc == data_length) {
 		/* All data has been processed */
 		memcpy(iv, parmblock.iv, AES_BLOCK_SIZE);
-		stats_increment(ICA_STATS_GHASH, hardware, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_GHASH, hardware, ENCRYPT,
+				      data_length);
 		return 0;
 	}
 
@@ -745,13 +746,13 @@ static inline int s390_aes_gcm_kma(const unsigned char *in_data,
 	if (rc >= 0) {
 		ctx->subkey_provided = 1;
 		if (ctx->direction)
-			stats_increment(ICA_STATS_AES_GCM_128 +
+			stats_increment_bytes(ICA_STATS_AES_GCM_128 +
 					aes_directed_fc_stats_ofs(function_code),
-					ALGO_HW, ENCRYPT);
+					ALGO_HW, ENCRYPT, data_length);
 		else
-			stats_increment(ICA_STATS_AES_GCM_128 +
+			stats_increment_bytes(ICA_STATS_AES_GCM_128 +
 					aes_directed_fc_stats_ofs(function_code),
-					ALGO_HW, DECRYPT);
+					ALGO_HW, DECRYPT, data_length);
 		return 0;
 	} else
 		return EIO;
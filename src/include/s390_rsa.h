@@ -21,6 +21,29 @@
 typedef struct ica_rsa_modexpo ica_rsa_modexpo_t;
 typedef struct ica_rsa_modexpo_crt ica_rsa_modexpo_crt_t;
 typedef struct ica_rsa_modexpo ica_rsa_modmult_t;
+
+/*
+ * A key, which is prepared for repeated use. It holds a private copy of the
+ * key, with a CRT key already in privileged form, and, if software fallbacks
+ * are built in, the key parts as BIGNUMs together with the Montgomery
+ * contexts of their moduli, so the software path does not rebuild them on
+ * every operation. A CRT key also gets n, e and mont_n of its public key and
+ * its blinding values, if e can be recovered from the key.
+ */
+struct ica_rsa_prepared_key {
+	int crt;
+	ica_rsa_key_mod_expo_t mod_expo;
+	ica_rsa_key_crt_t crt_key;
+	unsigned char *buf;
+	size_t buflen;
+#ifndef NO_SW_FALLBACKS
+	BIGNUM *n, *e;
+	BIGNUM *p, *q, *dp, *dq, *qinv;
+	BN_MONT_CTX *mont_n, *mont_p, *mont_q;
+	BN_BLINDING *blinding;
+#endif /* NO_SW_FALLBACKS */
+}; /* ICA_RSA_PREPARED_KEY */
+
 unsigned int rsa_key_generate_mod_expo(ica_adapter_handle_t deviceHandle,
 				       unsigned int modulus_bit_length,
 				       ica_rsa_key_mod_expo_t *public_key,
@@ -40,5 +63,17 @@ unsigned int rsa_key_generate_crt(ica_adapter_handle_t deviceHandle,
 unsigned int rsa_crt_sw(ica_rsa_modexpo_crt_t * pCrt);
 unsigned int rsa_mod_mult_sw(ica_rsa_modmult_t * pMul);
 unsigned int rsa_mod_expo_sw(ica_rsa_modexpo_t *pMex);
+unsigned int rsa_prepared_key_init_sw(ICA_RSA_PREPARED_KEY *key);
+void rsa_prepared_key_free_sw(ICA_RSA_PREPARED_KEY *key);
+unsigned int rsa_mod_expo_prepared_sw(ica_rsa_modexpo_t *pMex,
+				      const ICA_RSA_PREPARED_KEY *key);
+unsigned int rsa_crt_prepared_sw(ica_rsa_modexpo_crt_t *pCrt,
+				 const ICA_RSA_PREPARED_KEY *key);
+
+/* the status of a batch element, which is still to be processed */
+#define RSA_BATCH_PENDING	((unsigned int)-1)
+
+unsigned int rsa_mod_expo_batch_sw(ica_rsa_modexpo_t *rb, unsigned int *status,
+				   unsigned int count, uint64_t *begin);
 #endif
 
@@ -20,14 +20,20 @@
 #include <stdio.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
 
 #include "init.h"
+#include "adapter_pool.h"
 #include "fips.h"
 #include "icastats.h"
 #include "s390_prng.h"
 #include "s390_crypto.h"
 #include "ica_api.h"
 #include "rng.h"
+#include "rsa_keypool.h"
+#include "s390_rsa.h"
 
 #if OPENSSL_VERSION_PREREQ(3, 0)
 #include <openssl/crypto.h>
@@ -68,6 +74,9 @@ void end_sigill_section(struct sigaction *oldact, sigset_t *oldset)
 
 void ica_cleanup(void)
 {
+	/* before the OpenSSL context, which the key generation uses */
+	rsa_keypool_cleanup();
+
 #if OPENSSL_VERSION_PREREQ(3, 0)
 	if (openssl_provider != NULL)
 		OSSL_PROVIDER_unload(openssl_provider);
@@ -78,6 +87,125 @@ void ica_cleanup(void)
 #endif
 }
 
+/*
+ * Lazy initialization: the card discovery, the DRBG instances with their
+ * health test, the function list and the statistics segment are set up
+ * once on first use, so applications only pay for what they use. FIPS
+ * builds still initialize everything at load time in the mandated order,
+ * as the power-up tests need it before any service is provided.
+ */
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_once_t cards_once = PTHREAD_ONCE_INIT;
+static pthread_once_t functionlist_once = PTHREAD_ONCE_INIT;
+static pthread_once_t drbg_once = PTHREAD_ONCE_INIT;
+static pthread_once_t rng_once = PTHREAD_ONCE_INIT;
+static pthread_once_t prng_once = PTHREAD_ONCE_INIT;
+
+static void stats_init(void)
+{
+	if (stats_mmap(-1) == -1) {
+		syslog(LOG_INFO,
+		  "Failed to access shared memory segment for libica statistics.");
+	}
+}
+
+void ica_init_stats(void)
+{
+	pthread_once(&stats_once, stats_init);
+}
+
+/* CLOCK_MONOTONIC_COARSE ms of the last card discovery */
+static uint64_t cards_scanned;
+
+static uint64_t cards_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void cards_init(void)
+{
+	s390_crypto_cards_init();
+	__atomic_store_n(&cards_scanned, cards_clock(), __ATOMIC_RELAXED);
+}
+
+/*
+ * Cards are set online and offline at runtime, so the discovery is
+ * repeated on use once the rescan interval has passed. Only the thread
+ * advancing the timestamp rescans, the others go on with the switches as
+ * they are.
+ */
+void ica_init_cards(void)
+{
+	uint64_t now, last;
+	int interval;
+
+	pthread_once(&cards_once, cards_init);
+
+	interval = __atomic_load_n(&ica_card_rescan_interval, __ATOMIC_RELAXED);
+	if (interval == 0)
+		return;
+
+	now = cards_clock();
+	last = __atomic_load_n(&cards_scanned, __ATOMIC_RELAXED);
+	if (now - last < (uint64_t)interval)
+		return;
+	if (__atomic_compare_exchange_n(&cards_scanned, &last, now, 0,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		s390_crypto_cards_rescan();
+		adapter_pool_rescan();
+	}
+}
+
+static void functionlist_init(void)
+{
+	ica_init_cards();
+	s390_initialize_functionlist();
+}
+
+void ica_init_functionlist(void)
+{
+	pthread_once(&functionlist_once, functionlist_init);
+}
+
+static void drbg_init(void)
+{
+#ifndef ICA_FIPS
+	/* The fips_powerup_tests() include the ica_drbg_health_test(). */
+	ica_drbg_health_test(ica_drbg_generate, 256, true,
+				     ICA_DRBG_SHA512);
+#endif
+}
+
+void ica_init_drbg(void)
+{
+	pthread_once(&drbg_once, drbg_init);
+}
+
+static void rng_init_once(void)
+{
+	ica_init_drbg();
+	rng_init();
+}
+
+void ica_init_rng(void)
+{
+	pthread_once(&rng_once, rng_init_once);
+}
+
+static void prng_init_once(void)
+{
+	ica_init_drbg();
+	s390_prng_init();
+}
+
+void ica_init_prng(void)
+{
+	pthread_once(&prng_once, prng_init_once);
+}
+
 void __attribute__ ((constructor)) icainit(void)
 {
 	int value;
@@ -87,11 +215,6 @@ void __attribute__ ((constructor)) icainit(void)
 	if (!strcmp(program_invocation_name, "icastats"))
 		return;
 
-	if (stats_mmap(-1) == -1) {
-		syslog(LOG_INFO,
-		  "Failed to access shared memory segment for libica statistics.");
-	}
-
 	/*
 	 * Switches have to be done first. Otherwise we will not have
 	 * hw support in initialization.
@@ -113,6 +236,21 @@ void __attribute__ ((constructor)) icainit(void)
 	if (ptr && sscanf(ptr, "%i", &value) == 1)
 		ica_set_stats_mode(value);
 
+	/* check for RSA CRT verify mode environment variable */
+	ptr = getenv(ICA_RSA_CRT_VERIFY_ENV);
+	if (ptr && sscanf(ptr, "%i", &value) == 1)
+		ica_set_rsa_crt_verify_mode(value);
+
+	/* check for RSA route mode environment variable */
+	ptr = getenv(ICA_RSA_ROUTE_ENV);
+	if (ptr && sscanf(ptr, "%i", &value) == 1)
+		ica_set_rsa_route_mode(value);
+
+	/* check for card rescan interval environment variable */
+	ptr = getenv(ICA_CARD_RESCAN_ENV);
+	if (ptr && sscanf(ptr, "%i", &value) == 1)
+		ica_set_card_rescan_interval(value);
+
 #if OPENSSL_VERSION_PREREQ(3, 0)
 	/*
 	 * OpenSSL >= 3.0:
@@ -127,6 +265,8 @@ void __attribute__ ((constructor)) icainit(void)
 #endif
 
 #ifdef ICA_FIPS
+	ica_init_cards();
+
 	fips_init(); /* before powerup tests and initialize functionlist */
 #endif
 
@@ -134,13 +274,13 @@ void __attribute__ ((constructor)) icainit(void)
 	openssl3_initialized = 1;
 #endif
 
-	rng_init();
+#ifdef ICA_FIPS
+	ica_init_rng();
 
-	s390_prng_init();
+	ica_init_prng();
 
-	s390_initialize_functionlist();
+	ica_init_functionlist();
 
-#ifdef ICA_FIPS
 	fips_powerup_tests();
 #else
 #if OPENSSL_VERSION_PREREQ(3, 0)
@@ -150,10 +290,6 @@ void __attribute__ ((constructor)) icainit(void)
 		return;
 	}
 #endif
-
-	/* The fips_powerup_tests() include the ica_drbg_health_test(). */
-	ica_drbg_health_test(ica_drbg_generate, 256, true,
-				     ICA_DRBG_SHA512);
 #endif /* ICA_FIPS */
 
 	/* close the remaining open syslog file descriptor */
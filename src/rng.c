@@ -12,6 +12,7 @@
 #include <syslog.h>
 
 #include "ica_api.h"
+#include "init.h"
 #include "rng.h"
 #include "s390_crypto.h"
 
@@ -45,6 +46,8 @@ int rng_gen(unsigned char *buf, size_t buflen)
 	FILE *rng_fh;
 	int rc;
 
+	ica_init_rng();
+
 	if (rng_sh != NULL) {
 	    rc = ica_drbg_generate(rng_sh, 256, false, NULL, 0, buf, buflen);
 	    if (!rc)
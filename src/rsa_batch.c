@@ -0,0 +1,168 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <openssl/crypto.h>
+
+#include "ica_api.h"
+#include "icastats.h"
+#include "init.h"
+#include "rsa_batch.h"
+#include "s390_crypto.h"
+#include "s390_rsa.h"
+
+/*
+ * The adapter requests of a batch are issued by up to RSA_BATCH_IN_FLIGHT
+ * threads, the caller and helpers started for the batch, each taking the
+ * next element until all are done. The elements still pending afterwards,
+ * because there is no adapter or it failed, go to the software fallback in
+ * one call, which shares its setup between them. The latency of each
+ * element is taken from the start of its own request.
+ */
+struct rsa_batch {
+	ica_adapter_handle_t adapter_handle;
+	ica_rsa_modexpo_t *rb;
+	unsigned int *status;
+	unsigned int count;
+	unsigned int next;
+};
+
+static stats_fields_t rsa_batch_field(const ica_rsa_modexpo_t *rb)
+{
+	return ICA_STATS_RSA_ME_512 +
+	       rsa_keysize_stats_ofs(rb->inputdatalength);
+}
+
+static void *rsa_batch_hw(void *arg)
+{
+	struct rsa_batch *batch = arg;
+	unsigned int i;
+	uint64_t begin;
+
+	while ((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED))
+	       < batch->count) {
+		if (batch->status[i] != RSA_BATCH_PENDING)
+			continue;
+		begin = stats_latency_begin();
+		if (ioctl(batch->adapter_handle, ICARSAMODEXPO,
+			  &batch->rb[i])) {
+			stats_fallback_event(rsa_batch_field(&batch->rb[i]),
+					     STATS_FB_HW_ERROR, errno);
+			continue;
+		}
+		batch->status[i] = 0;
+		stats_increment_latency(rsa_batch_field(&batch->rb[i]),
+					ALGO_HW, ENCRYPT, begin);
+	}
+
+	return NULL;
+}
+
+static void rsa_batch_pipeline(struct rsa_batch *batch, unsigned int pending)
+{
+	pthread_t tid[RSA_BATCH_IN_FLIGHT - 1];
+	unsigned int i, helpers;
+
+	helpers = (pending < RSA_BATCH_IN_FLIGHT ?
+		   pending : RSA_BATCH_IN_FLIGHT) - 1;
+	for (i = 0; i < helpers; i++) {
+		/* with fewer helpers the batch just takes longer */
+		if (pthread_create(&tid[i], NULL, rsa_batch_hw, batch))
+			break;
+	}
+	helpers = i;
+
+	rsa_batch_hw(batch);
+
+	for (i = 0; i < helpers; i++)
+		pthread_join(tid[i], NULL);
+}
+
+unsigned int rsa_batch_mod_expo(ica_adapter_handle_t adapter_handle,
+				unsigned int count,
+				const unsigned char *const *input_data,
+				ica_rsa_key_mod_expo_t *const *rsa_keys,
+				unsigned char *const *output_data,
+				unsigned int *status)
+{
+	struct rsa_batch batch;
+	unsigned char *sw;
+	uint64_t *begin;
+	unsigned int i, pending = 0, rc = 0;
+	int reason;
+
+	batch.rb = calloc(count, sizeof(*batch.rb) + sizeof(*begin) + 1);
+	if (batch.rb == NULL)
+		return ENOMEM;
+	begin = (uint64_t *)(batch.rb + count);
+	sw = (unsigned char *)(begin + count);
+
+	batch.adapter_handle = adapter_handle;
+	batch.status = status;
+	batch.count = count;
+	batch.next = 0;
+
+	/* fill driver structures */
+	for (i = 0; i < count; i++) {
+		if (status[i] != RSA_BATCH_PENDING)
+			continue;
+		batch.rb[i].inputdata = (unsigned char *)input_data[i];
+		batch.rb[i].inputdatalength = rsa_keys[i]->key_length;
+		batch.rb[i].outputdata = output_data[i];
+		batch.rb[i].outputdatalength = rsa_keys[i]->key_length;
+		batch.rb[i].b_key = rsa_keys[i]->exponent;
+		batch.rb[i].n_modulus = rsa_keys[i]->modulus;
+		pending++;
+	}
+
+	ica_init_cards();
+
+	if (adapter_handle == DRIVER_NOT_LOADED)
+		reason = STATS_FB_NO_DRIVER;
+	else if (!any_card_online)
+		reason = STATS_FB_NO_CARD;
+	else
+		reason = -1;
+	if (reason == -1 && pending)
+		rsa_batch_pipeline(&batch, pending);
+
+	for (i = 0; i < count; i++) {
+		if (status[i] != RSA_BATCH_PENDING)
+			continue;
+		if (reason != -1)
+			stats_fallback_event(rsa_batch_field(&batch.rb[i]),
+					     reason, ENODEV);
+		if (ica_fallbacks_enabled)
+			sw[i] = 1;
+		else
+			status[i] = ENODEV;
+	}
+
+	if (ica_fallbacks_enabled) {
+		rc = rsa_mod_expo_batch_sw(batch.rb, status, count, begin);
+		for (i = 0; i < count; i++) {
+			if (!sw[i])
+				continue;
+			if (status[i] == RSA_BATCH_PENDING)
+				status[i] = rc;
+			else if (status[i] == 0)
+				stats_increment_latency(
+					rsa_batch_field(&batch.rb[i]),
+					ALGO_SW, ENCRYPT, begin[i]);
+		}
+	}
+
+	OPENSSL_cleanse(batch.rb, count * sizeof(*batch.rb));
+	free(batch.rb);
+
+	return 0;
+}
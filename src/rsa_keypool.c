@@ -0,0 +1,430 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+
+#include "ica_api.h"
+#include "rsa_keypool.h"
+#include "s390_rsa.h"
+
+/*
+ * Up to RSA_KEYPOOL_MAX_POOLS pools, one per modulus bit length and public
+ * exponent (0 for a random one), are refilled by a single worker thread.
+ * A pool is refilled up to size keys once it has low_water or fewer keys
+ * left. The worker generates keys without holding the lock.
+ *
+ * Pooled keys are never handed out twice: a forked child drops the keys it
+ * inherited and restarts the worker on demand.
+ */
+struct keypool_key {
+	ica_rsa_key_mod_expo_t pub;
+	ica_rsa_key_crt_t crt;
+	unsigned char *d;
+	size_t size;
+	unsigned char buf[];
+};
+
+struct keypool {
+	unsigned int bits;		/* 0: unused */
+	unsigned long e;
+	unsigned int size;
+	unsigned int low_water;
+	unsigned int count;
+	int refill;
+	uint64_t hits;
+	uint64_t misses;
+	struct keypool_key *keys[RSA_KEYPOOL_MAX_KEYS];
+};
+
+static struct keypool pools[RSA_KEYPOOL_MAX_POOLS];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+static pthread_t worker;
+static int worker_running;
+static int stop;
+
+/* the exponent is in the last sizeof(unsigned long) bytes, big endian */
+static unsigned long keypool_exponent(const ica_rsa_key_mod_expo_t *key)
+{
+	unsigned long e = 0;
+	unsigned int i;
+
+	for (i = key->key_length - sizeof(e); i < key->key_length; i++)
+		e = e << 8 | key->exponent[i];
+	return e;
+}
+
+static void keypool_key_free(struct keypool_key *key)
+{
+	if (!key)
+		return;
+
+	OPENSSL_cleanse(key->buf, key->size);
+	free(key);
+}
+
+/* d = e^-1 mod lcm(p - 1, q - 1), for ica_rsa_key_generate_mod_expo */
+static int keypool_key_d(struct keypool_key *key)
+{
+	unsigned int len = key->pub.key_length;
+	unsigned int short_len = (len + 1) / 2;
+	BIGNUM *p, *q, *e, *d, *gcd;
+	BN_CTX *ctx;
+	int rc = -1;
+
+	if ((ctx = BN_CTX_new()) == NULL)
+		return -1;
+	BN_CTX_start(ctx);
+	p = BN_CTX_get(ctx);
+	q = BN_CTX_get(ctx);
+	e = BN_CTX_get(ctx);
+	d = BN_CTX_get(ctx);
+	if ((gcd = BN_CTX_get(ctx)) == NULL)
+		goto out;
+	BN_set_flags(p, BN_FLG_CONSTTIME);
+	BN_set_flags(q, BN_FLG_CONSTTIME);
+	BN_set_flags(d, BN_FLG_CONSTTIME);
+
+	if (BN_bin2bn(key->crt.p, short_len + 8, p) &&
+	    BN_bin2bn(key->crt.q, short_len, q) &&
+	    BN_bin2bn(key->pub.exponent, len, e) &&
+	    BN_sub_word(p, 1) && BN_sub_word(q, 1) &&
+	    BN_gcd(gcd, p, q, ctx) && BN_mul(d, p, q, ctx) &&
+	    BN_div(d, NULL, d, gcd, ctx) &&
+	    BN_mod_inverse(d, e, d, ctx) &&
+	    BN_bn2binpad(d, key->d, len) == (int)len)
+		rc = 0;
+out:
+	BN_CTX_end(ctx);
+	BN_CTX_free(ctx);
+	return rc;
+}
+
+static struct keypool_key *keypool_key_generate(unsigned int bits,
+						unsigned long e)
+{
+	unsigned int len = (bits + 7) / 8;
+	unsigned int short_len = (len + 1) / 2, long_len = short_len + 8;
+	size_t size = 3 * len + 3 * long_len + 2 * short_len;
+	struct keypool_key *key;
+	unsigned char *ptr;
+
+	if ((key = calloc(1, sizeof(*key) + size)) == NULL)
+		return NULL;
+	key->size = size;
+
+	ptr = key->buf;
+	key->pub.key_length = len;
+	key->pub.modulus = ptr;
+	ptr += len;
+	key->pub.exponent = ptr;
+	ptr += len;
+	key->d = ptr;
+	ptr += len;
+	key->crt.key_length = len;
+	key->crt.p = ptr;
+	ptr += long_len;
+	key->crt.q = ptr;
+	ptr += short_len;
+	key->crt.dp = ptr;
+	ptr += long_len;
+	key->crt.dq = ptr;
+	ptr += short_len;
+	key->crt.qInverse = ptr;
+
+	/* like ica_rsa_key_generate_crt, which chooses e if it is 0 */
+	for (ptr = key->pub.exponent + len; e; e >>= 8)
+		*--ptr = e & 0xff;
+	if (rsa_key_generate_crt(DRIVER_NOT_LOADED, bits, &key->pub,
+				 &key->crt) || keypool_key_d(key)) {
+		keypool_key_free(key);
+		return NULL;
+	}
+	return key;
+}
+
+static void keypool_clear(struct keypool *pool)
+{
+	while (pool->count)
+		keypool_key_free(pool->keys[--pool->count]);
+}
+
+static struct keypool *keypool_find(unsigned int bits, unsigned long e)
+{
+	unsigned int i;
+
+	for (i = 0; i < RSA_KEYPOOL_MAX_POOLS; i++) {
+		if (pools[i].bits == bits && pools[i].e == e)
+			return &pools[i];
+	}
+	return NULL;
+}
+
+/* next pool to refill, round robin */
+static struct keypool *keypool_next(void)
+{
+	static unsigned int last;
+	unsigned int i, n;
+
+	for (n = 1; n <= RSA_KEYPOOL_MAX_POOLS; n++) {
+		i = (last + n) % RSA_KEYPOOL_MAX_POOLS;
+		if (pools[i].bits && pools[i].refill) {
+			last = i;
+			return &pools[i];
+		}
+	}
+	return NULL;
+}
+
+static void *keypool_worker(void *arg)
+{
+	struct keypool_key *key;
+	struct keypool *pool;
+	unsigned int bits;
+	unsigned long e;
+
+	(void)arg;
+
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		while (!stop && (pool = keypool_next()) == NULL)
+			pthread_cond_wait(&wakeup, &lock);
+		if (stop)
+			break;
+
+		bits = pool->bits;
+		e = pool->e;
+		pthread_mutex_unlock(&lock);
+
+		/* the slow part */
+		key = keypool_key_generate(bits, e);
+
+		pthread_mutex_lock(&lock);
+		if (pool->bits != bits || pool->e != e) {
+			/* the pool was removed meanwhile */
+			keypool_key_free(key);
+			continue;
+		}
+		if (!key) {
+			/* do not retry in a loop, until the next miss */
+			pool->refill = 0;
+			continue;
+		}
+		if (pool->count < pool->size)
+			pool->keys[pool->count++] = key;
+		else
+			keypool_key_free(key);
+		if (pool->count >= pool->size)
+			pool->refill = 0;
+	}
+	pthread_mutex_unlock(&lock);
+
+	return NULL;
+}
+
+/* called with the lock held */
+static int keypool_wakeup(void)
+{
+	if (!worker_running) {
+		if (pthread_create(&worker, NULL, keypool_worker, NULL))
+			return -1;
+		worker_running = 1;
+	}
+	pthread_cond_signal(&wakeup);
+	return 0;
+}
+
+static void keypool_atfork_prepare(void)
+{
+	pthread_mutex_lock(&lock);
+}
+
+static void keypool_atfork_parent(void)
+{
+	pthread_mutex_unlock(&lock);
+}
+
+/* the worker is gone and the keys belong to the parent */
+static void keypool_atfork_child(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < RSA_KEYPOOL_MAX_POOLS; i++) {
+		keypool_clear(&pools[i]);
+		pools[i].refill = 0;
+		pools[i].hits = 0;
+		pools[i].misses = 0;
+	}
+	worker_running = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+/* pthread_atfork handlers can not be unregistered, libica is linked with
+ * -z nodelete so that they stay valid after a dlclose.
+ */
+static void keypool_atfork_init(void)
+{
+	pthread_atfork(keypool_atfork_prepare, keypool_atfork_parent,
+		       keypool_atfork_child);
+}
+
+unsigned int rsa_keypool_set(unsigned int modulus_bit_length,
+			     unsigned long public_exponent, unsigned int size,
+			     unsigned int low_water)
+{
+	struct keypool *pool;
+	unsigned int rc = 0;
+
+	pthread_once(&atfork_once, keypool_atfork_init);
+
+	pthread_mutex_lock(&lock);
+	pool = keypool_find(modulus_bit_length, public_exponent);
+	if (size == 0) {
+		if (pool) {
+			keypool_clear(pool);
+			memset(pool, 0, sizeof(*pool));
+		}
+		goto out;
+	}
+
+	if (!pool && (pool = keypool_find(0, 0)) == NULL) {
+		rc = ENOSPC;
+		goto out;
+	}
+	pool->bits = modulus_bit_length;
+	pool->e = public_exponent;
+	pool->size = size;
+	pool->low_water = low_water;
+	while (pool->count > size)
+		keypool_key_free(pool->keys[--pool->count]);
+	pool->refill = pool->count < size;
+	if (pool->refill && keypool_wakeup())
+		rc = EAGAIN;
+out:
+	pthread_mutex_unlock(&lock);
+	return rc;
+}
+
+unsigned int rsa_keypool_stats(unsigned int modulus_bit_length,
+			       unsigned long public_exponent, uint64_t *hits,
+			       uint64_t *misses, unsigned int *available)
+{
+	struct keypool *pool;
+	unsigned int rc = 0;
+
+	pthread_mutex_lock(&lock);
+	if ((pool = keypool_find(modulus_bit_length, public_exponent)) == NULL) {
+		rc = ENOENT;
+	} else {
+		*hits = pool->hits;
+		*misses = pool->misses;
+		*available = pool->count;
+	}
+	pthread_mutex_unlock(&lock);
+	return rc;
+}
+
+/* a key of the pool for the exponent in public_key, if there is one */
+static struct keypool_key *keypool_take(unsigned int bits,
+					const ica_rsa_key_mod_expo_t *public_key)
+{
+	struct keypool_key *key = NULL;
+	unsigned long e = keypool_exponent(public_key);
+	struct keypool *pool;
+
+	pthread_mutex_lock(&lock);
+	if ((pool = keypool_find(bits, e)) != NULL && !stop) {
+		if (pool->count) {
+			key = pool->keys[--pool->count];
+			pool->keys[pool->count] = NULL;
+			pool->hits++;
+		} else {
+			pool->misses++;
+		}
+		if (pool->count <= pool->low_water) {
+			pool->refill = 1;
+			keypool_wakeup();
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return key;
+}
+
+unsigned int rsa_keypool_get_mod_expo(unsigned int modulus_bit_length,
+				      ica_rsa_key_mod_expo_t *public_key,
+				      ica_rsa_key_mod_expo_t *private_key)
+{
+	struct keypool_key *key;
+	unsigned int len = public_key->key_length;
+
+	if ((key = keypool_take(modulus_bit_length, public_key)) == NULL)
+		return ENOENT;
+
+	memcpy(public_key->modulus, key->pub.modulus, len);
+	memcpy(public_key->exponent, key->pub.exponent, len);
+	memcpy(private_key->modulus, key->pub.modulus, len);
+	memcpy(private_key->exponent, key->d, len);
+
+	keypool_key_free(key);
+	return 0;
+}
+
+unsigned int rsa_keypool_get_crt(unsigned int modulus_bit_length,
+				 ica_rsa_key_mod_expo_t *public_key,
+				 ica_rsa_key_crt_t *private_key)
+{
+	struct keypool_key *key;
+	unsigned int len = public_key->key_length;
+	unsigned int short_len = (len + 1) / 2, long_len = short_len + 8;
+
+	if ((key = keypool_take(modulus_bit_length, public_key)) == NULL)
+		return ENOENT;
+
+	memcpy(public_key->modulus, key->pub.modulus, len);
+	memcpy(public_key->exponent, key->pub.exponent, len);
+	memcpy(private_key->p, key->crt.p, long_len);
+	memcpy(private_key->q, key->crt.q, short_len);
+	memcpy(private_key->dp, key->crt.dp, long_len);
+	memcpy(private_key->dq, key->crt.dq, short_len);
+	memcpy(private_key->qInverse, key->crt.qInverse, long_len);
+
+	keypool_key_free(key);
+	return 0;
+}
+
+void rsa_keypool_cleanup(void)
+{
+	unsigned int i;
+	int running;
+
+	pthread_mutex_lock(&lock);
+	stop = 1;
+	running = worker_running;
+	pthread_cond_broadcast(&wakeup);
+	pthread_mutex_unlock(&lock);
+
+	/* waits for a key generation in progress */
+	if (running)
+		pthread_join(worker, NULL);
+
+	pthread_mutex_lock(&lock);
+	for (i = 0; i < RSA_KEYPOOL_MAX_POOLS; i++) {
+		keypool_clear(&pools[i]);
+		memset(&pools[i], 0, sizeof(pools[i]));
+	}
+	worker_running = 0;
+	stop = 0;
+	pthread_mutex_unlock(&lock);
+}
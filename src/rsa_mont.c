@@ -0,0 +1,429 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+/*
+ * Montgomery exponentiation for the RSA software path.
+ *
+ * Numbers are arrays of 64-bit digits, least significant first, like the
+ * ica_mp interface. A modulus is zero-padded to k blocks of 512 bits and
+ * R = 2^(512k), so all products are composed of 512x512-bit products:
+ *
+ *	mont_mul(a, b) = REDC(a * b) = a * b / R mod n
+ *	REDC(t)        = (t + (t * n' mod R) * n) / R, n' = -1/n mod R
+ *
+ * The exponentiation uses a fixed 4-bit window over the byte length of the
+ * exponent, a table lookup touching all entries and a masked final
+ * subtraction, so neither the timing nor the memory access pattern depends
+ * on the exponent value.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+
+#include "ica_api.h"
+#include "rsa_mont.h"
+
+#define BLOCK		8	/* digits per 512-bit block */
+#define MAX_DIGITS	(RSA_MONT_MAX_BITS / 64)
+#define WINDOW		4
+
+typedef unsigned __int128 uint128_t;
+
+struct mont_ctx {
+	unsigned int k;		/* blocks */
+	unsigned int len;	/* digits: BLOCK * k */
+	uint64_t n[MAX_DIGITS];
+	uint64_t n_inv[MAX_DIGITS];	/* n' */
+	uint64_t r2[MAX_DIGITS];	/* R^2 mod n */
+};
+
+/* portable ica_mp_mul512 */
+static void mul512_c(uint64_t r[16], const uint64_t a[8], const uint64_t b[8])
+{
+	uint128_t t;
+	uint64_t carry;
+	int i, j;
+
+	memset(r, 0, 16 * sizeof(uint64_t));
+	for (i = 0; i < 8; i++) {
+		carry = 0;
+		for (j = 0; j < 8; j++) {
+			t = (uint128_t)a[i] * b[j] + r[i + j] + carry;
+			r[i + j] = (uint64_t)t;
+			carry = (uint64_t)(t >> 64);
+		}
+		r[i + 8] = carry;
+	}
+}
+
+static inline void mul512(uint64_t r[16], const uint64_t a[8],
+			  const uint64_t b[8])
+{
+	/* fails, if the vector facilities are not enabled */
+	if (ica_mp_mul512(r, a, b))
+		mul512_c(r, a, b);
+}
+
+static inline void sqr512(uint64_t r[16], const uint64_t a[8])
+{
+	if (ica_mp_sqr512(r, a))
+		mul512_c(r, a, a);
+}
+
+/* r[0..len) += a[0..16) at r, carry propagated to r[len - 1] */
+static void add_block(uint64_t *r, unsigned int len, const uint64_t a[16])
+{
+	uint64_t carry = 0, t;
+	unsigned int i;
+
+	for (i = 0; i < 16; i++) {
+		t = r[i] + carry;
+		carry = t < carry;
+		t += a[i];
+		carry += t < a[i];
+		r[i] = t;
+	}
+	for (; i < len; i++) {
+		r[i] += carry;
+		carry = r[i] < carry;
+	}
+}
+
+/* r = a * b, r has 2 * len digits */
+static void mul_full(uint64_t *r, const uint64_t *a, const uint64_t *b,
+		     unsigned int k)
+{
+	uint64_t t[16];
+	unsigned int i, j, len = BLOCK * k;
+
+	memset(r, 0, 2 * len * sizeof(uint64_t));
+	for (i = 0; i < k; i++) {
+		for (j = 0; j < k; j++) {
+			mul512(t, a + BLOCK * i, b + BLOCK * j);
+			add_block(r + BLOCK * (i + j), 2 * len - BLOCK * (i + j),
+				  t);
+		}
+	}
+}
+
+/* r = a^2, r has 2 * len digits */
+static void sqr_full(uint64_t *r, const uint64_t *a, unsigned int k)
+{
+	uint64_t t[16];
+	unsigned int i, j, len = BLOCK * k;
+
+	memset(r, 0, 2 * len * sizeof(uint64_t));
+	for (i = 0; i < k; i++) {
+		sqr512(t, a + BLOCK * i);
+		add_block(r + 2 * BLOCK * i, 2 * len - 2 * BLOCK * i, t);
+		for (j = i + 1; j < k; j++) {
+			mul512(t, a + BLOCK * i, a + BLOCK * j);
+			/* the off-diagonal products count twice */
+			add_block(r + BLOCK * (i + j),
+				  2 * len - BLOCK * (i + j), t);
+			add_block(r + BLOCK * (i + j),
+				  2 * len - BLOCK * (i + j), t);
+		}
+	}
+}
+
+/* r = a * b mod R, r has len digits */
+static void mul_low(uint64_t *r, const uint64_t *a, const uint64_t *b,
+		    unsigned int k)
+{
+	uint64_t t[16];
+	unsigned int i, j, len = BLOCK * k;
+
+	memset(r, 0, len * sizeof(uint64_t));
+	for (i = 0; i < k; i++) {
+		for (j = 0; i + j < k; j++) {
+			mul512(t, a + BLOCK * i, b + BLOCK * j);
+			add_block(r + BLOCK * (i + j), len - BLOCK * (i + j),
+				  t);
+		}
+	}
+}
+
+/* r = a - b, returns the borrow */
+static uint64_t sub(uint64_t *r, const uint64_t *a, const uint64_t *b,
+		    unsigned int len)
+{
+	uint64_t borrow = 0, t;
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		t = a[i] - b[i];
+		r[i] = t - borrow;
+		borrow = (a[i] < b[i]) | (t < borrow);
+	}
+	return borrow;
+}
+
+/* r = a if mask is all ones, r unchanged if mask is 0 */
+static void select_if(uint64_t *r, const uint64_t *a, uint64_t mask,
+		      unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		r[i] = (r[i] & ~mask) | (a[i] & mask);
+}
+
+/* r = t / R mod n for t < n * R, r < n */
+static void redc(uint64_t *r, uint64_t *t, const struct mont_ctx *ctx)
+{
+	uint64_t m[MAX_DIGITS], u[2 * MAX_DIGITS], d[MAX_DIGITS];
+	uint64_t carry = 0, borrow, mask, s;
+	unsigned int i, len = ctx->len;
+
+	mul_low(m, t, ctx->n_inv, ctx->k);
+	mul_full(u, m, ctx->n, ctx->k);
+
+	/* t + u is divisible by R: only the carry of the lower half counts */
+	for (i = 0; i < 2 * len; i++) {
+		s = t[i] + carry;
+		carry = s < carry;
+		s += u[i];
+		carry += s < u[i];
+		if (i >= len)
+			r[i - len] = s;
+	}
+
+	/*
+	 * r + carry * R < 2n: subtract n once, if that is >= n, i.e. unless
+	 * r - n borrows and there is no carry.
+	 */
+	borrow = sub(d, r, ctx->n, len);
+	mask = (uint64_t)0 - (uint64_t)(1 - (borrow & (carry ^ 1)));
+	select_if(r, d, mask, len);
+
+	OPENSSL_cleanse(m, sizeof(m));
+	OPENSSL_cleanse(u, sizeof(u));
+	OPENSSL_cleanse(d, sizeof(d));
+}
+
+static void mont_mul(uint64_t *r, const uint64_t *a, const uint64_t *b,
+		     const struct mont_ctx *ctx)
+{
+	uint64_t t[2 * MAX_DIGITS];
+
+	mul_full(t, a, b, ctx->k);
+	redc(r, t, ctx);
+}
+
+static void mont_sqr(uint64_t *r, const uint64_t *a,
+		     const struct mont_ctx *ctx)
+{
+	uint64_t t[2 * MAX_DIGITS];
+
+	sqr_full(t, a, ctx->k);
+	redc(r, t, ctx);
+}
+
+/* r = a * b mod 2^(64 * len), schoolbook, for the set up only */
+static void mul_low_c(uint64_t *r, const uint64_t *a, const uint64_t *b,
+		      unsigned int len)
+{
+	uint64_t t[MAX_DIGITS], carry;
+	uint128_t p;
+	unsigned int i, j;
+
+	memset(t, 0, len * sizeof(uint64_t));
+	for (i = 0; i < len; i++) {
+		carry = 0;
+		for (j = 0; i + j < len; j++) {
+			p = (uint128_t)a[i] * b[j] + t[i + j] + carry;
+			t[i + j] = (uint64_t)p;
+			carry = (uint64_t)(p >> 64);
+		}
+	}
+	memcpy(r, t, len * sizeof(uint64_t));
+}
+
+/* n' = -1/n mod R by Newton iteration x = x * (2 - n * x) */
+static void mont_n_inv(struct mont_ctx *ctx)
+{
+	uint64_t x[MAX_DIGITS], t[MAX_DIGITS], zero[MAX_DIGITS], carry;
+	unsigned int i, prec;
+
+	memset(x, 0, sizeof(x));
+	memset(zero, 0, sizeof(zero));
+
+	/* 1/n mod 2^64: n is its own inverse mod 8, precision doubles */
+	x[0] = ctx->n[0];
+	for (i = 0; i < 5; i++)
+		x[0] *= 2 - ctx->n[0] * x[0];
+
+	for (prec = 2; prec / 2 < ctx->len; prec *= 2) {
+		if (prec > ctx->len)
+			prec = ctx->len;
+		mul_low_c(t, ctx->n, x, prec);
+		sub(t, zero, t, prec);
+		for (carry = 2, i = 0; i < prec; i++) {
+			t[i] += carry;
+			carry = t[i] < carry;
+		}
+		mul_low_c(x, x, t, prec);
+	}
+
+	sub(ctx->n_inv, zero, x, ctx->len);
+}
+
+static void bin2digits(uint64_t *r, unsigned int len, const unsigned char *bin,
+		       int bin_length)
+{
+	int i;
+
+	memset(r, 0, len * sizeof(uint64_t));
+	for (i = 0; i < bin_length; i++)
+		r[i / 8] |= (uint64_t)bin[bin_length - 1 - i] << (8 * (i % 8));
+}
+
+static int mont_ctx_init(struct mont_ctx *ctx, const unsigned char *mod,
+			 int mod_length)
+{
+	unsigned char r2[RSA_MONT_MAX_BITS / 8];
+	BIGNUM *r, *n;
+	BN_CTX *bn_ctx;
+	int rc = ENOMEM;
+
+	/* leading zeros */
+	while (mod_length > 0 && *mod == 0) {
+		mod++;
+		mod_length--;
+	}
+	if (mod_length == 0 || mod_length * 8 > RSA_MONT_MAX_BITS ||
+	    !(mod[mod_length - 1] & 1))
+		return RSA_MONT_UNSUPPORTED;
+
+	ctx->k = (mod_length + 63) / 64;
+	ctx->len = BLOCK * ctx->k;
+	bin2digits(ctx->n, ctx->len, mod, mod_length);
+	mont_n_inv(ctx);
+
+	/* R^2 mod n */
+	bn_ctx = BN_CTX_new();
+	r = BN_new();
+	n = BN_bin2bn(mod, mod_length, NULL);
+	if (n)
+		BN_set_flags(n, BN_FLG_CONSTTIME);	/* p or q */
+	if (bn_ctx && r && n && BN_set_bit(r, 2 * 512 * ctx->k) &&
+	    BN_mod(r, r, n, bn_ctx) &&
+	    BN_bn2binpad(r, r2, 64 * ctx->k) > 0) {
+		bin2digits(ctx->r2, ctx->len, r2, 64 * ctx->k);
+		rc = 0;
+	}
+
+	OPENSSL_cleanse(r2, sizeof(r2));
+	BN_CTX_free(bn_ctx);
+	BN_clear_free(r);
+	BN_clear_free(n);
+	return rc;
+}
+
+/* r = table[index], reading all entries */
+static void table_lookup(uint64_t *r, const uint64_t *table,
+			 unsigned int index, unsigned int len)
+{
+	uint64_t mask;
+	unsigned int i;
+
+	memset(r, 0, len * sizeof(uint64_t));
+	for (i = 0; i < (1 << WINDOW); i++) {
+		mask = (uint64_t)0 - (uint64_t)(i == index);
+		select_if(r, table + i * len, mask, len);
+	}
+}
+
+static unsigned int exp_window(const unsigned char *exp, int exp_length,
+			       int bit)
+{
+	/* bit: position of the window's lowest bit, WINDOW divides 8 */
+	return (exp[exp_length - 1 - bit / 8] >> (bit % 8)) &
+	       ((1 << WINDOW) - 1);
+}
+
+int rsa_mont_accelerated(void)
+{
+	uint64_t r[16], a[8];
+
+	memset(a, 0, sizeof(a));
+	return ica_mp_sqr512(r, a) == 0;
+}
+
+int rsa_mont_mod_expo(unsigned char *res, int res_length,
+		      const unsigned char *arg, int arg_length,
+		      const unsigned char *exp, int exp_length,
+		      const unsigned char *mod, int mod_length)
+{
+	uint64_t table[(1 << WINDOW) * MAX_DIGITS];
+	uint64_t a[MAX_DIGITS], acc[MAX_DIGITS], t[MAX_DIGITS];
+	struct mont_ctx ctx;
+	unsigned int i, len;
+	int bit, rc;
+
+	if ((rc = mont_ctx_init(&ctx, mod, mod_length)) != 0)
+		return rc;
+	len = ctx.len;
+
+	while (arg_length > 0 && *arg == 0) {
+		arg++;
+		arg_length--;
+	}
+	if (arg_length > 64 * (int)ctx.k)
+		return RSA_MONT_UNSUPPORTED;
+	bin2digits(a, len, arg, arg_length);
+
+	/* like BN_mod_exp_mont_consttime, the exponent's length is public */
+	while (exp_length > 0 && *exp == 0) {
+		exp++;
+		exp_length--;
+	}
+
+	/* table[i] = a^i * R mod n; a * R^2 < n * R as a < R */
+	memset(t, 0, sizeof(t));
+	t[0] = 1;
+	mont_mul(table, t, ctx.r2, &ctx);
+	mont_mul(table + len, a, ctx.r2, &ctx);
+	for (i = 2; i < (1 << WINDOW); i++)
+		mont_mul(table + i * len, table + (i - 1) * len, table + len,
+			 &ctx);
+
+	memcpy(acc, table, len * sizeof(uint64_t));
+	for (bit = 8 * exp_length - WINDOW; bit >= 0; bit -= WINDOW) {
+		for (i = 0; i < WINDOW; i++)
+			mont_sqr(acc, acc, &ctx);
+		table_lookup(t, table, exp_window(exp, exp_length, bit), len);
+		mont_mul(acc, acc, t, &ctx);
+	}
+
+	/* out of the Montgomery domain */
+	memset(t, 0, sizeof(t));
+	t[0] = 1;
+	mont_mul(acc, acc, t, &ctx);
+
+	rc = 0;
+	memset(res, 0, res_length);
+	for (i = 0; i < 8 * len; i++) {
+		unsigned char byte = acc[i / 8] >> (8 * (i % 8));
+
+		if ((int)i < res_length)
+			res[res_length - 1 - i] = byte;
+		else if (byte)
+			rc = EINVAL;
+	}
+
+	OPENSSL_cleanse(table, sizeof(table));
+	OPENSSL_cleanse(a, sizeof(a));
+	OPENSSL_cleanse(acc, sizeof(acc));
+	OPENSSL_cleanse(t, sizeof(t));
+	return rc;
+}
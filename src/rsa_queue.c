@@ -0,0 +1,244 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "ica_api.h"
+#include "rsa_queue.h"
+
+/*
+ * A queue has two rings of depth entries: the submitted requests, which
+ * wait for a worker, and the completed ones, which wait for ica_rsa_poll.
+ * Since at most depth requests are outstanding, neither can overflow.
+ * The eventfd counts the completed requests (EFD_SEMAPHORE), it is written
+ * and read under the lock, so it is readable exactly while the completion
+ * ring is not empty.
+ */
+struct ica_rsa_queue {
+	ica_adapter_handle_t adapter_handle;
+	pthread_mutex_t lock;
+	pthread_cond_t submitted;
+	pthread_cond_t completed;
+	ica_rsa_request_t **sub;
+	ica_rsa_request_t **done;
+	unsigned int depth;
+	unsigned int sub_head, sub_count;
+	unsigned int done_head, done_count;
+	unsigned int outstanding;
+	int efd;
+	int stop;
+	unsigned int threads;
+	pthread_t tid[];
+};
+
+/* the eventfd cannot overflow or underflow, see struct ica_rsa_queue */
+static void rsa_queue_efd_add(ICA_RSA_QUEUE *queue)
+{
+	uint64_t one = 1;
+	ssize_t rc;
+
+	rc = write(queue->efd, &one, sizeof(one));
+	(void)rc;
+}
+
+static void rsa_queue_efd_sub(ICA_RSA_QUEUE *queue)
+{
+	uint64_t one;
+	ssize_t rc;
+
+	rc = read(queue->efd, &one, sizeof(one));
+	(void)rc;
+}
+
+static void rsa_queue_execute(ica_adapter_handle_t adapter_handle,
+			      ica_rsa_request_t *req)
+{
+	if (req->type == ICA_RSA_REQ_MOD_EXPO)
+		req->status = req->prepared ?
+			ica_rsa_mod_expo_prepared(adapter_handle,
+						  req->input_data,
+						  req->prepared,
+						  req->output_data) :
+			ica_rsa_mod_expo(adapter_handle, req->input_data,
+					 req->mod_expo_key, req->output_data);
+	else
+		req->status = req->prepared ?
+			ica_rsa_crt_prepared(adapter_handle, req->input_data,
+					     req->prepared, req->output_data) :
+			ica_rsa_crt(adapter_handle, req->input_data,
+				    req->crt_key, req->output_data);
+}
+
+static void *rsa_queue_worker(void *arg)
+{
+	ICA_RSA_QUEUE *queue = arg;
+	ica_rsa_request_t *req;
+
+	pthread_mutex_lock(&queue->lock);
+	for (;;) {
+		while (!queue->sub_count && !queue->stop)
+			pthread_cond_wait(&queue->submitted, &queue->lock);
+		if (!queue->sub_count)
+			break;
+
+		req = queue->sub[queue->sub_head];
+		queue->sub_head = (queue->sub_head + 1) % queue->depth;
+		queue->sub_count--;
+		pthread_mutex_unlock(&queue->lock);
+
+		/* the blocking part, in parallel with the other workers */
+		rsa_queue_execute(queue->adapter_handle, req);
+
+		pthread_mutex_lock(&queue->lock);
+		queue->done[(queue->done_head + queue->done_count)
+			    % queue->depth] = req;
+		queue->done_count++;
+		rsa_queue_efd_add(queue);
+		pthread_cond_signal(&queue->completed);
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return NULL;
+}
+
+static void rsa_queue_destroy(ICA_RSA_QUEUE *queue)
+{
+	pthread_cond_destroy(&queue->completed);
+	pthread_cond_destroy(&queue->submitted);
+	pthread_mutex_destroy(&queue->lock);
+	if (queue->efd >= 0)
+		close(queue->efd);
+	free(queue->sub);
+	free(queue->done);
+	free(queue);
+}
+
+/* stops the workers after they processed all submitted requests */
+static void rsa_queue_stop(ICA_RSA_QUEUE *queue)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&queue->lock);
+	queue->stop = 1;
+	pthread_cond_broadcast(&queue->submitted);
+	pthread_mutex_unlock(&queue->lock);
+
+	for (i = 0; i < queue->threads; i++)
+		pthread_join(queue->tid[i], NULL);
+}
+
+unsigned int rsa_queue_new(ica_adapter_handle_t adapter_handle,
+			   unsigned int in_flight, unsigned int depth,
+			   ICA_RSA_QUEUE **queue)
+{
+	ICA_RSA_QUEUE *q;
+
+	q = calloc(1, sizeof(*q) + in_flight * sizeof(pthread_t));
+	if (q == NULL)
+		return ENOMEM;
+
+	q->adapter_handle = adapter_handle;
+	q->depth = depth;
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->submitted, NULL);
+	pthread_cond_init(&q->completed, NULL);
+	q->sub = calloc(depth, sizeof(*q->sub));
+	q->done = calloc(depth, sizeof(*q->done));
+	q->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE);
+	if (q->sub == NULL || q->done == NULL || q->efd < 0) {
+		rsa_queue_destroy(q);
+		return ENOMEM;
+	}
+
+	for (q->threads = 0; q->threads < in_flight; q->threads++) {
+		if (pthread_create(&q->tid[q->threads], NULL,
+				   rsa_queue_worker, q)) {
+			rsa_queue_stop(q);
+			rsa_queue_destroy(q);
+			return EAGAIN;
+		}
+	}
+
+	*queue = q;
+	return 0;
+}
+
+void rsa_queue_free(ICA_RSA_QUEUE *queue)
+{
+	rsa_queue_stop(queue);
+	rsa_queue_destroy(queue);
+}
+
+int rsa_queue_fd(ICA_RSA_QUEUE *queue)
+{
+	return queue->efd;
+}
+
+unsigned int rsa_queue_submit(ICA_RSA_QUEUE *queue,
+			      ica_rsa_request_t *request)
+{
+	pthread_mutex_lock(&queue->lock);
+	if (queue->outstanding == queue->depth) {
+		pthread_mutex_unlock(&queue->lock);
+		return EAGAIN;
+	}
+	queue->outstanding++;
+	queue->sub[(queue->sub_head + queue->sub_count) % queue->depth] =
+		request;
+	queue->sub_count++;
+	pthread_cond_signal(&queue->submitted);
+	pthread_mutex_unlock(&queue->lock);
+
+	return 0;
+}
+
+unsigned int rsa_queue_poll(ICA_RSA_QUEUE *queue,
+			    ica_rsa_request_t **requests, unsigned int max,
+			    int timeout_ms, unsigned int *count)
+{
+	struct timespec deadline;
+	unsigned int n;
+
+	if (timeout_ms > 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock(&queue->lock);
+	while (!queue->done_count && timeout_ms) {
+		if (timeout_ms < 0)
+			pthread_cond_wait(&queue->completed, &queue->lock);
+		else if (pthread_cond_timedwait(&queue->completed, &queue->lock,
+						&deadline) == ETIMEDOUT)
+			break;
+	}
+
+	for (n = 0; n < max && queue->done_count; n++) {
+		requests[n] = queue->done[queue->done_head];
+		queue->done_head = (queue->done_head + 1) % queue->depth;
+		queue->done_count--;
+		queue->outstanding--;
+		rsa_queue_efd_sub(queue);
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	*count = n;
+	return 0;
+}
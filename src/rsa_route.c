@@ -0,0 +1,158 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ *
+ * Copyright IBM Corp. 2021
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "icastats.h"
+#include "init.h"
+#include "rsa_route.h"
+
+/*
+ * Each bucket keeps an exponentially weighted moving average of the
+ * latency of the adapter and of the software fallback, and of the error
+ * rate of the adapter, whose failed requests are done in software as well.
+ * The adapter costs its latency plus the error rate times the software
+ * latency. The bucket starts diverting requests when that is more than
+ * 5/4 of the software latency and stops when it falls below the software
+ * latency again, so that it does not flip on noise. Every
+ * RSA_ROUTE_PROBE_SW-th request goes to software while not diverting and
+ * every RSA_ROUTE_PROBE_HW-th to the adapter while diverting, to keep both
+ * estimates current. The fields are accessed without a lock: a sample lost
+ * to a concurrent update does not matter for an average.
+ */
+#define RSA_ROUTE_SHIFT		3	/* weight of a new sample: 1/8 */
+#define RSA_ROUTE_ERR_ONE	65536	/* error rate 1 */
+#define RSA_ROUTE_PROBE_SW	1024
+#define RSA_ROUTE_PROBE_HW	16
+
+struct rsa_route {
+	uint64_t hw_ns;		/* 0 if not yet measured */
+	uint64_t sw_ns;		/* 0 if not yet measured */
+	uint64_t hw_err;	/* in 1 / RSA_ROUTE_ERR_ONE */
+	uint64_t count;
+	int diverting;
+} __attribute__((aligned(256)));
+
+static struct rsa_route routes[RSA_ROUTE_BUCKETS];
+
+static uint64_t ewma(uint64_t avg, uint64_t sample)
+{
+	return avg - (avg >> RSA_ROUTE_SHIFT) + (sample >> RSA_ROUTE_SHIFT);
+}
+
+/* a latency of 0 means that the path was not measured yet */
+static void ewma_latency(uint64_t *avg, uint64_t nsec)
+{
+	uint64_t old = __atomic_load_n(avg, __ATOMIC_RELAXED);
+
+	nsec = old ? ewma(old, nsec) : nsec;
+	__atomic_store_n(avg, nsec ? nsec : 1, __ATOMIC_RELAXED);
+}
+
+/* applies the hysteresis and records a change as a fallback event */
+static void rsa_route_update(unsigned int bucket)
+{
+	struct rsa_route *route = &routes[bucket];
+	uint64_t hw, sw, err, cost;
+	int diverting, to;
+
+	hw = __atomic_load_n(&route->hw_ns, __ATOMIC_RELAXED);
+	sw = __atomic_load_n(&route->sw_ns, __ATOMIC_RELAXED);
+	err = __atomic_load_n(&route->hw_err, __ATOMIC_RELAXED);
+	if (hw == 0 || sw == 0)
+		return;
+
+	cost = hw + sw * err / RSA_ROUTE_ERR_ONE;
+	diverting = __atomic_load_n(&route->diverting, __ATOMIC_RELAXED);
+	if (!diverting && cost * 4 > sw * 5)
+		to = 1;
+	else if (diverting && cost < sw)
+		to = 0;
+	else
+		return;
+
+	if (__atomic_compare_exchange_n(&route->diverting, &diverting, to, 0,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		stats_fallback_event(ICA_STATS_RSA_CRT_512 + bucket,
+				     to ? STATS_FB_ROUTE_SW : STATS_FB_ROUTE_HW,
+				     0);
+}
+
+int rsa_route_divert(unsigned int bucket)
+{
+	struct rsa_route *route = &routes[bucket];
+	unsigned int percent = ica_rsa_route_mode;
+	uint64_t n;
+
+	if (percent == 0)
+		return 0;
+
+	n = __atomic_fetch_add(&route->count, 1, __ATOMIC_RELAXED);
+	if (!__atomic_load_n(&route->diverting, __ATOMIC_RELAXED))
+		return n % RSA_ROUTE_PROBE_SW == 0;
+	if (n % RSA_ROUTE_PROBE_HW == 0)
+		return 0;
+
+	/* percent of the requests, evenly spread */
+	return n * percent / 100 != (n + 1) * percent / 100;
+}
+
+uint64_t rsa_route_clock(void)
+{
+	struct timespec ts;
+
+	if (ica_rsa_route_mode == 0)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void rsa_route_record(unsigned int bucket, int hardware, uint64_t begin,
+		      int failed)
+{
+	uint64_t end;
+
+	if (begin == 0)
+		return;
+
+	end = rsa_route_clock();
+	rsa_route_sample(bucket, hardware, end > begin ? end - begin : 1,
+			 failed);
+}
+
+void rsa_route_sample(unsigned int bucket, int hardware, uint64_t nsec,
+		      int failed)
+{
+	struct rsa_route *route = &routes[bucket];
+
+	if (hardware) {
+		__atomic_store_n(&route->hw_err,
+				 ewma(__atomic_load_n(&route->hw_err,
+						      __ATOMIC_RELAXED),
+				      failed ? RSA_ROUTE_ERR_ONE : 0),
+				 __ATOMIC_RELAXED);
+		if (!failed)
+			ewma_latency(&route->hw_ns, nsec);
+	} else if (!failed) {
+		ewma_latency(&route->sw_ns, nsec);
+	}
+
+	rsa_route_update(bucket);
+}
+
+int rsa_route_diverting(unsigned int bucket)
+{
+	return __atomic_load_n(&routes[bucket].diverting, __ATOMIC_RELAXED);
+}
+
+void rsa_route_reset(void)
+{
+	memset(routes, 0, sizeof(routes));
+}
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #include "fips.h"
 #include "init.h"
@@ -37,10 +38,8 @@ unsigned int sha1_switch, sha256_switch, sha512_switch, sha3_switch, des_switch,
 	     msa4_switch, msa5_switch, msa8_switch, trng_switch, msa9_switch,
 		 ecc_via_online_card, any_card_online;
 
-#define CARD_AVAILABLE		0x01
-#define CEXnA_AVAILABLE		0x02
-#define CEXnC_AVAILABLE		0x04
-#define CEX4C_AVAILABLE		0x08
+/* serializes the updates of the card switches and the function list */
+static pthread_mutex_t cards_lock = PTHREAD_MUTEX_INITIALIZER;
 
 s390_supported_function_t s390_kimd_functions[] = {
 	{SHA_1, S390_CRYPTO_SHA_1, &sha1_switch},
@@ -375,13 +374,32 @@ end:
 #define AP_PATH  "/sys/devices/ap"
 #define MAX_DEV_LEN 280
 
-unsigned int search_for_cards()
+unsigned int card_type_flags(const char *type)
 {
-	DIR *sysDir;
 	unsigned int ret = 0;
+
+	if (type[4] == 'A')
+		ret |= CARD_AVAILABLE | CEXnA_AVAILABLE;
+
+	if (type[4] == 'C')
+		ret |= CARD_AVAILABLE | CEXnC_AVAILABLE;
+
+	if (type[3] >= '4' && type[4] == 'C')
+		ret |= CARD_AVAILABLE | CEX4C_AVAILABLE;
+
+	return ret;
+}
+
+unsigned int for_each_online_card(void (*fn)(unsigned int card,
+					     const char *type, void *arg),
+				  void *arg)
+{
+	DIR *sysDir;
+	unsigned int num = 0;
+	unsigned long card;
 	char dev[MAX_DEV_LEN] = AP_PATH;
 	struct dirent *direntp;
-	char type[6];
+	char type[6], *end;
 
 	if ((sysDir = opendir(dev)) == NULL)
 		return 0;
@@ -391,6 +409,10 @@ unsigned int search_for_cards()
 		/* Skip entries that are not like "card01", "card02", etc. */
 		if (strncmp(direntp->d_name, "card", 4) != 0)
 			continue;
+		card = strtoul(direntp->d_name + 4, &end, 16);
+		if (end == direntp->d_name + 4 || *end != '\0' ||
+		    card >= MAX_CARDS)
+			continue;
 
 		/* Check if device online */
 		snprintf(dev, MAX_DEV_LEN, "%s/%s/online", AP_PATH, direntp->d_name);
@@ -403,36 +425,38 @@ unsigned int search_for_cards()
 		if (!get_device_type(dev, type))
 			continue;
 
-		/* Now setup return value according to found card */
-		if (type[4] == 'A')
-			ret |= CARD_AVAILABLE | CEXnA_AVAILABLE;
-
-		if (type[4] == 'C')
-			ret |= CARD_AVAILABLE | CEXnC_AVAILABLE;
-
-		if (type[3] >= '4' && type[4] == 'C')
-			ret |= CARD_AVAILABLE | CEX4C_AVAILABLE;
+		fn(card, type, arg);
+		num++;
 	}
 
 	closedir(sysDir);
 
+	return num;
+}
+
+static void add_card_flags(unsigned int card, const char *type, void *arg)
+{
+	(void)card;
+	*(unsigned int *)arg |= card_type_flags(type);
+}
+
+unsigned int search_for_cards()
+{
+	unsigned int ret = 0;
+
+	for_each_online_card(add_card_flags, &ret);
+
 	return ret;
 }
 
 void s390_crypto_switches_init(void)
 {
-	int msa, flags;
+	int msa;
 
 	msa = read_facility_bits();
 	if (!msa)
 		msa = read_cpuinfo();
 
-	flags = search_for_cards();
-	if (flags & CARD_AVAILABLE)
-		any_card_online = 1;
-	if (flags & CEX4C_AVAILABLE)
-		ecc_via_online_card = 1;
-
 	set_switches(msa);
 }
 
@@ -493,16 +517,16 @@ libica_func_list_element_int icaList[] = {
  {EC_DSA_SIGN,	ADAPTER, 0, ICA_FLAG_SW, 0},
  {EC_DSA_VERIFY, ADAPTER, 0, ICA_FLAG_SW, 0},
  {EC_KGEN,      ADAPTER, 0, ICA_FLAG_SW, 0},
- {ED25519_KEYGEN, MSA9, SCALAR_MULTIPLY_ED25519, 0, 0},
- {ED25519_SIGN,   MSA9, EDDSA_SIGN_ED25519, 0, 0},
- {ED25519_VERIFY, MSA9, EDDSA_VERIFY_ED25519, 0, 0},
- {ED448_KEYGEN,   MSA9, SCALAR_MULTIPLY_ED448, 0, 0},
- {ED448_SIGN,     MSA9, EDDSA_SIGN_ED448, 0, 0},
- {ED448_VERIFY,   MSA9, EDDSA_VERIFY_ED448, 0, 0},
- {X25519_KEYGEN,   MSA9, SCALAR_MULTIPLY_X25519, 0, 0},
- {X25519_DERIVE,   MSA9, SCALAR_MULTIPLY_X25519, 0, 0},
- {X448_KEYGEN,   MSA9, SCALAR_MULTIPLY_X448, 0, 0},
- {X448_DERIVE,   MSA9, SCALAR_MULTIPLY_X448, 0, 0},
+ {ED25519_KEYGEN, MSA9, SCALAR_MULTIPLY_ED25519, ICA_FLAG_SW, 0},
+ {ED25519_SIGN,   MSA9, EDDSA_SIGN_ED25519, ICA_FLAG_SW, 0},
+ {ED25519_VERIFY, MSA9, EDDSA_VERIFY_ED25519, ICA_FLAG_SW, 0},
+ {ED448_KEYGEN,   MSA9, SCALAR_MULTIPLY_ED448, ICA_FLAG_SW, 0},
+ {ED448_SIGN,     MSA9, EDDSA_SIGN_ED448, ICA_FLAG_SW, 0},
+ {ED448_VERIFY,   MSA9, EDDSA_VERIFY_ED448, ICA_FLAG_SW, 0},
+ {X25519_KEYGEN,   MSA9, SCALAR_MULTIPLY_X25519, ICA_FLAG_SW, 0},
+ {X25519_DERIVE,   MSA9, SCALAR_MULTIPLY_X25519, ICA_FLAG_SW, 0},
+ {X448_KEYGEN,   MSA9, SCALAR_MULTIPLY_X448, ICA_FLAG_SW, 0},
+ {X448_DERIVE,   MSA9, SCALAR_MULTIPLY_X448, ICA_FLAG_SW, 0},
  {RSA_ME,       ADAPTER, 0, ICA_FLAG_SW, 0},
  {RSA_CRT,      ADAPTER, 0, ICA_FLAG_SW, 0},
  {RSA_KEY_GEN_ME, ADAPTER, 0, ICA_FLAG_SW, 0},  // SW (openssl)
@@ -512,6 +536,52 @@ libica_func_list_element_int icaList[] = {
 
 };
 
+/*
+ * sets the flags and properties of a function list element, which depend on
+ * the online cards, see s390_crypto_cards_rescan. Called with cards_lock.
+ */
+static void functionlist_update_cards(libica_func_list_element_int *e)
+{
+	unsigned int flags = e->flags, property = e->property;
+
+	switch ((int) e->mech_mode_id) {
+	case EC_DH: /* fall-through */
+	case EC_DSA_SIGN: /* fall-through */
+	case EC_DSA_VERIFY: /* fall-through */
+	case EC_KGEN:
+		flags &= ~ICA_FLAG_DHW;
+		property &= ~ICA_PROPERTY_EC_BP;
+		if (!flags)
+			property &= ~ICA_PROPERTY_EC_NIST;
+		if (ecc_via_online_card) {
+			flags |= ICA_FLAG_DHW;
+			property |= ICA_PROPERTY_EC_BP | ICA_PROPERTY_EC_NIST;
+		}
+		break;
+	case RSA_ME: /* fall-through */
+	case RSA_CRT:
+		flags &= ~ICA_FLAG_DHW;
+		property &= ~ICA_PROPERTY_RSA_ALL;
+		if (any_card_online) {
+			flags |= ICA_FLAG_DHW;
+			property |= ICA_PROPERTY_RSA_ALL;
+		}
+		break;
+	case RSA_KEY_GEN_ME: /* fall-through */
+	case RSA_KEY_GEN_CRT:
+		/* sw flag already pre-set in icaList */
+		property &= ~ICA_PROPERTY_RSA_ALL;
+		if (any_card_online)
+			property |= ICA_PROPERTY_RSA_ALL;
+		break;
+	default:
+		return;
+	}
+
+	__atomic_store_n(&e->flags, flags, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->property, property, __ATOMIC_RELAXED);
+}
+
 /*
  * initializes the libica function list
  * Query s390_xxx_functions for each algorithm to check
@@ -591,24 +661,6 @@ int s390_initialize_functionlist()
 			e->flags |= *s390_kdsa_functions[e->id].enabled ? ICA_FLAG_SHW : 0;
 			if (e->flags)
 				e->property |= ICA_PROPERTY_EC_NIST;
-			if (ecc_via_online_card) {
-				e->flags |= ICA_FLAG_DHW;
-				e->property |= ICA_PROPERTY_EC_BP | ICA_PROPERTY_EC_NIST;
-			}
-			break;
-		case RSA_ME: /* fall-through */
-		case RSA_CRT:
-			if (any_card_online) {
-				e->flags |= ICA_FLAG_DHW;
-				e->property |= ICA_PROPERTY_RSA_ALL;
-			}
-			break;
-		case RSA_KEY_GEN_ME: /* fall-through */
-		case RSA_KEY_GEN_CRT:
-			if (any_card_online) {
-				/* sw flag already pre-set in icaList */
-				e->property |= ICA_PROPERTY_RSA_ALL;
-			}
 			break;
 		default:
 			/* Do nothing. */
@@ -616,9 +668,45 @@ int s390_initialize_functionlist()
 		}
 	}
 
+	pthread_mutex_lock(&cards_lock);
+	for (x = 0; x < list_len; x++)
+		functionlist_update_cards(&icaList[x]);
+	pthread_mutex_unlock(&cards_lock);
+
 	return 0;
 }
 
+/* Card discovery walks /sys/devices/ap, so it is done on first use of an
+ * adapter only, and repeated at most every ica_card_rescan_interval ms
+ * afterwards, see ica_init_cards.
+ */
+void s390_crypto_cards_init(void)
+{
+	s390_crypto_cards_rescan();
+}
+
+void s390_crypto_cards_rescan(void)
+{
+	unsigned int flags, x;
+
+	flags = search_for_cards();
+
+	pthread_mutex_lock(&cards_lock);
+	if ((any_card_online != 0) == !!(flags & CARD_AVAILABLE) &&
+	    (ecc_via_online_card != 0) == !!(flags & CEX4C_AVAILABLE)) {
+		pthread_mutex_unlock(&cards_lock);
+		return;
+	}
+
+	__atomic_store_n(&any_card_online, flags & CARD_AVAILABLE ? 1 : 0,
+			 __ATOMIC_RELAXED);
+	__atomic_store_n(&ecc_via_online_card, flags & CEX4C_AVAILABLE ? 1 : 0,
+			 __ATOMIC_RELAXED);
+	for (x = 0; x < sizeof(icaList) / sizeof(icaList[0]); x++)
+		functionlist_update_cards(&icaList[x]);
+	pthread_mutex_unlock(&cards_lock);
+}
+
 /**
  * Function that returns a list of crypto mechanisms supported by libica.
  * @param pmech_list
@@ -665,8 +753,10 @@ int s390_get_functionlist(libica_func_list_element *pmech_list,
 
   for (x = 0; x < *pmech_list_len; x++) {
       pmech_list[x].mech_mode_id = icaList[x].mech_mode_id;
-      pmech_list[x].flags        = icaList[x].flags;
-      pmech_list[x].property     = icaList[x].property;
+      pmech_list[x].flags        = __atomic_load_n(&icaList[x].flags,
+						    __ATOMIC_RELAXED);
+      pmech_list[x].property     = __atomic_load_n(&icaList[x].property,
+						    __ATOMIC_RELAXED);
 #ifdef ICA_FIPS
 	/* Disable the algorithm in the following cases:
 	 * - We are running in FIPS mode and the algorithm is not FIPS
@@ -25,6 +25,8 @@
 #include <openssl/fips.h>
 #endif /* OPENSSL_FIPS */
 
+#include "adapter_pool.h"
+#include "ec_comb.h"
 #include "fips.h"
 #include "s390_ecc.h"
 #include "s390_crypto.h"
@@ -81,6 +83,25 @@ static int is_supported_openssl_curve(int nid)
 	return ptr ? 1 : 0;
 }
 
+/**
+ * calculates the public key (X,Y) of the private key D with the comb tables,
+ * see ec_comb.h. Not for the NIST curves with MSA 9, where OpenSSL's s390x
+ * implementation uses the PCC instruction, and not in FIPS mode, where the
+ * FIPS provider derives the public keys like in eckeygen_sw.
+ */
+static int ec_comb_pubkey(unsigned int nid, const unsigned char *d,
+			  unsigned char *x, unsigned char *y)
+{
+	if (curve_supported_via_cpacf(nid))
+		return ENODEV;
+#ifdef ICA_FIPS
+	if (fips & ICA_FIPS_MODE)
+		return ENODEV;
+#endif /* ICA_FIPS */
+
+	return ec_comb_mul(nid, d, x, y);
+}
+
 #if OPENSSL_VERSION_PREREQ(3, 0)
 static int build_pkey_from_params(OSSL_PARAM_BLD *tmpl, int selection,
 								EVP_PKEY **pkey)
@@ -150,39 +171,25 @@ static EVP_PKEY *make_pkey(int nid, const unsigned char *p, size_t plen)
 #if !OPENSSL_VERSION_PREREQ(3, 0)
 	EC_KEY *ec_key = NULL;
 #else
-	unsigned char *pub_key = NULL;
+	unsigned char *pub_key = NULL, comb_pub[1 + 2 * MAX_ECC_PRIV_SIZE];
+	const unsigned char *pub;
 	unsigned int pub_key_len;
 	point_conversion_form_t form;
 	OSSL_PARAM_BLD *tmpl = NULL;
 	int rc;
 #endif
 
-	group = EC_GROUP_new_by_curve_name(nid);
-	if (group == NULL) {
-		goto err;
-	}
-
-	point = EC_POINT_new(group);
-	if (point == NULL) {
-		goto err;
-	}
-
 	bn_priv = BN_bin2bn(p, plen, NULL);
 	if (bn_priv == NULL) {
 		goto err;
 	}
 
-	if (!EC_POINT_mul(group, point, bn_priv, NULL, NULL, NULL)) {
-		goto err;
-	}
-
 #if !OPENSSL_VERSION_PREREQ(3, 0)
 	ec_key = EC_KEY_new_by_curve_name(nid);
 	if (ec_key == NULL) {
 		goto err;
 	}
 
-	EC_POINT_free(point);
 	point = EC_POINT_new(EC_KEY_get0_group(ec_key));
 	if (point == NULL) {
 		goto err;
@@ -205,10 +212,32 @@ static EVP_PKEY *make_pkey(int nid, const unsigned char *p, size_t plen)
 	}
 
 #else
-	form = EC_GROUP_get_point_conversion_form(group);
-	pub_key_len = EC_POINT_point2buf(group, point, form, &pub_key, NULL);
-	if (pub_key_len == 0) {
-		goto err;
+	if (plen == (size_t)privlen_from_nid(nid) &&
+	    ec_comb_pubkey(nid, p, comb_pub + 1, comb_pub + 1 + plen) == 0) {
+		comb_pub[0] = POINT_CONVERSION_UNCOMPRESSED;
+		pub = comb_pub;
+		pub_key_len = 1 + 2 * plen;
+	} else {
+		group = EC_GROUP_new_by_curve_name(nid);
+		if (group == NULL) {
+			goto err;
+		}
+
+		point = EC_POINT_new(group);
+		if (point == NULL) {
+			goto err;
+		}
+
+		if (!EC_POINT_mul(group, point, bn_priv, NULL, NULL, NULL)) {
+			goto err;
+		}
+
+		form = EC_GROUP_get_point_conversion_form(group);
+		pub_key_len = EC_POINT_point2buf(group, point, form, &pub_key, NULL);
+		if (pub_key_len == 0) {
+			goto err;
+		}
+		pub = pub_key;
 	}
 
 	tmpl = OSSL_PARAM_BLD_new();
@@ -217,7 +246,7 @@ static EVP_PKEY *make_pkey(int nid, const unsigned char *p, size_t plen)
 	}
 
 	if (!OSSL_PARAM_BLD_push_utf8_string(tmpl, OSSL_PKEY_PARAM_GROUP_NAME, OBJ_nid2sn(nid), 0) ||
-		!OSSL_PARAM_BLD_push_octet_string(tmpl, OSSL_PKEY_PARAM_PUB_KEY, pub_key, pub_key_len) ||
+		!OSSL_PARAM_BLD_push_octet_string(tmpl, OSSL_PKEY_PARAM_PUB_KEY, pub, pub_key_len) ||
 		!OSSL_PARAM_BLD_push_BN(tmpl, OSSL_PKEY_PARAM_PRIV_KEY, bn_priv)) {
 		goto err;
 	}
@@ -339,6 +368,122 @@ err:
 	return NULL;
 }
 
+/*
+ * OpenSSL objects of an ICA_EC_KEY for the software path. Building the key
+ * pair from D takes a point multiplication and the key checks, which cost
+ * about as much as a signature, so the keys are built on first use and kept
+ * until the ICA_EC_KEY changes, see ica_ec_key_init. A context is used by
+ * one operation at a time; concurrent operations with the same key make
+ * their own.
+ */
+#define EC_KEY_PRIV	0	/* key pair from D */
+#define EC_KEY_PUB	1	/* public key from X, Y */
+
+struct ec_key_cache {
+	EVP_PKEY *pkey[2];
+	EVP_PKEY_CTX *ctx[2];
+};
+
+struct ec_key_cache *ec_key_cache_new(void)
+{
+	return calloc(1, sizeof(struct ec_key_cache));
+}
+
+void ec_key_cache_clear(struct ec_key_cache *cache)
+{
+	int i;
+
+	if (cache == NULL)
+		return;
+
+	for (i = 0; i < 2; i++) {
+		EVP_PKEY_CTX_free(__atomic_exchange_n(&cache->ctx[i], NULL,
+						      __ATOMIC_ACQUIRE));
+		EVP_PKEY_free(__atomic_exchange_n(&cache->pkey[i], NULL,
+						  __ATOMIC_ACQUIRE));
+	}
+}
+
+void ec_key_cache_free(struct ec_key_cache *cache)
+{
+	ec_key_cache_clear(cache);
+	free(cache);
+}
+
+/* a cached key implies the curve is supported by OpenSSL */
+static int ec_key_cached(const ICA_EC_KEY *key, int which)
+{
+	return key->cache != NULL &&
+	       __atomic_load_n(&key->cache->pkey[which], __ATOMIC_ACQUIRE);
+}
+
+/*
+ * returns the key pair (EC_KEY_PRIV) or the public key (EC_KEY_PUB) of key,
+ * to be released with ec_key_put_pkey.
+ */
+static EVP_PKEY *ec_key_get_pkey(const ICA_EC_KEY *key, int which)
+{
+	struct ec_key_cache *cache = key->cache;
+	unsigned int privlen = privlen_from_nid(key->nid);
+	EVP_PKEY *pkey, *old = NULL;
+
+	if (cache != NULL) {
+		pkey = __atomic_load_n(&cache->pkey[which], __ATOMIC_ACQUIRE);
+		if (pkey != NULL)
+			return pkey;
+	}
+
+	if (which == EC_KEY_PRIV)
+		pkey = make_pkey(key->nid, key->D, privlen);
+	else
+		pkey = make_public_pkey(key->nid, key->X, 2 * privlen);
+	if (pkey == NULL || cache == NULL)
+		return pkey;
+
+	if (!__atomic_compare_exchange_n(&cache->pkey[which], &old, pkey, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		/* built by another thread meanwhile */
+		EVP_PKEY_free(pkey);
+		pkey = old;
+	}
+	return pkey;
+}
+
+static void ec_key_put_pkey(const ICA_EC_KEY *key, EVP_PKEY *pkey)
+{
+	if (key->cache == NULL)
+		EVP_PKEY_free(pkey);
+}
+
+/* returns a context for pkey, to be released with ec_key_put_ctx */
+static EVP_PKEY_CTX *ec_key_get_ctx(const ICA_EC_KEY *key, int which,
+				    EVP_PKEY *pkey)
+{
+	EVP_PKEY_CTX *ctx = NULL;
+
+	if (key->cache != NULL)
+		ctx = __atomic_exchange_n(&key->cache->ctx[which], NULL,
+					  __ATOMIC_ACQUIRE);
+	if (ctx == NULL)
+		ctx = EVP_PKEY_CTX_new(pkey, NULL);
+	return ctx;
+}
+
+/* keeps ctx for the next operation, if it completed */
+static void ec_key_put_ctx(const ICA_EC_KEY *key, int which,
+			   EVP_PKEY_CTX *ctx, int completed)
+{
+	EVP_PKEY_CTX *old = NULL;
+
+	if (ctx == NULL)
+		return;
+
+	if (!completed || key->cache == NULL ||
+	    !__atomic_compare_exchange_n(&key->cache->ctx[which], &old, ctx, 0,
+					 __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		EVP_PKEY_CTX_free(ctx);
+}
+
 /**
  * makes a keyblock length field at given struct and returns its length.
  */
@@ -535,6 +680,19 @@ static void finalize_xcrb(struct ica_xcRB* xcrb, struct CPRBX *preqcblk, struct
 	xcrb->reply_control_blk_addr = (void *) prepcblk;
 }
 
+/**
+ * addresses an ica_xcRB struct to the card of a pooled adapter handle, see
+ * ica_adapter_pool_open. The retry after a failure goes to any card again.
+ */
+static void xcrb_set_card(struct ica_xcRB *xcrb,
+			  ica_adapter_handle_t adapter_handle)
+{
+	int card = adapter_pool_card(adapter_handle);
+
+	if (card >= 0)
+		xcrb->user_defined = card;
+}
+
 /**
  * creates an ECDH xcrb request message for zcrypt.
  *
@@ -942,6 +1100,7 @@ unsigned int ecdh_hw(ica_adapter_handle_t adapter_handle,
 		goto ret;
 	}
 
+	xcrb_set_card(&xcrb, adapter_handle);
 	rc = ioctl(adapter_handle, ZSECSENDCPRB, xcrb);
 	if (rc != 0) {
 		dom_addressing = dom_addressing_default_domain;
@@ -995,19 +1154,20 @@ unsigned int ecdh_sw(const ICA_EC_KEY *privkey_A, const ICA_EC_KEY *pubkey_B,
 
 	BEGIN_OPENSSL_LIBCTX(openssl_libctx, ret);
 
-	if (!is_supported_openssl_curve(privkey_A->nid)) {
+	if (!ec_key_cached(privkey_A, EC_KEY_PRIV) &&
+	    !is_supported_openssl_curve(privkey_A->nid)) {
 		ret = EPERM;
 		goto err;
 	}
 
-	a = make_pkey(privkey_A->nid, privkey_A->D, privlen);
-	b = make_public_pkey(pubkey_B->nid, pubkey_B->X, 2 * privlen);
+	a = ec_key_get_pkey(privkey_A, EC_KEY_PRIV);
+	b = ec_key_get_pkey(pubkey_B, EC_KEY_PUB);
 	if (!a || !b) {
 		ret = EIO;
 		goto err;
 	}
 
-	ctx = EVP_PKEY_CTX_new(a, NULL);
+	ctx = ec_key_get_ctx(privkey_A, EC_KEY_PRIV, a);
 	if (ctx == NULL) {
 		ret = EIO;
 		goto err;
@@ -1027,12 +1187,11 @@ unsigned int ecdh_sw(const ICA_EC_KEY *privkey_A, const ICA_EC_KEY *pubkey_B,
 	ret = 0;
 
 err:
+	ec_key_put_ctx(privkey_A, EC_KEY_PRIV, ctx, ret == 0);
 	if (a != NULL)
-		EVP_PKEY_free(a);
+		ec_key_put_pkey(privkey_A, a);
 	if (b != NULL)
-		EVP_PKEY_free(b);
-	if (ctx != NULL)
-		EVP_PKEY_CTX_free(ctx);
+		ec_key_put_pkey(pubkey_B, b);
 
 	END_OPENSSL_LIBCTX(ret);
 	return ret;
@@ -1267,6 +1426,9 @@ static unsigned int provide_pubkey(const ICA_EC_KEY *privkey, unsigned char *X,
 		return 0;
 	}
 
+	if (ec_comb_pubkey(privkey->nid, privkey->D, X, Y) == 0)
+		return 0;
+
 	/* Get (D) as BIGNUM */
 	if ((bn_d = BN_bin2bn(privkey->D, privlen, NULL)) == NULL) {
 		return EFAULT;
@@ -1394,6 +1556,7 @@ unsigned int ecdsa_sign_hw(ica_adapter_handle_t adapter_handle,
 		goto ret;
 	}
 
+	xcrb_set_card(&xcrb, adapter_handle);
 	rc = ioctl(adapter_handle, ZSECSENDCPRB, xcrb);
 	if (rc != 0) {
 		dom_addressing = dom_addressing_default_domain;
@@ -1426,6 +1589,116 @@ ret:
 	return rc;
 }
 
+/*
+ * OpenSSL signs and verifies DER encoded ECDSA-Sig-Value structures,
+ * SEQUENCE { INTEGER r, INTEGER s }, while libica uses r || s. The
+ * conversion is done on the stack: the integers are at most
+ * MAX_ECC_PRIV_SIZE + 1 bytes long, so only the sequence length may need
+ * the long form.
+ */
+#define ECDSA_DER_MAX_SIZE	(3 + 2 * (2 + MAX_ECC_PRIV_SIZE + 1))
+
+/* encodes the unsigned big endian integer in[0..len-1] and returns the length */
+static size_t der_put_integer(unsigned char *out, const unsigned char *in,
+			      size_t len)
+{
+	size_t pad;
+
+	while (len > 1 && in[0] == 0) {
+		in++;
+		len--;
+	}
+	pad = in[0] & 0x80 ? 1 : 0;
+
+	out[0] = 0x02;
+	out[1] = len + pad;
+	out[2] = 0x00;
+	memcpy(out + 2 + pad, in, len);
+	return 2 + pad + len;
+}
+
+/* encodes the signature r || s and returns the length of der */
+static size_t ecdsa_sig_to_der(const unsigned char *sig, size_t privlen,
+			       unsigned char der[ECDSA_DER_MAX_SIZE])
+{
+	size_t len;
+
+	len = der_put_integer(der + 3, sig, privlen);
+	len += der_put_integer(der + 3 + len, sig + privlen, privlen);
+
+	der[0] = 0x30;
+	if (len < 0x80) {
+		der[1] = len;
+		memmove(der + 2, der + 3, len);
+		return 2 + len;
+	}
+	der[1] = 0x81;
+	der[2] = len;
+	return 3 + len;
+}
+
+/*
+ * decodes the integer at *der into out[0..len-1] and advances *der.
+ * Returns 0 if successful, -1 if malformed or longer than len.
+ */
+static int der_get_integer(const unsigned char **der, const unsigned char *end,
+			   unsigned char *out, size_t len)
+{
+	const unsigned char *p = *der;
+	size_t n;
+
+	if (end - p < 2 || p[0] != 0x02 || p[1] == 0 || p[1] >= 0x80 ||
+	    (size_t)(end - p - 2) < p[1])
+		return -1;
+	n = p[1];
+	p += 2;
+	*der = p + n;
+
+	/* r and s are positive */
+	if (p[0] & 0x80)
+		return -1;
+
+	while (n > 0 && p[0] == 0) {
+		p++;
+		n--;
+	}
+	if (n > len)
+		return -1;
+	memset(out, 0, len - n);
+	memcpy(out + len - n, p, n);
+	return 0;
+}
+
+/*
+ * decodes the DER encoded signature into r || s.
+ * Returns 0 if successful, -1 if malformed.
+ */
+static int der_to_ecdsa_sig(const unsigned char *der, size_t derlen,
+			    unsigned char *sig, size_t privlen)
+{
+	const unsigned char *end = der + derlen;
+	size_t len;
+
+	if (derlen < 2 || der[0] != 0x30)
+		return -1;
+	if (der[1] < 0x80) {
+		len = der[1];
+		der += 2;
+	} else if (der[1] == 0x81 && derlen >= 3) {
+		len = der[2];
+		der += 3;
+	} else {
+		return -1;
+	}
+	if ((size_t)(end - der) != len)
+		return -1;
+
+	if (der_get_integer(&der, end, sig, privlen) ||
+	    der_get_integer(&der, end, sig + privlen, privlen) || der != end)
+		return -1;
+	return 0;
+}
+
 /**
  * creates an ECDSA signature in software using OpenSSL.
  * Returns 0 if successful
@@ -1436,13 +1709,10 @@ unsigned int ecdsa_sign_sw(const ICA_EC_KEY *privkey,
 		unsigned char *signature)
 {
 	int rc = 0;
-    EVP_PKEY *ec_pkey = NULL;
-    ECDSA_SIG *sig = NULL;
-    const BIGNUM *r, *s;
-    EVP_PKEY_CTX *ctx = NULL;
-    size_t siglen;
-    unsigned char *sigbuf = NULL;
-    const unsigned char *p;
+	EVP_PKEY *ec_pkey = NULL;
+	EVP_PKEY_CTX *ctx = NULL;
+	unsigned char der[ECDSA_DER_MAX_SIZE];
+	size_t derlen = sizeof(der);
 	unsigned int privlen = privlen_from_nid(privkey->nid);
 
 #ifdef ICA_FIPS
@@ -1452,18 +1722,19 @@ unsigned int ecdsa_sign_sw(const ICA_EC_KEY *privkey,
 
 	BEGIN_OPENSSL_LIBCTX(openssl_libctx, rc);
 
-	if (!is_supported_openssl_curve(privkey->nid)) {
+	if (!ec_key_cached(privkey, EC_KEY_PRIV) &&
+	    !is_supported_openssl_curve(privkey->nid)) {
 		rc = EPERM;
 		goto err;
 	}
 
-	ec_pkey = make_pkey(privkey->nid, privkey->D, privlen);
+	ec_pkey = ec_key_get_pkey(privkey, EC_KEY_PRIV);
 	if (ec_pkey == NULL) {
 		rc = EIO;
 		goto err;
 	}
 
-	ctx = EVP_PKEY_CTX_new(ec_pkey, NULL);
+	ctx = ec_key_get_ctx(privkey, EC_KEY_PRIV, ec_pkey);
 	if (ctx == NULL) {
 		rc = EIO;
 		goto err;
@@ -1474,46 +1745,23 @@ unsigned int ecdsa_sign_sw(const ICA_EC_KEY *privkey,
 		goto err;
 	}
 
-	if (EVP_PKEY_sign(ctx, NULL, &siglen, hash, (size_t)hash_length) <= 0) {
-		rc = EIO;
-		goto err;
-	}
-
-	sigbuf = malloc(siglen);
-	if (sigbuf == NULL) {
-		rc = EIO;
-		goto err;
-	}
-
-	if (EVP_PKEY_sign(ctx, sigbuf, &siglen, hash, (size_t)hash_length) <= 0) {
+	if (EVP_PKEY_sign(ctx, der, &derlen, hash, (size_t)hash_length) <= 0) {
 		rc = EIO;
 		goto err;
 	}
 
-	p = sigbuf;
-	sig = d2i_ECDSA_SIG(NULL, &p, siglen);
-	if (sig == NULL) {
+	/* Insert leading 0x00's if r or s shorter than privlen */
+	if (der_to_ecdsa_sig(der, derlen, signature, privlen)) {
 		rc = EIO;
 		goto err;
 	}
 
-	ECDSA_SIG_get0(sig, &r, &s);
-
-	/* Insert leading 0x00's if r or s shorter than privlen */
-	BN_bn2binpad(r, signature, privlen);
-	BN_bn2binpad(s, signature + privlen, privlen);
-
 	rc = 0;
 
 err:
-	if (sig != NULL)
-		ECDSA_SIG_free(sig);
+	ec_key_put_ctx(privkey, EC_KEY_PRIV, ctx, rc == 0);
 	if (ec_pkey != NULL)
-		EVP_PKEY_free(ec_pkey);
-	if (sigbuf != NULL)
-		free(sigbuf);
-	if (ctx != NULL)
-		EVP_PKEY_CTX_free(ctx);
+		ec_key_put_pkey(privkey, ec_pkey);
 
 	END_OPENSSL_LIBCTX(rc);
 	return rc;
@@ -1688,6 +1936,60 @@ struct {				\
 	return rc;
 }
 
+/*
+ * ecdsa_verify_cpacf with a parameter block kept by the caller, e.g. for
+ * the signatures of a batch: the block is only cleared when the curve
+ * changes, otherwise just the fields are overwritten.
+ * Returns 0 if the signature is valid, EFAULT if not, EINVAL if cpacf does
+ * not support the curve.
+ */
+int ecdsa_verify_cpacf_param(struct ecdsa_verify_param *param,
+			     const ICA_EC_KEY *pub, const unsigned char *hash,
+			     size_t hashlen, const unsigned char *sig)
+{
+	unsigned char *p = (unsigned char *)param->buff;
+	size_t size, privlen, off;
+	unsigned long fc;
+
+	/* field size: sig_r, sig_s, hash, pub_x, pub_y */
+	switch (pub->nid) {
+	case NID_X9_62_prime256v1:
+		size = 32;
+		fc = s390_kdsa_functions[ECDSA_VERIFY_P256].hw_fc;
+		break;
+	case NID_secp384r1:
+		size = 48;
+		fc = s390_kdsa_functions[ECDSA_VERIFY_P384].hw_fc;
+		break;
+	case NID_secp521r1:
+		size = 80;
+		fc = s390_kdsa_functions[ECDSA_VERIFY_P521].hw_fc;
+		break;
+	default:
+		return EINVAL;
+	}
+
+	if (param->nid != pub->nid) {
+		memset(param->buff, 0, sizeof(param->buff));
+		param->nid = pub->nid;
+	} else {
+		/* the padding of the hash */
+		memset(p + 2 * size, 0, size);
+	}
+
+	privlen = privlen_from_nid(pub->nid);
+	off = size - privlen;
+	memcpy(p + off, sig, privlen);
+	memcpy(p + size + off, sig + privlen, privlen);
+	memcpy(p + 3 * size + off, pub->X, privlen);
+	memcpy(p + 4 * size + off, pub->Y, privlen);
+
+	off = size - (hashlen > size ? size : hashlen);
+	memcpy(p + 2 * size + off, hash, size - off);
+
+	return s390_kdsa(fc, param->buff, NULL, 0) ? EFAULT : 0;
+}
+
 /*
  * Sign a hashed message using under a private key.
  * Returns 0 if successful. If cpacf doesnt support the curve,
@@ -1889,6 +2191,7 @@ unsigned int ecdsa_verify_hw(ica_adapter_handle_t adapter_handle,
 		goto ret;
 	}
 
+	xcrb_set_card(&xcrb, adapter_handle);
 	rc = ioctl(adapter_handle, ZSECSENDCPRB, xcrb);
 	if (rc != 0) {
 		dom_addressing = dom_addressing_default_domain;
@@ -1945,11 +2248,9 @@ unsigned int ecdsa_verify_sw(const ICA_EC_KEY *pubkey,
 		const unsigned char *hash, unsigned int hash_length,
 		const unsigned char *signature) {
 	int rc = 0;
-	BIGNUM *r = NULL, *s = NULL;
-	ECDSA_SIG *sig = NULL;
-	unsigned char *sigbuf = NULL;
 	EVP_PKEY_CTX *ctx = NULL;
-	size_t siglen;
+	unsigned char der[ECDSA_DER_MAX_SIZE];
+	size_t derlen;
 	EVP_PKEY *ec_pkey = NULL;
 	unsigned int privlen = privlen_from_nid(pubkey->nid);
 
@@ -1960,42 +2261,21 @@ unsigned int ecdsa_verify_sw(const ICA_EC_KEY *pubkey,
 
 	BEGIN_OPENSSL_LIBCTX(openssl_libctx, rc);
 
-	if (!is_supported_openssl_curve(pubkey->nid)) {
+	if (!ec_key_cached(pubkey, EC_KEY_PUB) &&
+	    !is_supported_openssl_curve(pubkey->nid)) {
 		rc = EINVAL;
 		goto err;
 	}
 
-	sig = ECDSA_SIG_new();
-	if (sig == NULL) {
-		rc = EIO;
-		goto err;
-	}
-
-	r = BN_bin2bn(signature, privlen, NULL);
-	s = BN_bin2bn(signature + privlen, privlen, NULL);
-	if (r == NULL || s == NULL) {
-		rc = EIO;
-		goto err;
-	}
-
-	if (!ECDSA_SIG_set0(sig, r, s)) {
-		rc = EIO;
-		goto err;
-	}
-
-	siglen = i2d_ECDSA_SIG(sig, &sigbuf);
-	if (siglen <= 0) {
-		rc = EIO;
-		goto err;
-	}
+	derlen = ecdsa_sig_to_der(signature, privlen, der);
 
-	ec_pkey = make_public_pkey(pubkey->nid, pubkey->X, 2 * privlen);
+	ec_pkey = ec_key_get_pkey(pubkey, EC_KEY_PUB);
 	if (ec_pkey == NULL) {
 		rc = EIO;
 		goto err;
 	}
 
-	ctx = EVP_PKEY_CTX_new(ec_pkey, NULL);
+	ctx = ec_key_get_ctx(pubkey, EC_KEY_PUB, ec_pkey);
 	if (ctx == NULL) {
 		rc = EIO;
 		goto err;
@@ -2006,7 +2286,7 @@ unsigned int ecdsa_verify_sw(const ICA_EC_KEY *pubkey,
 		goto err;
 	}
 
-	rc = EVP_PKEY_verify(ctx, sigbuf, siglen, hash, hash_length);
+	rc = EVP_PKEY_verify(ctx, der, derlen, hash, hash_length);
 	switch (rc) {
 	case 0: /* signature invalid */
 		rc = EFAULT;
@@ -2020,14 +2300,9 @@ unsigned int ecdsa_verify_sw(const ICA_EC_KEY *pubkey,
 	}
 
 err:
-	if (sig != NULL)
-		ECDSA_SIG_free(sig);
+	ec_key_put_ctx(pubkey, EC_KEY_PUB, ctx, rc == 0 || rc == EFAULT);
 	if (ec_pkey != NULL)
-		EVP_PKEY_free(ec_pkey);
-	if (sigbuf != NULL)
-		OPENSSL_free(sigbuf);
-	if (ctx != NULL)
-		EVP_PKEY_CTX_free(ctx);
+		ec_key_put_pkey(pubkey, ec_pkey);
 
 	END_OPENSSL_LIBCTX(rc);
 	return rc;
@@ -2298,6 +2573,7 @@ unsigned int eckeygen_hw(ica_adapter_handle_t adapter_handle, ICA_EC_KEY *key)
 		goto ret;
 	}
 
+	xcrb_set_card(&xcrb, adapter_handle);
 	rc = ioctl(adapter_handle, ZSECSENDCPRB, xcrb);
 	if (rc != 0) {
 		dom_addressing = dom_addressing_default_domain;
@@ -2353,7 +2629,7 @@ unsigned int eckeygen_sw(ICA_EC_KEY *key)
 #else
 	BIGNUM *bn_d = NULL;
 #endif
-	int rc = 0;
+	int rc = 0, comb;
 	EVP_PKEY_CTX *ctx = NULL;
 	EVP_PKEY *ec_pkey = NULL;
 	unsigned char *ecpoint = NULL, *d = NULL;
@@ -2367,6 +2643,18 @@ unsigned int eckeygen_sw(ICA_EC_KEY *key)
 
 	BEGIN_OPENSSL_LIBCTX(openssl_libctx, rc);
 
+	/* with the comb tables, see ec_comb_pubkey */
+	comb = !curve_supported_via_cpacf(key->nid);
+#ifdef ICA_FIPS
+	/* keys in FIPS mode come from the FIPS provider */
+	if (fips & ICA_FIPS_MODE)
+		comb = 0;
+#endif /* ICA_FIPS */
+	if (comb && ec_comb_keygen(key->nid, key->D, key->X, key->Y) == 0) {
+		rc = 0;
+		goto err;
+	}
+
 	if (!is_supported_openssl_curve(key->nid)) {
 		rc = EPERM;
 		goto err;
@@ -2563,11 +2851,14 @@ int x25519_derive_pub(unsigned char pub[32],
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 	};
+	uint64_t begin;
 	int rc;
 
+	begin = stats_latency_begin();
 	rc = scalar_mulx_cpacf(pub, priv, x25519_base_u, NID_X25519);
 
-	stats_increment(ICA_STATS_X25519_KEYGEN, ALGO_HW, ENCRYPT);
+	stats_increment_latency(ICA_STATS_X25519_KEYGEN, ALGO_HW, ENCRYPT,
+				begin);
 	return rc;
 }
 
@@ -2581,11 +2872,14 @@ int x448_derive_pub(unsigned char pub[56],
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 	};
+	uint64_t begin;
 	int rc;
 
+	begin = stats_latency_begin();
 	rc = scalar_mulx_cpacf(pub, priv, x448_base_u, NID_X448);
 
-	stats_increment(ICA_STATS_X448_KEYGEN, ALGO_HW, ENCRYPT);
+	stats_increment_latency(ICA_STATS_X448_KEYGEN, ALGO_HW, ENCRYPT,
+				begin);
 	return rc;
 }
 
@@ -2609,8 +2903,10 @@ int ed25519_derive_pub(unsigned char pub[32],
 	uint64_t lo, hi;
 	unsigned char buf[64];
 	unsigned char res_x[32];
+	uint64_t begin;
 	int rc;
 
+	begin = stats_latency_begin();
 	lo = 0;
 	hi = 0;
 	rc = s390_sha512(NULL, (unsigned char *)priv, 32, buf,
@@ -2638,7 +2934,8 @@ int ed25519_derive_pub(unsigned char pub[32],
 	/* to big endian */
 	s390_flip_endian_32(pub, pub);
 
-	stats_increment(ICA_STATS_ED25519_KEYGEN, ALGO_HW, ENCRYPT);
+	stats_increment_latency(ICA_STATS_ED25519_KEYGEN, ALGO_HW, ENCRYPT,
+				begin);
 	rc = 0;
 out:
 	return rc;
@@ -2676,8 +2973,10 @@ int ed448_derive_pub(unsigned char pub[57],
 	uint64_t lo, hi;
 	unsigned char buf[114], pub64[64];
 	unsigned char res_x[64];
+	uint64_t begin;
 	int rc;
 
+	begin = stats_latency_begin();
 	memset(res_x, 0, sizeof(res_x));
 	memset(pub64, 0, sizeof(pub64));
 
@@ -2711,15 +3010,196 @@ int ed448_derive_pub(unsigned char pub[57],
 	s390_flip_endian_64(pub64, pub64);
 
 	memcpy(pub, pub64 + 64 - 57, 57);
-	stats_increment(ICA_STATS_ED448_KEYGEN, ALGO_HW, ENCRYPT);
+	stats_increment_latency(ICA_STATS_ED448_KEYGEN, ALGO_HW, ENCRYPT,
+				begin);
 	rc = 0;
 out:
 	return rc;
 }
 
+/*
+ * Software fallback of X25519, X448, Ed25519 and Ed448 if MSA 9 is not
+ * available, for nid NID_X25519, NID_X448, NID_ED25519 or NID_ED448. Keys,
+ * shared secrets and signatures are in the little endian encodings of
+ * RFC 7748 and RFC 8032, as passed to the ica_x and ica_ed API functions.
+ *
+ * OpenSSL computes the public key of a private key when importing it, so
+ * *pkey caches the OpenSSL key of a context between calls. It is created from
+ * the raw key on first use and has to be freed with ed_x_pkey_free_sw
+ * whenever the key of the context changes.
+ */
+static size_t ed_x_keylen(int nid)
+{
+	switch (nid) {
+	case NID_X25519:
+	case NID_ED25519:
+		return 32;
+	case NID_X448:
+		return 56;
+	case NID_ED448:
+		return 57;
+	default:
+		return 0;
+	}
+}
+
+static EVP_PKEY *ed_x_pkey_sw(EVP_PKEY **pkey, int nid,
+			      const unsigned char *key, int is_private)
+{
+	if (*pkey != NULL)
+		return *pkey;
+
+	if (is_private)
+		*pkey = EVP_PKEY_new_raw_private_key(nid, NULL, key,
+						     ed_x_keylen(nid));
+	else
+		*pkey = EVP_PKEY_new_raw_public_key(nid, NULL, key,
+						    ed_x_keylen(nid));
+	return *pkey;
+}
+
+void ed_x_pkey_free_sw(EVP_PKEY **pkey)
+{
+	EVP_PKEY_free(*pkey);
+	*pkey = NULL;
+}
+
+/*
+ * Derive public key in software.
+ * Returns 0 if successful, EIO if an internal error occurred.
+ */
+int ed_x_derive_pub_sw(EVP_PKEY **pkey, int nid, const unsigned char *priv,
+		       unsigned char *pub)
+{
+	size_t publen = ed_x_keylen(nid);
+	int rc = EIO;
+
+	BEGIN_OPENSSL_LIBCTX(openssl_libctx, rc);
+
+	if (ed_x_pkey_sw(pkey, nid, priv, 1) != NULL &&
+	    EVP_PKEY_get_raw_public_key(*pkey, pub, &publen) == 1)
+		rc = 0;
+
+	END_OPENSSL_LIBCTX(rc);
+	return rc;
+}
+
+/*
+ * X25519 or X448 shared secret calculation in software.
+ * Returns 0 if successful, EIO if an internal error occurred or the shared
+ * secret is zero.
+ */
+int x_derive_sw(EVP_PKEY **pkey, int nid, const unsigned char *priv,
+		const unsigned char *peer_pub, unsigned char *shared_secret)
+{
+	size_t len = ed_x_keylen(nid);
+	EVP_PKEY_CTX *ctx = NULL;
+	EVP_PKEY *peer = NULL;
+	int rc = EIO;
+
+	BEGIN_OPENSSL_LIBCTX(openssl_libctx, rc);
+
+	if (ed_x_pkey_sw(pkey, nid, priv, 1) == NULL)
+		goto err;
+
+	peer = EVP_PKEY_new_raw_public_key(nid, NULL, peer_pub, len);
+	ctx = EVP_PKEY_CTX_new(*pkey, NULL);
+	if (peer == NULL || ctx == NULL)
+		goto err;
+
+	if (EVP_PKEY_derive_init(ctx) <= 0 ||
+	    EVP_PKEY_derive_set_peer(ctx, peer) <= 0 ||
+	    EVP_PKEY_derive(ctx, shared_secret, &len) <= 0)
+		goto err;
+
+	rc = 0;
+err:
+	EVP_PKEY_CTX_free(ctx);
+	EVP_PKEY_free(peer);
+	END_OPENSSL_LIBCTX(rc);
+	return rc;
+}
+
+/*
+ * Ed25519 or Ed448 signature generation in software.
+ * Returns 0 if successful, EIO if an internal error occurred.
+ */
+int eddsa_sign_sw(EVP_PKEY **pkey, int nid, const unsigned char *priv,
+		  const unsigned char *msg, size_t msglen, unsigned char *sig)
+{
+	size_t siglen = 2 * ed_x_keylen(nid);
+	EVP_MD_CTX *ctx = NULL;
+	int rc = EIO;
+
+	BEGIN_OPENSSL_LIBCTX(openssl_libctx, rc);
+
+	if (ed_x_pkey_sw(pkey, nid, priv, 1) == NULL)
+		goto err;
+
+	ctx = EVP_MD_CTX_new();
+	if (ctx == NULL)
+		goto err;
+
+	/* EdDSA hashes the message itself, so there is no digest. */
+	if (EVP_DigestSignInit(ctx, NULL, NULL, NULL, *pkey) <= 0 ||
+	    EVP_DigestSign(ctx, sig, &siglen, msg, msglen) <= 0)
+		goto err;
+
+	rc = 0;
+err:
+	EVP_MD_CTX_free(ctx);
+	END_OPENSSL_LIBCTX(rc);
+	return rc;
+}
+
+/*
+ * Ed25519 or Ed448 signature verification in software.
+ * Returns 0 if the signature is valid, EFAULT if it is invalid and EIO if an
+ * internal error occurred.
+ */
+int eddsa_verify_sw(EVP_PKEY **pkey, int nid, const unsigned char *pub,
+		    const unsigned char *msg, size_t msglen,
+		    const unsigned char *sig)
+{
+	size_t siglen = 2 * ed_x_keylen(nid);
+	EVP_MD_CTX *ctx = NULL;
+	int rc = EIO;
+
+	BEGIN_OPENSSL_LIBCTX(openssl_libctx, rc);
+
+	if (ed_x_pkey_sw(pkey, nid, pub, 0) == NULL)
+		goto err;
+
+	ctx = EVP_MD_CTX_new();
+	if (ctx == NULL)
+		goto err;
+
+	if (EVP_DigestVerifyInit(ctx, NULL, NULL, NULL, *pkey) <= 0)
+		goto err;
+
+	rc = EVP_DigestVerify(ctx, sig, siglen, msg, msglen);
+	switch (rc) {
+	case 0: /* signature invalid */
+		rc = EFAULT;
+		break;
+	case 1: /* signature valid */
+		rc = 0;
+		break;
+	default: /* internal error */
+		rc = EIO;
+		break;
+	}
+err:
+	EVP_MD_CTX_free(ctx);
+	END_OPENSSL_LIBCTX(rc);
+	return rc;
+}
+
 #ifdef ICA_INTERNAL_TEST_EC
 
 #include "../test/testcase.h"
+#include "../test/eddsa_test.h"
+#include "../test/x_test.h"
 #include "test_vec.h"
 
 #define TEST_ERROR(msg, alg, tv)					    \
@@ -3117,8 +3597,579 @@ static void scalar_mul_test(void)
 }
 #endif /* NO_CPACF */
 
+#define BENCH_USEC	1000000
+
+/* operations per second of one software path, run for BENCH_USEC */
+#define BENCH(ops_per_sec, call)					\
+	do {								\
+		struct timeval start, now;				\
+		unsigned long long n = 0, usec;				\
+									\
+		gettimeofday(&start, NULL);				\
+		do {							\
+			if ((call) != 0)				\
+				EXIT_ERR(#call " failed.");		\
+			n++;						\
+			gettimeofday(&now, NULL);			\
+			usec = delta_usec(&start, &now);		\
+		} while (usec < BENCH_USEC);				\
+		ops_per_sec = (double)n * 1000000 / usec;		\
+	} while (0)
+
+/*
+ * The software path with the OpenSSL keys cached on the ICA_EC_KEY against
+ * a copy without cache, which rebuilds them for each operation.
+ */
+static void ec_sw_cache_test(unsigned int nid, const char *name)
+{
+	unsigned char hash[32], sig[MAX_ECDSA_SIG_SIZE];
+	unsigned char z[MAX_ECC_PRIV_SIZE], z2[MAX_ECC_PRIV_SIZE];
+	double sign_old, sign_new, verify_old, verify_new;
+	double derive_old, derive_new;
+	ICA_EC_KEY *a, *b, a_old, b_old;
+	unsigned int privlen;
+
+	a = ica_ec_key_new(nid, &privlen);
+	b = ica_ec_key_new(nid, &privlen);
+	if (a == NULL || b == NULL)
+		EXIT_ERR("ica_ec_key_new failed.");
+	if (eckeygen_sw(a) || eckeygen_sw(b))
+		EXIT_ERR("eckeygen_sw failed.");
+	/* same key material, no cache */
+	a_old = *a;
+	a_old.cache = NULL;
+	b_old = *b;
+	b_old.cache = NULL;
+	memset(hash, 0x5a, sizeof(hash));
+
+	/* both paths compute compatible results */
+	if (ecdsa_sign_sw(a, hash, sizeof(hash), sig) ||
+	    ecdsa_verify_sw(&a_old, hash, sizeof(hash), sig) ||
+	    ecdsa_sign_sw(&a_old, hash, sizeof(hash), sig) ||
+	    ecdsa_verify_sw(a, hash, sizeof(hash), sig))
+		EXIT_ERR("signature not verified.");
+	sig[0] ^= 0x01;
+	if (ecdsa_verify_sw(a, hash, sizeof(hash), sig) != EFAULT)
+		EXIT_ERR("wrong signature verified.");
+	sig[0] ^= 0x01;
+	if (ecdh_sw(a, b, z) || ecdh_sw(&b_old, &a_old, z2) ||
+	    memcmp(z, z2, privlen))
+		EXIT_ERR("shared secrets differ.");
+
+	/* a changed key is not served from the cache, see ica_ec_key_init */
+	memcpy(a->X, b->X, 3 * privlen);
+	ec_key_cache_clear(a->cache);
+	if (ecdh_sw(a, b, z) || ecdh_sw(b, b, z2) || memcmp(z, z2, privlen) ||
+	    ecdsa_verify_sw(a, hash, sizeof(hash), sig) != EFAULT)
+		EXIT_ERR("key change not noticed.");
+	if (ecdsa_sign_sw(a, hash, sizeof(hash), sig))
+		EXIT_ERR("ecdsa_sign_sw failed.");
+
+	BENCH(sign_old, ecdsa_sign_sw(&a_old, hash, sizeof(hash), sig));
+	BENCH(sign_new, ecdsa_sign_sw(a, hash, sizeof(hash), sig));
+	BENCH(verify_old, ecdsa_verify_sw(&a_old, hash, sizeof(hash), sig));
+	BENCH(verify_new, ecdsa_verify_sw(a, hash, sizeof(hash), sig));
+	BENCH(derive_old, ecdh_sw(&a_old, &b_old, z));
+	BENCH(derive_new, ecdh_sw(a, b, z));
+
+	printf("%s sign   %10.1f ops/s, cached %10.1f ops/s (x%.2f)\n",
+	       name, sign_old, sign_new, sign_new / sign_old);
+	printf("%s verify %10.1f ops/s, cached %10.1f ops/s (x%.2f)\n",
+	       name, verify_old, verify_new, verify_new / verify_old);
+	printf("%s derive %10.1f ops/s, cached %10.1f ops/s (x%.2f)\n",
+	       name, derive_old, derive_new, derive_new / derive_old);
+
+	ica_ec_key_free(a);
+	ica_ec_key_free(b);
+}
+
+/*
+ * r || s with leading zero bytes and set high bits: the DER conversion is
+ * the same as OpenSSL's.
+ */
+static void ecdsa_der_test(unsigned int privlen)
+{
+	unsigned char sig[MAX_ECDSA_SIG_SIZE], back[MAX_ECDSA_SIG_SIZE];
+	unsigned char der[ECDSA_DER_MAX_SIZE], *ref;
+	const unsigned char *p;
+	ECDSA_SIG *ossl_sig;
+	BIGNUM *r, *s;
+	size_t derlen;
+	int i, reflen;
+
+	for (i = 0; i < 64; i++) {
+		rng_gen(sig, 2 * privlen);
+		if (i & 1)
+			memset(sig, 0, i % privlen);
+		if (i & 2)
+			sig[privlen] |= 0x80;
+		if (i & 4)
+			memset(sig + privlen, 0, privlen - 1);
+		if (i == 8)
+			memset(sig, 0, privlen);
+
+		derlen = ecdsa_sig_to_der(sig, privlen, der);
+		ossl_sig = ECDSA_SIG_new();
+		r = BN_bin2bn(sig, privlen, NULL);
+		s = BN_bin2bn(sig + privlen, privlen, NULL);
+		if (ossl_sig == NULL || r == NULL || s == NULL ||
+		    !ECDSA_SIG_set0(ossl_sig, r, s))
+			EXIT_ERR("ECDSA_SIG_set0 failed.");
+		ref = NULL;
+		reflen = i2d_ECDSA_SIG(ossl_sig, &ref);
+		if (reflen <= 0 || (size_t)reflen != derlen ||
+		    memcmp(der, ref, derlen))
+			EXIT_ERR("DER encoding differs from OpenSSL's.");
+		OPENSSL_free(ref);
+		ECDSA_SIG_free(ossl_sig);
+
+		if (der_to_ecdsa_sig(der, derlen, back, privlen) ||
+		    memcmp(back, sig, 2 * privlen))
+			EXIT_ERR("DER decoding failed.");
+		p = der;
+		ossl_sig = d2i_ECDSA_SIG(NULL, &p, derlen);
+		if (ossl_sig == NULL || p != der + derlen)
+			EXIT_ERR("OpenSSL does not decode the encoding.");
+		ECDSA_SIG_free(ossl_sig);
+	}
+
+	/* malformed encodings */
+	sig[0] |= 0x80;
+	derlen = ecdsa_sig_to_der(sig, privlen, der);
+	if (der_to_ecdsa_sig(der, derlen - 1, back, privlen) == 0 ||
+	    der_to_ecdsa_sig(der, derlen, back, privlen - 1) == 0)
+		EXIT_ERR("malformed encoding decoded.");
+	der[0] = 0x31;
+	if (der_to_ecdsa_sig(der, derlen, back, privlen) == 0)
+		EXIT_ERR("malformed encoding decoded.");
+}
+
+#ifndef __SANITIZE_ADDRESS__
+/*
+ * Counts the heap allocations of this process, including OpenSSL's, while
+ * count_allocs is set.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static int count_allocs;
+static unsigned long allocs;
+
+void *malloc(size_t size)
+{
+	if (count_allocs)
+		allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (count_allocs)
+		allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (count_allocs)
+		allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+/* allocations of one call, which must return 0 */
+#define ALLOCS(count, call)						\
+	do {								\
+		int rc_;						\
+									\
+		allocs = 0;						\
+		count_allocs = 1;					\
+		rc_ = (call);						\
+		count_allocs = 0;					\
+		if (rc_ != 0)						\
+			EXIT_ERR(#call " failed.");			\
+		count = allocs;						\
+	} while (0)
+
+/* the round trip through ECDSA_SIG, which the software path did before */
+static int ecdsa_sig_round_trip(const unsigned char *der, size_t derlen,
+				unsigned char *sig, unsigned int privlen)
+{
+	const unsigned char *p = der;
+	unsigned char *buf = NULL;
+	ECDSA_SIG *ossl_sig;
+	const BIGNUM *r, *s;
+	int len;
+
+	if ((ossl_sig = d2i_ECDSA_SIG(NULL, &p, derlen)) == NULL)
+		return -1;
+	ECDSA_SIG_get0(ossl_sig, &r, &s);
+	BN_bn2binpad(r, sig, privlen);
+	BN_bn2binpad(s, sig + privlen, privlen);
+	ECDSA_SIG_free(ossl_sig);
+
+	ossl_sig = ECDSA_SIG_new();
+	if (ossl_sig == NULL ||
+	    !ECDSA_SIG_set0(ossl_sig, BN_bin2bn(sig, privlen, NULL),
+			    BN_bin2bn(sig + privlen, privlen, NULL)))
+		return -1;
+	len = i2d_ECDSA_SIG(ossl_sig, &buf);
+	ECDSA_SIG_free(ossl_sig);
+	OPENSSL_free(buf);
+	return len > 0 ? 0 : -1;
+}
+
+/*
+ * Heap allocations per signature and verification of the software path,
+ * which are all OpenSSL's: the conversion between r || s and DER does not
+ * allocate.
+ */
+static void ecdsa_sw_alloc_test(unsigned int nid, const char *name)
+{
+	unsigned char hash[32], sig[MAX_ECDSA_SIG_SIZE];
+	unsigned char der[ECDSA_DER_MAX_SIZE];
+	unsigned long sign, verify, codec, round_trip;
+	unsigned int privlen;
+	size_t derlen = 0;
+	ICA_EC_KEY *key;
+
+	key = ica_ec_key_new(nid, &privlen);
+	if (key == NULL || eckeygen_sw(key))
+		EXIT_ERR("eckeygen_sw failed.");
+	memset(hash, 0x5a, sizeof(hash));
+
+	/* with the keys and contexts cached */
+	if (ecdsa_sign_sw(key, hash, sizeof(hash), sig) ||
+	    ecdsa_verify_sw(key, hash, sizeof(hash), sig))
+		EXIT_ERR("signature not verified.");
+
+	ALLOCS(sign, ecdsa_sign_sw(key, hash, sizeof(hash), sig));
+	ALLOCS(verify, ecdsa_verify_sw(key, hash, sizeof(hash), sig));
+	ALLOCS(codec, (derlen = ecdsa_sig_to_der(sig, privlen, der)) == 0 ||
+		      der_to_ecdsa_sig(der, derlen, sig, privlen));
+	ALLOCS(round_trip, ecdsa_sig_round_trip(der, derlen, sig, privlen));
+
+	printf("%s allocations: sign %lu, verify %lu, DER conversion %lu "
+	       "(through ECDSA_SIG %lu)\n", name, sign, verify, codec,
+	       round_trip);
+	if (codec != 0)
+		EXIT_ERR("DER conversion allocates.");
+
+	ica_ec_key_free(key);
+}
+#endif /* __SANITIZE_ADDRESS__ */
+
+/* a key pair generated by OpenSSL, like eckeygen_sw without comb tables */
+static int evp_keygen(unsigned int nid)
+{
+	EVP_PKEY_CTX *ctx;
+	EVP_PKEY *pkey = NULL;
+	int rc = -1;
+
+	ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+	if (ctx != NULL && EVP_PKEY_keygen_init(ctx) > 0 &&
+	    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, nid) > 0 &&
+	    EVP_PKEY_keygen(ctx, &pkey) > 0)
+		rc = 0;
+	EVP_PKEY_free(pkey);
+	EVP_PKEY_CTX_free(ctx);
+	return rc;
+}
+
+/*
+ * The comb tables compute the same public keys as OpenSSL for random and
+ * extreme private keys, and key generation with them against OpenSSL's.
+ */
+static void ec_comb_test(unsigned int nid, const char *name)
+{
+	unsigned char d[MAX_ECC_PRIV_SIZE], x[MAX_ECC_PRIV_SIZE];
+	unsigned char y[MAX_ECC_PRIV_SIZE], ref[1 + 2 * MAX_ECC_PRIV_SIZE];
+	const BIGNUM *order;
+	EC_GROUP *group;
+	EC_POINT *point;
+	BIGNUM *bn_d;
+	double comb, evp;
+	unsigned int i, privlen = privlen_from_nid(nid);
+
+	group = EC_GROUP_new_by_curve_name(nid);
+	point = group ? EC_POINT_new(group) : NULL;
+	bn_d = BN_new();
+	if (point == NULL || bn_d == NULL)
+		EXIT_ERR("OpenSSL EC objects not allocated.");
+	order = EC_GROUP_get0_order(group);
+
+	for (i = 0; i < 64; i++) {
+		switch (i) {
+		case 0:		/* 1 */
+			memset(d, 0, privlen);
+			d[privlen - 1] = 1;
+			break;
+		case 1:		/* n - 1 */
+			BN_bn2binpad(order, d, privlen);
+			d[privlen - 1]--;
+			break;
+		case 2:		/* all bits, beyond n for P-521 */
+			memset(d, 0xff, privlen);
+			break;
+		default:
+			rng_gen(d, privlen);
+			break;
+		}
+		if (ec_comb_mul(nid, d, x, y))
+			EXIT_ERR("ec_comb_mul failed.");
+		if (!BN_bin2bn(d, privlen, bn_d) ||
+		    !EC_POINT_mul(group, point, bn_d, NULL, NULL, NULL) ||
+		    EC_POINT_point2oct(group, point,
+				       POINT_CONVERSION_UNCOMPRESSED, ref,
+				       sizeof(ref), NULL) != 1 + 2 * privlen)
+			EXIT_ERR("EC_POINT_mul failed.");
+		if (memcmp(x, ref + 1, privlen) ||
+		    memcmp(y, ref + 1 + privlen, privlen))
+			EXIT_ERR("comb and OpenSSL public keys differ.");
+	}
+
+	/* 0 and n yield the point at infinity */
+	memset(d, 0, privlen);
+	if (ec_comb_mul(nid, d, x, y) != EINVAL)
+		EXIT_ERR("public key of 0.");
+	BN_bn2binpad(order, d, privlen);
+	if (ec_comb_mul(nid, d, x, y) != EINVAL)
+		EXIT_ERR("public key of n.");
+
+	BENCH(comb, ec_comb_keygen(nid, d, x, y));
+	BENCH(evp, evp_keygen(nid));
+	printf("%-8s keygen %10.1f ops/s, comb %10.1f ops/s (x%.2f)\n",
+	       name, evp, comb, comb / evp);
+
+	BN_free(bn_d);
+	EC_POINT_free(point);
+	EC_GROUP_free(group);
+}
+
+/*
+ * The X25519 and X448 software fallback via the ica_x API: the test vectors
+ * of test/x_test.h, pairwise shared secrets and the derive throughput.
+ * Called with msa9_switch off.
+ */
+static void x25519_sw_test(void)
+{
+	unsigned char pub1[32], pub2[32], z1[32], z2[32];
+	ICA_X25519_CTX *ctx1, *ctx2;
+	unsigned long i;
+	double derive;
+
+	if (ica_x25519_ctx_new(&ctx1) || ica_x25519_ctx_new(&ctx2))
+		EXIT_ERR("ica_x25519_ctx_new failed.");
+
+	for (i = 0; i < X_TV_LEN; i++) {
+		if (X_TV[i].nid != NID_X25519)
+			continue;
+		if (ica_x25519_key_set(ctx1, X_TV[i].priv, NULL) ||
+		    ica_x25519_derive(ctx1, z1, X_TV[i].peer_pub))
+			TEST_ERROR("ica_x25519_derive failed", "X25519", i);
+		if (memcmp(z1, X_TV[i].shared_secret, sizeof(z1)))
+			TEST_ERROR("Wrong shared secret", "X25519", i);
+	}
+
+	for (i = 0; i < 16; i++) {
+		if (ica_x25519_key_gen(ctx1) || ica_x25519_key_gen(ctx2) ||
+		    ica_x25519_key_get(ctx1, NULL, pub1) ||
+		    ica_x25519_key_get(ctx2, NULL, pub2) ||
+		    ica_x25519_derive(ctx1, z1, pub2) ||
+		    ica_x25519_derive(ctx2, z2, pub1))
+			EXIT_ERR("X25519 key exchange failed.");
+		if (memcmp(z1, z2, sizeof(z1)))
+			EXIT_ERR("X25519 shared secrets differ.");
+	}
+
+	BENCH(derive, ica_x25519_derive(ctx1, z1, pub2));
+	printf("X25519 sw derive %10.1f ops/s\n", derive);
+
+	ica_x25519_ctx_del(&ctx1);
+	ica_x25519_ctx_del(&ctx2);
+}
+
+static void x448_sw_test(void)
+{
+	unsigned char pub1[56], pub2[56], z1[56], z2[56];
+	ICA_X448_CTX *ctx1, *ctx2;
+	unsigned long i;
+	double derive;
+
+	if (ica_x448_ctx_new(&ctx1) || ica_x448_ctx_new(&ctx2))
+		EXIT_ERR("ica_x448_ctx_new failed.");
+
+	for (i = 0; i < X_TV_LEN; i++) {
+		if (X_TV[i].nid != NID_X448)
+			continue;
+		if (ica_x448_key_set(ctx1, X_TV[i].priv, NULL) ||
+		    ica_x448_derive(ctx1, z1, X_TV[i].peer_pub))
+			TEST_ERROR("ica_x448_derive failed", "X448", i);
+		if (memcmp(z1, X_TV[i].shared_secret, sizeof(z1)))
+			TEST_ERROR("Wrong shared secret", "X448", i);
+	}
+
+	for (i = 0; i < 16; i++) {
+		if (ica_x448_key_gen(ctx1) || ica_x448_key_gen(ctx2) ||
+		    ica_x448_key_get(ctx1, NULL, pub1) ||
+		    ica_x448_key_get(ctx2, NULL, pub2) ||
+		    ica_x448_derive(ctx1, z1, pub2) ||
+		    ica_x448_derive(ctx2, z2, pub1))
+			EXIT_ERR("X448 key exchange failed.");
+		if (memcmp(z1, z2, sizeof(z1)))
+			EXIT_ERR("X448 shared secrets differ.");
+	}
+
+	BENCH(derive, ica_x448_derive(ctx1, z1, pub2));
+	printf("X448   sw derive %10.1f ops/s\n", derive);
+
+	ica_x448_ctx_del(&ctx1);
+	ica_x448_ctx_del(&ctx2);
+}
+
+/*
+ * The Ed25519 and Ed448 software fallback via the ica_ed API: the test
+ * vectors of test/eddsa_test.h, with the private key and with only the
+ * public key in the context, and the sign and verify throughput.
+ * Called with msa9_switch off.
+ */
+static void ed25519_sw_test(void)
+{
+	unsigned char pub[32], sig[64], msg[64];
+	ICA_ED25519_CTX *ctx, *pub_ctx;
+	const struct eddsa_tv *tv;
+	double sign, verify;
+	unsigned long i;
+
+	if (ica_ed25519_ctx_new(&ctx) || ica_ed25519_ctx_new(&pub_ctx))
+		EXIT_ERR("ica_ed25519_ctx_new failed.");
+
+	for (i = 0; i < EDDSA_TV_LEN; i++) {
+		tv = &EDDSA_TV[i];
+		if (tv->nid != NID_ED25519)
+			continue;
+		if (ica_ed25519_key_set(ctx, tv->priv, NULL) ||
+		    ica_ed25519_key_get(ctx, NULL, pub))
+			TEST_ERROR("ica_ed25519_key_get failed", "ED25519", i);
+		if (memcmp(pub, tv->pub, sizeof(pub)))
+			TEST_ERROR("Wrong public key", "ED25519", i);
+		if (ica_ed25519_sign(ctx, sig, tv->msg, tv->msglen))
+			TEST_ERROR("ica_ed25519_sign failed", "ED25519", i);
+		if (memcmp(sig, tv->sig, sizeof(sig)))
+			TEST_ERROR("Wrong signature", "ED25519", i);
+		if (ica_ed25519_verify(ctx, sig, tv->msg, tv->msglen))
+			TEST_ERROR("ica_ed25519_verify failed", "ED25519", i);
+
+		if (ica_ed25519_key_set(pub_ctx, NULL, tv->pub) ||
+		    ica_ed25519_verify(pub_ctx, sig, tv->msg, tv->msglen))
+			TEST_ERROR("ica_ed25519_verify failed", "ED25519", i);
+		sig[i % sizeof(sig)] ^= 0x01;
+		if (!ica_ed25519_verify(pub_ctx, sig, tv->msg, tv->msglen))
+			TEST_ERROR("Invalid signature verified", "ED25519", i);
+	}
+
+	rng_gen(msg, sizeof(msg));
+	if (ica_ed25519_key_gen(ctx) || ica_ed25519_key_get(ctx, NULL, pub) ||
+	    ica_ed25519_key_set(pub_ctx, NULL, pub))
+		EXIT_ERR("ica_ed25519_key_gen failed.");
+	BENCH(sign, ica_ed25519_sign(ctx, sig, msg, sizeof(msg)));
+	BENCH(verify, ica_ed25519_verify(pub_ctx, sig, msg, sizeof(msg)));
+	printf("Ed25519 sw sign %10.1f ops/s, verify %10.1f ops/s\n",
+	       sign, verify);
+
+	ica_ed25519_ctx_del(&ctx);
+	ica_ed25519_ctx_del(&pub_ctx);
+}
+
+static void ed448_sw_test(void)
+{
+	unsigned char pub[57], sig[114], msg[64];
+	ICA_ED448_CTX *ctx, *pub_ctx;
+	const struct eddsa_tv *tv;
+	double sign, verify;
+	unsigned long i;
+
+	if (ica_ed448_ctx_new(&ctx) || ica_ed448_ctx_new(&pub_ctx))
+		EXIT_ERR("ica_ed448_ctx_new failed.");
+
+	for (i = 0; i < EDDSA_TV_LEN; i++) {
+		tv = &EDDSA_TV[i];
+		if (tv->nid != NID_ED448)
+			continue;
+		if (ica_ed448_key_set(ctx, tv->priv, NULL) ||
+		    ica_ed448_key_get(ctx, NULL, pub))
+			TEST_ERROR("ica_ed448_key_get failed", "ED448", i);
+		if (memcmp(pub, tv->pub, sizeof(pub)))
+			TEST_ERROR("Wrong public key", "ED448", i);
+		if (ica_ed448_sign(ctx, sig, tv->msg, tv->msglen))
+			TEST_ERROR("ica_ed448_sign failed", "ED448", i);
+		if (memcmp(sig, tv->sig, sizeof(sig)))
+			TEST_ERROR("Wrong signature", "ED448", i);
+		if (ica_ed448_verify(ctx, sig, tv->msg, tv->msglen))
+			TEST_ERROR("ica_ed448_verify failed", "ED448", i);
+
+		if (ica_ed448_key_set(pub_ctx, NULL, tv->pub) ||
+		    ica_ed448_verify(pub_ctx, sig, tv->msg, tv->msglen))
+			TEST_ERROR("ica_ed448_verify failed", "ED448", i);
+		sig[i % sizeof(sig)] ^= 0x01;
+		if (!ica_ed448_verify(pub_ctx, sig, tv->msg, tv->msglen))
+			TEST_ERROR("Invalid signature verified", "ED448", i);
+	}
+
+	rng_gen(msg, sizeof(msg));
+	if (ica_ed448_key_gen(ctx) || ica_ed448_key_get(ctx, NULL, pub) ||
+	    ica_ed448_key_set(pub_ctx, NULL, pub))
+		EXIT_ERR("ica_ed448_key_gen failed.");
+	BENCH(sign, ica_ed448_sign(ctx, sig, msg, sizeof(msg)));
+	BENCH(verify, ica_ed448_verify(pub_ctx, sig, msg, sizeof(msg)));
+	printf("Ed448   sw sign %10.1f ops/s, verify %10.1f ops/s\n",
+	       sign, verify);
+
+	ica_ed448_ctx_del(&ctx);
+	ica_ed448_ctx_del(&pub_ctx);
+}
+
+static void ed_x_sw_test(void)
+{
+	unsigned int msa9 = msa9_switch;
+
+	/* use the software fallback also on MSA 9 machines */
+	msa9_switch = 0;
+	x25519_sw_test();
+	x448_sw_test();
+	ed25519_sw_test();
+	ed448_sw_test();
+	msa9_switch = msa9;
+}
+
 int main(void)
 {
+	/* test exit on first failure */
+	ecdsa_der_test(32);
+	ecdsa_der_test(48);
+	ecdsa_der_test(66);
+#ifndef __SANITIZE_ADDRESS__
+	ecdsa_sw_alloc_test(NID_X9_62_prime256v1, "P-256");
+	ecdsa_sw_alloc_test(NID_secp384r1, "P-384");
+	ecdsa_sw_alloc_test(NID_secp521r1, "P-521");
+#endif
+	ec_sw_cache_test(NID_X9_62_prime256v1, "P-256");
+	ec_sw_cache_test(NID_secp384r1, "P-384");
+	ec_sw_cache_test(NID_secp521r1, "P-521");
+	ec_comb_test(NID_X9_62_prime192v1, "P-192");
+	ec_comb_test(NID_secp224r1, "P-224");
+	ec_comb_test(NID_X9_62_prime256v1, "P-256");
+	ec_comb_test(NID_secp384r1, "P-384");
+	ec_comb_test(NID_secp521r1, "P-521");
+	ec_comb_test(NID_brainpoolP160r1, "BP-160");
+	ec_comb_test(NID_brainpoolP192r1, "BP-192");
+	ec_comb_test(NID_brainpoolP224r1, "BP-224");
+	ec_comb_test(NID_brainpoolP256r1, "BP-256");
+	ec_comb_test(NID_brainpoolP320r1, "BP-320");
+	ec_comb_test(NID_brainpoolP384r1, "BP-384");
+	ec_comb_test(NID_brainpoolP512r1, "BP-512");
+	ed_x_sw_test();
+
 #ifdef NO_CPACF
 	printf("Skipping EC internal test, because CPACF support disabled via config option.\n");
 	exit(TEST_SKIP);
@@ -218,6 +218,8 @@ int s390_prng(unsigned char *output_data, unsigned int output_length)
 	if (output_length == 0)
 		return 0;
 
+	ica_init_prng();
+
 	const size_t q = output_length
 	    / ICA_DRBG_SHA512->max_no_of_bytes_per_req;
 	const size_t r = output_length
@@ -16,8 +16,11 @@
 
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <openssl/crypto.h>
+#include <openssl/err.h>
 #include <openssl/rsa.h>
 #include <openssl/evp.h>
 
@@ -27,7 +30,10 @@
 #endif /* OPENSSL_FIPS */
 
 #include "fips.h"
+#include "init.h"
+#include "icastats.h"
 #include "s390_rsa.h"
+#include "rsa_mont.h"
 #include "s390_prng.h"
 #include "s390_crypto.h"
 
@@ -48,15 +54,6 @@ static unsigned int mod_expo_sw(int arg_length, unsigned char *arg, int exp_leng
 static unsigned int mod_mul_sw(int fc_1_length, unsigned char *fc1, int fc_2_length,
 			      unsigned char *fc2, int mod_length, unsigned char *mod,
 			      int *res_length, unsigned char *res, BN_CTX *ctx);
-static unsigned int mod_sw(int arg_length, unsigned char *arg, int mod_length,
-			   unsigned char *mod, int *res_length, unsigned char *res, BN_CTX *ctx);
-static unsigned int add_sw(int aug_length, unsigned char *aug, int add_length,
-			   unsigned char *add, int *res_length, unsigned char *res, BN_CTX *ctx);
-static unsigned int mod_sub_sw(int min_length, unsigned char *minu, int sub_length,
-			       unsigned char *sub, int mod_length, unsigned char *mod,
-			       int *res_length, unsigned char *res, BN_CTX * ctx);
-static unsigned int mul_sw(int fc_1_length, unsigned char *fc1, int fc_2_length,
-			   unsigned char *fc2, int *res_length, unsigned char *res, BN_CTX *ctx);
 static unsigned int mod_expo_sw(int arg_length, unsigned char *arg, int exp_length,
 				unsigned char *exp, int mod_length, unsigned char *mod,
 				int *res_length, unsigned char *res, BN_CTX *ctx);
@@ -568,8 +565,6 @@ unsigned int rsa_mod_expo_sw(ica_rsa_modexpo_t *pMex)
 		       (int *)&(pMex->outputdatalength), pMex->outputdata, ctx);
 
 	BN_CTX_free(ctx);
-	if (rc == 1)
-		rc = EIO;
 	return rc;
 #endif /* NO_SW_FALLBACKS */
 }
@@ -598,7 +593,8 @@ unsigned int rsa_mod_expo_sw(ica_rsa_modexpo_t *pMex)
  * @param ctx
  * Pointer to a BN_CTX
  *
- * Returns 0 if successful BN error code if unsuccessful.
+ * Returns 0 if successful, EINVAL if the result does not fit into the output
+ * buffer, else another errno.
  */
 static unsigned int mod_expo_sw(int arg_length, unsigned char *arg, int exp_length,
 				unsigned char *exp, int mod_length, unsigned char *mod,
@@ -619,6 +615,19 @@ static unsigned int mod_expo_sw(int arg_length, unsigned char *arg, int exp_leng
 		return EACCES;
 #endif /* ICA_FIPS */
 
+	/*
+	 * Constant time on the ica_mp kernels, up to RSA_MONT_MAX_BITS. The
+	 * engine's portable multiplier is slower than OpenSSL's, so without
+	 * the vector facilities BN_mod_exp is used.
+	 */
+	if (rsa_mont_accelerated()) {
+		rc = rsa_mont_mod_expo(res, *res_length, arg, arg_length, exp,
+				       exp_length, mod, mod_length);
+		if (rc != RSA_MONT_UNSUPPORTED)
+			return rc;
+		rc = 0;
+	}
+
 	BN_CTX_start(ctx);
 
 	b_arg = BN_CTX_get(ctx);
@@ -647,7 +656,7 @@ static unsigned int mod_expo_sw(int arg_length, unsigned char *arg, int exp_leng
 	}
 
 	if ((ln = BN_num_bytes(b_res)) > *res_length) {
-		rc = 1;
+		rc = EINVAL;
 		goto cleanup;
 	}
 
@@ -673,6 +682,9 @@ static unsigned int mod_expo_sw(int arg_length, unsigned char *arg, int exp_leng
 
 /**
  * Perform a RSA mod expo on input data using a key in CRT format, in software.
+ * It is computed like with rsa_crt_prepared_sw, with the key prepared for
+ * this operation only. No state of the key is kept afterwards, callers who
+ * want the blinding values reused prepare the key themselves.
  *
  * @param pCrt
  * Address of an ica_rsa_modexpo_crt_t, containing:
@@ -696,454 +708,1083 @@ unsigned int rsa_crt_sw(ica_rsa_modexpo_crt_t * pCrt)
 	UNUSED(pCrt);
 	return EPERM;
 #else
-	int rc = 0;
-	unsigned int long_length = 0;
-	unsigned int short_length = 0;
-	BN_CTX *ctx = NULL;
+	ICA_RSA_PREPARED_KEY key;
+	unsigned int rc;
 
 #ifdef ICA_FIPS
 	if ((fips & ICA_FIPS_MODE) && (!openssl_in_fips_mode()))
 		return EACCES;
 #endif /* ICA_FIPS */
 
-	short_length = (pCrt->inputdatalength+1) / 2;
-	long_length = short_length + 8;
-/*
-	Use variable buffer length. Earlier version contained fixed 136byte
-	size for ir buffers. Thus the software fallback should be able to
-	handle keys of bigger size, too.
-*/
-	unsigned char ir1[long_length];
-	int ir_1_length = sizeof(ir1);
-	unsigned char ir2[long_length];
-	int ir_2_length = sizeof(ir2);
-	unsigned char temp[long_length];
-	int temp_length = sizeof(temp);
+	/* the key parts are parsed from the caller's buffers, not copied */
+	memset(&key, 0, sizeof(key));
+	key.crt = 1;
+	key.crt_key.key_length = pCrt->inputdatalength;
+	key.crt_key.p = pCrt->np_prime;
+	key.crt_key.q = pCrt->nq_prime;
+	key.crt_key.dp = pCrt->bp_key;
+	key.crt_key.dq = pCrt->bq_key;
+	key.crt_key.qInverse = pCrt->u_mult_inv;
+
+	if ((rc = rsa_prepared_key_init_sw(&key)) != 0)
+		return rc;
+	rc = rsa_crt_prepared_sw(pCrt, &key);
+	rsa_prepared_key_free_sw(&key);
 
-	if ((ctx = BN_CTX_new()) == NULL) {
-		return EFAULT;
-	}
-
-	memset(ir1, 0, sizeof(ir1));
-	if ((rc = mod_sw(pCrt->inputdatalength, pCrt->inputdata,
-			 long_length, pCrt->np_prime, &ir_1_length, ir1, ctx)) != 0)
-		goto err;
+	return rc;
+#endif /* NO_SW_FALLBACKS */
+}
 
-	memset(temp, 0, sizeof(temp));
-	if ((rc = mod_expo_sw(ir_1_length, ir1,
-			      long_length, pCrt->bp_key,
-			      long_length, pCrt->np_prime,
-			      &temp_length, temp, ctx)) != 0)
-		goto err;
+#ifndef NO_SW_FALLBACKS
+static BIGNUM *prepared_bn(const unsigned char *buf, int len, int consttime)
+{
+	BIGNUM *bn;
 
-	memset(ir1, 0, sizeof(ir1));
-	memcpy(ir1, temp, temp_length);
-	ir_1_length = temp_length;
+	if ((bn = BN_bin2bn(buf, len, NULL)) == NULL)
+		return NULL;
+	if (consttime)
+		BN_set_flags(bn, BN_FLG_CONSTTIME);
+	return bn;
+}
 
-	memset(ir2, 0, sizeof(ir2));
-	if ((rc = mod_sw(pCrt->inputdatalength, pCrt->inputdata,
-			 short_length, pCrt->nq_prime, &ir_2_length,
-			 ir2, ctx)) != 0)
-		goto err;
+static BN_MONT_CTX *prepared_mont(const BIGNUM *mod, BN_CTX *ctx)
+{
+	BN_MONT_CTX *mont;
 
-	temp_length = sizeof(temp);
-	memset(temp, 0, sizeof(temp));
-	if ((rc = mod_expo_sw(ir_2_length, ir2,
-			      short_length, pCrt->bq_key,
-			      short_length, pCrt->nq_prime,
-			      &temp_length, temp, ctx)) != 0)
-		goto err;
+	if ((mont = BN_MONT_CTX_new()) == NULL)
+		return NULL;
+	if (!BN_MONT_CTX_set(mont, mod, ctx)) {
+		BN_MONT_CTX_free(mont);
+		return NULL;
+	}
+	return mont;
+}
 
-	memset(ir2, 0, sizeof(ir2));
-	memcpy(ir2, temp, temp_length);
-	ir_2_length = temp_length;
-
-	temp_length = sizeof(ir1);
-	if ((rc = mod_sub_sw(ir_1_length, ir1,
-			   ir_2_length, ir2,
-			   long_length, pCrt->np_prime,
-			   &temp_length, ir1, ctx)) != 0) {
-		if (rc != -1) {
-			goto err;
-		} else {
-			if ((unsigned int)ir_2_length
-			    > pCrt->outputdatalength) {
-				memcpy(pCrt->outputdata,
-				       ir2 + (ir_2_length -
-					      pCrt->outputdatalength),
-				       pCrt->outputdatalength);
-			} else {
-				if ((unsigned int)ir_2_length
-				    < pCrt->outputdatalength) {
-					memset(pCrt->outputdata, 0,
-					       (pCrt->outputdatalength -
-						ir_2_length));
-					memcpy(pCrt->outputdata +
-					       (pCrt->outputdatalength -
-						ir_2_length), ir2, ir_2_length);
-				} else {
-					memcpy(pCrt->outputdata, ir2,
-					       ir_2_length);
-				}
-			}
-			rc = 0;
-			goto cleanup;
-		}
+/*
+ * r = a^e mod m, with a < m, using the Montgomery context of m. The
+ * exponents of private CRT keys carry BN_FLG_CONSTTIME. They go to the
+ * constant time engine, if it runs on the ica_mp kernels (see mod_expo_sw),
+ * else OpenSSL takes its constant time path for them.
+ */
+static int prepared_mod_exp(BIGNUM *r, const BIGNUM *a, const BIGNUM *e,
+			    const BIGNUM *m, BN_MONT_CTX *mont, BN_CTX *ctx)
+{
+	unsigned char buf[4][RSA_MONT_MAX_BITS / 8];
+	int len = BN_num_bytes(m), rc = RSA_MONT_UNSUPPORTED;
+
+	if (BN_get_flags(e, BN_FLG_CONSTTIME) &&
+	    len <= (int)sizeof(buf[0]) && rsa_mont_accelerated()) {
+		if (BN_bn2binpad(a, buf[0], len) == len &&
+		    BN_bn2binpad(e, buf[1], len) == len &&
+		    BN_bn2binpad(m, buf[2], len) == len)
+			rc = rsa_mont_mod_expo(buf[3], len, buf[0], len,
+					       buf[1], len, buf[2], len);
+		if (rc == 0 && BN_bin2bn(buf[3], len, r) == NULL)
+			rc = ENOMEM;
+		OPENSSL_cleanse(buf, sizeof(buf));
+		if (rc != RSA_MONT_UNSUPPORTED)
+			return rc == 0;
 	}
 
-	ir_1_length = temp_length;
+	return BN_mod_exp_mont(r, a, e, m, ctx, mont);
+}
 
-	temp_length = sizeof(temp);
-	memset(temp, 0, sizeof(temp));
-	if ((rc = mod_mul_sw(ir_1_length, ir1,
-			     long_length, pCrt->u_mult_inv,
-			     long_length, pCrt->np_prime,
-			     &temp_length, temp, ctx)) != 0)
-		goto err;
+/* returns 1 if e * d = 1 mod m1 */
+static int crt_exp_inverse(const BIGNUM *e, const BIGNUM *d, const BIGNUM *m1,
+			   BIGNUM *t, BN_CTX *ctx)
+{
+	return BN_mod_mul(t, e, d, m1, ctx) && BN_is_one(t);
+}
 
-	if ((rc = mul_sw(temp_length, temp,
-			short_length, pCrt->nq_prime,
-			(int *)&(pCrt->outputdatalength), pCrt->outputdata, ctx)) != 0)
-		goto err;
+/*
+ * Sets up the public key of a prepared CRT key for blinding and for the
+ * verification of results: e = dp^-1 mod (p - 1) is the public exponent, if
+ * it is less than p - 1, and the same holds for q. So e is known if both
+ * agree, which is the case for all common keys. Otherwise the key can be
+ * neither blinded nor verified and is refused with EINVAL. The common
+ * exponents are tried first, they cost a multiplication instead of an
+ * inversion.
+ */
+static unsigned int prepared_crt_public(ICA_RSA_PREPARED_KEY *key,
+					BN_CTX *ctx)
+{
+	static const BN_ULONG common[] = { 65537, 3, 17 };
+	BIGNUM *p1, *q1, *t;
+	unsigned int rc = ENOMEM, i;
+	int ok = 0;
 
-	if ((rc = add_sw(pCrt->outputdatalength, pCrt->outputdata,
-			ir_2_length, ir2,
-			(int *)&(pCrt->outputdatalength), pCrt->outputdata, ctx)) != 0)
-		goto err;
+	BN_CTX_start(ctx);
+	p1 = BN_CTX_get(ctx);
+	q1 = BN_CTX_get(ctx);
+	if ((t = BN_CTX_get(ctx)) == NULL || (key->e = BN_new()) == NULL ||
+	    !BN_sub(p1, key->p, BN_value_one()) ||
+	    !BN_sub(q1, key->q, BN_value_one()))
+		goto out;
+	BN_set_flags(p1, BN_FLG_CONSTTIME);
+	BN_set_flags(q1, BN_FLG_CONSTTIME);
+
+	for (i = 0; i < sizeof(common) / sizeof(common[0]) && !ok; i++)
+		ok = BN_set_word(key->e, common[i]) &&
+		     crt_exp_inverse(key->e, key->dp, p1, t, ctx) &&
+		     crt_exp_inverse(key->e, key->dq, q1, t, ctx);
+
+	/* no inverse is not an error here */
+	ERR_set_mark();
+	if (!ok)
+		ok = BN_mod_inverse(key->e, key->dp, p1, ctx) != NULL &&
+		     !BN_is_one(key->e) &&
+		     crt_exp_inverse(key->e, key->dq, q1, t, ctx);
+	ERR_pop_to_mark();
+	if (!ok) {
+		rc = EINVAL;
+		goto out;
+	}
 
-	goto cleanup;
+	if ((key->n = BN_new()) == NULL || !BN_mul(key->n, key->p, key->q, ctx))
+		goto out;
+	if ((key->mont_n = prepared_mont(key->n, ctx)) == NULL ||
+	    (key->blinding = BN_BLINDING_create_param(NULL, key->e, key->n,
+						      ctx, BN_mod_exp_mont,
+						      key->mont_n)) == NULL)
+		goto out;
+	rc = 0;
 
-      err:
-	rc = EIO;
+out:
+	BN_CTX_end(ctx);
+	return rc;
+}
+#endif /* NO_SW_FALLBACKS */
 
-      cleanup:
-	BN_CTX_free(ctx);
+/**
+ * Parse the key parts of a prepared key into BIGNUMs and set up the
+ * Montgomery contexts of its moduli.
+ *
+ * Returns 0 if successful.
+ */
+unsigned int rsa_prepared_key_init_sw(ICA_RSA_PREPARED_KEY *key)
+{
+#ifdef NO_SW_FALLBACKS
+	UNUSED(key);
+	return 0;
+#else
+	unsigned int short_length, long_length;
+	BN_CTX *ctx;
+	int rc = ENOMEM;
+
+	if ((ctx = BN_CTX_new()) == NULL)
+		return ENOMEM;
+
+	if (key->crt) {
+		short_length = (key->crt_key.key_length + 1) / 2;
+		long_length = short_length + 8;
+
+		if ((key->p = prepared_bn(key->crt_key.p, long_length, 1))
+		    == NULL ||
+		    (key->q = prepared_bn(key->crt_key.q, short_length, 1))
+		    == NULL ||
+		    (key->dp = prepared_bn(key->crt_key.dp, long_length, 1))
+		    == NULL ||
+		    (key->dq = prepared_bn(key->crt_key.dq, short_length, 1))
+		    == NULL ||
+		    (key->qinv = prepared_bn(key->crt_key.qInverse,
+					     long_length, 1)) == NULL)
+			goto out;
+		/* Montgomery needs odd moduli */
+		if (!BN_is_odd(key->p) || !BN_is_odd(key->q)) {
+			rc = EINVAL;
+			goto out;
+		}
+		if ((key->mont_p = prepared_mont(key->p, ctx)) == NULL ||
+		    (key->mont_q = prepared_mont(key->q, ctx)) == NULL)
+			goto out;
+		if ((rc = prepared_crt_public(key, ctx)) != 0)
+			goto out;
+	} else {
+		if ((key->n = prepared_bn(key->mod_expo.modulus,
+					  key->mod_expo.key_length, 0))
+		    == NULL ||
+		    (key->e = prepared_bn(key->mod_expo.exponent,
+					  key->mod_expo.key_length, 0))
+		    == NULL)
+			goto out;
+		if (!BN_is_odd(key->n)) {
+			rc = EINVAL;
+			goto out;
+		}
+		if ((key->mont_n = prepared_mont(key->n, ctx)) == NULL)
+			goto out;
+	}
+	rc = 0;
 
+out:
+	BN_CTX_free(ctx);
+	if (rc)
+		rsa_prepared_key_free_sw(key);
 	return rc;
 #endif /* NO_SW_FALLBACKS */
 }
 
-#ifndef NO_SW_FALLBACKS
 /**
- * Perform a 'residue modulo' operation using an argument and a modulus.
- * @param arg_length The byte length of the input data
- * @param arg Pointer to input data
- * @param mod_length The byte length of the modulus
- * @param mod Pointer to the modulus
- * @param res_length
- * On input it points to the byte length of the output buffer. On output it
- * points to the actual byte length of the output_data.
- * @param res Pointer to the output buffer
- * @param ctx Pointer to a BN_CTX
+ * Free the BIGNUMs and Montgomery contexts of a prepared key.
+ */
+void rsa_prepared_key_free_sw(ICA_RSA_PREPARED_KEY *key)
+{
+#ifdef NO_SW_FALLBACKS
+	UNUSED(key);
+#else
+	BN_BLINDING_free(key->blinding);
+	BN_clear_free(key->n);
+	BN_clear_free(key->e);
+	BN_clear_free(key->p);
+	BN_clear_free(key->q);
+	BN_clear_free(key->dp);
+	BN_clear_free(key->dq);
+	BN_clear_free(key->qinv);
+	BN_MONT_CTX_free(key->mont_n);
+	BN_MONT_CTX_free(key->mont_p);
+	BN_MONT_CTX_free(key->mont_q);
+	key->n = key->e = NULL;
+	key->p = key->q = key->dp = key->dq = key->qinv = NULL;
+	key->mont_n = key->mont_p = key->mont_q = NULL;
+	key->blinding = NULL;
+#endif /* NO_SW_FALLBACKS */
+}
+
+/**
+ * Perform a mod expo operation like rsa_mod_expo_sw, using the BIGNUMs and
+ * the Montgomery context of a prepared key in modulus/exponent form.
  *
- * Returns 0 if successful, BN error code if unsuccessful
+ * Returns 0 if successful.
  */
-static unsigned int mod_sw(int arg_length, unsigned char *arg, int mod_length,
-			   unsigned char *mod, int *res_length, unsigned char *res, BN_CTX *ctx)
+unsigned int rsa_mod_expo_prepared_sw(ica_rsa_modexpo_t *pMex,
+				      const ICA_RSA_PREPARED_KEY *key)
 {
-	int rc = 0;
-	int ln = 0;
-	int pad = 0;
-	BIGNUM *b_arg = NULL;
-	BIGNUM *b_mod = NULL;
-	BIGNUM *b_res = NULL;
+#ifdef NO_SW_FALLBACKS
+	UNUSED(pMex);
+	UNUSED(key);
+	return EPERM;
+#else
+	BIGNUM *b_arg, *b_res;
+	BN_CTX *ctx;
+	int rc = EIO;
 
 #ifdef ICA_FIPS
 	if ((fips & ICA_FIPS_MODE) && (!openssl_in_fips_mode()))
 		return EACCES;
 #endif /* ICA_FIPS */
 
-	BN_CTX_start(ctx);
+	if ((ctx = BN_CTX_new()) == NULL)
+		return EFAULT;
 
+	BN_CTX_start(ctx);
 	b_arg = BN_CTX_get(ctx);
-	b_mod = BN_CTX_get(ctx);
 	if ((b_res = BN_CTX_get(ctx)) == NULL) {
-		rc = -ENOMEM;
+		rc = ENOMEM;
 		goto cleanup;
 	}
 
-	b_arg = BN_bin2bn((const unsigned char *)arg, arg_length, b_arg);
-	b_mod = BN_bin2bn((const unsigned char *)mod, mod_length, b_mod);
-
-	if (!(BN_mod(b_res, b_arg, b_mod, ctx))) {
-		goto err;
-	}
+	if (BN_bin2bn(pMex->inputdata, pMex->inputdatalength, b_arg) == NULL)
+		goto cleanup;
 
-	if ((ln = BN_num_bytes(b_res)) > *res_length) {
-		rc = 1;
+	/* check if modulus value > data value */
+	if (BN_ucmp(b_arg, key->n) >= 0) {
+		rc = EINVAL;
 		goto cleanup;
 	}
 
-	if (ln)
-		pad = *res_length - ln;
-
-	ln = BN_bn2bin(b_res, (unsigned char *)(res + pad));
-
-	if (pad)
-		memset(res, 0, pad);
-
-	goto cleanup;
+	if (!prepared_mod_exp(b_res, b_arg, key->e, key->n, key->mont_n, ctx))
+		goto cleanup;
 
-      err:
-	rc = EIO;
+	if (BN_bn2binpad(b_res, pMex->outputdata, pMex->outputdatalength) < 0)
+		goto cleanup;
+	rc = 0;
 
-      cleanup:
+cleanup:
 	BN_CTX_end(ctx);
-
+	BN_CTX_free(ctx);
 	return rc;
+#endif /* NO_SW_FALLBACKS */
 }
 
 /**
- * Perform a multiprecision subtraction modulo a modulus using a minuend,
- * subtrahend and modulus
+ * Perform a RSA mod expo on input data like rsa_crt_sw, using the BIGNUMs
+ * and the Montgomery contexts of a prepared key in CRT form:
  *
- * @param min_length The byte length of the minuend
- * @param min Pointer to minuend
- * @param sub_length The byte length of the subtrahend
- * @param sub Pointer to the subtrahend
- * @param mod_length The byte length of the modulus
- * @param mod The modulus
- * @param res_length
- * On input it points to the byte length of the output buffer. On output it
- * points to the actual byte length of the output_data
- * @param res Pointer to the output buffer
- * @param ctx Pointer to a BN_CTX
+ *	m1 = (c mod p)^dp mod p
+ *	m2 = (c mod q)^dq mod q
+ *	m  = m2 + q * ((m1 - m2) * qInverse mod p)
+ *
+ * c is blinded with r^e mod n before and m unblinded with r^-1 mod n
+ * afterwards, with the public key recovered by prepared_crt_public. The
+ * blinding values of the key are updated by squaring them on every
+ * operation. Then m^e = c mod n is verified, unless disabled with ica_set_rsa_crt_verify_mode,
+ * so that a faulty result, which would reveal p or q, is never returned.
  *
- * Returns 0 if successful, BN error code if unsuccessful
- * Process:
- * 1) If the subtrahend exceeds the minuend, use add_sw to
- * add the modulus to the minuend
- * 2) Call BN_CTX_get for the minuend, subtrahend & result BN's
- * 3) Convert the minuend and subtrahend BN's using BN_bin2bn
- * 4) Call BN_sub
- * 5) Convert the result from a BN to a string using BN_bn2bin
- * 6) Call BN_free for the minuend, subtrahend and result BN's
+ * Returns 0 if successful, EIO if the verification fails.
  */
-static unsigned int mod_sub_sw(int min_length, unsigned char *minu, int sub_length,
-			       unsigned char *sub, int mod_length, unsigned char *mod,
-			       int *res_length, unsigned char *res, BN_CTX * ctx)
+unsigned int rsa_crt_prepared_sw(ica_rsa_modexpo_crt_t *pCrt,
+				 const ICA_RSA_PREPARED_KEY *key)
 {
-	int rc = 0;
-	int ln = 0;
-	int pad = 0;
-
-	int min_size, sub_size, dif_size;
+#ifdef NO_SW_FALLBACKS
+	UNUSED(pCrt);
+	UNUSED(key);
+	return EPERM;
+#else
+	BIGNUM *c, *m1, *m2, *h, *in, *unblind;
+	BN_CTX *ctx;
+	int rc = EIO, ok;
 
 #ifdef ICA_FIPS
 	if ((fips & ICA_FIPS_MODE) && (!openssl_in_fips_mode()))
 		return EACCES;
 #endif /* ICA_FIPS */
 
-	BIGNUM *b_min = NULL;
-	BIGNUM *b_sub = NULL;
-	BIGNUM *b_mod = NULL;
-	BIGNUM *b_res = NULL;
+	if ((ctx = BN_CTX_new()) == NULL)
+		return EFAULT;
 
 	BN_CTX_start(ctx);
-
-	b_min = BN_CTX_get(ctx);
-	b_sub = BN_CTX_get(ctx);
-	b_mod = BN_CTX_get(ctx);
-	if ((b_res = BN_CTX_get(ctx)) == NULL) {
-		rc = -ENOMEM;
+	c = BN_CTX_get(ctx);
+	m1 = BN_CTX_get(ctx);
+	m2 = BN_CTX_get(ctx);
+	h = BN_CTX_get(ctx);
+	in = BN_CTX_get(ctx);
+	if ((unblind = BN_CTX_get(ctx)) == NULL) {
+		rc = ENOMEM;
 		goto cleanup;
 	}
 
-	b_min = BN_bin2bn((const unsigned char *)minu, min_length, b_min);
-	b_sub = BN_bin2bn((const unsigned char *)sub, sub_length, b_sub);
-	b_mod = BN_bin2bn((const unsigned char *)mod, mod_length, b_mod);
+	if (BN_bin2bn(pCrt->inputdata, pCrt->inputdatalength, c) == NULL)
+		goto cleanup;
 
-	min_size = BN_num_bytes(b_min);
-	sub_size = BN_num_bytes(b_sub);
+	if (!BN_nnmod(c, c, key->n, ctx) || !BN_copy(in, c))
+		goto cleanup;
+	/* the key may be used by several threads */
+	BN_BLINDING_lock(key->blinding);
+	ok = BN_BLINDING_convert_ex(c, unblind, key->blinding, ctx);
+	BN_BLINDING_unlock(key->blinding);
+	if (!ok)
+		goto cleanup;
 
-	/* if sub == min, the result is zero, but it's an error */
-	if (sub_size == min_size) {
-		dif_size = memcmp(sub, minu, sub_length);
-		if (dif_size == 0) {
-			memset(res, 0, *res_length);
-			rc = -1;
-			goto cleanup;
-		}
-	}
-	/* if sub < min, the result is just min - sub */
-	if ((sub_size < min_size) || ((sub_size == min_size) && (dif_size < 0))) {
-		if (!(BN_sub(b_res, b_min, b_sub))) {
-			goto err;
-		}
-	} else {                /* sub > min, so the result is (min + mod) - sub */
-		if (!(BN_add(b_res, b_min, b_mod))) {
-			goto err;
-		}
-		if (!(BN_sub(b_res, b_res, b_sub))) {
-			goto err;
-		}
-	}
+	if (!BN_nnmod(m1, c, key->p, ctx) ||
+	    !prepared_mod_exp(m1, m1, key->dp, key->p, key->mont_p, ctx))
+		goto cleanup;
+	if (!BN_nnmod(m2, c, key->q, ctx) ||
+	    !prepared_mod_exp(m2, m2, key->dq, key->q, key->mont_q, ctx))
+		goto cleanup;
 
-	if ((ln = BN_num_bytes(b_res)) > *res_length) {
-		rc = 1;
+	if (!BN_mod_sub(h, m1, m2, key->p, ctx) ||
+	    !BN_mod_mul(h, h, key->qinv, key->p, ctx) ||
+	    !BN_mul(h, h, key->q, ctx) ||
+	    !BN_add(h, h, m2))
 		goto cleanup;
-	}
 
-	if (ln)
-		pad = *res_length - ln;
+	if (!BN_BLINDING_invert_ex(h, unblind, key->blinding, ctx))
+		goto cleanup;
+	if (ica_rsa_crt_verify_enabled &&
+	    (!BN_mod_exp_mont(m1, h, key->e, key->n, ctx, key->mont_n) ||
+	     BN_cmp(m1, in) != 0))
+		goto cleanup;
 
-	ln = BN_bn2bin(b_res, (unsigned char *)(res + pad));
+	if (BN_bn2binpad(h, pCrt->outputdata, pCrt->outputdatalength) < 0)
+		goto cleanup;
+	rc = 0;
+
+cleanup:
+	BN_clear(c);
+	BN_clear(m1);
+	BN_clear(m2);
+	BN_clear(h);
+	BN_clear(unblind);
+	BN_CTX_end(ctx);
+	BN_CTX_free(ctx);
+	return rc;
+#endif /* NO_SW_FALLBACKS */
+}
 
-	if (pad)
-		memset(res, 0, pad);
+#ifndef NO_SW_FALLBACKS
+/* the Montgomery contexts of the last moduli seen in a batch */
+#define BATCH_MONT_CACHE	8
+
+struct batch_mont {
+	const unsigned char *mod;
+	unsigned int len;
+	BIGNUM *n;
+	BN_MONT_CTX *mont;
+};
+
+static struct batch_mont *batch_mont_get(struct batch_mont *cache,
+					 unsigned int *next,
+					 const unsigned char *mod,
+					 unsigned int len, BN_CTX *ctx)
+{
+	struct batch_mont *entry;
+	unsigned int i;
+
+	for (i = 0; i < BATCH_MONT_CACHE; i++) {
+		entry = &cache[i];
+		if (entry->mont && entry->len == len &&
+		    (entry->mod == mod || !memcmp(entry->mod, mod, len)))
+			return entry;
+	}
 
-	goto cleanup;
+	/* replace the oldest entry */
+	entry = &cache[*next];
+	*next = (*next + 1) % BATCH_MONT_CACHE;
+	BN_MONT_CTX_free(entry->mont);
+	entry->mont = NULL;
+	if ((entry->n = BN_bin2bn(mod, len, entry->n)) == NULL ||
+	    !BN_is_odd(entry->n) ||
+	    (entry->mont = prepared_mont(entry->n, ctx)) == NULL)
+		return NULL;
+	entry->mod = mod;
+	entry->len = len;
+	return entry;
+}
 
-      err:
-	rc = EIO;
+/*
+ * Returns the exponent as a word, or 0 if it is longer than a word (or 0).
+ */
+static uint64_t batch_short_exp(const unsigned char *exp, unsigned int len)
+{
+	uint64_t e = 0;
+	unsigned int i;
+
+	for (i = 0; i < len && !exp[i]; i++)
+		;
+	if (len - i > sizeof(e))
+		return 0;
+	for (; i < len; i++)
+		e = e << 8 | exp[i];
+	return e;
+}
 
-      cleanup:
-	BN_CTX_end(ctx);
+/*
+ * r = a^e mod n for a short exponent e > 0, left to right binary in the
+ * Montgomery domain of n. Not constant time, so only for public exponents:
+ * for e = 65537 these are 16 squarings and one multiplication, without the
+ * window setup of BN_mod_exp_mont.
+ */
+static int mod_exp_short(BIGNUM *r, const BIGNUM *a, uint64_t e,
+			 BN_MONT_CTX *mont, BN_CTX *ctx)
+{
+	BIGNUM *am;
+	int i, rc = 0;
 
+	BN_CTX_start(ctx);
+	if ((am = BN_CTX_get(ctx)) == NULL ||
+	    !BN_to_montgomery(am, a, mont, ctx) || !BN_copy(r, am))
+		goto out;
+	for (i = 62 - __builtin_clzll(e); i >= 0; i--) {
+		if (!BN_mod_mul_montgomery(r, r, r, mont, ctx))
+			goto out;
+		if (((e >> i) & 1) && !BN_mod_mul_montgomery(r, r, am, mont, ctx))
+			goto out;
+	}
+	rc = BN_from_montgomery(r, r, mont, ctx);
+out:
+	BN_CTX_end(ctx);
 	return rc;
 }
+#endif /* NO_SW_FALLBACKS */
 
 /**
- * Perform a multiprecision addition using an augend and addend
- * @param aug_length The byte length of the augend
- * @param aug Pointer to augend
- * @param add_length The byte length of the addend
- * @param add Pointer to the addend
- * @param res_length On input it points to the byte length of the output buffer.
- *		On output it points to the actual byte length of the
- *		output_data
- * @param res Pointer to the output buffer
- * @param ctx Pointer to a BN_CTX
+ * Perform the mod expo operations of a batch like rsa_mod_expo_sw, skipping
+ * the elements whose status is not RSA_BATCH_PENDING. Public keys with an
+ * exponent of up to 64 bits share one BN_CTX and the Montgomery contexts of
+ * recurring moduli, longer exponents go through rsa_mod_expo_sw.
+ * If begin is not NULL, begin[i] is set to stats_latency_begin() right
+ * before element i is processed.
  *
- * Returns 0 if successful, BN error code if unsuccessful
- * Process:
- * 1) Call BN_CTX_get for the augend, addend and result BN's
- * 2) Convert the augend and addend BN's using BN_bin2bn
- * 3) Call BN_add
- * 4) Convert the result from a BN to a string using BN_bn2bin
- * 5) Call BN_free for the augend, addend and result BN's
-*/
-static unsigned int add_sw(int aug_length, unsigned char *aug, int add_length,
-			   unsigned char *add, int *res_length, unsigned char *res, BN_CTX *ctx)
+ * Sets the status of each processed element, returns 0 or ENOMEM.
+ */
+unsigned int rsa_mod_expo_batch_sw(ica_rsa_modexpo_t *rb, unsigned int *status,
+				   unsigned int count, uint64_t *begin)
 {
-	int rc = 0;
-	int ln = 0;
-	int pad = 0;
-	BIGNUM *b_aug = NULL;
-	BIGNUM *b_add = NULL;
-	BIGNUM *b_res = NULL;
-
-	BN_CTX_start(ctx);
+#ifdef NO_SW_FALLBACKS
+	unsigned int i;
+
+	UNUSED(rb);
+	UNUSED(begin);
+	for (i = 0; i < count; i++)
+		if (status[i] == RSA_BATCH_PENDING)
+			status[i] = EPERM;
+	return 0;
+#else
+	struct batch_mont cache[BATCH_MONT_CACHE], *entry;
+	unsigned int i, len, next = 0;
+	BIGNUM *a, *r;
+	BN_CTX *ctx;
+	uint64_t e;
 
 #ifdef ICA_FIPS
 	if ((fips & ICA_FIPS_MODE) && (!openssl_in_fips_mode()))
 		return EACCES;
 #endif /* ICA_FIPS */
 
-	b_aug = BN_CTX_get(ctx);
-	b_add = BN_CTX_get(ctx);
-	if ((b_res = BN_CTX_get(ctx)) == NULL) {
-		rc = -ENOMEM;
-		goto cleanup;
+	if ((ctx = BN_CTX_new()) == NULL)
+		return ENOMEM;
+	memset(cache, 0, sizeof(cache));
+
+	BN_CTX_start(ctx);
+	a = BN_CTX_get(ctx);
+	if ((r = BN_CTX_get(ctx)) == NULL) {
+		BN_CTX_end(ctx);
+		BN_CTX_free(ctx);
+		return ENOMEM;
 	}
 
-	b_aug = BN_bin2bn((const unsigned char *)aug, aug_length, b_aug);
-	b_add = BN_bin2bn((const unsigned char *)add, add_length, b_add);
+	for (i = 0; i < count; i++) {
+		if (status[i] != RSA_BATCH_PENDING)
+			continue;
+		if (begin != NULL)
+			begin[i] = stats_latency_begin();
+		len = rb[i].inputdatalength;
+
+		e = batch_short_exp(rb[i].b_key, len);
+		if (!e) {
+			status[i] = rsa_mod_expo_sw(&rb[i]);
+			continue;
+		}
 
-	if (!(BN_add(b_res, b_aug, b_add))) {
-		goto err;
-	}
+		/* check if modulus value > data value */
+		if (memcmp(rb[i].n_modulus, rb[i].inputdata, len) <= 0) {
+			status[i] = EINVAL;
+			continue;
+		}
 
-	if ((ln = BN_num_bytes(b_res)) > *res_length) {
-		rc = 1;
-		goto cleanup;
+		entry = batch_mont_get(cache, &next, rb[i].n_modulus, len, ctx);
+		if (entry == NULL) {
+			/* even modulus or no memory */
+			status[i] = rsa_mod_expo_sw(&rb[i]);
+			continue;
+		}
+
+		if (BN_bin2bn(rb[i].inputdata, len, a) == NULL ||
+		    !mod_exp_short(r, a, e, entry->mont, ctx) ||
+		    BN_bn2binpad(r, rb[i].outputdata,
+				 rb[i].outputdatalength) < 0)
+			status[i] = EIO;
+		else
+			status[i] = 0;
 	}
 
-	if (ln)
-		pad = *res_length - ln;
+	for (i = 0; i < BATCH_MONT_CACHE; i++) {
+		BN_free(cache[i].n);
+		BN_MONT_CTX_free(cache[i].mont);
+	}
+	BN_CTX_end(ctx);
+	BN_CTX_free(ctx);
+	return 0;
+#endif /* NO_SW_FALLBACKS */
+}
 
-	ln = BN_bn2bin(b_res, (unsigned char *)(res + pad));
+#ifdef ICA_INTERNAL_TEST_RSA
+
+#include <stdio.h>
+#include <openssl/rand.h>
+#include "rsa_route.h"
+#include "../test/testcase.h"
+
+#define BENCH_USEC	1000000
+
+/* operations per second of one software path, run for BENCH_USEC */
+#define BENCH(ops_per_sec, call)					\
+	do {								\
+		struct timeval start, now;				\
+		unsigned long long n = 0, usec;				\
+									\
+		gettimeofday(&start, NULL);				\
+		do {							\
+			if ((call) != 0)				\
+				EXIT_ERR(#call " failed.");		\
+			n++;						\
+			gettimeofday(&now, NULL);			\
+			usec = delta_usec(&start, &now);		\
+		} while (usec < BENCH_USEC);				\
+		ops_per_sec = (double)n * 1000000 / usec;		\
+	} while (0)
+
+static void rsa_prepared_test(unsigned int bits)
+{
+	unsigned int len = bits / 8, short_len = (len + 1) / 2;
+	unsigned char n[len], e[len], in[len], out[len], out2[len], back[len];
+	unsigned char p[short_len + 8], q[short_len], dp[short_len + 8],
+		      dq[short_len], qinv[short_len + 8];
+	ica_rsa_key_mod_expo_t pub = { len, n, e };
+	ica_rsa_key_crt_t priv = { len, p, q, dp, dq, qinv };
+	ICA_RSA_PREPARED_KEY *pub_prep, *priv_prep;
+	ica_rsa_modexpo_crt_t crt;
+	ica_rsa_modexpo_t me;
+	double crt_old, crt_new, me_old, me_new;
+
+	memset(e, 0, len);
+	e[len - 3] = 0x01;
+	e[len - 1] = 0x01;	/* 65537 */
+	if (rsa_key_generate_crt(DRIVER_NOT_LOADED, bits, &pub, &priv))
+		EXIT_ERR("rsa_key_generate_crt failed.");
+
+	if (ica_rsa_key_mod_expo_prepare(&pub, &pub_prep))
+		EXIT_ERR("ica_rsa_key_mod_expo_prepare failed.");
+	if (ica_rsa_key_crt_prepare(&priv, &priv_prep))
+		EXIT_ERR("ica_rsa_key_crt_prepare failed.");
+	ica_rsa_crt_key_check(&priv);
+
+	if (RAND_bytes(in, len) != 1)
+		EXIT_ERR("RAND_bytes failed.");
+	in[0] = 0;	/* less than the modulus */
+
+	crt.inputdata = in;
+	crt.inputdatalength = len;
+	crt.outputdata = out;
+	crt.outputdatalength = len;
+	crt.np_prime = p;
+	crt.nq_prime = q;
+	crt.bp_key = dp;
+	crt.bq_key = dq;
+	crt.u_mult_inv = qinv;
+
+	me.inputdata = out;
+	me.inputdatalength = len;
+	me.outputdata = back;
+	me.outputdatalength = len;
+	me.b_key = e;
+	me.n_modulus = n;
+
+	/* both paths compute the same results, which are inverse */
+	if (rsa_crt_sw(&crt) || rsa_mod_expo_sw(&me))
+		EXIT_ERR("software path failed.");
+	if (memcmp(back, in, len))
+		EXIT_ERR("public operation does not invert the private one.");
+	crt.outputdata = out2;
+	if (rsa_crt_prepared_sw(&crt, priv_prep))
+		EXIT_ERR("rsa_crt_prepared_sw failed.");
+	if (memcmp(out, out2, len))
+		EXIT_ERR("prepared CRT result differs.");
+	memset(back, 0, len);
+	if (rsa_mod_expo_prepared_sw(&me, pub_prep))
+		EXIT_ERR("rsa_mod_expo_prepared_sw failed.");
+	if (memcmp(back, in, len))
+		EXIT_ERR("prepared mod expo result differs.");
+
+	/* input not less than the modulus */
+	me.inputdata = n;
+	if (rsa_mod_expo_prepared_sw(&me, pub_prep) != EINVAL)
+		EXIT_ERR("rsa_mod_expo_prepared_sw accepted input >= n.");
+	me.inputdata = out;
+
+	BENCH(crt_old, rsa_crt_sw(&crt));
+	BENCH(crt_new, rsa_crt_prepared_sw(&crt, priv_prep));
+	BENCH(me_old, rsa_mod_expo_sw(&me));
+	BENCH(me_new, rsa_mod_expo_prepared_sw(&me, pub_prep));
+
+	printf("RSA-%u CRT     %10.1f ops/s, prepared %10.1f ops/s (x%.2f)\n",
+	       bits, crt_old, crt_new, crt_new / crt_old);
+	printf("RSA-%u ME pub  %10.1f ops/s, prepared %10.1f ops/s (x%.2f)\n",
+	       bits, me_old, me_new, me_new / me_old);
+
+	ica_rsa_prepared_key_free(pub_prep);
+	ica_rsa_prepared_key_free(priv_prep);
+	OPENSSL_cleanse(p, sizeof(p));
+	OPENSSL_cleanse(q, sizeof(q));
+	OPENSSL_cleanse(dp, sizeof(dp));
+	OPENSSL_cleanse(dq, sizeof(dq));
+	OPENSSL_cleanse(qinv, sizeof(qinv));
+}
 
-	if (pad)
-		memset(res, 0, pad);
+static void rsa_crt_hardening_test(unsigned int bits)
+{
+	unsigned int len = bits / 8, short_len = (len + 1) / 2, i;
+	unsigned char n[len], e[len], in[len], out[len], out2[len], back[len];
+	unsigned char p[short_len + 8], q[short_len], dp[short_len + 8],
+		      dq[short_len], qinv[short_len + 8];
+	ica_rsa_key_mod_expo_t pub = { len, n, e };
+	ica_rsa_key_crt_t priv = { len, p, q, dp, dq, qinv };
+	ICA_RSA_PREPARED_KEY *prep;
+	ica_rsa_modexpo_crt_t crt;
+	ica_rsa_modexpo_t me;
+	double crt_verify, crt_noverify, prep_verify, prep_noverify;
+
+	memset(e, 0, len);
+	e[len - 3] = 0x01;
+	e[len - 1] = 0x01;	/* 65537 */
+	if (rsa_key_generate_crt(DRIVER_NOT_LOADED, bits, &pub, &priv))
+		EXIT_ERR("rsa_key_generate_crt failed.");
+	ica_rsa_crt_key_check(&priv);
+	if (ica_rsa_key_crt_prepare(&priv, &prep))
+		EXIT_ERR("ica_rsa_key_crt_prepare failed.");
+	if (prep->blinding == NULL || !BN_is_word(prep->e, 65537))
+		EXIT_ERR("public exponent not recovered.");
+
+	crt.inputdata = in;
+	crt.inputdatalength = len;
+	crt.outputdata = out;
+	crt.outputdatalength = len;
+	crt.np_prime = p;
+	crt.nq_prime = q;
+	crt.bp_key = dp;
+	crt.bq_key = dq;
+	crt.u_mult_inv = qinv;
+
+	me.inputdata = out;
+	me.inputdatalength = len;
+	me.outputdata = back;
+	me.outputdatalength = len;
+	me.b_key = e;
+	me.n_modulus = n;
+
+	/* the prepared key, with its blinding values updated by squaring,
+	 * and the key prepared by rsa_crt_sw for one operation give the same
+	 * results */
+	for (i = 0; i < 40; i++) {
+		if (RAND_bytes(in, len) != 1)
+			EXIT_ERR("RAND_bytes failed.");
+		in[0] = 0;
+		crt.outputdata = out;
+		if (rsa_crt_prepared_sw(&crt, prep))
+			EXIT_ERR("rsa_crt_prepared_sw failed.");
+		crt.outputdata = out2;
+		if (rsa_crt_sw(&crt))
+			EXIT_ERR("rsa_crt_sw failed.");
+		if (memcmp(out, out2, len))
+			EXIT_ERR("blinded results differ.");
+		if (rsa_mod_expo_sw(&me) || memcmp(back, in, len))
+			EXIT_ERR("public operation does not invert the blinded one.");
+	}
 
-	goto cleanup;
+	/* a fault in the computation is detected, the result not returned */
+	crt.outputdata = out;
+	if (!BN_add_word(prep->dp, 2))
+		EXIT_ERR("BN_add_word failed.");
+	memset(out, 0xaa, len);
+	if (rsa_crt_prepared_sw(&crt, prep) != EIO)
+		EXIT_ERR("faulty CRT result not detected.");
+	for (i = 0; i < len; i++) {
+		if (out[i] != 0xaa)
+			EXIT_ERR("faulty CRT result returned.");
+	}
+	ica_set_rsa_crt_verify_mode(ICA_RSA_CRT_VERIFY_DISABLED);
+	if (rsa_crt_prepared_sw(&crt, prep))
+		EXIT_ERR("unverified CRT failed.");
+	ica_set_rsa_crt_verify_mode(ICA_RSA_CRT_VERIFY_ENABLED);
+	if (!BN_sub_word(prep->dp, 2))
+		EXIT_ERR("BN_sub_word failed.");
+
+	/* without a recoverable e, e.g. an inconsistent dq, the key can be
+	 * neither blinded nor verified and is refused */
+	dq[short_len - 1] ^= 2;
+	if (rsa_crt_sw(&crt) != EINVAL)
+		EXIT_ERR("rsa_crt_sw accepted an unverifiable key.");
+	dq[short_len - 1] ^= 2;
+
+	ica_set_rsa_crt_verify_mode(ICA_RSA_CRT_VERIFY_DISABLED);
+	BENCH(crt_noverify, rsa_crt_sw(&crt));
+	BENCH(prep_noverify, rsa_crt_prepared_sw(&crt, prep));
+	ica_set_rsa_crt_verify_mode(ICA_RSA_CRT_VERIFY_ENABLED);
+	BENCH(crt_verify, rsa_crt_sw(&crt));
+	BENCH(prep_verify, rsa_crt_prepared_sw(&crt, prep));
+
+	printf("RSA-%u CRT blinded %10.1f ops/s, verified %10.1f ops/s "
+	       "(x%.2f)\n", bits, crt_noverify, crt_verify,
+	       crt_verify / crt_noverify);
+	printf("RSA-%u CRT blinded prepared %10.1f ops/s, verified %10.1f "
+	       "ops/s (x%.2f)\n", bits, prep_noverify, prep_verify,
+	       prep_verify / prep_noverify);
+
+	ica_rsa_prepared_key_free(prep);
+	OPENSSL_cleanse(p, sizeof(p));
+	OPENSSL_cleanse(q, sizeof(q));
+	OPENSSL_cleanse(dp, sizeof(dp));
+	OPENSSL_cleanse(dq, sizeof(dq));
+	OPENSSL_cleanse(qinv, sizeof(qinv));
+}
 
-      err:
-	rc = EIO;
+static int bn_mod_expo(unsigned char *res, int len, const unsigned char *arg,
+		       const unsigned char *exp, const unsigned char *mod,
+		       BN_CTX *ctx)
+{
+	BIGNUM *a, *e, *n, *r;
+	int rc = -1;
 
-      cleanup:
+	BN_CTX_start(ctx);
+	a = BN_CTX_get(ctx);
+	e = BN_CTX_get(ctx);
+	n = BN_CTX_get(ctx);
+	r = BN_CTX_get(ctx);
+	if (r && BN_bin2bn(arg, len, a) && BN_bin2bn(exp, len, e) &&
+	    BN_bin2bn(mod, len, n) && BN_mod_exp(r, a, e, n, ctx) &&
+	    BN_bn2binpad(r, res, len) == len)
+		rc = 0;
 	BN_CTX_end(ctx);
-
 	return rc;
 }
 
-/**
- * Perform a multiprecision multiply using a multiplicand and multiplier.
- * @param fc_1_length The byte length of the multiplicand
- * @param fc1 Pointer to multiplicand
- * @param fc_2_length The byte length of the multiplier
- * @param fc2 Pointer to the multiplier
- * @param res_length
- * On input it points to the byte length of the output buffer. On output it
- * points to the actual byte length of the output_data.
- * @param res Pointer to the output buffer
- * @param ctx Pointer to a BN_CTX
- *
- * Returns 0 if successful, BN error code if unsuccessful
- */
-static unsigned int mul_sw(int fc_1_length, unsigned char *fc1, int fc_2_length,
-			   unsigned char *fc2, int *res_length, unsigned char *res, BN_CTX *ctx)
+static void rsa_mont_test(unsigned int bits)
 {
-	int rc = 0;
-	int ln = 0;
-	int pad = 0;
-	BIGNUM *b_fc1 = NULL;
-	BIGNUM *b_fc2 = NULL;
-	BIGNUM *b_res = NULL;
+	unsigned int len = bits / 8, i;
+	unsigned char mod[len], e[len], in[len], out[len], out2[len];
+	BIGNUM *bn;
+	BN_CTX *ctx;
+	double ops_bn, ops_mont;
+
+	ctx = BN_CTX_new();
+	bn = BN_new();
+	if (!ctx || !bn)
+		EXIT_ERR("BN allocation failed.");
+
+	/* random odd moduli, bases and full length exponents */
+	for (i = 0; i < 16; i++) {
+		if (!BN_rand(bn, bits, BN_RAND_TOP_ONE, BN_RAND_BOTTOM_ODD) ||
+		    BN_bn2binpad(bn, mod, len) != (int)len ||
+		    RAND_bytes(in, len) != 1 || RAND_bytes(e, len) != 1)
+			EXIT_ERR("random numbers failed.");
+		in[0] = 0;		/* less than the modulus */
+		if (i == 1)
+			memset(in, 0, len);
+		if (i == 2)
+			memset(e, 0, len - 1);
+
+		if (bn_mod_expo(out, len, in, e, mod, ctx))
+			EXIT_ERR("BN_mod_exp failed.");
+		if (rsa_mont_mod_expo(out2, len, in, len, e, len, mod, len))
+			EXIT_ERR("rsa_mont_mod_expo failed.");
+		if (memcmp(out, out2, len))
+			EXIT_ERR("rsa_mont_mod_expo result differs from BN_mod_exp.");
+	}
 
-	BN_CTX_start(ctx);
+	BENCH(ops_bn, bn_mod_expo(out, len, in, e, mod, ctx));
+	BENCH(ops_mont, rsa_mont_mod_expo(out2, len, in, len, e, len, mod, len));
 
-#ifdef ICA_FIPS
-	if ((fips & ICA_FIPS_MODE) && (!openssl_in_fips_mode()))
-		return EACCES;
-#endif /* ICA_FIPS */
+	printf("RSA-%u mod expo BN_mod_exp %10.1f ops/s, "
+	       "rsa_mont (%s) %10.1f ops/s (x%.2f)\n", bits, ops_bn,
+	       rsa_mont_accelerated() ? "ica_mp" : "C", ops_mont,
+	       ops_mont / ops_bn);
 
-	b_fc1 = BN_CTX_get(ctx);
-	b_fc2 = BN_CTX_get(ctx);
-	if ((b_res = BN_CTX_get(ctx)) == NULL) {
-		rc = -ENOMEM;
-		goto cleanup;
+	BN_free(bn);
+	BN_CTX_free(ctx);
+}
+
+#define BATCH_MAX	256
+#define BATCH_MODULI	4
+
+static unsigned int batch_run(ica_rsa_modexpo_t *rb, unsigned int *status,
+			      unsigned int count)
+{
+	unsigned int i, rc;
+
+	for (i = 0; i < count; i++)
+		status[i] = RSA_BATCH_PENDING;
+	if ((rc = rsa_mod_expo_batch_sw(rb, status, count, NULL)) != 0)
+		return rc;
+	for (i = 0; i < count; i++) {
+		if (status[i])
+			return status[i];
 	}
+	return 0;
+}
 
-	b_fc1 = BN_bin2bn((const unsigned char *)fc1, fc_1_length, b_fc1);
-	b_fc2 = BN_bin2bn((const unsigned char *)fc2, fc_2_length, b_fc2);
+static void rsa_batch_test(unsigned int bits)
+{
+	unsigned int len = bits / 8, i, size, status[BATCH_MAX];
+	unsigned char mod[BATCH_MODULI][len], exp[3][len], in[len], ref[len];
+	unsigned char *out;
+	ica_rsa_modexpo_t rb[BATCH_MAX];
+	double ops_single, ops_batch;
+	BIGNUM *bn;
+	BN_CTX *ctx;
+
+	ctx = BN_CTX_new();
+	bn = BN_new();
+	out = malloc(BATCH_MAX * len);
+	if (!ctx || !bn || !out)
+		EXIT_ERR("allocation failed.");
+
+	/* random odd moduli, e = 65537, e = 3 and a full length exponent */
+	for (i = 0; i < BATCH_MODULI; i++) {
+		if (!BN_rand(bn, bits, BN_RAND_TOP_ONE, BN_RAND_BOTTOM_ODD) ||
+		    BN_bn2binpad(bn, mod[i], len) != (int)len)
+			EXIT_ERR("random numbers failed.");
+	}
+	memset(exp, 0, sizeof(exp));
+	exp[0][len - 3] = 0x01;
+	exp[0][len - 1] = 0x01;
+	exp[1][len - 1] = 0x03;
+	if (RAND_bytes(exp[2], len) != 1 || RAND_bytes(in, len) != 1)
+		EXIT_ERR("RAND_bytes failed.");
+	in[0] = 0;	/* less than the moduli */
+
+	for (i = 0; i < BATCH_MAX; i++) {
+		rb[i].inputdata = in;
+		rb[i].inputdatalength = len;
+		rb[i].outputdata = out + i * len;
+		rb[i].outputdatalength = len;
+		rb[i].b_key = exp[i % 3];
+		rb[i].n_modulus = mod[i % BATCH_MODULI];
+	}
 
-	if (!(BN_mul(b_res, b_fc1, b_fc2, ctx))) {
-		goto err;
+	/* one input not less than its modulus and one element skipped */
+	rb[5].inputdata = rb[5].n_modulus;
+	for (i = 0; i < 64; i++)
+		status[i] = i == 7 ? 0 : RSA_BATCH_PENDING;
+	memset(out, 0, 64 * len);
+	if (rsa_mod_expo_batch_sw(rb, status, 64, NULL))
+		EXIT_ERR("rsa_mod_expo_batch_sw failed.");
+	for (i = 0; i < 64; i++) {
+		if (i == 5) {
+			if (status[i] != EINVAL)
+				EXIT_ERR("batch accepted input >= modulus.");
+			continue;
+		}
+		if (i == 7) {
+			if (status[i] || out[i * len + len - 1])
+				EXIT_ERR("batch processed a skipped element.");
+			continue;
+		}
+		if (status[i] || bn_mod_expo(ref, len, in, rb[i].b_key,
+					     rb[i].n_modulus, ctx) ||
+		    memcmp(ref, rb[i].outputdata, len))
+			EXIT_ERR("batch result differs from BN_mod_exp.");
+	}
+	rb[5].inputdata = in;
+
+	/* public key operations, e = 65537 */
+	for (i = 0; i < BATCH_MAX; i++)
+		rb[i].b_key = exp[0];
+
+	BENCH(ops_single, rsa_mod_expo_sw(&rb[0]));
+	for (size = 1; size <= BATCH_MAX; size *= 4) {
+		BENCH(ops_batch, batch_run(rb, status, size));
+		ops_batch *= size;
+		printf("RSA-%u ME pub  %10.1f ops/s, batch of %3u %10.1f ops/s "
+		       "(x%.2f)\n", bits, ops_single, size, ops_batch,
+		       ops_batch / ops_single);
 	}
 
-	if ((ln = BN_num_bytes(b_res)) > *res_length) {
-		rc = 1;
-		goto cleanup;
+	free(out);
+	BN_free(bn);
+	BN_CTX_free(ctx);
+}
+
+#define ROUTE_SW_NS	1000000
+#define ROUTE_OPS	10000
+
+/*
+ * ROUTE_OPS routing decisions of one bucket against a simulated adapter
+ * taking hw_ns, of which every fail_every-th request fails (0: none), and
+ * software taking ROUTE_SW_NS. Returns the number of diverted requests.
+ */
+static unsigned int route_run(unsigned int bucket, uint64_t hw_ns,
+			      unsigned int fail_every)
+{
+	unsigned int i, diverted = 0;
+
+	for (i = 0; i < ROUTE_OPS; i++) {
+		if (rsa_route_divert(bucket)) {
+			rsa_route_sample(bucket, ALGO_SW, ROUTE_SW_NS, 0);
+			diverted++;
+		} else {
+			rsa_route_sample(bucket, ALGO_HW, hw_ns,
+					 fail_every && i % fail_every == 0);
+		}
 	}
+	return diverted;
+}
 
-	if (ln)
-		pad = *res_length - ln;
+static void rsa_route_test(void)
+{
+	const unsigned int bucket = rsa_keysize_stats_ofs(2048 / 8);
+	stats_event_t events[STATS_EVENTS];
+	unsigned int i, num, diverted, to_sw = 0, to_hw = 0;
+
+	rsa_route_reset();
+	if (route_run(bucket, 4 * ROUTE_SW_NS, 0))
+		EXIT_ERR("routing not disabled by default.");
+	ica_set_rsa_route_mode(200);
+	if (ica_rsa_route_mode != 100)
+		EXIT_ERR("route mode not limited to 100 percent.");
+	ica_set_rsa_route_mode(50);
+	rsa_route_reset();
+
+	/* a fast adapter only gets the software probes diverted */
+	diverted = route_run(bucket, ROUTE_SW_NS / 5, 0);
+	if (rsa_route_diverting(bucket) || diverted > ROUTE_OPS / 1024 + 1)
+		EXIT_ERR("requests diverted from a fast adapter.");
+
+	/* half of the requests leave an adapter twice as slow */
+	diverted = route_run(bucket, 2 * ROUTE_SW_NS, 0);
+	V_(printf("slow adapter: %u of %u requests diverted\n", diverted,
+		  ROUTE_OPS));
+	if (!rsa_route_diverting(bucket) || diverted < ROUTE_OPS * 45 / 100 ||
+	    diverted > ROUTE_OPS / 2)
+		EXIT_ERR("wrong share of requests diverted.");
+
+	/* hysteresis: between 1 and 5/4 of the software latency, it stays */
+	route_run(bucket, ROUTE_SW_NS * 11 / 10, 0);
+	if (!rsa_route_diverting(bucket))
+		EXIT_ERR("diverting stopped above the software latency.");
+	route_run(bucket, ROUTE_SW_NS * 9 / 10, 0);
+	if (rsa_route_diverting(bucket))
+		EXIT_ERR("diverting did not stop.");
+	route_run(bucket, ROUTE_SW_NS * 11 / 10, 0);
+	if (rsa_route_diverting(bucket))
+		EXIT_ERR("diverting restarted below 5/4 of the software latency.");
+
+	/* an adapter failing every other request costs half a software op */
+	route_run(bucket, ROUTE_SW_NS * 8 / 10, 2);
+	if (!rsa_route_diverting(bucket))
+		EXIT_ERR("failing adapter not diverted from.");
+
+	/* all but the hardware probes */
+	ica_set_rsa_route_mode(100);
+	diverted = route_run(bucket, 2 * ROUTE_SW_NS, 0);
+	V_(printf("slow adapter, mode 100: %u of %u requests diverted\n",
+		  diverted, ROUTE_OPS));
+	if (diverted < ROUTE_OPS - ROUTE_OPS / 16 - 1)
+		EXIT_ERR("wrong share of requests diverted.");
+
+	ica_set_rsa_route_mode(0);
+	rsa_route_reset();
+
+	/* the changes are fallback events, if the statistics are available */
+	num = get_stats_events(events, NULL);
+	for (i = 0; i < num; i++) {
+		if (events[i].pid != getpid() ||
+		    events[i].field != ICA_STATS_RSA_CRT_2048)
+			continue;
+		to_sw += events[i].reason == STATS_FB_ROUTE_SW;
+		to_hw += events[i].reason == STATS_FB_ROUTE_HW;
+	}
+	if (num && (to_sw != 2 || to_hw != 1))
+		EXIT_ERR("routing changes not recorded as events.");
 
-	ln = BN_bn2bin(b_res, (unsigned char *)(res + pad));
+	printf("RSA routing: %u changes recorded\n", to_sw + to_hw);
+}
 
-	if (pad)
-		memset(res, 0, pad);
+int main(int argc, char *argv[])
+{
+	set_verbosity(argc, argv);
 
-	goto cleanup;
+	/* routing between a simulated adapter and software */
+	rsa_route_test();
 
-      err:
-	rc = EIO;
+	/* Montgomery engine against OpenSSL, private key sized exponents */
+	rsa_mont_test(1024);
+	rsa_mont_test(2048);
+	rsa_mont_test(3072);
+	rsa_mont_test(4096);
 
-      cleanup:
-	BN_CTX_end(ctx);
+	/* software fallback ops/s without and with a prepared key */
+	rsa_prepared_test(2048);
+	rsa_prepared_test(3072);
+	rsa_prepared_test(4096);
 
-	return rc;
+	/* blinded CRT, without and with verification of the results */
+	rsa_crt_hardening_test(2048);
+	rsa_crt_hardening_test(4096);
+
+	/* software fallback of batches of public key operations */
+	rsa_batch_test(2048);
+
+	return TEST_SUCC;
 }
-#endif /* NO_SW_FALLBACKS */
+
+#endif /* ICA_INTERNAL_TEST_RSA */
@@ -39,7 +39,8 @@ int s390_sha1(unsigned char *iv, const unsigned char *input_data,
 				 message_part, running_length, NULL, SHA_1);
 
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHA1, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHA1, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -55,7 +56,8 @@ int s390_sha224(unsigned char *iv, const unsigned char *input_data,
 				 message_part, running_length, NULL, SHA_224);
 
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHA224, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHA224, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -71,7 +73,8 @@ int s390_sha256(unsigned char *iv, const unsigned char *input_data,
 				 message_part, running_length, NULL, SHA_256);
 
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHA256, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHA256, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -88,7 +91,8 @@ int s390_sha384(unsigned char *iv, const unsigned char *input_data,
 				 running_length_hi, SHA_384);
 
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHA384, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHA384, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -106,7 +110,8 @@ int s390_sha512(unsigned char *iv, const unsigned char *input_data,
 				 running_length_hi, SHA_512);
 
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHA512, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHA512, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -124,7 +129,8 @@ int s390_sha512_224(unsigned char *iv, const unsigned char *input_data,
 				 running_length_hi, SHA_512_224);
 
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHA512_224, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHA512_224, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -142,7 +148,8 @@ int s390_sha512_256(unsigned char *iv, const unsigned char *input_data,
 				 running_length_hi, SHA_512_256);
 
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHA512_256, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHA512_256, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -158,7 +165,8 @@ int s390_sha3_224(unsigned char *iv, const unsigned char *input_data,
 				sha_constants[SHA_3_224].hash_length,
 				 message_part, running_length, NULL, SHA_3_224);
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHA3_224, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHA3_224, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -174,7 +182,8 @@ int s390_sha3_256(unsigned char *iv, const unsigned char *input_data,
 				sha_constants[SHA_3_256].hash_length,
 				 message_part, running_length, NULL, SHA_3_256);
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHA3_256, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHA3_256, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -192,7 +201,8 @@ int s390_sha3_384(unsigned char *iv, const unsigned char *input_data,
 				 message_part, running_length_lo,
 				 running_length_hi, SHA_3_384);
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHA3_384, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHA3_384, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -210,7 +220,8 @@ int s390_sha3_512(unsigned char *iv, const unsigned char *input_data,
 				 message_part, running_length_lo,
 				 running_length_hi, SHA_3_512);
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHA3_512, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHA3_512, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -227,7 +238,8 @@ int s390_shake_128(unsigned char *iv, const unsigned char *input_data,
 				 message_part, running_length_lo,
 				 running_length_hi, SHAKE_128);
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHAKE_128, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHAKE_128, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -244,7 +256,8 @@ int s390_shake_256(unsigned char *iv, const unsigned char *input_data,
 				 message_part, running_length_lo,
 				 running_length_hi, SHAKE_256);
 	if (rc == 0)
-		stats_increment(ICA_STATS_SHAKE_256, ALGO_HW, ENCRYPT);
+		stats_increment_bytes(ICA_STATS_SHAKE_256, ALGO_HW, ENCRYPT,
+				      input_length);
 
 	return rc;
 }
@@ -0,0 +1,210 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ */
+
+/* Copyright IBM Corp. 2021 */
+
+/*
+ * Adapter handle pools (ica_adapter_pool_open) against the zcrypt stand-in
+ * device zcrypt_shim.so with a fake sysfs tree of several cards: only the
+ * online RSA and ECC capable cards are in the pool, a card with its own
+ * zcrypt device node gets a dedicated handle, handles are handed out by
+ * least outstanding requests, and many threads decrypting through the pool
+ * are spread evenly over the cards.
+ */
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "ica_api.h"
+#include "rsa_test.h"
+#include "testcase.h"
+#include "zcrypt_shim.h"
+
+#define THREADS		16
+#define OPS		32
+#define LATENCY_US	"1000"
+
+/* the 2048 bit key of rsa_test.h */
+#define KEY		1
+
+static const struct zcrypt_shim_card cards[] = {
+	{ 0x00, "CEX7A", 1, NULL },
+	{ 0x01, "CEX7C", 1, "zcrypt-card01" },
+	{ 0x03, "CEX6C", 1, NULL },
+	{ 0x04, "CEX7C", 0, NULL },	/* offline */
+	{ 0x05, "CEX3C", 1, NULL },	/* no ECC */
+	{ 0x0a, "CEX7P", 1, NULL },	/* EP11 */
+};
+/* the cards expected in the pool and which of them support ECC */
+static const unsigned int pooled[] = { 0x00, 0x01, 0x03, 0x05 };
+#define POOLED	(sizeof(pooled) / sizeof(pooled[0]))
+#define ECC_CARD(card)	((card) == 0x01 || (card) == 0x03)
+
+static ICA_ADAPTER_POOL *pool;
+static ica_rsa_key_crt_t key;
+static pthread_barrier_t barrier;
+static unsigned int failures;
+
+/* index of the card of adapter_handle in the pool */
+static int card_index(ica_adapter_handle_t adapter_handle)
+{
+	ica_adapter_pool_card_t card;
+	unsigned int i;
+
+	for (i = 0; ica_adapter_pool_stats(pool, i, &card) == 0; i++) {
+		if (card.adapter_handle == adapter_handle)
+			return i;
+	}
+	return -1;
+}
+
+static void *decrypt_thread(void *arg)
+{
+	unsigned char out[RESULT_LENGTH];
+	ica_adapter_handle_t ah;
+	unsigned int i, rc;
+
+	(void)arg;
+	pthread_barrier_wait(&barrier);
+
+	for (i = 0; i < OPS; i++) {
+		if (ica_adapter_pool_get(pool, ICA_ADAPTER_POOL_RSA, &ah)) {
+			__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+		rc = ica_rsa_crt(ah, ciphertext[KEY], &key, out);
+		ica_adapter_pool_put(pool, ah);
+		if (rc || memcmp(out, input_data, RSA_BYTE_LENGHT[KEY]))
+			__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+static int pool_test(void)
+{
+	unsigned int (*fd_ops)(int), (*fd_max_in_flight)(int);
+	ica_adapter_handle_t ah[2 * POOLED], ecc[4];
+	ica_adapter_pool_card_t card;
+	unsigned int i, j, count[POOLED];
+	pthread_t threads[THREADS];
+
+	(void)e;	/* suppress unused var warning */
+	(void)n;
+
+	fd_ops = (unsigned int (*)(int))dlsym(RTLD_DEFAULT,
+					      "zcrypt_shim_fd_ops");
+	fd_max_in_flight = (unsigned int (*)(int))dlsym(RTLD_DEFAULT,
+					"zcrypt_shim_fd_max_in_flight");
+	if (fd_ops == NULL || fd_max_in_flight == NULL)
+		EXIT_ERR("zcrypt_shim.so not preloaded.");
+
+	if (ica_adapter_pool_open(NULL) != EINVAL)
+		EXIT_ERR("ica_adapter_pool_open accepted invalid parameters.");
+	if (ica_adapter_pool_open(&pool))
+		EXIT_ERR("ica_adapter_pool_open failed.");
+
+	/* the online RSA and ECC capable cards, in sysfs order */
+	memset(count, 0, sizeof(count));
+	for (i = 0; ica_adapter_pool_stats(pool, i, &card) == 0; i++) {
+		V_(printf("card %02x %s handle %d%s\n", card.card, card.type,
+			  card.adapter_handle,
+			  card.dedicated ? " (dedicated)" : ""));
+		for (j = 0; j < POOLED; j++) {
+			if (card.card == pooled[j])
+				count[j]++;
+		}
+		if (card.dedicated != (card.card == 0x01))
+			EXIT_ERR("wrong dedicated handle.");
+	}
+	if (i != POOLED)
+		EXIT_ERR("wrong number of cards in the pool.");
+	for (j = 0; j < POOLED; j++) {
+		if (count[j] != 1)
+			EXIT_ERR("card missing in the pool.");
+	}
+
+	if (ica_adapter_pool_get(pool, 0x80, &ah[0]) != EINVAL)
+		EXIT_ERR("ica_adapter_pool_get accepted invalid flags.");
+
+	/* least outstanding: two rounds over all cards */
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < 2 * POOLED; i++) {
+		if (ica_adapter_pool_get(pool, ICA_ADAPTER_POOL_RSA, &ah[i]) ||
+		    card_index(ah[i]) < 0)
+			EXIT_ERR("ica_adapter_pool_get failed.");
+		count[card_index(ah[i])]++;
+	}
+	for (j = 0; j < POOLED; j++) {
+		if (count[j] != 2)
+			EXIT_ERR("handles not spread over the cards.");
+	}
+	/* a put back handle is the least busy one */
+	ica_adapter_pool_put(pool, ah[3]);
+	if (ica_adapter_pool_get(pool, ICA_ADAPTER_POOL_RSA, &ah[3]) ||
+	    card_index(ah[3]) != card_index(ah[3 + POOLED]))
+		EXIT_ERR("least busy card not chosen.");
+	for (i = 0; i < 2 * POOLED; i++)
+		ica_adapter_pool_put(pool, ah[i]);
+
+	/* ECC requests only go to CEX4C or newer coprocessors */
+	for (i = 0; i < 4; i++) {
+		if (ica_adapter_pool_get(pool, ICA_ADAPTER_POOL_ECC, &ecc[i]) ||
+		    ica_adapter_pool_stats(pool, card_index(ecc[i]), &card) ||
+		    !ECC_CARD(card.card) || card.outstanding != i / 2 + 1)
+			EXIT_ERR("wrong card for ECC.");
+	}
+	for (i = 0; i < 4; i++)
+		ica_adapter_pool_put(pool, ecc[i]);
+
+	/* many threads decrypting through the pool */
+	key.key_length = RSA_BYTE_LENGHT[KEY];
+	key.p = p[KEY];
+	key.q = q[KEY];
+	key.dp = dp[KEY];
+	key.dq = dq[KEY];
+	key.qInverse = qinv[KEY];
+
+	pthread_barrier_init(&barrier, NULL, THREADS);
+	for (i = 0; i < THREADS; i++) {
+		if (pthread_create(&threads[i], NULL, decrypt_thread, NULL))
+			EXIT_ERR("pthread_create failed.");
+	}
+	for (i = 0; i < THREADS; i++)
+		pthread_join(threads[i], NULL);
+	pthread_barrier_destroy(&barrier);
+	if (failures)
+		EXIT_ERR("decryption through the pool failed.");
+
+	for (i = 0; ica_adapter_pool_stats(pool, i, &card) == 0; i++) {
+		V_(printf("card %02x: %u operations, max %u in flight\n",
+			  card.card, fd_ops(card.adapter_handle),
+			  fd_max_in_flight(card.adapter_handle)));
+		if (card.outstanding != 0)
+			EXIT_ERR("handle not put back.");
+		/* never more than its share of the threads on a card */
+		if (fd_ops(card.adapter_handle) < THREADS * OPS / POOLED / 2 ||
+		    fd_max_in_flight(card.adapter_handle) >
+		    (THREADS + POOLED - 1) / POOLED)
+			EXIT_ERR("requests not spread over the cards.");
+	}
+
+	ica_adapter_pool_close(pool);
+
+	printf("All adapter pool tests passed.\n");
+	return TEST_SUCC;
+}
+
+int main(int argc, char **argv)
+{
+	set_verbosity(argc, argv);
+
+	if (argc >= 2 && strcmp(argv[1], ZCRYPT_SHIM_ARG) == 0)
+		return pool_test();
+
+	return zcrypt_shim_run_cards("adapter_pool_test", LATENCY_US, cards,
+				     sizeof(cards) / sizeof(cards[0]));
+}
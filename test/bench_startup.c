@@ -0,0 +1,290 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ */
+
+/* Copyright IBM Corp. 2021 */
+
+/*
+ * Startup benchmark, see 'make bench-startup'. For each library given on
+ * the command line (e.g. libica.so and libica-cex.so) it measures
+ *
+ * - the wall time and number of system calls of a program, which only
+ *   loads the library and calls ica_get_version(), compared to a baseline
+ *   program, which does not load it,
+ * - the cost of each initialization phase: loading the library (including
+ *   its constructor), and the first use of each lazily initialized
+ *   subsystem, i.e. the first call of its trigger function minus the
+ *   second call.
+ *
+ * The results are written as JSON to stdout. FIPS and non-FIPS builds are
+ * told apart by the ica_fips_powerup_tests symbol, which only FIPS builds
+ * export.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include "ica_api.h"
+#include "testcase.h"
+
+#define RUNS	20
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the measured program: load lib (unless "none") and get its version */
+static int child(const char *lib)
+{
+	__typeof__(&ica_get_version) get_version;
+	libica_version_info version;
+	void *handle;
+
+	if (strcmp(lib, "none") == 0)
+		return TEST_SUCC;
+
+	if ((handle = dlopen(lib, RTLD_NOW)) == NULL)
+		return TEST_ERR;
+	get_version = (__typeof__(get_version))dlsym(handle, "ica_get_version");
+	if (get_version == NULL || get_version(&version) != 0)
+		return TEST_ERR;
+	return TEST_SUCC;
+}
+
+static pid_t spawn(const char *lib, int traced)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid == 0) {
+		if (traced && ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1)
+			_exit(TEST_ERR);
+		execl("/proc/self/exe", "bench_startup", "--child", lib,
+		      (char *)NULL);
+		_exit(TEST_ERR);
+	}
+	return pid;
+}
+
+static int exited_ok(int status)
+{
+	return WIFEXITED(status) && WEXITSTATUS(status) == TEST_SUCC;
+}
+
+/* minimum and average wall time from fork to exit in nanoseconds */
+static int wall_time(const char *lib, uint64_t *min, uint64_t *avg)
+{
+	uint64_t start, t, sum = 0;
+	unsigned int i;
+	int status;
+	pid_t pid;
+
+	*min = ~0ULL;
+	for (i = 0; i < RUNS; i++) {
+		start = now_ns();
+		if ((pid = spawn(lib, 0)) == -1 ||
+		    waitpid(pid, &status, 0) != pid || !exited_ok(status))
+			return -1;
+		t = now_ns() - start;
+		sum += t;
+		if (t < *min)
+			*min = t;
+	}
+	*avg = sum / RUNS;
+	return 0;
+}
+
+/* Number of system calls after exec, -1 if the child cannot be traced
+ * (e.g. ptrace is not permitted in a container).
+ */
+static long syscalls(const char *lib)
+{
+	long stops = 0;
+	int status;
+	pid_t pid;
+
+	if ((pid = spawn(lib, 1)) == -1)
+		return -1;
+
+	/* stopped by SIGTRAP after exec */
+	if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) {
+		waitpid(pid, &status, 0);
+		return -1;
+	}
+	ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)PTRACE_O_TRACESYSGOOD);
+
+	for (;;) {
+		if (ptrace(PTRACE_SYSCALL, pid, NULL, NULL) == -1 ||
+		    waitpid(pid, &status, 0) != pid)
+			return -1;
+		if (WIFEXITED(status) || WIFSIGNALED(status))
+			break;
+		if (WIFSTOPPED(status) && WSTOPSIG(status) == (SIGTRAP | 0x80))
+			stops++;
+	}
+	if (!exited_ok(status))
+		return -1;
+
+	/* exit_group has an entry stop only */
+	return (stops + 1) / 2;
+}
+
+/* duration of the first call of a phase's trigger minus the second one,
+ * 0 if within the noise
+ */
+#define PHASE(name, call)						\
+	do {								\
+		uint64_t t1, t2;					\
+									\
+		t1 = now_ns();						\
+		call;							\
+		t1 = now_ns() - t1;					\
+		t2 = now_ns();						\
+		call;							\
+		t2 = now_ns() - t2;					\
+		printf(",\n\t\t\t\t\"%s\": %llu", name,			\
+		       (unsigned long long)(t1 > t2 ? t1 - t2 : 0));	\
+	} while (0)
+
+#define SYM(handle, fn) ((__typeof__(&fn))dlsym(handle, #fn))
+
+/* prints the phases of a fresh process, which loads lib */
+static int phases(const char *lib)
+{
+	__typeof__(&ica_get_version) get_version;
+	__typeof__(&ica_set_stats_mode) set_stats_mode;
+	__typeof__(&ica_sha256) sha256;
+	__typeof__(&ica_open_adapter) open_adapter;
+	__typeof__(&ica_close_adapter) close_adapter;
+	__typeof__(&ica_get_functionlist) get_functionlist;
+	__typeof__(&ica_random_number_generate) random_number_generate;
+	__typeof__(&ica_x25519_ctx_new) x25519_ctx_new;
+	__typeof__(&ica_x25519_key_gen) x25519_key_gen;
+	__typeof__(&ica_x25519_ctx_del) x25519_ctx_del;
+	unsigned char hash[SHA256_HASH_LENGTH], rnd[16];
+	libica_version_info version;
+	ica_adapter_handle_t ah;
+	sha256_context_t sha_ctx;
+	ICA_X25519_CTX *x_ctx;
+	unsigned int count;
+	uint64_t t;
+	void *handle;
+
+	t = now_ns();
+	handle = dlopen(lib, RTLD_NOW);
+	t = now_ns() - t;
+	if (handle == NULL)
+		return TEST_ERR;
+
+	get_version = SYM(handle, ica_get_version);
+	set_stats_mode = SYM(handle, ica_set_stats_mode);
+	sha256 = SYM(handle, ica_sha256);
+	open_adapter = SYM(handle, ica_open_adapter);
+	close_adapter = SYM(handle, ica_close_adapter);
+	get_functionlist = SYM(handle, ica_get_functionlist);
+	random_number_generate = SYM(handle, ica_random_number_generate);
+	x25519_ctx_new = SYM(handle, ica_x25519_ctx_new);
+	x25519_key_gen = SYM(handle, ica_x25519_key_gen);
+	x25519_ctx_del = SYM(handle, ica_x25519_ctx_del);
+	if (!get_version || !set_stats_mode || !sha256 || !open_adapter ||
+	    !close_adapter || !get_functionlist || !random_number_generate ||
+	    !x25519_ctx_new || !x25519_key_gen || !x25519_ctx_del)
+		return TEST_ERR;
+
+	if (get_version(&version) != 0)
+		return TEST_ERR;
+	printf("\t\t\t\"version\": \"%u.%u.%u\",\n", version.major_version,
+	       version.minor_version, version.fixpack_version);
+	printf("\t\t\t\"fips_build\": %s,\n",
+	       dlsym(handle, "ica_fips_powerup_tests") ? "true" : "false");
+
+	printf("\t\t\t\"phases_ns\": {\n\t\t\t\t\"load\": %llu",
+	       (unsigned long long)t);
+	PHASE("get_version", get_version(&version));
+	set_stats_mode(1);
+	PHASE("stats_mmap", sha256(SHA_MSG_PART_ONLY, 3,
+				   (unsigned char *)"abc", &sha_ctx, hash));
+	PHASE("cards", open_adapter(&ah); close_adapter(ah));
+	PHASE("functionlist", get_functionlist(NULL, &count));
+	PHASE("drbg_health_test_prng",
+	      random_number_generate(sizeof(rnd), rnd));
+	PHASE("rng", if (x25519_ctx_new(&x_ctx) == 0) {
+			x25519_key_gen(x_ctx);
+			x25519_ctx_del(&x_ctx);
+		     });
+	printf("\n\t\t\t}\n");
+	fflush(stdout);
+	return TEST_SUCC;
+}
+
+static int bench(const char *lib, int first)
+{
+	uint64_t min, avg;
+	long calls;
+	int status;
+	pid_t pid;
+
+	if (wall_time(lib, &min, &avg)) {
+		fprintf(stderr, "Failed to run %s.\n", lib);
+		return -1;
+	}
+	calls = syscalls(lib);
+
+	printf("%s\t\t{\n\t\t\t\"library\": \"%s\",\n", first ? "" : ",\n",
+	       lib);
+	printf("\t\t\t\"wall_ns_min\": %llu,\n\t\t\t\"wall_ns_avg\": %llu,\n",
+	       (unsigned long long)min, (unsigned long long)avg);
+	printf("\t\t\t\"syscalls\": %ld", calls);
+	if (strcmp(lib, "none") == 0) {
+		printf("\n\t\t}");
+		return 0;
+	}
+	printf(",\n");
+	fflush(stdout);
+
+	/* a fresh process, which has not initialized anything yet */
+	pid = fork();
+	if (pid == 0)
+		_exit(phases(lib));
+	if (pid == -1 || waitpid(pid, &status, 0) != pid ||
+	    !exited_ok(status)) {
+		fprintf(stderr, "Failed to measure the phases of %s.\n", lib);
+		return -1;
+	}
+	printf("\t\t}");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+
+	if (argc == 3 && strcmp(argv[1], "--child") == 0)
+		return child(argv[2]);
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <library>...\n", argv[0]);
+		return TEST_ERR;
+	}
+
+	printf("{\n\t\"runs\": %d,\n\t\"results\": [\n", RUNS);
+	if (bench("none", 1))
+		return TEST_FAIL;
+	for (i = 1; i < argc; i++) {
+		if (bench(argv[i], 0))
+			return TEST_FAIL;
+	}
+	printf("\n\t]\n}\n");
+	return TEST_SUCC;
+}
@@ -0,0 +1,171 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ */
+
+/* Copyright IBM Corp. 2021 */
+
+/*
+ * Cards set online and offline at runtime (ica_set_card_rescan_interval)
+ * against the zcrypt stand-in device zcrypt_shim.so with a fake sysfs tree:
+ * RSA requests go to an accelerator once it is online and fail once it is
+ * offline again, the adapter flags of the function list follow the
+ * accelerator and the ECC capable coprocessor, and the rescan is rate
+ * limited by the interval.
+ */
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ica_api.h"
+#include "rsa_test.h"
+#include "testcase.h"
+#include "zcrypt_shim.h"
+
+#define INTERVAL_MS	"50"
+#define TIMEOUT_MS	2000
+#define LATENCY_US	"100"
+
+/* the 2048 bit key of rsa_test.h */
+#define KEY		1
+
+static const struct zcrypt_shim_card cards[] = {
+	{ 0x00, "CEX7A", 0, NULL },
+	{ 0x01, "CEX7C", 0, NULL },
+};
+
+static unsigned int (*shim_ops)(void);
+static ica_adapter_handle_t ah;
+static ica_rsa_key_mod_expo_t pub;
+
+static void set_online(unsigned int card, int online)
+{
+	char dir[PATH_MAX];
+
+	snprintf(dir, sizeof(dir), "%s/card%02x", getenv("ZCRYPT_SHIM_SYSFS"),
+		 card);
+	if (zcrypt_shim_write_file(dir, "online", online ? "1\n" : "0\n"))
+		EXIT_ERR("writing the online attribute failed.");
+}
+
+/* the adapter flag of mechanism in the function list */
+static int dhw(unsigned int mechanism)
+{
+	libica_func_list_element *list;
+	unsigned int i, len;
+	int flag = -1;
+
+	if (ica_get_functionlist(NULL, &len))
+		return -1;
+	if ((list = calloc(len, sizeof(*list))) == NULL)
+		return -1;
+	if (ica_get_functionlist(list, &len) == 0) {
+		for (i = 0; i < len; i++) {
+			if (list[i].mech_mode_id == mechanism)
+				flag = list[i].flags & ICA_FLAG_DHW ? 1 : 0;
+		}
+	}
+	free(list);
+	return flag;
+}
+
+/* 1 if an RSA request went to the adapter, 0 if it failed for no card */
+static int rsa_online(void)
+{
+	unsigned char out[RESULT_LENGTH];
+	unsigned int ops = shim_ops(), rc;
+
+	rc = ica_rsa_mod_expo(ah, input_data, &pub, out);
+	if (rc == 0 && shim_ops() == ops + 1 &&
+	    memcmp(out, ciphertext[KEY], RSA_BYTE_LENGHT[KEY]) == 0)
+		return 1;
+	if (rc == ENODEV && shim_ops() == ops)
+		return 0;
+	return -1;
+}
+
+/* polls until the RSA path, RSA_ME and EC_DSA_SIGN show rsa and ecc */
+static int wait_for(int rsa, int ecc)
+{
+	int i;
+
+	for (i = 0; i < TIMEOUT_MS / 10; i++) {
+		if (rsa_online() == rsa && dhw(RSA_ME) == rsa &&
+		    dhw(EC_DSA_SIGN) == ecc)
+			return 0;
+		usleep(10000);
+	}
+	return -1;
+}
+
+static int rescan_test(void)
+{
+	(void)dp;	/* suppress unused var warning */
+	(void)dq;
+	(void)p;
+	(void)q;
+	(void)qinv;
+
+	shim_ops = (unsigned int (*)(void))dlsym(RTLD_DEFAULT,
+						 "zcrypt_shim_ops");
+	if (shim_ops == NULL)
+		EXIT_ERR("zcrypt_shim.so not preloaded.");
+
+	if (ica_open_adapter(&ah) || ah == DRIVER_NOT_LOADED)
+		EXIT_ERR("ica_open_adapter failed.");
+	pub.key_length = RSA_BYTE_LENGHT[KEY];
+	pub.modulus = n[KEY];
+	pub.exponent = e[KEY];
+
+	/* all cards offline */
+	if (rsa_online() != 0 || dhw(RSA_ME) != 0)
+		EXIT_ERR("offline card used.");
+
+	set_online(0x00, 1);
+	if (wait_for(1, 0))
+		EXIT_ERR("accelerator set online not found.");
+	V_(printf("accelerator online\n"));
+
+	set_online(0x01, 1);
+	if (wait_for(1, 1))
+		EXIT_ERR("coprocessor set online not found.");
+	V_(printf("coprocessor online\n"));
+
+	set_online(0x00, 0);
+	set_online(0x01, 0);
+	if (wait_for(0, 0))
+		EXIT_ERR("cards set offline still used.");
+	V_(printf("cards offline\n"));
+
+	/* no rescan before the interval has passed */
+	ica_set_card_rescan_interval(3600 * 1000);
+	set_online(0x00, 1);
+	usleep(10 * atoi(INTERVAL_MS) * 1000);
+	if (rsa_online() != 0 || dhw(RSA_ME) != 0)
+		EXIT_ERR("rescan not rate limited.");
+
+	/* and none at all with interval 0 */
+	ica_set_card_rescan_interval(0);
+	if (rsa_online() != 0 || dhw(RSA_ME) != 0)
+		EXIT_ERR("rescan not disabled.");
+
+	ica_close_adapter(ah);
+
+	printf("All card rescan tests passed.\n");
+	return TEST_SUCC;
+}
+
+int main(int argc, char **argv)
+{
+	set_verbosity(argc, argv);
+
+	if (argc >= 2 && strcmp(argv[1], ZCRYPT_SHIM_ARG) == 0)
+		return rescan_test();
+
+	setenv(ICA_CARD_RESCAN_ENV, INTERVAL_MS, 1);
+	return zcrypt_shim_run_cards("card_rescan_test", LATENCY_US, cards,
+				     sizeof(cards) / sizeof(cards[0]));
+}
@@ -0,0 +1,180 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ */
+
+/* Copyright IBM Corp. 2021 */
+
+/*
+ * Batches of ECDSA signature verifications (ica_ecdsa_verify_batch) with
+ * several keys and curves: checks the status of each element against
+ * ica_ecdsa_verify(), and measures the throughput for batch sizes 1 to 256
+ * compared to calling ica_ecdsa_verify() for each signature.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <openssl/obj_mac.h>
+#include "ica_api.h"
+#include "testcase.h"
+
+#define KEYS_PER_CURVE	4
+#define BATCH		96
+#define MAX_BATCH	256
+#define BENCH_OPS	1024
+#define HASH_LENGTH	32
+
+#define MAX_ECC_PRIV_SIZE	66 /* 521 bits */
+#define MAX_ECDSA_SIG_SIZE	132
+
+static const unsigned int curves[] = {
+	NID_X9_62_prime256v1, NID_secp384r1, NID_secp521r1,
+	NID_brainpoolP256r1,
+};
+#define CURVES	(sizeof(curves) / sizeof(curves[0]))
+
+static ICA_EC_KEY *keys[CURVES * KEYS_PER_CURVE];
+static unsigned int num_keys;
+
+static const ICA_EC_KEY *key[MAX_BATCH];
+static const unsigned char *hash[MAX_BATCH];
+static unsigned int hash_len[MAX_BATCH];
+static const unsigned char *sig[MAX_BATCH];
+static unsigned int status[MAX_BATCH];
+static unsigned char hashes[MAX_BATCH][HASH_LENGTH];
+static unsigned char sigs[MAX_BATCH][MAX_ECDSA_SIG_SIZE];
+
+/* signs a different hash for element i with k */
+static int sign(ica_adapter_handle_t ah, unsigned int i, ICA_EC_KEY *k)
+{
+	memset(hashes[i], 0, HASH_LENGTH);
+	memcpy(hashes[i], &i, sizeof(i));
+	key[i] = k;
+	hash[i] = hashes[i];
+	hash_len[i] = HASH_LENGTH;
+	sig[i] = sigs[i];
+	return ica_ecdsa_sign(ah, k, hashes[i], HASH_LENGTH, sigs[i],
+			      MAX_ECDSA_SIG_SIZE);
+}
+
+/*
+ * Verifications per second of BENCH_OPS P-256 signatures, in batches of
+ * size or, for size 0, with ica_ecdsa_verify().
+ */
+static double bench(ica_adapter_handle_t ah, unsigned int size)
+{
+	struct timeval start, end;
+	unsigned int i, j;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < BENCH_OPS; i += size ? size : 1) {
+		if (size == 0) {
+			if (ica_ecdsa_verify(ah, key[0], hash[0], hash_len[0],
+					     sig[0], MAX_ECDSA_SIG_SIZE))
+				EXIT_ERR("ica_ecdsa_verify failed.");
+			continue;
+		}
+		if (ica_ecdsa_verify_batch(ah, size, key, hash, hash_len, sig,
+					   status))
+			EXIT_ERR("ica_ecdsa_verify_batch failed.");
+		for (j = 0; j < size; j++) {
+			if (status[j])
+				EXIT_ERR("batch element failed.");
+		}
+	}
+	gettimeofday(&end, NULL);
+
+	return (double)BENCH_OPS * 1000000 / delta_usec(&start, &end);
+}
+
+int main(int argc, char **argv)
+{
+	ica_adapter_handle_t ah;
+	unsigned int i, j, privlen, rc, size;
+	double single, batch;
+	ICA_EC_KEY *k;
+
+	set_verbosity(argc, argv);
+
+	if (!ecc_available()) {
+		printf("Skipping ECDSA batch test, because the required HW"
+		       " is not available on this machine.\n");
+		return TEST_SKIP;
+	}
+
+	if (ica_open_adapter(&ah))
+		V_(printf("ica_open_adapter failed.\n"));
+
+	for (i = 0; i < CURVES; i++) {
+		for (j = 0; j < KEYS_PER_CURVE; j++) {
+			k = ica_ec_key_new(curves[i], &privlen);
+			if (k == NULL)
+				break;
+			rc = ica_ec_key_generate(ah, k);
+			if (rc) {
+				ica_ec_key_free(k);
+				V_(printf("Curve %u not supported on this "
+					  "system, skipping ...\n", curves[i]));
+				break;
+			}
+			keys[num_keys++] = k;
+		}
+	}
+	if (num_keys == 0)
+		EXIT_ERR("no key generated.");
+
+	if (ica_ecdsa_verify_batch(ah, 0, key, hash, hash_len, sig, status)
+	    != EINVAL ||
+	    ica_ecdsa_verify_batch(ah, 1, key, hash, hash_len, NULL, status)
+	    != EINVAL)
+		EXIT_ERR("ica_ecdsa_verify_batch accepted invalid parameters.");
+
+	/* mixed keys and curves, invalid signatures and parameters */
+	for (i = 0; i < BATCH; i++) {
+		if (sign(ah, i, keys[i % num_keys]))
+			EXIT_ERR("ica_ecdsa_sign failed.");
+		if (i % 7 == 3)
+			sigs[i][1] ^= 0x01;
+	}
+	key[BATCH / 2] = NULL;
+	hash_len[BATCH / 3] = 33;
+	if (ica_ecdsa_verify_batch(ah, BATCH, key, hash, hash_len, sig, status))
+		EXIT_ERR("ica_ecdsa_verify_batch failed.");
+	for (i = 0; i < BATCH; i++) {
+		if (key[i] == NULL || hash_len[i] == 33)
+			rc = EINVAL;
+		else
+			rc = ica_ecdsa_verify(ah, key[i], hash[i], hash_len[i],
+					      sig[i], MAX_ECDSA_SIG_SIZE);
+		if (status[i] != rc) {
+			V_(printf("element %u: status %u, expected %u\n", i,
+				  status[i], rc));
+			EXIT_ERR("wrong status.");
+		}
+		if (i % 7 == 3 ? rc != EFAULT : key[i] && hash_len[i] != 33 &&
+		    rc != 0)
+			EXIT_ERR("wrong verification result.");
+	}
+
+	/* the first P-256 key, which all elements share */
+	for (i = 0; i < MAX_BATCH; i++) {
+		if (sign(ah, i, keys[0]))
+			EXIT_ERR("ica_ecdsa_sign failed.");
+	}
+	single = bench(ah, 0);
+	for (size = 1; size <= MAX_BATCH; size *= 2) {
+		batch = bench(ah, size);
+		V_(printf("ECDSA P-256 verify: batch size %3u %10.1f ops/s, "
+			  "single %10.1f ops/s (x%.2f)\n", size, batch, single,
+			  batch / single));
+	}
+
+	for (i = 0; i < num_keys; i++)
+		ica_ec_key_free(keys[i]);
+	ica_close_adapter(ah);
+
+	printf("All ECDSA batch tests passed.\n");
+	return TEST_SUCC;
+}
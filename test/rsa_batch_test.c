@@ -0,0 +1,161 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ */
+
+/* Copyright IBM Corp. 2021 */
+
+/*
+ * Batches of RSA public key operations (ica_rsa_mod_expo_batch) against the
+ * zcrypt stand-in device zcrypt_shim.so: checks the results and the status
+ * of each element, that the batch is pipelined through the adapter, and
+ * measures the throughput for batch sizes 1 to 256 compared to calling
+ * ica_rsa_mod_expo() for each element.
+ */
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "ica_api.h"
+#include "rsa_test.h"
+#include "testcase.h"
+#include "zcrypt_shim.h"
+
+#define BATCH		64
+#define MAX_BATCH	256
+#define BENCH_OPS	256
+#define IN_FLIGHT	16
+#define LATENCY_US	"1000"
+
+/* the 2048 and 4096 bit keys of rsa_test.h, also allowed in FIPS mode */
+static const unsigned int keys[] = {1, 2, 4, 5};
+#define KEYS	(sizeof(keys) / sizeof(keys[0]))
+
+static ica_rsa_key_mod_expo_t pub[KEYS];
+static const unsigned char *in[MAX_BATCH];
+static ica_rsa_key_mod_expo_t *key[MAX_BATCH];
+static unsigned char *out[MAX_BATCH];
+static unsigned char buf[MAX_BATCH][512];
+static unsigned int status[MAX_BATCH];
+
+/*
+ * Operations per second of BENCH_OPS public key operations with the first
+ * key, in batches of size or, for size 0, with ica_rsa_mod_expo().
+ */
+static double bench(ica_adapter_handle_t ah, unsigned int size)
+{
+	struct timeval start, end;
+	unsigned int i, j;
+
+	for (i = 0; i < size; i++) {
+		in[i] = input_data;
+		key[i] = &pub[0];
+		out[i] = buf[i];
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < BENCH_OPS; i += size ? size : 1) {
+		if (size == 0) {
+			if (ica_rsa_mod_expo(ah, input_data, &pub[0], buf[0]))
+				EXIT_ERR("ica_rsa_mod_expo failed.");
+			continue;
+		}
+		if (ica_rsa_mod_expo_batch(ah, size, in, key, out, status))
+			EXIT_ERR("ica_rsa_mod_expo_batch failed.");
+		for (j = 0; j < size; j++) {
+			if (status[j])
+				EXIT_ERR("batch element failed.");
+		}
+	}
+	gettimeofday(&end, NULL);
+
+	return (double)BENCH_OPS * 1000000 / delta_usec(&start, &end);
+}
+
+static int batch_test(void)
+{
+	unsigned int (*max_in_flight)(void);
+	ica_adapter_handle_t ah;
+	unsigned int i, k, size;
+	double single, batch;
+	int bad = BATCH / 2, nokey = BATCH / 3;
+
+	(void)dp;	/* suppress unused var warning */
+	(void)dq;
+	(void)p;
+	(void)q;
+	(void)qinv;
+
+	max_in_flight = (unsigned int (*)(void))dlsym(RTLD_DEFAULT,
+					"zcrypt_shim_max_in_flight");
+	if (max_in_flight == NULL)
+		EXIT_ERR("zcrypt_shim.so not preloaded.");
+
+	if (ica_open_adapter(&ah) || ah == DRIVER_NOT_LOADED)
+		EXIT_ERR("ica_open_adapter failed.");
+
+	for (i = 0; i < KEYS; i++) {
+		pub[i].key_length = RSA_BYTE_LENGHT[keys[i]];
+		pub[i].modulus = n[keys[i]];
+		pub[i].exponent = e[keys[i]];
+	}
+
+	if (ica_rsa_mod_expo_batch(ah, 0, in, key, out, status) != EINVAL ||
+	    ica_rsa_mod_expo_batch(ah, 1, in, key, NULL, status) != EINVAL)
+		EXIT_ERR("ica_rsa_mod_expo_batch accepted invalid parameters.");
+
+	/* one input >= modulus and one element without a key */
+	for (i = 0; i < BATCH; i++) {
+		k = i % KEYS;
+		in[i] = (int)i == bad ? n[keys[k]] : input_data;
+		key[i] = (int)i == nokey ? NULL : &pub[k];
+		out[i] = buf[i];
+		memset(buf[i], 0, sizeof(buf[i]));
+	}
+	if (ica_rsa_mod_expo_batch(ah, BATCH, in, key, out, status))
+		EXIT_ERR("ica_rsa_mod_expo_batch failed.");
+	for (i = 0; i < BATCH; i++) {
+		k = keys[i % KEYS];
+		if ((int)i == bad) {
+			if (status[i] == 0)
+				EXIT_ERR("input >= modulus succeeded.");
+		} else if ((int)i == nokey) {
+			if (status[i] != EINVAL)
+				EXIT_ERR("element without a key not rejected.");
+		} else if (status[i]) {
+			EXIT_ERR("batch element failed.");
+		} else if (memcmp(out[i], ciphertext[k], RSA_BYTE_LENGHT[k])) {
+			EXIT_ERR("wrong result.");
+		}
+	}
+	V_(printf("%u operations, max %u in flight\n", BATCH,
+		  max_in_flight()));
+	if (max_in_flight() < 2 || max_in_flight() > IN_FLIGHT)
+		EXIT_ERR("batch not pipelined through the adapter.");
+
+	single = bench(ah, 0);
+	for (size = 1; size <= MAX_BATCH; size *= 2) {
+		batch = bench(ah, size);
+		V_(printf("RSA-%u public key operations, %s usec latency: "
+			  "batch size %3u %10.1f ops/s, single %10.1f ops/s "
+			  "(x%.2f)\n", RSA_BYTE_LENGHT[keys[0]] * 8, LATENCY_US,
+			  size, batch, single, batch / single));
+	}
+
+	ica_close_adapter(ah);
+
+	printf("All RSA batch tests passed.\n");
+	return TEST_SUCC;
+}
+
+int main(int argc, char **argv)
+{
+	set_verbosity(argc, argv);
+
+	if (argc >= 2 && strcmp(argv[1], ZCRYPT_SHIM_ARG) == 0)
+		return batch_test();
+
+	return zcrypt_shim_run("rsa_batch_test", LATENCY_US);
+}
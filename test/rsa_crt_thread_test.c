@@ -0,0 +1,136 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ */
+
+/* Copyright IBM Corp. 2021 */
+
+/*
+ * Many threads decrypting with one shared RSA CRT key, against the zcrypt
+ * stand-in device zcrypt_shim.so: ica_rsa_crt() with a key in unprivileged
+ * form (p < q) must neither modify nor race on it, and a key prepared with
+ * ica_rsa_key_crt_prepare() is usable by all threads concurrently.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "ica_api.h"
+#include "rsa_test.h"
+#include "testcase.h"
+#include "zcrypt_shim.h"
+
+#define THREADS		16
+#define OPS		32
+#define LATENCY_US	"100"
+
+/* the 2048 bit key of rsa_test.h in unprivileged form */
+#define KEY		4
+
+static ica_adapter_handle_t ah;
+static ica_rsa_key_crt_t shared;
+static ICA_RSA_PREPARED_KEY *prepared;
+static pthread_barrier_t barrier;
+static unsigned int failures;
+
+static void *decrypt_thread(void *arg)
+{
+	unsigned char out[RESULT_LENGTH];
+	unsigned int i, rc;
+
+	(void)arg;
+	pthread_barrier_wait(&barrier);
+
+	for (i = 0; i < OPS; i++) {
+		memset(out, 0, sizeof(out));
+		if (i % 2)
+			rc = ica_rsa_crt_prepared(ah, ciphertext[KEY], prepared,
+						  out);
+		else
+			rc = ica_rsa_crt(ah, ciphertext[KEY], &shared, out);
+		if (rc || memcmp(out, input_data, RSA_BYTE_LENGHT[KEY])) {
+			__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+			V_(printf("%s failed, rc = %u.\n", i % 2 ?
+				  "ica_rsa_crt_prepared" : "ica_rsa_crt", rc));
+		}
+	}
+	return NULL;
+}
+
+static int thread_test(void)
+{
+	unsigned char p_orig[sizeof(p[KEY])], q_orig[sizeof(q[KEY])];
+	unsigned char qinv_bad[sizeof(qinv[1])];
+	ica_rsa_key_crt_t bad;
+	ICA_RSA_PREPARED_KEY *key;
+	pthread_t threads[THREADS];
+	struct timeval start, end;
+	unsigned int i;
+
+	(void)e;	/* suppress unused var warning */
+	(void)n;
+
+	if (ica_open_adapter(&ah) || ah == DRIVER_NOT_LOADED)
+		EXIT_ERR("ica_open_adapter failed.");
+
+	shared.key_length = RSA_BYTE_LENGHT[KEY];
+	shared.p = p[KEY];
+	shared.q = q[KEY];
+	shared.dp = dp[KEY];
+	shared.dq = dq[KEY];
+	shared.qInverse = qinv[KEY];
+	memcpy(p_orig, p[KEY], sizeof(p_orig));
+	memcpy(q_orig, q[KEY], sizeof(q_orig));
+
+	if (ica_rsa_key_crt_prepare(&shared, &prepared))
+		EXIT_ERR("ica_rsa_key_crt_prepare failed.");
+
+	/* a privileged key with a wrong qInverse is rejected */
+	memcpy(qinv_bad, qinv[1], sizeof(qinv_bad));
+	qinv_bad[RSA_BYTE_LENGHT[1] / 2 + 8 - 1] ^= 1;
+	bad.key_length = RSA_BYTE_LENGHT[1];
+	bad.p = p[1];
+	bad.q = q[1];
+	bad.dp = dp[1];
+	bad.dq = dq[1];
+	bad.qInverse = qinv_bad;
+	if (ica_rsa_key_crt_prepare(&bad, &key) != EINVAL)
+		EXIT_ERR("ica_rsa_key_crt_prepare accepted a wrong qInverse.");
+
+	pthread_barrier_init(&barrier, NULL, THREADS);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < THREADS; i++) {
+		if (pthread_create(&threads[i], NULL, decrypt_thread, NULL))
+			EXIT_ERR("pthread_create failed.");
+	}
+	for (i = 0; i < THREADS; i++)
+		pthread_join(threads[i], NULL);
+	gettimeofday(&end, NULL);
+	pthread_barrier_destroy(&barrier);
+
+	V_(printf("%u threads, %u operations each: %llu usec\n", THREADS, OPS,
+		  delta_usec(&start, &end)));
+
+	if (failures)
+		EXIT_ERR("decryption with the shared key failed.");
+	if (memcmp(p_orig, p[KEY], sizeof(p_orig)) ||
+	    memcmp(q_orig, q[KEY], sizeof(q_orig)))
+		EXIT_ERR("ica_rsa_crt modified the key.");
+
+	ica_rsa_prepared_key_free(prepared);
+	ica_close_adapter(ah);
+
+	printf("All RSA CRT thread tests passed.\n");
+	return TEST_SUCC;
+}
+
+int main(int argc, char **argv)
+{
+	set_verbosity(argc, argv);
+
+	if (argc >= 2 && strcmp(argv[1], ZCRYPT_SHIM_ARG) == 0)
+		return thread_test();
+
+	return zcrypt_shim_run("rsa_crt_thread_test", LATENCY_US);
+}
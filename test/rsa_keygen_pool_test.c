@@ -0,0 +1,219 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ */
+
+/* Copyright IBM Corp. 2021 */
+
+/*
+ * RSA key generation served from a background key pool, see
+ * ica_rsa_keygen_pool_set: pooled keys are valid and distinct, hits and
+ * misses are counted, a forked child does not inherit pooled keys and
+ * ica_cleanup removes the pools.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <openssl/bn.h>
+#include "ica_api.h"
+#include "testcase.h"
+
+#define BITS		2048
+#define LEN		(BITS / 8)
+#define SHORT_LEN	(LEN / 2)
+#define LONG_LEN	(SHORT_LEN + 8)
+#define E		65537UL
+#define POOL_SIZE	3
+#define LOW_WATER	1
+#define FILL_TIMEOUT_S	120
+
+struct key {
+	unsigned char n[LEN], e[LEN], d[LEN];
+	unsigned char p[LONG_LEN], q[SHORT_LEN], dp[LONG_LEN], dq[SHORT_LEN];
+	unsigned char qinv[LONG_LEN];
+};
+
+static void set_exponent(struct key *key)
+{
+	unsigned long e = E;
+	unsigned char *ptr;
+
+	memset(key->e, 0, LEN);
+	for (ptr = key->e + LEN; e; e >>= 8)
+		*--ptr = e & 0xff;
+}
+
+static unsigned int available(void)
+{
+	uint64_t hits, misses;
+	unsigned int n;
+
+	if (ica_rsa_keygen_pool_stats(BITS, E, &hits, &misses, &n))
+		return 0;
+	return n;
+}
+
+static int wait_full(void)
+{
+	int i;
+
+	for (i = 0; i < FILL_TIMEOUT_S * 100; i++) {
+		if (available() == POOL_SIZE)
+			return 0;
+		usleep(10000);
+	}
+	return -1;
+}
+
+static unsigned long long generate_crt(struct key *key)
+{
+	ica_rsa_key_mod_expo_t pub = { LEN, key->n, key->e };
+	ica_rsa_key_crt_t priv = { LEN, key->p, key->q, key->dp, key->dq,
+				   key->qinv };
+	struct timeval start, end;
+
+	set_exponent(key);
+	gettimeofday(&start, NULL);
+	if (ica_rsa_key_generate_crt(DRIVER_NOT_LOADED, BITS, &pub, &priv))
+		EXIT_ERR("ica_rsa_key_generate_crt failed.");
+	gettimeofday(&end, NULL);
+	return delta_usec(&start, &end);
+}
+
+/* n = p * q and qInverse * q = 1 mod p */
+static int check_crt(const struct key *key)
+{
+	BIGNUM *n, *p, *q, *qinv, *t;
+	BN_CTX *ctx;
+	int rc = -1;
+
+	ctx = BN_CTX_new();
+	n = BN_bin2bn(key->n, LEN, NULL);
+	p = BN_bin2bn(key->p, LONG_LEN, NULL);
+	q = BN_bin2bn(key->q, SHORT_LEN, NULL);
+	qinv = BN_bin2bn(key->qinv, LONG_LEN, NULL);
+	t = BN_new();
+	if (ctx && n && p && q && qinv && t && BN_mul(t, p, q, ctx) &&
+	    BN_cmp(t, n) == 0 && BN_mod_mul(t, qinv, q, p, ctx) &&
+	    BN_is_one(t))
+		rc = 0;
+
+	BN_CTX_free(ctx);
+	BN_free(n);
+	BN_free(p);
+	BN_free(q);
+	BN_free(qinv);
+	BN_free(t);
+	return rc;
+}
+
+/* (m^e)^d = m mod n */
+static int check_mod_expo(const struct key *key)
+{
+	BIGNUM *n, *e, *d, *m, *c;
+	BN_CTX *ctx;
+	int rc = -1;
+
+	ctx = BN_CTX_new();
+	n = BN_bin2bn(key->n, LEN, NULL);
+	e = BN_bin2bn(key->e, LEN, NULL);
+	d = BN_bin2bn(key->d, LEN, NULL);
+	m = BN_new();
+	c = BN_new();
+	if (ctx && n && e && d && m && c && BN_rand_range(m, n) &&
+	    BN_mod_exp(c, m, e, n, ctx) && BN_mod_exp(c, c, d, n, ctx) &&
+	    BN_cmp(c, m) == 0)
+		rc = 0;
+
+	BN_CTX_free(ctx);
+	BN_free(n);
+	BN_free(e);
+	BN_free(d);
+	BN_free(m);
+	BN_free(c);
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	static struct key keys[POOL_SIZE + 1];
+	ica_rsa_key_mod_expo_t pub, priv;
+	unsigned long long usec, pooled = 0;
+	uint64_t hits, misses;
+	unsigned int i, n;
+	int status;
+	pid_t pid;
+
+	set_verbosity(argc, argv);
+
+	if (ica_rsa_keygen_pool_set(BITS, E, POOL_SIZE, POOL_SIZE) != EINVAL ||
+	    ica_rsa_keygen_pool_set(BITS, 4, POOL_SIZE, LOW_WATER) != EINVAL)
+		EXIT_ERR("ica_rsa_keygen_pool_set accepted invalid parameters.");
+	if (ica_rsa_keygen_pool_stats(BITS, E, &hits, &misses, &n) != ENOENT)
+		EXIT_ERR("ica_rsa_keygen_pool_stats found a pool not set.");
+
+	if (ica_rsa_keygen_pool_set(BITS, E, POOL_SIZE, LOW_WATER))
+		EXIT_ERR("ica_rsa_keygen_pool_set failed.");
+	if (wait_full())
+		EXIT_ERR("pool not filled.");
+
+	/* served from the pool */
+	for (i = 0; i < POOL_SIZE; i++) {
+		pooled += generate_crt(&keys[i]);
+		if (check_crt(&keys[i]))
+			EXIT_ERR("pooled CRT key is invalid.");
+		if (i && !memcmp(keys[i].n, keys[i - 1].n, LEN))
+			EXIT_ERR("pooled key handed out twice.");
+	}
+	if (ica_rsa_keygen_pool_stats(BITS, E, &hits, &misses, &n) ||
+	    hits != POOL_SIZE)
+		EXIT_ERR("wrong number of hits.");
+
+	/* the pool is refilled after falling to the low water mark */
+	if (wait_full())
+		EXIT_ERR("pool not refilled.");
+
+	set_exponent(&keys[POOL_SIZE]);
+	pub.key_length = priv.key_length = LEN;
+	pub.modulus = keys[POOL_SIZE].n;
+	pub.exponent = keys[POOL_SIZE].e;
+	priv.modulus = keys[POOL_SIZE].n;
+	priv.exponent = keys[POOL_SIZE].d;
+	if (ica_rsa_key_generate_mod_expo(DRIVER_NOT_LOADED, BITS, &pub, &priv))
+		EXIT_ERR("ica_rsa_key_generate_mod_expo failed.");
+	if (check_mod_expo(&keys[POOL_SIZE]))
+		EXIT_ERR("pooled mod expo key is invalid.");
+
+	/* without a pool for the exponent */
+	if (ica_rsa_keygen_pool_set(BITS, E, 0, 0))
+		EXIT_ERR("removing the pool failed.");
+	usec = generate_crt(&keys[0]);
+	if (check_crt(&keys[0]))
+		EXIT_ERR("CRT key is invalid.");
+	V_(printf("RSA-%u key generation: pooled %llu usec, synchronous "
+		  "%llu usec\n", BITS, pooled / POOL_SIZE, usec));
+
+	/* a child must not hand out the parent's keys */
+	if (ica_rsa_keygen_pool_set(BITS, E, POOL_SIZE, LOW_WATER) ||
+	    wait_full())
+		EXIT_ERR("pool not filled.");
+	pid = fork();
+	if (pid == 0)
+		_exit(available() == 0 ? TEST_SUCC : TEST_FAIL);
+	if (pid == -1 || waitpid(pid, &status, 0) != pid ||
+	    !WIFEXITED(status) || WEXITSTATUS(status) != TEST_SUCC)
+		EXIT_ERR("forked child inherited pooled keys.");
+	if (available() != POOL_SIZE)
+		EXIT_ERR("fork changed the parent's pool.");
+
+	ica_cleanup();
+	if (ica_rsa_keygen_pool_stats(BITS, E, &hits, &misses, &n) != ENOENT)
+		EXIT_ERR("ica_cleanup did not remove the pool.");
+
+	printf("All RSA key pool tests passed.\n");
+	return TEST_SUCC;
+}
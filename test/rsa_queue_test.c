@@ -0,0 +1,165 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ */
+
+/* Copyright IBM Corp. 2021 */
+
+/*
+ * Asynchronous RSA requests (ica_rsa_submit/ica_rsa_poll) against the
+ * zcrypt stand-in device zcrypt_shim.so: the test runs itself with the
+ * shim preloaded, a fake /sys/devices/ap with one online accelerator and an
+ * emulated adapter latency, and checks the results, the per-request status
+ * and that the queue keeps the requested number of operations in flight.
+ */
+#include <dlfcn.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "ica_api.h"
+#include "rsa_test.h"
+#include "testcase.h"
+#include "zcrypt_shim.h"
+
+#define IN_FLIGHT	8
+#define DEPTH		64
+#define LATENCY_US	"2000"
+
+/* the 2048 and 4096 bit keys of rsa_test.h, also allowed in FIPS mode */
+static const unsigned int keys[] = {1, 2, 4, 5};
+#define KEYS	(sizeof(keys) / sizeof(keys[0]))
+
+static int queue_test(void)
+{
+	unsigned int (*max_in_flight)(void);
+	static unsigned char out[DEPTH][512];
+	ICA_RSA_PREPARED_KEY *prepared[KEYS];
+	ica_rsa_key_mod_expo_t pub[KEYS];
+	ica_rsa_key_crt_t priv;
+	ica_rsa_request_t req[DEPTH + 1], *done[DEPTH];
+	ica_adapter_handle_t ah;
+	ICA_RSA_QUEUE *queue;
+	struct timeval start, end;
+	struct pollfd pfd;
+	unsigned int i, k, count, completed = 0, rc;
+	int bad = DEPTH / 2;
+
+	max_in_flight = (unsigned int (*)(void))dlsym(RTLD_DEFAULT,
+					"zcrypt_shim_max_in_flight");
+	if (max_in_flight == NULL)
+		EXIT_ERR("zcrypt_shim.so not preloaded.");
+
+	if (ica_open_adapter(&ah) || ah == DRIVER_NOT_LOADED)
+		EXIT_ERR("ica_open_adapter failed.");
+
+	for (i = 0; i < KEYS; i++) {
+		k = keys[i];
+		pub[i].key_length = RSA_BYTE_LENGHT[k];
+		pub[i].modulus = n[k];
+		pub[i].exponent = e[k];
+		priv.key_length = RSA_BYTE_LENGHT[k];
+		priv.p = p[k];
+		priv.q = q[k];
+		priv.dp = dp[k];
+		priv.dq = dq[k];
+		priv.qInverse = qinv[k];
+		if (ica_rsa_key_crt_prepare(&priv, &prepared[i]))
+			EXIT_ERR("ica_rsa_key_crt_prepare failed.");
+	}
+
+	rc = ica_rsa_queue_new(ah, IN_FLIGHT, DEPTH, &queue);
+	if (rc)
+		EXIT_ERR("ica_rsa_queue_new failed.");
+
+	/* alternately encrypt with public keys and decrypt with prepared
+	 * private ones, one encryption has input >= modulus */
+	memset(req, 0, sizeof(req));
+	gettimeofday(&start, NULL);
+	for (i = 0; i < DEPTH; i++) {
+		k = (i / 2) % KEYS;
+		req[i].output_data = out[i];
+		req[i].user_data = &req[i];
+		if (i % 2 == 0) {
+			req[i].type = ICA_RSA_REQ_MOD_EXPO;
+			req[i].input_data = (int)i == bad ? n[keys[k]] :
+							    input_data;
+			req[i].mod_expo_key = &pub[k];
+		} else {
+			req[i].type = ICA_RSA_REQ_CRT;
+			req[i].input_data = ciphertext[keys[k]];
+			req[i].prepared = prepared[k];
+		}
+		if (ica_rsa_submit(queue, &req[i]))
+			EXIT_ERR("ica_rsa_submit failed.");
+	}
+
+	req[DEPTH].type = ICA_RSA_REQ_MOD_EXPO;
+	req[DEPTH].input_data = input_data;
+	req[DEPTH].mod_expo_key = &pub[0];
+	req[DEPTH].output_data = out[0];
+	if (ica_rsa_submit(queue, &req[DEPTH]) != EAGAIN)
+		EXIT_ERR("ica_rsa_submit accepted more than depth requests.");
+
+	pfd.fd = ica_rsa_queue_fd(queue);
+	pfd.events = POLLIN;
+	while (completed < DEPTH) {
+		if (poll(&pfd, 1, 10000) != 1)
+			EXIT_ERR("no completion within 10s.");
+		if (ica_rsa_poll(queue, done, DEPTH, 0, &count) || !count)
+			EXIT_ERR("ica_rsa_poll returned no request.");
+
+		for (i = 0; i < count; i++) {
+			ica_rsa_request_t *r = done[i];
+
+			k = keys[((r - req) / 2) % KEYS];
+			if (r->user_data != r)
+				EXIT_ERR("wrong user_data.");
+			if (r - req == bad) {
+				if (r->status == 0)
+					EXIT_ERR("input >= modulus succeeded.");
+			} else if (r->status) {
+				EXIT_ERR("request failed.");
+			} else if (memcmp(r->output_data,
+					  r->type == ICA_RSA_REQ_CRT ?
+					  input_data : ciphertext[k],
+					  RSA_BYTE_LENGHT[k])) {
+				EXIT_ERR("wrong result.");
+			}
+		}
+		completed += count;
+	}
+	gettimeofday(&end, NULL);
+
+	/* nothing left: the eventfd is not readable */
+	if (poll(&pfd, 1, 0) != 0)
+		EXIT_ERR("queue fd readable without completions.");
+	if (ica_rsa_poll(queue, done, DEPTH, 10, &count) || count)
+		EXIT_ERR("ica_rsa_poll returned a request twice.");
+
+	V_(printf("%u requests, %u in flight (max %u seen), %s usec latency: "
+		  "%llu usec\n", DEPTH, IN_FLIGHT, max_in_flight(), LATENCY_US,
+		  delta_usec(&start, &end)));
+	if (max_in_flight() < 2 || max_in_flight() > IN_FLIGHT)
+		EXIT_ERR("wrong number of requests in flight.");
+
+	ica_rsa_queue_free(queue);
+	for (i = 0; i < KEYS; i++)
+		ica_rsa_prepared_key_free(prepared[i]);
+	ica_close_adapter(ah);
+
+	printf("All RSA queue tests passed.\n");
+	return TEST_SUCC;
+}
+
+int main(int argc, char **argv)
+{
+	set_verbosity(argc, argv);
+
+	if (argc >= 2 && strcmp(argv[1], ZCRYPT_SHIM_ARG) == 0)
+		return queue_test();
+
+	return zcrypt_shim_run("rsa_queue_test", LATENCY_US);
+}
@@ -46,6 +46,7 @@ int main(int argc, char **argv)
 	ica_adapter_handle_t adapter_handle;
 	unsigned char my_result[RESULT_LENGTH];
 	unsigned char my_result2[RESULT_LENGTH];
+	ICA_RSA_PREPARED_KEY *pub_prep, *priv_prep;
 	int i, rc;
 	struct timeval start,end;
 
@@ -119,6 +120,39 @@ int main(int argc, char **argv)
 			return TEST_FAIL;
 		}
 
+		/* same operations with prepared keys */
+		rc = ica_rsa_key_mod_expo_prepare(&mod_expo_key, &pub_prep);
+		if (rc)
+			exit(handle_ica_error(rc, "ica_rsa_key_mod_expo_prepare"));
+		rc = ica_rsa_key_crt_prepare(&crt_key, &priv_prep);
+		if (rc)
+			exit(handle_ica_error(rc, "ica_rsa_key_crt_prepare"));
+
+		memset(my_result, 0, sizeof(my_result));
+		memset(my_result2, 0, sizeof(my_result2));
+		rc = ica_rsa_mod_expo_prepared(adapter_handle, input_data,
+					       pub_prep, my_result);
+		if (rc)
+			exit(handle_ica_error(rc, "ica_rsa_mod_expo_prepared"));
+		rc = ica_rsa_crt_prepared(adapter_handle, ciphertext[i],
+					  priv_prep, my_result2);
+		if (rc)
+			exit(handle_ica_error(rc, "ica_rsa_crt_prepared"));
+		if (memcmp(my_result, ciphertext[i], RSA_BYTE_LENGHT[i]) ||
+		    memcmp(my_result2, input_data, RSA_BYTE_LENGHT[i])) {
+			printf("Results with prepared keys do not match.  Failure!\n");
+			return TEST_FAIL;
+		}
+
+		/* a key is only usable in the form it was prepared in */
+		if (ica_rsa_crt_prepared(adapter_handle, ciphertext[i],
+					 pub_prep, my_result2) != EINVAL) {
+			printf("ica_rsa_crt_prepared accepted a mod expo key.\n");
+			return TEST_FAIL;
+		}
+
+		ica_rsa_prepared_key_free(pub_prep);
+		ica_rsa_prepared_key_free(priv_prep);
 	}
 
 	rc = ica_close_adapter(adapter_handle);
@@ -0,0 +1,117 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ */
+
+/* Copyright IBM Corp. 2021 */
+
+/*
+ * Startup benchmark: measures the time from exec of a program linked with
+ * libica to the result of its first hash, i.e. the library load and
+ * initialization cost of a short-lived tool. The program executes itself
+ * as the child, which hashes "abc" once and reports the time since the
+ * parent's fork over a pipe.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "ica_api.h"
+#include "testcase.h"
+
+#define RUNS	100
+
+static const unsigned char abc_sha256[SHA256_HASH_LENGTH] = {
+	0xBA, 0x78, 0x16, 0xBF, 0x8F, 0x01, 0xCF, 0xEA,
+	0x41, 0x41, 0x40, 0xDE, 0x5D, 0xAE, 0x22, 0x23,
+	0xB0, 0x03, 0x61, 0xA3, 0x96, 0x17, 0x7A, 0x9C,
+	0xB4, 0x10, 0xFF, 0x61, 0xF2, 0x00, 0x15, 0xAD,
+};
+
+/* child: first hash, then report the time since start over fd */
+static int first_hash(const char *start_arg, const char *fd_arg)
+{
+	unsigned char hash[SHA256_HASH_LENGTH];
+	sha256_context_t ctx;
+	struct timeval start, now;
+	unsigned long long usec;
+	int fd;
+
+	if (ica_sha256(SHA_MSG_PART_ONLY, 3, (unsigned char *)"abc", &ctx,
+		       hash) != 0 || memcmp(hash, abc_sha256, sizeof(hash)))
+		return TEST_FAIL;
+	gettimeofday(&now, NULL);
+
+	if (sscanf(start_arg, "%ld.%ld", &start.tv_sec, &start.tv_usec) != 2)
+		return TEST_FAIL;
+	fd = atoi(fd_arg);
+	usec = delta_usec(&start, &now);
+	if (write(fd, &usec, sizeof(usec)) != sizeof(usec))
+		return TEST_FAIL;
+	return TEST_SUCC;
+}
+
+static int run_child(unsigned long long *usec)
+{
+	char start_arg[64], fd_arg[16];
+	struct timeval start;
+	int fds[2], status, rc;
+	pid_t pid;
+
+	if (pipe(fds))
+		return -1;
+
+	gettimeofday(&start, NULL);
+	pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		snprintf(start_arg, sizeof(start_arg), "%ld.%06ld",
+			 start.tv_sec, start.tv_usec);
+		snprintf(fd_arg, sizeof(fd_arg), "%d", fds[1]);
+		execl("/proc/self/exe", "startup_test", "--child", start_arg,
+		      fd_arg, (char *)NULL);
+		_exit(TEST_ERR);
+	}
+	close(fds[1]);
+	if (pid == -1) {
+		close(fds[0]);
+		return -1;
+	}
+
+	rc = read(fds[0], usec, sizeof(*usec)) == sizeof(*usec) ? 0 : -1;
+	close(fds[0]);
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != TEST_SUCC)
+		return -1;
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long usec, min = ~0ULL, sum = 0;
+	unsigned int i;
+
+	if (argc == 4 && strcmp(argv[1], "--child") == 0)
+		return first_hash(argv[2], argv[3]);
+
+	set_verbosity(argc, argv);
+
+	for (i = 0; i < RUNS; i++) {
+		if (run_child(&usec)) {
+			printf("Startup test failed: child %u failed.\n", i);
+			return TEST_FAIL;
+		}
+		V_(printf("run %u: %llu usec\n", i, usec));
+		sum += usec;
+		if (usec < min)
+			min = usec;
+	}
+
+	printf("exec to first hash: min %llu usec, avg %llu usec (%u runs)\n",
+	       min, sum / RUNS, RUNS);
+	printf("All startup tests passed.\n");
+	return TEST_SUCC;
+}
@@ -0,0 +1,272 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ */
+
+/* Copyright IBM Corp. 2021 */
+
+/*
+ * LD_PRELOAD stand-in for a zcrypt device and its cards, used by tests
+ * without crypto adapters:
+ *
+ * - ioctl ICARSAMODEXPO and ICARSACRT are computed in software, after a
+ *   delay of ZCRYPT_SHIM_LATENCY_US microseconds (default 0). Input not
+ *   less than the modulus fails with EINVAL like on a real adapter.
+ *   Z90STAT_STATUS_MASK succeeds, all other ioctls go to the real device
+ *   (e.g. LIBICA_CRYPT_DEVICE=/dev/null).
+ * - opendir and fopen of /sys/devices/ap/... and /sys/class/zcrypt/... are
+ *   redirected to the directory ZCRYPT_SHIM_SYSFS and its subdirectory
+ *   class, if it is set. open of a zcrypt device node /dev/zcrypt-... opens
+ *   /dev/null instead.
+ *
+ * zcrypt_shim_ops() and zcrypt_shim_max_in_flight() return the number of
+ * emulated RSA operations and the maximum of them running concurrently,
+ * zcrypt_shim_fd_ops() and zcrypt_shim_fd_max_in_flight() the same for the
+ * operations on one file descriptor.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <asm/zcrypt.h>
+#include <openssl/bn.h>
+
+#define AP_PATH		"/sys/devices/ap"
+#define ZCRYPT_PATH	"/sys/class/zcrypt"
+#define ZCDN_PREFIX	"/dev/zcrypt-"
+#define MAX_FD		1024
+
+struct counters {
+	unsigned int ops, in_flight, max_in_flight;
+};
+
+static struct counters all, fds[MAX_FD];
+
+unsigned int zcrypt_shim_ops(void)
+{
+	return __atomic_load_n(&all.ops, __ATOMIC_RELAXED);
+}
+
+unsigned int zcrypt_shim_max_in_flight(void)
+{
+	return __atomic_load_n(&all.max_in_flight, __ATOMIC_RELAXED);
+}
+
+unsigned int zcrypt_shim_fd_ops(int fd)
+{
+	if (fd < 0 || fd >= MAX_FD)
+		return 0;
+	return __atomic_load_n(&fds[fd].ops, __ATOMIC_RELAXED);
+}
+
+unsigned int zcrypt_shim_fd_max_in_flight(int fd)
+{
+	if (fd < 0 || fd >= MAX_FD)
+		return 0;
+	return __atomic_load_n(&fds[fd].max_in_flight, __ATOMIC_RELAXED);
+}
+
+static void count_begin(struct counters *c)
+{
+	unsigned int n, max;
+
+	__atomic_add_fetch(&c->ops, 1, __ATOMIC_RELAXED);
+	n = __atomic_add_fetch(&c->in_flight, 1, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&c->max_in_flight, __ATOMIC_RELAXED);
+	while (n > max && !__atomic_compare_exchange_n(&c->max_in_flight, &max,
+			n, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static void op_begin(int fd)
+{
+	const char *env;
+
+	count_begin(&all);
+	if (fd >= 0 && fd < MAX_FD)
+		count_begin(&fds[fd]);
+
+	if ((env = getenv("ZCRYPT_SHIM_LATENCY_US")) != NULL)
+		usleep(strtoul(env, NULL, 0));
+}
+
+static void op_end(int fd)
+{
+	__atomic_sub_fetch(&all.in_flight, 1, __ATOMIC_RELAXED);
+	if (fd >= 0 && fd < MAX_FD)
+		__atomic_sub_fetch(&fds[fd].in_flight, 1, __ATOMIC_RELAXED);
+}
+
+static int bn_out(const BIGNUM *r, unsigned char *out, unsigned int len)
+{
+	return BN_bn2binpad(r, out, len) < 0 ? EIO : 0;
+}
+
+static int mod_expo(struct ica_rsa_modexpo *mex)
+{
+	BIGNUM *a, *e, *n, *r;
+	BN_CTX *ctx;
+	unsigned int len = mex->inputdatalength;
+	int rc = EIO;
+
+	ctx = BN_CTX_new();
+	a = BN_bin2bn(mex->inputdata, len, NULL);
+	e = BN_bin2bn(mex->b_key, len, NULL);
+	n = BN_bin2bn(mex->n_modulus, len, NULL);
+	r = BN_new();
+	if (!ctx || !a || !e || !n || !r)
+		goto out;
+
+	if (BN_ucmp(a, n) >= 0) {
+		rc = EINVAL;
+		goto out;
+	}
+	if (BN_mod_exp(r, a, e, n, ctx))
+		rc = bn_out(r, mex->outputdata, mex->outputdatalength);
+out:
+	BN_free(a);
+	BN_free(e);
+	BN_free(n);
+	BN_free(r);
+	BN_CTX_free(ctx);
+	return rc;
+}
+
+static int crt(struct ica_rsa_modexpo_crt *crt)
+{
+	BIGNUM *c, *p, *q, *dp, *dq, *qinv, *m1, *m2;
+	BN_CTX *ctx;
+	unsigned int short_len = (crt->inputdatalength + 1) / 2;
+	unsigned int long_len = short_len + 8;
+	int rc = EIO;
+
+	ctx = BN_CTX_new();
+	c = BN_bin2bn(crt->inputdata, crt->inputdatalength, NULL);
+	p = BN_bin2bn(crt->np_prime, long_len, NULL);
+	q = BN_bin2bn(crt->nq_prime, short_len, NULL);
+	dp = BN_bin2bn(crt->bp_key, long_len, NULL);
+	dq = BN_bin2bn(crt->bq_key, short_len, NULL);
+	qinv = BN_bin2bn(crt->u_mult_inv, long_len, NULL);
+	m1 = BN_new();
+	m2 = BN_new();
+	if (!ctx || !c || !p || !q || !dp || !dq || !qinv || !m1 || !m2)
+		goto out;
+
+	/* m = m2 + q * ((m1 - m2) * qinv mod p) */
+	if (BN_mod(m1, c, p, ctx) && BN_mod_exp(m1, m1, dp, p, ctx) &&
+	    BN_mod(m2, c, q, ctx) && BN_mod_exp(m2, m2, dq, q, ctx) &&
+	    BN_mod_sub(m1, m1, m2, p, ctx) &&
+	    BN_mod_mul(m1, m1, qinv, p, ctx) && BN_mul(m1, m1, q, ctx) &&
+	    BN_add(m1, m1, m2))
+		rc = bn_out(m1, crt->outputdata, crt->outputdatalength);
+out:
+	BN_free(c);
+	BN_free(p);
+	BN_free(q);
+	BN_free(dp);
+	BN_free(dq);
+	BN_free(qinv);
+	BN_free(m1);
+	BN_free(m2);
+	BN_CTX_free(ctx);
+	return rc;
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	static int (*real_ioctl)(int, unsigned long, ...);
+	va_list ap;
+	void *arg;
+	int rc;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	switch (request) {
+	case Z90STAT_STATUS_MASK:
+		memset(arg, 0, 64);
+		return 0;
+	case ICARSAMODEXPO:
+	case ICARSACRT:
+		op_begin(fd);
+		rc = request == ICARSAMODEXPO ? mod_expo(arg) : crt(arg);
+		op_end(fd);
+		if (rc) {
+			errno = rc;
+			return -1;
+		}
+		return 0;
+	default:
+		if (!real_ioctl)
+			real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+		return real_ioctl(fd, request, arg);
+	}
+}
+
+/*
+ * path below ZCRYPT_SHIM_SYSFS for paths below /sys/devices/ap and below
+ * ZCRYPT_SHIM_SYSFS/class for paths below /sys/class/zcrypt
+ */
+static const char *sysfs_path(const char *path, char *buf, size_t size)
+{
+	const char *root = getenv("ZCRYPT_SHIM_SYSFS");
+
+	if (!root)
+		return path;
+	if (strncmp(path, AP_PATH, strlen(AP_PATH)) == 0)
+		snprintf(buf, size, "%s%s", root, path + strlen(AP_PATH));
+	else if (strncmp(path, ZCRYPT_PATH, strlen(ZCRYPT_PATH)) == 0)
+		snprintf(buf, size, "%s/class%s", root,
+			 path + strlen(ZCRYPT_PATH));
+	else
+		return path;
+	return buf;
+}
+
+DIR *opendir(const char *name)
+{
+	static DIR *(*real_opendir)(const char *);
+	char buf[4096];
+
+	if (!real_opendir)
+		real_opendir = dlsym(RTLD_NEXT, "opendir");
+	return real_opendir(sysfs_path(name, buf, sizeof(buf)));
+}
+
+FILE *fopen(const char *pathname, const char *mode)
+{
+	static FILE *(*real_fopen)(const char *, const char *);
+	char buf[4096];
+
+	if (!real_fopen)
+		real_fopen = dlsym(RTLD_NEXT, "fopen");
+	return real_fopen(sysfs_path(pathname, buf, sizeof(buf)), mode);
+}
+
+int open(const char *pathname, int flags, ...)
+{
+	static int (*real_open)(const char *, int, ...);
+	mode_t mode = 0;
+	va_list ap;
+
+	if (flags & O_CREAT) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+
+	if (!real_open)
+		real_open = dlsym(RTLD_NEXT, "open");
+	if (strncmp(pathname, ZCDN_PREFIX, strlen(ZCDN_PREFIX)) == 0)
+		pathname = "/dev/null";
+	return real_open(pathname, flags, mode);
+}
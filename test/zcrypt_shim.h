@@ -0,0 +1,159 @@
+/* This program is released under the Common Public License V1.0
+ *
+ * You should have received a copy of Common Public License V1.0 along with
+ * with this program.
+ */
+
+/* Copyright IBM Corp. 2021 */
+
+/*
+ * Running a test against the zcrypt stand-in device zcrypt_shim.so, see
+ * zcrypt_shim.c.
+ */
+#ifndef ZCRYPT_SHIM_H
+#define ZCRYPT_SHIM_H
+
+#include <dirent.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "testcase.h"
+
+/* the argument of the test's run under the shim */
+#define ZCRYPT_SHIM_ARG	"--shim"
+
+static int zcrypt_shim_write_file(const char *dir, const char *name,
+				  const char *data)
+{
+	char path[2 * PATH_MAX];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	if ((f = fopen(path, "w")) == NULL)
+		return -1;
+	fputs(data, f);
+	return fclose(f);
+}
+
+struct zcrypt_shim_card {
+	unsigned int card;
+	const char *type;	/* e.g. "CEX7A" */
+	int online;
+	/* name of a zcrypt device node for this card only, or NULL */
+	const char *node;
+};
+
+/* removes the directory tree at path */
+static void zcrypt_shim_rm(const char *path)
+{
+	char sub[PATH_MAX];
+	struct dirent *entry;
+	DIR *dir;
+
+	if ((dir = opendir(path)) != NULL) {
+		while ((entry = readdir(dir)) != NULL) {
+			if (strcmp(entry->d_name, ".") == 0 ||
+			    strcmp(entry->d_name, "..") == 0)
+				continue;
+			snprintf(sub, sizeof(sub), "%s/%s", path,
+				 entry->d_name);
+			zcrypt_shim_rm(sub);
+		}
+		closedir(dir);
+	}
+	remove(path);
+}
+
+/*
+ * Sets up a fake /sys/devices/ap with num cards, and /sys/class/zcrypt with
+ * their device nodes, and runs the test binary again with ZCRYPT_SHIM_ARG
+ * and zcrypt_shim.so preloaded, emulating an adapter latency of latency_us
+ * microseconds. Returns the exit status of that run, or TEST_SKIP if the
+ * shim was not built.
+ */
+static int zcrypt_shim_run_cards(const char *name, const char *latency_us,
+				 const struct zcrypt_shim_card *cards,
+				 unsigned int num)
+{
+	char sysfs[] = "/tmp/zcrypt_shim.XXXXXX";
+	char exe[PATH_MAX], shim[PATH_MAX + 32], dir[PATH_MAX];
+	char preload[2 * PATH_MAX], type[16], mask[2 + 64 + 2];
+	const char *old;
+	unsigned int i, j;
+	int status;
+	ssize_t len;
+	pid_t pid;
+
+	if ((len = readlink("/proc/self/exe", exe, sizeof(exe) - 1)) < 0)
+		return TEST_ERR;
+	exe[len] = '\0';
+	snprintf(shim, sizeof(shim), "%s/.libs/zcrypt_shim.so", dirname(exe));
+	if (access(shim, R_OK)) {
+		printf("Skipping: %s not found.\n", shim);
+		return TEST_SKIP;
+	}
+
+	if (mkdtemp(sysfs) == NULL)
+		return TEST_ERR;
+	snprintf(dir, sizeof(dir), "%s/class", sysfs);
+	if (mkdir(dir, 0700))
+		return TEST_ERR;
+	for (i = 0; i < num; i++) {
+		snprintf(dir, sizeof(dir), "%s/card%02x", sysfs, cards[i].card);
+		snprintf(type, sizeof(type), "%s\n", cards[i].type);
+		if (mkdir(dir, 0700) ||
+		    zcrypt_shim_write_file(dir, "online",
+					   cards[i].online ? "1\n" : "0\n") ||
+		    zcrypt_shim_write_file(dir, "type", type))
+			return TEST_ERR;
+		if (cards[i].node == NULL)
+			continue;
+
+		/* apmask: card 0 is the most significant bit */
+		strcpy(mask, "0x");
+		for (j = 0; j < 64; j++)
+			mask[2 + j] = j == cards[i].card / 4 ?
+				"8421"[cards[i].card % 4] : '0';
+		strcpy(mask + 2 + 64, "\n");
+		snprintf(dir, sizeof(dir), "%s/class/%s", sysfs, cards[i].node);
+		if (mkdir(dir, 0700) ||
+		    zcrypt_shim_write_file(dir, "apmask", mask))
+			return TEST_ERR;
+	}
+
+	old = getenv("LD_PRELOAD");
+	snprintf(preload, sizeof(preload), "%s%s%s", shim, old ? " " : "",
+		 old ? old : "");
+	setenv("LD_PRELOAD", preload, 1);
+	setenv("ZCRYPT_SHIM_SYSFS", sysfs, 1);
+	setenv("ZCRYPT_SHIM_LATENCY_US", latency_us, 1);
+	setenv("LIBICA_CRYPT_DEVICE", "/dev/null", 1);
+
+	pid = fork();
+	if (pid == 0) {
+		execl("/proc/self/exe", name, ZCRYPT_SHIM_ARG,
+		      verbosity_ ? "-v" : (char *)NULL, (char *)NULL);
+		_exit(TEST_ERR);
+	}
+	if (pid == -1 || waitpid(pid, &status, 0) != pid)
+		status = TEST_ERR << 8;
+
+	zcrypt_shim_rm(sysfs);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : TEST_FAIL;
+}
+
+/* zcrypt_shim_run_cards with one online accelerator */
+static inline int zcrypt_shim_run(const char *name, const char *latency_us)
+{
+	static const struct zcrypt_shim_card card = { 0, "CEX7A", 1, NULL };
+
+	return zcrypt_shim_run_cards(name, latency_us, &card, 1);
+}
+
+#endif